@@ -1,4 +1,5 @@
 #include "FtpClient.h"
+#include "async_logger.h"
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -46,7 +47,7 @@ std::string FtpClient::readResponse() {
         }
     }
     
-    std::cout << ansiColor(90) << "Server: " << response << ansiReset() << std::endl;
+    LOG_INFO("ftp", "Server: " + response.substr(0, response.find_last_not_of("\r\n") + 1));
     return response;
 }
 
@@ -62,7 +63,7 @@ std::string FtpClient::sendCommand(const std::string& command) {
         displayCommand = std::regex_replace(command, userRegex, "$1************");
     }
 
-    std::cout << ansiColor(90) << "Client: " << displayCommand << ansiReset() << std::endl;
+    LOG_INFO("ftp", "Client: " + displayCommand);
     std::string cmd = command + "\r\n";
     if (send(controlSocket, cmd.c_str(), cmd.length(), 0) == -1) {
         throw std::runtime_error("Failed to send command");
@@ -88,7 +89,7 @@ int FtpClient::createDataConnection() {
     std::string response = sendCommand("PASV");
     auto [ip, port] = parsePassiveMode(response);
     
-    std::cout << ansiColor(94) << "Debug: Connecting to data socket at " << ip << ":" << port << ansiReset() << std::endl;
+    LOG_DEBUG("ftp", "Connecting to data socket at " + ip + ":" + std::to_string(port));
     
     int dataSocket = socket(AF_INET, SOCK_STREAM, 0);
     if (dataSocket == -1) {
@@ -105,8 +106,7 @@ int FtpClient::createDataConnection() {
     }
     
     if (ip.substr(0, 3) == "172" || ip.substr(0, 3) == "10." || ip.substr(0, 7) == "192.168") {
-        std::cout << ansiColor(94) << "Debug: FTP server returned internal IP " << ip 
-                  << ", using server address from config instead." << ansiReset() << std::endl;
+        LOG_DEBUG("ftp", "FTP server returned internal IP " + ip + ", using server address from config instead.");
         ip = server;
     }
     
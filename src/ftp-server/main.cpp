@@ -1,5 +1,6 @@
 #include "Config.h"
 #include "FileMonitor.h"
+#include "async_logger.h"
 #include <iostream>
 #include <stdexcept>
 
@@ -11,6 +12,7 @@ int main(int argc, char* argv[]) {
             envPath = argv[1];
         }
 
+        logging::configureFromEnvironment();
         Config config = loadConfig(envPath);
 
         auto handler = []() {
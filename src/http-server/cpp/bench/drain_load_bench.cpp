@@ -0,0 +1,206 @@
+// drain_load_bench - Keep-alive load across a reload, a binary upgrade or
+// a shutdown. CLIENTS threads send GET / back to back for SECONDS, and at
+// half time SIGNAL (HUP, USR2, TERM or none) goes to the server's PID. A
+// request on a keep-alive connection the server closed before answering
+// is retried once on a new connection, as browsers do for idempotent
+// requests. Anything else that does not end in a 200 is a failure. So is
+// a refused connection, or one closed unanswered, except after TERM, when
+// nothing is left to accept them. Prints the counts and the latency
+// p50/p99/max before and after the signal.
+//
+//     ./bench/drain_load PORT CLIENTS SECONDS PID SIGNAL
+//     ./bench/drain_load 8080 16 6 $(pidof main) USR2
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+enum class Outcome {
+    OK,
+    OK_CLOSED,      // answered with Connection: close
+    NOT_ANSWERED,   // closed before a byte of the response; safe to retry
+    FAILED
+};
+
+struct Counts {
+    long requests = 0;
+    long retries = 0;
+    long failures = 0;
+    long refused = 0;
+    std::vector<double> before;     // seconds, by when the request started
+    std::vector<double> after;
+};
+
+static int connectTo(int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sock, (sockaddr*)&address, sizeof(address)) < 0) {
+        close(sock);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sock;
+}
+
+static Outcome request(int sock) {
+    static const char GET[] = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    if (send(sock, GET, sizeof(GET) - 1, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(GET) - 1)) {
+        return Outcome::NOT_ANSWERED;
+    }
+
+    std::string response;
+    char chunk[16384];
+    size_t headerEnd;
+    while ((headerEnd = response.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t received = recv(sock, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return response.empty() ? Outcome::NOT_ANSWERED : Outcome::FAILED;
+        }
+        response.append(chunk, static_cast<size_t>(received));
+    }
+    if (response.compare(0, 12, "HTTP/1.1 200") != 0) {
+        return Outcome::FAILED;
+    }
+
+    std::string headers = response.substr(0, headerEnd);
+    std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+    size_t at = headers.find("\r\ncontent-length:");
+    size_t length = at == std::string::npos ? 0 : strtoul(headers.c_str() + at + 17, nullptr, 10);
+    while (response.size() < headerEnd + 4 + length) {
+        ssize_t received = recv(sock, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return Outcome::FAILED;
+        }
+        response.append(chunk, static_cast<size_t>(received));
+    }
+    return headers.find("\r\nconnection: close") != std::string::npos ? Outcome::OK_CLOSED : Outcome::OK;
+}
+
+static void client(int port, Clock::time_point end, const std::atomic<bool>& signalled, Counts& counts) {
+    int sock = -1;
+    while (Clock::now() < end) {
+        if (sock == -1 && (sock = connectTo(port)) == -1) {
+            // Nothing accepting, e.g. after TERM
+            counts.refused++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        bool afterSignal = signalled;
+        Clock::time_point start = Clock::now();
+        Outcome outcome = request(sock);
+        if (outcome == Outcome::NOT_ANSWERED) {
+            close(sock);
+            counts.retries++;
+            if ((sock = connectTo(port)) == -1 || (outcome = request(sock)) == Outcome::NOT_ANSWERED) {
+                // Left in the backlog of a listener that closed
+                counts.refused++;
+                if (sock != -1) {
+                    close(sock);
+                    sock = -1;
+                }
+                continue;
+            }
+        }
+
+        counts.requests++;
+        if (outcome == Outcome::OK || outcome == Outcome::OK_CLOSED) {
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            (afterSignal ? counts.after : counts.before).push_back(seconds);
+        } else {
+            counts.failures++;
+        }
+        if (outcome != Outcome::OK && sock != -1) {
+            close(sock);
+            sock = -1;
+        }
+    }
+    if (sock != -1) {
+        close(sock);
+    }
+}
+
+static double percentile(std::vector<double> values, double p) {
+    std::sort(values.begin(), values.end());
+    size_t at = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    return values[at];
+}
+
+static void report(const char* when, const std::vector<double>& seconds) {
+    if (seconds.empty()) {
+        printf("  %-14s no requests\n", when);
+        return;
+    }
+    printf("  %-14s %7zu ok  p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms\n", when, seconds.size(),
+           percentile(seconds, 0.5) * 1e3, percentile(seconds, 0.99) * 1e3,
+           *std::max_element(seconds.begin(), seconds.end()) * 1e3);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 6) {
+        fprintf(stderr, "usage: %s PORT CLIENTS SECONDS PID HUP|USR2|TERM|none\n", argv[0]);
+        return 1;
+    }
+    int port = atoi(argv[1]);
+    int clients = atoi(argv[2]);
+    double seconds = atof(argv[3]);
+    pid_t pid = atoi(argv[4]);
+    std::string name = argv[5];
+    int signal = name == "HUP" ? SIGHUP : name == "USR2" ? SIGUSR2 : name == "TERM" ? SIGTERM : 0;
+    if (clients < 1 || seconds <= 0 || (signal == 0 && name != "none")) {
+        fprintf(stderr, "CLIENTS and SECONDS must be positive, SIGNAL one of HUP, USR2, TERM, none\n");
+        return 1;
+    }
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    std::atomic<bool> signalled(false);
+    std::vector<Counts> counts(clients);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; i++) {
+        threads.emplace_back(client, port, end, std::cref(signalled), std::ref(counts[i]));
+    }
+
+    std::this_thread::sleep_until(start + (end - start) / 2);
+    signalled = true;
+    if (signal != 0 && kill(pid, signal) != 0) {
+        perror("kill");
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    Counts total;
+    for (const auto& one : counts) {
+        total.requests += one.requests;
+        total.retries += one.retries;
+        total.failures += one.failures;
+        total.refused += one.refused;
+        total.before.insert(total.before.end(), one.before.begin(), one.before.end());
+        total.after.insert(total.after.end(), one.after.begin(), one.after.end());
+    }
+    printf("%d clients for %.1f s, SIG%s at %.1f s: %ld requests, %ld failures, %ld retried, %ld connects refused\n",
+           clients, seconds, signal != 0 ? name.c_str() : "NONE", seconds / 2, total.requests, total.failures,
+           total.retries, total.refused);
+    report("before signal", total.before);
+    report("after signal", total.after);
+    return total.failures == 0 && (total.refused == 0 || signal == SIGTERM) ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+// page_load_bench - Page-load latency over HTTP/1.1 and over h2c. A load
+// fetches the page, then SUBRESOURCES further URLs at once, the way a
+// browser fetches what the page refers to: over HTTP/1.1 on up to
+// CONNECTIONS keep-alive connections, one request at a time on each; over
+// h2c as concurrent streams on one connection (prior knowledge). Every
+// load opens new connections, as a first visit does. Prints p50, p99 and
+// mean load time for each protocol.
+//
+//     ./bench/page_load PORT LOADS SUBRESOURCES [CONNECTIONS] [PAGE] [SUBRESOURCE]
+//     ./bench/page_load 8080 500 20 6 / /static/style.css
+
+#include "../hpack.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const uint8_t FRAME_DATA = 0x0;
+static const uint8_t FRAME_HEADERS = 0x1;
+static const uint8_t FRAME_SETTINGS = 0x4;
+static const uint8_t FRAME_PING = 0x6;
+static const uint8_t FRAME_GOAWAY = 0x7;
+static const uint8_t FRAME_WINDOW_UPDATE = 0x8;
+static const uint8_t FLAG_END_STREAM = 0x1;
+static const uint8_t FLAG_ACK = 0x1;
+static const uint8_t FLAG_END_HEADERS = 0x4;
+
+static void fail(const char* what) {
+    fprintf(stderr, "page load failed: %s\n", what);
+    exit(2);
+}
+
+static int connectTo(int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sock, (sockaddr*)&address, sizeof(address)) < 0) {
+        fail("connect");
+    }
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sock;
+}
+
+static void sendAll(int sock, const std::string& data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        ssize_t sent = send(sock, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            fail("send");
+        }
+        offset += static_cast<size_t>(sent);
+    }
+}
+
+// One keep-alive HTTP/1.1 connection, one request at a time
+class Http1Client {
+    private:
+        int sock;
+        std::string buffer;
+
+        void readMore() {
+            char chunk[65536];
+            ssize_t received = recv(sock, chunk, sizeof(chunk), 0);
+            if (received <= 0) {
+                fail("HTTP/1.1 connection closed");
+            }
+            buffer.append(chunk, static_cast<size_t>(received));
+        }
+
+    public:
+        explicit Http1Client(int port) : sock(connectTo(port)) {}
+        ~Http1Client() { close(sock); }
+
+        void get(const std::string& path) {
+            sendAll(sock, "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+            size_t headerEnd;
+            while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+                readMore();
+            }
+            if (buffer.compare(0, 12, "HTTP/1.1 200") != 0) {
+                fail(("HTTP/1.1 status " + buffer.substr(0, buffer.find('\r'))).c_str());
+            }
+
+            size_t length = 0;
+            std::string headers = buffer.substr(0, headerEnd);
+            std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+            size_t at = headers.find("\r\ncontent-length:");
+            if (at != std::string::npos) {
+                length = strtoul(headers.c_str() + at + 17, nullptr, 10);
+            }
+            size_t end = headerEnd + 4 + length;
+            while (buffer.size() < end) {
+                readMore();
+            }
+            buffer.erase(0, end);
+        }
+};
+
+// One h2c connection with prior knowledge; responses are only counted
+class Http2Client {
+    private:
+        int sock;
+        HpackEncoder encoder;
+        uint32_t nextStreamId;
+        std::string buffer;
+
+        static std::string frame(uint8_t type, uint8_t flags, uint32_t streamId, const std::string& payload) {
+            std::string out;
+            out += static_cast<char>((payload.size() >> 16) & 0xff);
+            out += static_cast<char>((payload.size() >> 8) & 0xff);
+            out += static_cast<char>(payload.size() & 0xff);
+            out += static_cast<char>(type);
+            out += static_cast<char>(flags);
+            for (int shift = 24; shift >= 0; shift -= 8) {
+                out += static_cast<char>((streamId >> shift) & 0xff);
+            }
+            return out + payload;
+        }
+
+        // Of the frame at the front of buffer, header included; 0 until its header is in
+        size_t bufferedFrameSize() const {
+            if (buffer.size() < 9) {
+                return 0;
+            }
+            return 9 + ((static_cast<size_t>(static_cast<unsigned char>(buffer[0])) << 16) |
+                        (static_cast<size_t>(static_cast<unsigned char>(buffer[1])) << 8) |
+                        static_cast<size_t>(static_cast<unsigned char>(buffer[2])));
+        }
+
+    public:
+        explicit Http2Client(int port) : sock(connectTo(port)), nextStreamId(1) {
+            // A large window (SETTINGS_INITIAL_WINDOW_SIZE) so flow control never waits
+            std::string settings("\x00\x04\x7f\xff\xff\xff", 6);
+            std::string increment("\x7f\xff\x00\x00", 4);
+            sendAll(sock, std::string(PREFACE, sizeof(PREFACE) - 1) + frame(FRAME_SETTINGS, 0, 0, settings) +
+                          frame(FRAME_WINDOW_UPDATE, 0, 0, increment));
+        }
+        ~Http2Client() { close(sock); }
+
+        // Sends every request before reading any response
+        void get(const std::vector<std::string>& paths) {
+            std::string requests;
+            for (const auto& path : paths) {
+                std::string block;
+                encoder.encode({{":method", "GET"}, {":scheme", "http"}, {":authority", "localhost"}, {":path", path}}, block);
+                requests += frame(FRAME_HEADERS, FLAG_END_HEADERS | FLAG_END_STREAM, nextStreamId, block);
+                nextStreamId += 2;
+            }
+            sendAll(sock, requests);
+
+            size_t finished = 0;
+            while (finished < paths.size()) {
+                while (bufferedFrameSize() == 0 || buffer.size() < bufferedFrameSize()) {
+                    char chunk[65536];
+                    ssize_t received = recv(sock, chunk, sizeof(chunk), 0);
+                    if (received <= 0) {
+                        fail("h2c connection closed");
+                    }
+                    buffer.append(chunk, static_cast<size_t>(received));
+                }
+                size_t length = bufferedFrameSize() - 9;
+                uint8_t type = static_cast<uint8_t>(buffer[3]);
+                uint8_t flags = static_cast<uint8_t>(buffer[4]);
+                std::string payload = buffer.substr(9, length);
+                buffer.erase(0, 9 + length);
+
+                if ((type == FRAME_DATA || type == FRAME_HEADERS) && (flags & FLAG_END_STREAM)) {
+                    finished++;
+                } else if (type == FRAME_SETTINGS && !(flags & FLAG_ACK)) {
+                    sendAll(sock, frame(FRAME_SETTINGS, FLAG_ACK, 0, ""));
+                } else if (type == FRAME_PING && !(flags & FLAG_ACK)) {
+                    sendAll(sock, frame(FRAME_PING, FLAG_ACK, 0, payload));
+                } else if (type == FRAME_GOAWAY) {
+                    fail("GOAWAY");
+                }
+            }
+        }
+};
+
+static double percentile(std::vector<double> values, double p) {
+    std::sort(values.begin(), values.end());
+    size_t at = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    return values[at];
+}
+
+static void report(const char* protocol, const std::vector<double>& loads, size_t requestsPerLoad) {
+    double total = 0;
+    for (double seconds : loads) {
+        total += seconds;
+    }
+    printf("%-14s p50 %8.3f ms  p99 %8.3f ms  mean %8.3f ms  (%.0f requests/s)\n", protocol,
+           percentile(loads, 0.5) * 1e3, percentile(loads, 0.99) * 1e3, total / loads.size() * 1e3,
+           loads.size() * requestsPerLoad / total);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s PORT LOADS SUBRESOURCES [CONNECTIONS] [PAGE] [SUBRESOURCE]\n", argv[0]);
+        return 1;
+    }
+    int port = atoi(argv[1]);
+    int loads = atoi(argv[2]);
+    int subresources = atoi(argv[3]);
+    int connections = argc > 4 ? atoi(argv[4]) : 6;
+    std::string page = argc > 5 ? argv[5] : "/";
+    std::string subresource = argc > 6 ? argv[6] : "/static/style.css";
+    if (loads < 1 || subresources < 0 || connections < 1) {
+        fprintf(stderr, "LOADS and CONNECTIONS must be positive\n");
+        return 1;
+    }
+
+    // Distinct URLs, as a page's images would be
+    std::vector<std::string> urls;
+    for (int i = 0; i < subresources; i++) {
+        urls.push_back(subresource + "?" + std::to_string(i));
+    }
+
+    std::vector<double> http1;
+    for (int load = 0; load < loads; load++) {
+        auto start = Clock::now();
+        std::vector<Http1Client*> clients;
+        clients.push_back(new Http1Client(port));
+        clients[0]->get(page);
+
+        // The browser's queue: each connection takes the next URL when free
+        for (int i = 1; i < connections && i <= subresources; i++) {
+            clients.push_back(new Http1Client(port));
+        }
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> fetchers;
+        for (size_t c = 0; c < clients.size(); c++) {
+            fetchers.emplace_back([&, c] {
+                for (size_t url = next++; url < urls.size(); url = next++) {
+                    clients[c]->get(urls[url]);
+                }
+            });
+        }
+        for (auto& fetcher : fetchers) {
+            fetcher.join();
+        }
+        http1.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+        for (auto* client : clients) {
+            delete client;
+        }
+    }
+
+    std::vector<double> http2;
+    for (int load = 0; load < loads; load++) {
+        auto start = Clock::now();
+        Http2Client client(port);
+        client.get({page});
+        if (!urls.empty()) {
+            client.get(urls);
+        }
+        http2.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+    }
+
+    printf("%d loads of %s and %d subresources:\n", loads, page.c_str(), subresources);
+    report(("HTTP/1.1 x" + std::to_string(std::min(connections, std::max(subresources, 1)))).c_str(), http1, subresources + 1);
+    report("h2c x1", http2, subresources + 1);
+    return 0;
+}
@@ -0,0 +1,222 @@
+// ws_fanout_bench - Fan-out latency of the /ws push. Opens SUBSCRIBERS
+// WebSockets, then adds a contact over HTTP BROADCASTS times, one after
+// another, and times each until every subscriber has its delta. Prints
+// the per-broadcast time to reach all subscribers and the time each
+// delivery took, p50/p99/max, and counts resyncs (a subscriber that fell
+// behind). Needs a descriptor limit above SUBSCRIBERS, in this process and
+// the server's (ulimit -n).
+//
+//     ./bench/ws_fanout PORT SUBSCRIBERS BROADCASTS
+//     ./bench/ws_fanout 8080 10000 50
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static const unsigned char OPCODE_TEXT = 0x1;
+
+static void fail(const std::string& what) {
+    fprintf(stderr, "fan-out failed: %s\n", what.c_str());
+    exit(2);
+}
+
+static int connectTo(int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (sock < 0 || connect(sock, (sockaddr*)&address, sizeof(address)) < 0) {
+        fail(std::string("connect: ") + strerror(errno));
+    }
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sock;
+}
+
+static void sendAll(int sock, const std::string& data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        ssize_t sent = send(sock, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            fail("send");
+        }
+        offset += static_cast<size_t>(sent);
+    }
+}
+
+// Reads one response head and whatever body Content-Length announces
+static std::string readResponse(int sock) {
+    std::string response;
+    char chunk[4096];
+    size_t headerEnd;
+    while ((headerEnd = response.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t received = recv(sock, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            fail("connection closed before a response");
+        }
+        response.append(chunk, static_cast<size_t>(received));
+    }
+    std::string headers = response.substr(0, headerEnd);
+    std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+    size_t at = headers.find("\r\ncontent-length:");
+    size_t length = at == std::string::npos ? 0 : strtoul(headers.c_str() + at + 17, nullptr, 10);
+    while (response.size() < headerEnd + 4 + length) {
+        ssize_t received = recv(sock, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            fail("connection closed in a response body");
+        }
+        response.append(chunk, static_cast<size_t>(received));
+    }
+    return response;
+}
+
+static double percentile(std::vector<double> values, double p) {
+    std::sort(values.begin(), values.end());
+    size_t at = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    return values[at];
+}
+
+static void report(const char* what, const std::vector<double>& seconds) {
+    printf("  %-22s p50 %9.3f ms  p99 %9.3f ms  max %9.3f ms\n", what, percentile(seconds, 0.5) * 1e3,
+           percentile(seconds, 0.99) * 1e3, *std::max_element(seconds.begin(), seconds.end()) * 1e3);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s PORT SUBSCRIBERS BROADCASTS\n", argv[0]);
+        return 1;
+    }
+    int port = atoi(argv[1]);
+    int subscribers = atoi(argv[2]);
+    int broadcasts = atoi(argv[3]);
+    if (subscribers < 1 || broadcasts < 1) {
+        fprintf(stderr, "SUBSCRIBERS and BROADCASTS must be positive\n");
+        return 1;
+    }
+
+    rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < static_cast<rlim_t>(subscribers) + 64) {
+        files.rlim_cur = std::min<rlim_t>(files.rlim_max, subscribers + 64);
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    int epollFd = epoll_create1(0);
+    std::vector<int> sockets;
+    auto connectStart = Clock::now();
+    for (int i = 0; i < subscribers; i++) {
+        int sock = connectTo(port);
+        sendAll(sock, "GET /ws HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n");
+        std::string response = readResponse(sock);
+        if (response.compare(0, 12, "HTTP/1.1 101") != 0) {
+            fail("subscriber " + std::to_string(i) + ": " + response.substr(0, response.find('\r')));
+        }
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u32 = static_cast<uint32_t>(i);
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, sock, &event);
+        sockets.push_back(sock);
+    }
+    printf("%d subscribers connected in %.3f s\n", subscribers,
+           std::chrono::duration<double>(Clock::now() - connectStart).count());
+
+    int http = connectTo(port);
+    std::vector<std::string> buffers(subscribers);
+    std::vector<double> toAll;
+    std::vector<double> deliveries;
+    long resyncs = 0;
+    epoll_event events[256];
+    for (int broadcast = 0; broadcast < broadcasts; broadcast++) {
+        std::string name = "Fanout" + std::to_string(broadcast);
+        std::string marker = "\"name\":\"" + name + "\"";
+        auto start = Clock::now();
+        sendAll(http, "POST /add?name=" + name + "&phone=555-" + std::to_string(broadcast) +
+                      " HTTP/1.1\r\nHost: localhost\r\nContent-Length: 0\r\n\r\n");
+        readResponse(http);
+
+        // Every subscriber gets this broadcast's delta (or a resync) before the next one
+        int waiting = subscribers;
+        while (waiting > 0) {
+            int count = epoll_wait(epollFd, events, 256, 10000);
+            if (count <= 0) {
+                fail(std::to_string(waiting) + " subscribers still waiting for " + name);
+            }
+            for (int e = 0; e < count; e++) {
+                uint32_t i = events[e].data.u32;
+                char chunk[65536];
+                ssize_t received = recv(sockets[i], chunk, sizeof(chunk), 0);
+                if (received <= 0) {
+                    fail("subscriber " + std::to_string(i) + " was disconnected");
+                }
+                std::string& buffer = buffers[i];
+                buffer.append(chunk, static_cast<size_t>(received));
+
+                // Server frames are unmasked
+                while (buffer.size() >= 2) {
+                    unsigned char opcode = static_cast<unsigned char>(buffer[0]) & 0x0F;
+                    uint64_t length = static_cast<unsigned char>(buffer[1]) & 0x7F;
+                    size_t header = 2;
+                    if (length == 126 || length == 127) {
+                        size_t bytes = length == 126 ? 2 : 8;
+                        if (buffer.size() < 2 + bytes) {
+                            break;
+                        }
+                        length = 0;
+                        for (size_t b = 0; b < bytes; b++) {
+                            length = (length << 8) | static_cast<unsigned char>(buffer[2 + b]);
+                        }
+                        header += bytes;
+                    }
+                    if (buffer.size() < header + length) {
+                        break;
+                    }
+                    std::string payload = buffer.substr(header, length);
+                    buffer.erase(0, header + length);
+
+                    if (opcode != OPCODE_TEXT) {
+                        continue;
+                    }
+                    if (payload.find("\"resync\"") != std::string::npos) {
+                        resyncs++;
+                        waiting--;
+                    } else if (payload.find(marker) != std::string::npos) {
+                        deliveries.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+                        waiting--;
+                    }
+                }
+            }
+        }
+        toAll.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+    }
+
+    printf("%d broadcasts to %d subscribers, one at a time:\n", broadcasts, subscribers);
+    report("to every subscriber", toAll);
+    report("each delivery", deliveries);
+    double total = 0;
+    for (double seconds : toAll) {
+        total += seconds;
+    }
+    printf("  %.0f deliveries/s, %ld resyncs\n", deliveries.size() / total, resyncs);
+
+    for (int sock : sockets) {
+        close(sock);
+    }
+    close(http);
+    return 0;
+}
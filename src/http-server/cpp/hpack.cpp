@@ -0,0 +1,437 @@
+#include "hpack.h"
+#include <algorithm>
+#include <array>
+
+static const HpackField STATIC_TABLE[61] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""}
+};
+
+// RFC 7541 Appendix B, indexed by symbol (256 = EOS)
+static const uint32_t HUFFMAN_CODES[257] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+    0x3fffffff
+};
+
+static const uint8_t HUFFMAN_LENGTHS[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30
+};
+
+static const size_t STATIC_TABLE_SIZE = 61;
+static const size_t ENTRY_OVERHEAD = 32;
+
+// Headers whose values change on every response only pollute the dynamic table
+static bool isVolatileHeader(const std::string& name) {
+    return name == "content-length" || name == "date" || name == "etag" ||
+           name == "location" || name == "set-cookie" || name == ":path";
+}
+
+HpackTable::HpackTable(size_t maxSize) : size(0), maxSize(maxSize) {}
+
+void HpackTable::evict() {
+    while (size > maxSize && !entries.empty()) {
+        size -= entries.back().name.size() + entries.back().value.size() + ENTRY_OVERHEAD;
+        entries.pop_back();
+    }
+}
+
+void HpackTable::add(const HpackField& field) {
+    size_t entrySize = field.name.size() + field.value.size() + ENTRY_OVERHEAD;
+    if (entrySize > maxSize) {
+        // An entry larger than the table empties it (RFC 7541 section 4.4)
+        entries.clear();
+        size = 0;
+        return;
+    }
+    entries.push_front(field);
+    size += entrySize;
+    evict();
+}
+
+void HpackTable::setMaxSize(size_t newMaxSize) {
+    maxSize = newMaxSize;
+    evict();
+}
+
+size_t HpackTable::getMaxSize() const {
+    return maxSize;
+}
+
+size_t HpackTable::count() const {
+    return entries.size();
+}
+
+const HpackField* HpackTable::get(size_t index) const {
+    if (index == 0) return nullptr;
+    if (index <= STATIC_TABLE_SIZE) return &STATIC_TABLE[index - 1];
+    index -= STATIC_TABLE_SIZE + 1;
+    if (index >= entries.size()) return nullptr;
+    return &entries[index];
+}
+
+size_t HpackTable::find(const HpackField& field, size_t& nameIndex) const {
+    nameIndex = 0;
+    for (size_t i = 0; i < STATIC_TABLE_SIZE; i++) {
+        if (STATIC_TABLE[i].name == field.name) {
+            if (STATIC_TABLE[i].value == field.value) return i + 1;
+            if (nameIndex == 0) nameIndex = i + 1;
+        }
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].name == field.name) {
+            if (entries[i].value == field.value) return STATIC_TABLE_SIZE + 1 + i;
+            if (nameIndex == 0) nameIndex = STATIC_TABLE_SIZE + 1 + i;
+        }
+    }
+    return 0;
+}
+
+void hpackEncodeInteger(uint64_t value, int prefixBits, unsigned char firstByte, std::string& output) {
+    uint64_t limit = (1u << prefixBits) - 1;
+    if (value < limit) {
+        output += static_cast<char>(firstByte | value);
+        return;
+    }
+    output += static_cast<char>(firstByte | limit);
+    value -= limit;
+    while (value >= 128) {
+        output += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    output += static_cast<char>(value);
+}
+
+bool hpackDecodeInteger(const unsigned char* data, size_t length, size_t& position, int prefixBits, uint64_t& value) {
+    if (position >= length) return false;
+    uint64_t limit = (1u << prefixBits) - 1;
+    value = data[position++] & limit;
+    if (value < limit) return true;
+
+    int shift = 0;
+    while (position < length) {
+        unsigned char byte = data[position++];
+        if (shift > 56) return false;
+        value += static_cast<uint64_t>(byte & 0x7F) << shift;
+        shift += 7;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+size_t huffmanEncodedLength(const std::string& input) {
+    size_t bits = 0;
+    for (unsigned char c : input) {
+        bits += HUFFMAN_LENGTHS[c];
+    }
+    return (bits + 7) / 8;
+}
+
+void huffmanEncode(const std::string& input, std::string& output) {
+    uint64_t accumulator = 0;
+    int pendingBits = 0;
+    for (unsigned char c : input) {
+        accumulator = (accumulator << HUFFMAN_LENGTHS[c]) | HUFFMAN_CODES[c];
+        pendingBits += HUFFMAN_LENGTHS[c];
+        while (pendingBits >= 8) {
+            pendingBits -= 8;
+            output += static_cast<char>(accumulator >> pendingBits);
+        }
+    }
+    if (pendingBits > 0) {
+        // Pad with the most significant bits of EOS (all ones)
+        accumulator = (accumulator << (8 - pendingBits)) | (0xFF >> pendingBits);
+        output += static_cast<char>(accumulator);
+    }
+}
+
+namespace {
+
+// Binary decoding tree built once from the canonical code table
+struct HuffmanTree {
+    struct Node {
+        std::array<int, 2> children{{-1, -1}};
+        int symbol = -1;
+    };
+    std::vector<Node> nodes;
+
+    HuffmanTree() {
+        nodes.emplace_back();
+        for (int symbol = 0; symbol <= 256; symbol++) {
+            int node = 0;
+            for (int bit = HUFFMAN_LENGTHS[symbol] - 1; bit >= 0; bit--) {
+                int branch = (HUFFMAN_CODES[symbol] >> bit) & 1;
+                if (nodes[node].children[branch] < 0) {
+                    nodes[node].children[branch] = static_cast<int>(nodes.size());
+                    nodes.emplace_back();
+                }
+                node = nodes[node].children[branch];
+            }
+            nodes[node].symbol = symbol;
+        }
+    }
+};
+
+}
+
+bool huffmanDecode(const unsigned char* data, size_t length, std::string& output) {
+    static const HuffmanTree tree;
+
+    int node = 0;
+    int depth = 0;
+    bool allOnes = true;
+    for (size_t i = 0; i < length; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            int branch = (data[i] >> bit) & 1;
+            node = tree.nodes[node].children[branch];
+            if (node < 0) return false;
+            depth++;
+            allOnes = allOnes && branch == 1;
+
+            int symbol = tree.nodes[node].symbol;
+            if (symbol >= 0) {
+                // EOS inside a string is a decoding error
+                if (symbol == 256) return false;
+                output += static_cast<char>(symbol);
+                node = 0;
+                depth = 0;
+                allOnes = true;
+            }
+        }
+    }
+
+    // Leftover bits must be a strict EOS prefix shorter than one byte
+    return depth < 8 && allOnes;
+}
+
+static bool decodeString(const unsigned char* data, size_t length, size_t& position, std::string& output) {
+    if (position >= length) return false;
+    bool huffman = (data[position] & 0x80) != 0;
+    uint64_t stringLength;
+    if (!hpackDecodeInteger(data, length, position, 7, stringLength)) return false;
+    if (stringLength > length - position) return false;
+
+    output.clear();
+    if (huffman) {
+        if (!huffmanDecode(data + position, stringLength, output)) return false;
+    } else {
+        output.assign(reinterpret_cast<const char*>(data + position), stringLength);
+    }
+    position += stringLength;
+    return true;
+}
+
+static void encodeString(const std::string& value, std::string& output) {
+    size_t huffmanLength = huffmanEncodedLength(value);
+    if (huffmanLength < value.size()) {
+        hpackEncodeInteger(huffmanLength, 7, 0x80, output);
+        huffmanEncode(value, output);
+    } else {
+        hpackEncodeInteger(value.size(), 7, 0x00, output);
+        output += value;
+    }
+}
+
+HpackDecoder::HpackDecoder(size_t maxTableSize, size_t maxListSize)
+    : table(maxTableSize), settingsMaxSize(maxTableSize), maxListSize(maxListSize) {}
+
+HpackDecoder::Result HpackDecoder::decode(const unsigned char* data, size_t length, std::vector<HpackField>& headers) {
+    size_t position = 0;
+    bool fieldSeen = false;
+    // Indexed fields cost a byte each however large they are, so the
+    // decoded size is checked as it grows rather than the block's
+    size_t listSize = 0;
+
+    while (position < length) {
+        unsigned char first = data[position];
+
+        if (first & 0x80) {
+            // Indexed header field
+            uint64_t index;
+            if (!hpackDecodeInteger(data, length, position, 7, index)) return COMPRESSION_ERROR;
+            const HpackField* field = table.get(index);
+            if (!field) return COMPRESSION_ERROR;
+            listSize += field->name.size() + field->value.size() + 32;
+            if (listSize > maxListSize) return LIST_TOO_LARGE;
+            headers.push_back(*field);
+            fieldSeen = true;
+        } else if ((first & 0xE0) == 0x20) {
+            // Dynamic table size update, only allowed before the first field
+            uint64_t newSize;
+            if (fieldSeen || !hpackDecodeInteger(data, length, position, 5, newSize)) return COMPRESSION_ERROR;
+            if (newSize > settingsMaxSize) return COMPRESSION_ERROR;
+            table.setMaxSize(newSize);
+        } else {
+            // Literal: with incremental indexing (01), without indexing (0000) or never indexed (0001)
+            bool indexing = (first & 0xC0) == 0x40;
+            int prefixBits = indexing ? 6 : 4;
+
+            uint64_t nameIndex;
+            if (!hpackDecodeInteger(data, length, position, prefixBits, nameIndex)) return COMPRESSION_ERROR;
+
+            HpackField field;
+            if (nameIndex > 0) {
+                const HpackField* named = table.get(nameIndex);
+                if (!named) return COMPRESSION_ERROR;
+                field.name = named->name;
+            } else if (!decodeString(data, length, position, field.name)) {
+                return COMPRESSION_ERROR;
+            }
+            if (!decodeString(data, length, position, field.value)) return COMPRESSION_ERROR;
+
+            listSize += field.name.size() + field.value.size() + 32;
+            if (listSize > maxListSize) return LIST_TOO_LARGE;
+
+            if (indexing) table.add(field);
+            headers.push_back(std::move(field));
+            fieldSeen = true;
+        }
+    }
+
+    return OK;
+}
+
+HpackEncoder::HpackEncoder() : table(4096), pendingMaxSize(4096), sizeUpdatePending(false) {}
+
+void HpackEncoder::setMaxTableSize(size_t maxSize) {
+    // Never grow past the default; a smaller table is all this server needs
+    pendingMaxSize = std::min<size_t>(maxSize, 4096);
+    if (pendingMaxSize != table.getMaxSize()) {
+        sizeUpdatePending = true;
+    }
+}
+
+void HpackEncoder::encode(const std::vector<HpackField>& headers, std::string& output) {
+    if (sizeUpdatePending) {
+        table.setMaxSize(pendingMaxSize);
+        hpackEncodeInteger(pendingMaxSize, 5, 0x20, output);
+        sizeUpdatePending = false;
+    }
+
+    for (const auto& field : headers) {
+        size_t nameIndex;
+        size_t index = table.find(field, nameIndex);
+        if (index > 0) {
+            hpackEncodeInteger(index, 7, 0x80, output);
+            continue;
+        }
+
+        bool indexing = !isVolatileHeader(field.name);
+        if (indexing) {
+            hpackEncodeInteger(nameIndex, 6, 0x40, output);
+        } else {
+            hpackEncodeInteger(nameIndex, 4, 0x00, output);
+        }
+        if (nameIndex == 0) {
+            encodeString(field.name, output);
+        }
+        encodeString(field.value, output);
+
+        if (indexing) table.add(field);
+    }
+}
@@ -0,0 +1,80 @@
+// Hpack - HTTP/2 header compression (RFC 7541): static and dynamic tables,
+// prefixed integers and Huffman-coded string literals.
+
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstddef>
+#include <cstdint>
+
+struct HpackField {
+    std::string name;
+    std::string value;
+};
+
+class HpackTable {
+    private:
+        std::deque<HpackField> entries; // newest first
+        size_t size;
+        size_t maxSize;
+
+        void evict();
+
+    public:
+        explicit HpackTable(size_t maxSize = 4096);
+
+        void add(const HpackField& field);
+        void setMaxSize(size_t newMaxSize);
+        size_t getMaxSize() const;
+        size_t count() const;
+
+        // Combined index space: 1..61 static, then dynamic entries
+        const HpackField* get(size_t index) const;
+        // Returns the combined index of an exact match (or 0) and of a name match
+        size_t find(const HpackField& field, size_t& nameIndex) const;
+};
+
+class HpackDecoder {
+    private:
+        HpackTable table;
+        size_t settingsMaxSize;
+        size_t maxListSize;
+
+    public:
+        enum Result { OK, COMPRESSION_ERROR, LIST_TOO_LARGE };
+
+        // maxListSize bounds the decoded block as SETTINGS_MAX_HEADER_LIST_SIZE
+        // counts it: name, value and 32 octets for each field
+        explicit HpackDecoder(size_t maxTableSize = 4096, size_t maxListSize = SIZE_MAX);
+
+        // Decodes one complete header block. Anything but OK leaves the
+        // decoder out of step with the peer, and the connection must be
+        // torn down.
+        Result decode(const unsigned char* data, size_t length, std::vector<HpackField>& headers);
+};
+
+class HpackEncoder {
+    private:
+        HpackTable table;
+        size_t pendingMaxSize;
+        bool sizeUpdatePending;
+
+    public:
+        HpackEncoder();
+
+        // Peer's SETTINGS_HEADER_TABLE_SIZE; announced in the next header block
+        void setMaxTableSize(size_t maxSize);
+        void encode(const std::vector<HpackField>& headers, std::string& output);
+};
+
+void hpackEncodeInteger(uint64_t value, int prefixBits, unsigned char firstByte, std::string& output);
+bool hpackDecodeInteger(const unsigned char* data, size_t length, size_t& position, int prefixBits, uint64_t& value);
+
+size_t huffmanEncodedLength(const std::string& input);
+void huffmanEncode(const std::string& input, std::string& output);
+bool huffmanDecode(const unsigned char* data, size_t length, std::string& output);
+
+#endif // HPACK_H
@@ -0,0 +1,645 @@
+#include "http2.h"
+#include "openssl_base64.h"
+#include "async_logger.h"
+#include <algorithm>
+#include <cctype>
+
+const std::string HTTP2_PREFACE("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", 24);
+
+// Frame types
+static const uint8_t FRAME_DATA = 0x0;
+static const uint8_t FRAME_HEADERS = 0x1;
+static const uint8_t FRAME_PRIORITY = 0x2;
+static const uint8_t FRAME_RST_STREAM = 0x3;
+static const uint8_t FRAME_SETTINGS = 0x4;
+static const uint8_t FRAME_PUSH_PROMISE = 0x5;
+static const uint8_t FRAME_PING = 0x6;
+static const uint8_t FRAME_GOAWAY = 0x7;
+static const uint8_t FRAME_WINDOW_UPDATE = 0x8;
+static const uint8_t FRAME_CONTINUATION = 0x9;
+
+// Frame flags
+static const uint8_t FLAG_END_STREAM = 0x1;
+static const uint8_t FLAG_ACK = 0x1;
+static const uint8_t FLAG_END_HEADERS = 0x4;
+static const uint8_t FLAG_PADDED = 0x8;
+static const uint8_t FLAG_PRIORITY = 0x20;
+
+// Error codes
+static const uint32_t ERROR_NONE = 0x0;
+static const uint32_t ERROR_PROTOCOL = 0x1;
+static const uint32_t ERROR_FLOW_CONTROL = 0x3;
+static const uint32_t ERROR_STREAM_CLOSED = 0x5;
+static const uint32_t ERROR_FRAME_SIZE = 0x6;
+static const uint32_t ERROR_REFUSED_STREAM = 0x7;
+static const uint32_t ERROR_COMPRESSION = 0x9;
+static const uint32_t ERROR_ENHANCE_YOUR_CALM = 0xB;
+
+// Settings identifiers
+static const uint16_t SETTINGS_HEADER_TABLE_SIZE = 0x1;
+static const uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+static const uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+static const uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+static const uint16_t SETTINGS_MAX_HEADER_LIST_SIZE = 0x6;
+
+static const size_t FRAME_HEADER_SIZE = 9;
+static const uint32_t DEFAULT_WINDOW_SIZE = 65535;
+static const uint32_t MAX_WINDOW_SIZE = 0x7FFFFFFF;
+static const uint32_t LOCAL_MAX_FRAME_SIZE = 16384;
+static const uint32_t MAX_CONCURRENT_STREAMS = 100;
+static const size_t MAX_HEADER_BLOCK_SIZE = 64 * 1024;
+static const uint32_t MAX_HEADER_LIST_SIZE = 64 * 1024;
+static const size_t MAX_REQUEST_BODY_SIZE = 8 * 1024 * 1024;
+
+static uint32_t readUint32(const unsigned char* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static void appendUint32(std::string& out, uint32_t value) {
+    out += static_cast<char>(value >> 24);
+    out += static_cast<char>(value >> 16);
+    out += static_cast<char>(value >> 8);
+    out += static_cast<char>(value);
+}
+
+// Hop-by-hop headers are forbidden in HTTP/2 (RFC 7540 section 8.1.2.2)
+static bool isConnectionSpecific(const std::string& name) {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade";
+}
+
+Http2Connection::Http2Connection(Transport& transport, RequestHandler handler, const std::string& buffered,
+                                 int drainFd)
+    : transport(transport), handler(std::move(handler)), input(buffered), inputOffset(0),
+      decoder(4096, MAX_HEADER_LIST_SIZE), lastStreamId(0), continuationStreamId(0), continuationEndsStream(false),
+      connectionSendWindow(DEFAULT_WINDOW_SIZE), peerInitialWindowSize(DEFAULT_WINDOW_SIZE),
+      peerMaxFrameSize(16384), goingAway(false), drainFd(drainFd), goawaySent(false), goawayStreamId(0) {}
+
+void Http2Connection::serve() {
+    if (!readPreface()) {
+        return;
+    }
+    writeSettings();
+    run();
+}
+
+void Http2Connection::serveUpgrade(const HttpRequest& request, const std::string& settingsHeader) {
+    // HTTP2-Settings carries a base64url SETTINGS payload without padding
+    std::string encoded = settingsHeader;
+    std::replace(encoded.begin(), encoded.end(), '-', '+');
+    std::replace(encoded.begin(), encoded.end(), '_', '/');
+    while (encoded.size() % 4 != 0) {
+        encoded += '=';
+    }
+
+    try {
+        writeSettings();
+        if (!encoded.empty()) {
+            std::string payload = base64_decode(encoded);
+            applySettings(reinterpret_cast<const unsigned char*>(payload.data()), payload.size());
+        }
+
+        // Stream 1 is half-closed (remote) and carries the response to the upgrade request
+        lastStreamId = 1;
+        Stream& stream = streams[1];
+        stream.requestComplete = true;
+        stream.sendWindow = peerInitialWindowSize;
+        queueResponse(1, handler(request));
+        pump();
+    } catch (const std::exception& e) {
+        LOG_WARN("http2", std::string("Upgrade failed: ") + e.what());
+        return;
+    }
+
+    if (!flush() || !readPreface()) {
+        return;
+    }
+    run();
+}
+
+bool Http2Connection::readMore() {
+    char buffer[16384];
+    long received = transport.read(buffer, sizeof(buffer));
+    if (received <= 0) {
+        return false;
+    }
+    if (inputOffset > 0) {
+        input.erase(0, inputOffset);
+        inputOffset = 0;
+    }
+    input.append(buffer, received);
+    return true;
+}
+
+bool Http2Connection::readPreface() {
+    while (input.size() - inputOffset < HTTP2_PREFACE.size()) {
+        if (!readMore()) return false;
+    }
+    if (input.compare(inputOffset, HTTP2_PREFACE.size(), HTTP2_PREFACE) != 0) {
+        return false;
+    }
+    inputOffset += HTTP2_PREFACE.size();
+    return true;
+}
+
+void Http2Connection::run() {
+    try {
+        while (true) {
+            processBufferedFrames();
+            pump();
+            if (!flush()) return;
+
+            if (goingAway && streams.empty()) break;
+
+            // Until a drain starts, waiting for input also waits for the drain
+            if (drainFd >= 0 && !goingAway) {
+                int ready = transport.wait(drainFd);
+                if (ready < 0) break;
+                if (ready == 0) {
+                    goingAway = true;
+                    writeGoaway(ERROR_NONE);
+                    continue;
+                }
+            }
+            if (!readMore()) break;
+        }
+        if (!goawaySent) writeGoaway(ERROR_NONE);
+    } catch (const ConnectionError& e) {
+        LOG_WARN("http2", std::string("Connection error: ") + e.what());
+        writeGoaway(e.code);
+    }
+    flush();
+}
+
+bool Http2Connection::processBufferedFrames() {
+    bool processed = false;
+    while (input.size() - inputOffset >= FRAME_HEADER_SIZE) {
+        const unsigned char* header = reinterpret_cast<const unsigned char*>(input.data()) + inputOffset;
+        uint32_t length = (static_cast<uint32_t>(header[0]) << 16) | (header[1] << 8) | header[2];
+        if (length > LOCAL_MAX_FRAME_SIZE) {
+            throw ConnectionError(ERROR_FRAME_SIZE, "frame exceeds SETTINGS_MAX_FRAME_SIZE");
+        }
+        if (input.size() - inputOffset < FRAME_HEADER_SIZE + length) {
+            break;
+        }
+
+        uint8_t type = header[3];
+        uint8_t flags = header[4];
+        uint32_t streamId = readUint32(header + 5) & 0x7FFFFFFF;
+        handleFrame(type, flags, streamId, header + FRAME_HEADER_SIZE, length);
+
+        inputOffset += FRAME_HEADER_SIZE + length;
+        processed = true;
+    }
+    return processed;
+}
+
+void Http2Connection::handleFrame(uint8_t type, uint8_t flags, uint32_t streamId, const unsigned char* payload, size_t length) {
+    // A header block must not be interleaved with any other frame
+    if (continuationStreamId != 0 && (type != FRAME_CONTINUATION || streamId != continuationStreamId)) {
+        throw ConnectionError(ERROR_PROTOCOL, "expected CONTINUATION");
+    }
+
+    switch (type) {
+        case FRAME_DATA:
+            handleData(flags, streamId, payload, length);
+            break;
+
+        case FRAME_HEADERS:
+            handleHeaders(flags, streamId, payload, length);
+            break;
+
+        case FRAME_CONTINUATION:
+            if (continuationStreamId == 0) {
+                throw ConnectionError(ERROR_PROTOCOL, "unexpected CONTINUATION");
+            }
+            headerBlock.append(reinterpret_cast<const char*>(payload), length);
+            if (headerBlock.size() > MAX_HEADER_BLOCK_SIZE) {
+                throw ConnectionError(ERROR_ENHANCE_YOUR_CALM, "header block too large");
+            }
+            if (flags & FLAG_END_HEADERS) {
+                continuationStreamId = 0;
+                finishHeaderBlock(streamId, continuationEndsStream);
+            }
+            break;
+
+        case FRAME_PRIORITY:
+            if (streamId == 0) throw ConnectionError(ERROR_PROTOCOL, "PRIORITY on stream 0");
+            if (length != 5) throw ConnectionError(ERROR_FRAME_SIZE, "bad PRIORITY length");
+            break;
+
+        case FRAME_RST_STREAM:
+            if (streamId == 0) throw ConnectionError(ERROR_PROTOCOL, "RST_STREAM on stream 0");
+            if (length != 4) throw ConnectionError(ERROR_FRAME_SIZE, "bad RST_STREAM length");
+            streams.erase(streamId);
+            break;
+
+        case FRAME_SETTINGS:
+            if (streamId != 0) throw ConnectionError(ERROR_PROTOCOL, "SETTINGS on a stream");
+            if (flags & FLAG_ACK) {
+                if (length != 0) throw ConnectionError(ERROR_FRAME_SIZE, "SETTINGS ACK with payload");
+                break;
+            }
+            applySettings(payload, length);
+            writeFrame(FRAME_SETTINGS, FLAG_ACK, 0, nullptr, 0);
+            break;
+
+        case FRAME_PUSH_PROMISE:
+            throw ConnectionError(ERROR_PROTOCOL, "clients cannot push");
+
+        case FRAME_PING:
+            if (streamId != 0) throw ConnectionError(ERROR_PROTOCOL, "PING on a stream");
+            if (length != 8) throw ConnectionError(ERROR_FRAME_SIZE, "bad PING length");
+            if (!(flags & FLAG_ACK)) {
+                writeFrame(FRAME_PING, FLAG_ACK, 0, reinterpret_cast<const char*>(payload), length);
+            }
+            break;
+
+        case FRAME_GOAWAY:
+            goingAway = true;
+            break;
+
+        case FRAME_WINDOW_UPDATE:
+            handleWindowUpdate(streamId, payload, length);
+            break;
+
+        default:
+            // Unknown frame types must be ignored
+            break;
+    }
+}
+
+void Http2Connection::handleData(uint8_t flags, uint32_t streamId, const unsigned char* payload, size_t length) {
+    if (streamId == 0) {
+        throw ConnectionError(ERROR_PROTOCOL, "DATA on stream 0");
+    }
+
+    // The whole frame counts against flow control, padding included; credit it back immediately
+    if (length > 0) {
+        writeWindowUpdate(0, static_cast<uint32_t>(length));
+    }
+
+    size_t padding = 0;
+    if (flags & FLAG_PADDED) {
+        if (length < 1 || payload[0] >= length) throw ConnectionError(ERROR_PROTOCOL, "bad DATA padding");
+        padding = payload[0];
+        payload++;
+        length--;
+    }
+    length -= padding;
+
+    auto it = streams.find(streamId);
+    if (it == streams.end() || it->second.requestComplete) {
+        if (streamId > lastStreamId) throw ConnectionError(ERROR_PROTOCOL, "DATA on idle stream");
+        writeRstStream(streamId, ERROR_STREAM_CLOSED);
+        return;
+    }
+
+    Stream& stream = it->second;
+    if (stream.body.size() + length > MAX_REQUEST_BODY_SIZE) {
+        writeRstStream(streamId, ERROR_ENHANCE_YOUR_CALM);
+        streams.erase(it);
+        return;
+    }
+    stream.body.append(reinterpret_cast<const char*>(payload), length);
+
+    if (flags & FLAG_END_STREAM) {
+        stream.requestComplete = true;
+        dispatch(streamId);
+    } else if (length + padding > 0) {
+        writeWindowUpdate(streamId, static_cast<uint32_t>(length + padding + (flags & FLAG_PADDED ? 1 : 0)));
+    }
+}
+
+void Http2Connection::handleHeaders(uint8_t flags, uint32_t streamId, const unsigned char* payload, size_t length) {
+    if (streamId == 0 || (streamId & 1) == 0) {
+        throw ConnectionError(ERROR_PROTOCOL, "HEADERS on an invalid stream");
+    }
+
+    size_t padding = 0;
+    if (flags & FLAG_PADDED) {
+        if (length < 1) throw ConnectionError(ERROR_PROTOCOL, "bad HEADERS padding");
+        padding = payload[0];
+        payload++;
+        length--;
+    }
+    if (flags & FLAG_PRIORITY) {
+        if (length < 5) throw ConnectionError(ERROR_FRAME_SIZE, "bad HEADERS priority");
+        payload += 5;
+        length -= 5;
+    }
+    if (padding > length) {
+        throw ConnectionError(ERROR_PROTOCOL, "bad HEADERS padding");
+    }
+    length -= padding;
+
+    headerBlock.assign(reinterpret_cast<const char*>(payload), length);
+    bool endStream = (flags & FLAG_END_STREAM) != 0;
+    if (flags & FLAG_END_HEADERS) {
+        finishHeaderBlock(streamId, endStream);
+    } else {
+        continuationStreamId = streamId;
+        continuationEndsStream = endStream;
+    }
+}
+
+void Http2Connection::finishHeaderBlock(uint32_t streamId, bool endStream) {
+    // Always decode so the HPACK state stays in sync, even for refused streams
+    std::vector<HpackField> fields;
+    HpackDecoder::Result decoded =
+        decoder.decode(reinterpret_cast<const unsigned char*>(headerBlock.data()), headerBlock.size(), fields);
+    if (decoded == HpackDecoder::LIST_TOO_LARGE) {
+        throw ConnectionError(ERROR_ENHANCE_YOUR_CALM, "header list exceeds SETTINGS_MAX_HEADER_LIST_SIZE");
+    }
+    if (decoded != HpackDecoder::OK) {
+        throw ConnectionError(ERROR_COMPRESSION, "HPACK decoding failed");
+    }
+    headerBlock.clear();
+
+    auto it = streams.find(streamId);
+    if (it != streams.end() && !it->second.requestComplete) {
+        // Trailers: nothing in this server uses them
+        if (!endStream) throw ConnectionError(ERROR_PROTOCOL, "trailers without END_STREAM");
+        it->second.requestComplete = true;
+        dispatch(streamId);
+        return;
+    }
+    if (streamId <= lastStreamId) {
+        throw ConnectionError(ERROR_PROTOCOL, "stream identifier reused");
+    }
+    lastStreamId = streamId;
+
+    size_t active = 0;
+    for (const auto& entry : streams) {
+        if (!entry.second.requestComplete || entry.second.responseQueued) active++;
+    }
+    if (active >= MAX_CONCURRENT_STREAMS || goingAway) {
+        writeRstStream(streamId, ERROR_REFUSED_STREAM);
+        return;
+    }
+
+    Stream& stream = streams[streamId];
+    stream.requestHeaders = std::move(fields);
+    stream.sendWindow = peerInitialWindowSize;
+    if (endStream) {
+        stream.requestComplete = true;
+        dispatch(streamId);
+    }
+}
+
+void Http2Connection::applySettings(const unsigned char* payload, size_t length) {
+    if (length % 6 != 0) {
+        throw ConnectionError(ERROR_FRAME_SIZE, "bad SETTINGS length");
+    }
+
+    for (size_t offset = 0; offset < length; offset += 6) {
+        uint16_t identifier = static_cast<uint16_t>((payload[offset] << 8) | payload[offset + 1]);
+        uint32_t value = readUint32(payload + offset + 2);
+
+        switch (identifier) {
+            case SETTINGS_HEADER_TABLE_SIZE:
+                encoder.setMaxTableSize(value);
+                break;
+
+            case SETTINGS_INITIAL_WINDOW_SIZE: {
+                if (value > MAX_WINDOW_SIZE) {
+                    throw ConnectionError(ERROR_FLOW_CONTROL, "initial window too large");
+                }
+                // The change applies to every open stream (RFC 7540 section 6.9.2)
+                int64_t delta = static_cast<int64_t>(value) - peerInitialWindowSize;
+                for (auto& entry : streams) {
+                    entry.second.sendWindow += delta;
+                    if (entry.second.sendWindow > MAX_WINDOW_SIZE) {
+                        throw ConnectionError(ERROR_FLOW_CONTROL, "stream window overflow");
+                    }
+                }
+                peerInitialWindowSize = value;
+                break;
+            }
+
+            case SETTINGS_MAX_FRAME_SIZE:
+                if (value < 16384 || value > 16777215) {
+                    throw ConnectionError(ERROR_PROTOCOL, "invalid SETTINGS_MAX_FRAME_SIZE");
+                }
+                peerMaxFrameSize = value;
+                break;
+
+            default:
+                // ENABLE_PUSH, MAX_CONCURRENT_STREAMS and MAX_HEADER_LIST_SIZE
+                // do not constrain a server that never pushes
+                break;
+        }
+    }
+}
+
+void Http2Connection::handleWindowUpdate(uint32_t streamId, const unsigned char* payload, size_t length) {
+    if (length != 4) {
+        throw ConnectionError(ERROR_FRAME_SIZE, "bad WINDOW_UPDATE length");
+    }
+    uint32_t increment = readUint32(payload) & 0x7FFFFFFF;
+
+    if (streamId == 0) {
+        if (increment == 0) throw ConnectionError(ERROR_PROTOCOL, "zero WINDOW_UPDATE");
+        connectionSendWindow += increment;
+        if (connectionSendWindow > MAX_WINDOW_SIZE) {
+            throw ConnectionError(ERROR_FLOW_CONTROL, "connection window overflow");
+        }
+        return;
+    }
+
+    auto it = streams.find(streamId);
+    if (it == streams.end()) {
+        return;
+    }
+    if (increment == 0) {
+        writeRstStream(streamId, ERROR_PROTOCOL);
+        streams.erase(it);
+        return;
+    }
+    it->second.sendWindow += increment;
+    if (it->second.sendWindow > MAX_WINDOW_SIZE) {
+        writeRstStream(streamId, ERROR_FLOW_CONTROL);
+        streams.erase(it);
+    }
+}
+
+void Http2Connection::dispatch(uint32_t streamId) {
+    Stream& stream = streams[streamId];
+
+    HttpRequest request;
+    request.httpVersion = "HTTP/2";
+    std::string target;
+    std::string cookies;
+    for (const auto& field : stream.requestHeaders) {
+        if (field.name == ":method") {
+            request.method = field.value;
+        } else if (field.name == ":path") {
+            target = field.value;
+        } else if (field.name == ":authority") {
+            request.headers["Host"] = field.value;
+        } else if (field.name == "cookie") {
+            // Cookie crumbs may be split across fields (RFC 7540 section 8.1.2.5)
+            cookies += (cookies.empty() ? "" : "; ") + field.value;
+        } else if (!field.name.empty() && field.name[0] != ':') {
+            request.headers[field.name] = field.value;
+        }
+    }
+    if (!cookies.empty()) {
+        request.headers["Cookie"] = cookies;
+    }
+
+    if (request.method.empty() || target.empty()) {
+        writeRstStream(streamId, ERROR_PROTOCOL);
+        streams.erase(streamId);
+        return;
+    }
+
+    request.setTarget(target);
+    request.body = std::move(stream.body);
+    request.parseFormBody();
+
+    HttpResponse response;
+    try {
+        response = handler(request);
+    } catch (const std::exception& e) {
+        LOG_ERROR("http2", std::string("Handler failed: ") + e.what());
+        response = HttpResponse();
+        response.setStatus(500, "Internal Server Error");
+        response.setContentType("text/plain");
+        response.body = "Internal Server Error";
+        response.setContentLength();
+    }
+    queueResponse(streamId, response);
+}
+
+void Http2Connection::queueResponse(uint32_t streamId, const HttpResponse& response) {
+    std::vector<HpackField> fields;
+    fields.push_back({":status", std::to_string(response.statusCode)});
+    for (const auto& header : response.headers) {
+        std::string name = header.first;
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (!isConnectionSpecific(name)) {
+            fields.push_back({name, header.second});
+        }
+    }
+
+    std::string block;
+    encoder.encode(fields, block);
+
+    // Split the header block into HEADERS + CONTINUATION frames as needed
+    bool hasBody = !response.body.empty();
+    size_t offset = 0;
+    bool first = true;
+    do {
+        size_t chunk = std::min<size_t>(block.size() - offset, peerMaxFrameSize);
+        bool last = offset + chunk == block.size();
+        uint8_t flags = last ? FLAG_END_HEADERS : 0;
+        if (first && !hasBody) flags |= FLAG_END_STREAM;
+        writeFrame(first ? FRAME_HEADERS : FRAME_CONTINUATION, flags, streamId, block.data() + offset, chunk);
+        offset += chunk;
+        first = false;
+    } while (offset < block.size());
+
+    if (!hasBody) {
+        streams.erase(streamId);
+        return;
+    }
+
+    Stream& stream = streams[streamId];
+    stream.responseQueued = true;
+    stream.pendingData = response.body;
+    stream.pendingOffset = 0;
+}
+
+// Interleaves DATA frames across streams, one frame per stream per round,
+// until every response is sent or blocked on a flow-control window
+void Http2Connection::pump() {
+    bool progress = true;
+    while (progress && connectionSendWindow > 0) {
+        progress = false;
+        for (auto it = streams.begin(); it != streams.end() && connectionSendWindow > 0;) {
+            Stream& stream = it->second;
+            if (!stream.responseQueued || stream.sendWindow <= 0) {
+                ++it;
+                continue;
+            }
+
+            size_t remaining = stream.pendingData.size() - stream.pendingOffset;
+            size_t chunk = std::min<size_t>(remaining, peerMaxFrameSize);
+            chunk = std::min<size_t>(chunk, static_cast<size_t>(connectionSendWindow));
+            chunk = std::min<size_t>(chunk, static_cast<size_t>(stream.sendWindow));
+
+            bool last = chunk == remaining;
+            writeFrame(FRAME_DATA, last ? FLAG_END_STREAM : 0, it->first,
+                       stream.pendingData.data() + stream.pendingOffset, chunk);
+            stream.pendingOffset += chunk;
+            stream.sendWindow -= chunk;
+            connectionSendWindow -= chunk;
+            progress = true;
+
+            if (last) {
+                it = streams.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void Http2Connection::writeFrame(uint8_t type, uint8_t flags, uint32_t streamId, const char* payload, size_t length) {
+    output += static_cast<char>(length >> 16);
+    output += static_cast<char>(length >> 8);
+    output += static_cast<char>(length);
+    output += static_cast<char>(type);
+    output += static_cast<char>(flags);
+    appendUint32(output, streamId & 0x7FFFFFFF);
+    if (length > 0) {
+        output.append(payload, length);
+    }
+}
+
+void Http2Connection::writeSettings() {
+    std::string payload;
+    payload += static_cast<char>(SETTINGS_MAX_CONCURRENT_STREAMS >> 8);
+    payload += static_cast<char>(SETTINGS_MAX_CONCURRENT_STREAMS & 0xFF);
+    appendUint32(payload, MAX_CONCURRENT_STREAMS);
+    payload += static_cast<char>(SETTINGS_MAX_HEADER_LIST_SIZE >> 8);
+    payload += static_cast<char>(SETTINGS_MAX_HEADER_LIST_SIZE & 0xFF);
+    appendUint32(payload, MAX_HEADER_LIST_SIZE);
+    writeFrame(FRAME_SETTINGS, 0, 0, payload.data(), payload.size());
+}
+
+void Http2Connection::writeWindowUpdate(uint32_t streamId, uint32_t increment) {
+    std::string payload;
+    appendUint32(payload, increment);
+    writeFrame(FRAME_WINDOW_UPDATE, 0, streamId, payload.data(), payload.size());
+}
+
+void Http2Connection::writeRstStream(uint32_t streamId, uint32_t errorCode) {
+    std::string payload;
+    appendUint32(payload, errorCode);
+    writeFrame(FRAME_RST_STREAM, 0, streamId, payload.data(), payload.size());
+}
+
+void Http2Connection::writeGoaway(uint32_t errorCode) {
+    // Streams refused after the first GOAWAY do not count; its last stream
+    // identifier may only go down
+    if (!goawaySent) {
+        goawaySent = true;
+        goawayStreamId = lastStreamId;
+    }
+    std::string payload;
+    appendUint32(payload, goawayStreamId);
+    appendUint32(payload, errorCode);
+    writeFrame(FRAME_GOAWAY, 0, 0, payload.data(), payload.size());
+}
+
+bool Http2Connection::flush() {
+    if (output.empty()) {
+        return true;
+    }
+    bool ok = transport.writeAll(output);
+    output.clear();
+    return ok;
+}
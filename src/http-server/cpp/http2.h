@@ -0,0 +1,100 @@
+// Http2 - HTTP/2 (RFC 7540) server connection: framing, stream multiplexing
+// and flow control on top of HPACK. Requests are dispatched to the same
+// handler the HTTP/1.1 path uses.
+
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+#include "http_message.h"
+#include "hpack.h"
+#include "transport.h"
+
+// Client connection preface (RFC 7540 section 3.5)
+extern const std::string HTTP2_PREFACE;
+
+typedef std::function<HttpResponse(const HttpRequest&)> RequestHandler;
+
+class Http2Connection {
+    private:
+        struct Stream {
+            std::vector<HpackField> requestHeaders;
+            std::string body;
+            bool requestComplete = false;
+            int64_t sendWindow = 0;
+            std::string pendingData;
+            size_t pendingOffset = 0;
+            bool responseQueued = false;
+        };
+
+        // Connection-level error; answered with GOAWAY and a close
+        class ConnectionError : public std::runtime_error {
+            public:
+                uint32_t code;
+                ConnectionError(uint32_t code, const std::string& message)
+                    : std::runtime_error(message), code(code) {}
+        };
+
+        Transport& transport;
+        RequestHandler handler;
+        std::string input;
+        size_t inputOffset;
+        std::string output;
+        HpackDecoder decoder;
+        HpackEncoder encoder;
+        std::map<uint32_t, Stream> streams;
+        uint32_t lastStreamId;
+        uint32_t continuationStreamId;
+        bool continuationEndsStream;
+        std::string headerBlock;
+        int64_t connectionSendWindow;
+        uint32_t peerInitialWindowSize;
+        uint32_t peerMaxFrameSize;
+        bool goingAway;
+        int drainFd;
+        bool goawaySent;
+        uint32_t goawayStreamId;
+
+        bool readMore();
+        bool readPreface();
+        void run();
+        bool processBufferedFrames();
+        void handleFrame(uint8_t type, uint8_t flags, uint32_t streamId, const unsigned char* payload, size_t length);
+        void handleData(uint8_t flags, uint32_t streamId, const unsigned char* payload, size_t length);
+        void handleHeaders(uint8_t flags, uint32_t streamId, const unsigned char* payload, size_t length);
+        void finishHeaderBlock(uint32_t streamId, bool endStream);
+        void applySettings(const unsigned char* payload, size_t length);
+        void handleWindowUpdate(uint32_t streamId, const unsigned char* payload, size_t length);
+
+        void dispatch(uint32_t streamId);
+        void queueResponse(uint32_t streamId, const HttpResponse& response);
+        void pump();
+
+        void writeFrame(uint8_t type, uint8_t flags, uint32_t streamId, const char* payload, size_t length);
+        void writeSettings();
+        void writeWindowUpdate(uint32_t streamId, uint32_t increment);
+        void writeRstStream(uint32_t streamId, uint32_t errorCode);
+        void writeGoaway(uint32_t errorCode);
+        bool flush();
+
+    public:
+        // buffered holds bytes the HTTP/1.1 reader already consumed from the
+        // transport. Once drainFd turns readable the connection sends GOAWAY,
+        // finishes the streams already open and closes.
+        Http2Connection(Transport& transport, RequestHandler handler, const std::string& buffered = "",
+                        int drainFd = -1);
+
+        // Serves a connection that starts with the client preface (prior knowledge or ALPN h2)
+        void serve();
+
+        // Serves an h2c connection upgraded from HTTP/1.1 (RFC 7540 section 3.2);
+        // the upgrade request itself is answered on stream 1
+        void serveUpgrade(const HttpRequest& request, const std::string& settingsHeader);
+};
+
+#endif // HTTP2_H
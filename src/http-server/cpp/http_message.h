@@ -0,0 +1,210 @@
+// HttpMessage - Protocol-agnostic request/response types shared by the
+// HTTP/1.1 and HTTP/2 front ends.
+
+#ifndef HTTP_MESSAGE_H
+#define HTTP_MESSAGE_H
+
+#include <string>
+#include <map>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <iterator>
+
+// Header names are case-insensitive; HTTP/2 always sends them lowercase
+struct CaseInsensitiveLess {
+    bool operator()(const std::string& a, const std::string& b) const {
+        return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(),
+            [](unsigned char x, unsigned char y) { return std::tolower(x) < std::tolower(y); });
+    }
+};
+
+typedef std::map<std::string, std::string, CaseInsensitiveLess> HeaderMap;
+
+// HTTP request parser
+class HttpRequest {
+    public:
+        std::string method;
+        std::string path;
+        std::string httpVersion;
+        HeaderMap headers;
+        std::map<std::string, std::string> queryParams;
+        std::string body;
+
+        HttpRequest() = default;
+
+        static HttpRequest parse(const std::string& requestStr) {
+            HttpRequest request;
+            std::istringstream stream(requestStr);
+            std::string line;
+
+            // Parse request line
+            if (std::getline(stream, line)) {
+                line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+                std::istringstream lineStream(line);
+                std::string target;
+                lineStream >> request.method >> target >> request.httpVersion;
+                request.setTarget(target);
+            }
+
+            // Parse headers
+            while (std::getline(stream, line) && !line.empty() && line != "\r") {
+                line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+                size_t colonPos = line.find(':');
+                if (colonPos != std::string::npos) {
+                    std::string key = line.substr(0, colonPos);
+                    std::string value = line.substr(colonPos + 1);
+                    // Trim leading/trailing whitespace
+                    value.erase(0, value.find_first_not_of(' '));
+                    value.erase(value.find_last_not_of(' ') + 1);
+                    // A repeated field is one list (RFC 9110 section 5.3), so a
+                    // second Content-Length shows up instead of replacing the first
+                    auto existing = request.headers.find(key);
+                    if (existing != request.headers.end()) {
+                        existing->second += ", " + value;
+                    } else {
+                        request.headers[key] = value;
+                    }
+                }
+            }
+
+            // Parse body if Content-Length is present and valid
+            auto lengthHeader = request.headers.find("Content-Length");
+            size_t contentLength = 0;
+            if (lengthHeader != request.headers.end() && parseContentLength(lengthHeader->second, contentLength)) {
+                if (contentLength > 0) {
+                    // Only what was passed in, however much the header claims
+                    std::string rest((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+                    request.body = rest.substr(0, contentLength);
+                    request.parseFormBody();
+                }
+            }
+
+            return request;
+        }
+
+        // Content-Length is digits only; signs, spaces, lists and values that
+        // overflow are refused
+        static bool parseContentLength(const std::string& value, size_t& length) {
+            if (value.empty() || value.size() > 18) {
+                return false;
+            }
+            length = 0;
+            for (char c : value) {
+                if (c < '0' || c > '9') {
+                    return false;
+                }
+                length = length * 10 + (c - '0');
+            }
+            return true;
+        }
+
+        // Splits a request target into path and query parameters
+        void setTarget(const std::string& target) {
+            path = target;
+            size_t questionMarkPos = path.find('?');
+            if (questionMarkPos != std::string::npos) {
+                std::string queryString = path.substr(questionMarkPos + 1);
+                path = path.substr(0, questionMarkPos);
+                parseQueryParams(queryString);
+            }
+        }
+
+        // If this is a form submission, parse the form data
+        void parseFormBody() {
+            auto it = headers.find("Content-Type");
+            if (it != headers.end() && it->second == "application/x-www-form-urlencoded") {
+                parseQueryParams(body);
+            }
+        }
+
+    private:
+        void parseQueryParams(const std::string& queryString) {
+            std::istringstream stream(queryString);
+            std::string pair;
+            
+            while (std::getline(stream, pair, '&')) {
+                size_t equalsPos = pair.find('=');
+                if (equalsPos != std::string::npos) {
+                    std::string key = pair.substr(0, equalsPos);
+                    std::string value = pair.substr(equalsPos + 1);
+                    // URL decode the value
+                    queryParams[urlDecode(key)] = urlDecode(value);
+                }
+            }
+        }
+        
+        std::string urlDecode(const std::string& encoded) {
+            std::string result;
+            for (size_t i = 0; i < encoded.length(); ++i) {
+                if (encoded[i] == '%' && i + 2 < encoded.length()) {
+                    int value;
+                    std::istringstream(encoded.substr(i + 1, 2)) >> std::hex >> value;
+                    result += static_cast<char>(value);
+                    i += 2;
+                } else if (encoded[i] == '+') {
+                    result += ' ';
+                } else {
+                    result += encoded[i];
+                }
+            }
+            return result;
+        }
+};
+
+// HTTP response builder
+class HttpResponse {
+    public:
+        int statusCode;
+        std::string statusMessage;
+        HeaderMap headers;
+        std::string body;
+
+        HttpResponse() : statusCode(200), statusMessage("OK") {
+            headers["Server"] = "PhoneBookServer/1.0";
+            headers["Connection"] = "close";
+            setDate();
+        }
+
+        void setStatus(int code, const std::string& message) {
+            statusCode = code;
+            statusMessage = message;
+        }
+
+        void setContentType(const std::string& contentType) {
+            headers["Content-Type"] = contentType;
+        }
+
+        void setContentLength() {
+            headers["Content-Length"] = std::to_string(body.length());
+        }
+
+        void setDate() {
+            std::time_t now = std::time(nullptr);
+            std::tm gmt;
+            gmtime_r(&now, &gmt);
+            
+            char buffer[100];
+            std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+            
+            headers["Date"] = buffer;
+        }
+
+        std::string toString() const {
+            std::ostringstream response;
+            response << "HTTP/1.1 " << statusCode << " " << statusMessage << "\r\n";
+            
+            for (const auto& header : headers) {
+                response << header.first << ": " << header.second << "\r\n";
+            }
+            
+            response << "\r\n";
+            response << body;
+            
+            return response.str();
+        }
+};
+
+
+#endif // HTTP_MESSAGE_H
@@ -14,23 +14,23 @@
 #include <unordered_map>
 #include <memory>
 #include <regex>
-
-#ifdef _WIN32
-    #include <winsock2.h>
-    #include <ws2tcpip.h>
-    #pragma comment(lib, "ws2_32.lib")
-    typedef SOCKET socket_t;
-    #define CLOSE_SOCKET closesocket
-#else
-    #include <unistd.h>
-    #include <sys/socket.h>
-    #include <netinet/in.h>
-    #include <arpa/inet.h>
-    typedef int socket_t;
-    #define CLOSE_SOCKET close
-    #define INVALID_SOCKET -1
-    #define SOCKET_ERROR -1
-#endif
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cerrno>
+#include "http_message.h"
+#include "http2.h"
+#include "transport.h"
+#include "thumbnail.h"
+#include "websocket.h"
+#include "async_logger.h"
+#include "server_config.h"
+#include "socket_handoff.h"
+#include <fcntl.h>
+#include <poll.h>
 
 namespace fs = std::filesystem;
 
@@ -61,163 +61,12 @@ struct Contact {
         : name(n), phone(p), imagePath(i) {}
 };
 
-// HTTP request parser
-class HttpRequest {
-    public:
-        std::string method;
-        std::string path;
-        std::string httpVersion;
-        std::map<std::string, std::string> headers;
-        std::map<std::string, std::string> queryParams;
-        std::string body;
-
-        HttpRequest() = default;
-
-        static HttpRequest parse(const std::string& requestStr) {
-            HttpRequest request;
-            std::istringstream stream(requestStr);
-            std::string line;
-
-            // Parse request line
-            if (std::getline(stream, line)) {
-                line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
-                std::istringstream lineStream(line);
-                lineStream >> request.method >> request.path >> request.httpVersion;
-                
-                // Parse query parameters if present
-                size_t questionMarkPos = request.path.find('?');
-                if (questionMarkPos != std::string::npos) {
-                    std::string queryString = request.path.substr(questionMarkPos + 1);
-                    request.path = request.path.substr(0, questionMarkPos);
-                    request.parseQueryParams(queryString);
-                }
-            }
-
-            // Parse headers
-            while (std::getline(stream, line) && !line.empty() && line != "\r") {
-                line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
-                size_t colonPos = line.find(':');
-                if (colonPos != std::string::npos) {
-                    std::string key = line.substr(0, colonPos);
-                    std::string value = line.substr(colonPos + 1);
-                    // Trim leading/trailing whitespace
-                    value.erase(0, value.find_first_not_of(' '));
-                    value.erase(value.find_last_not_of(' ') + 1);
-                    request.headers[key] = value;
-                }
-            }
-
-            // Parse body if Content-Length is present
-            if (request.headers.find("Content-Length") != request.headers.end()) {
-                int contentLength = std::stoi(request.headers["Content-Length"]);
-                if (contentLength > 0) {
-                    char* bodyBuffer = new char[contentLength + 1];
-                    stream.read(bodyBuffer, contentLength);
-                    bodyBuffer[contentLength] = '\0';
-                    request.body = bodyBuffer;
-                    delete[] bodyBuffer;
-                    
-                    // If this is a form submission, parse the form data
-                    if (request.headers["Content-Type"] == "application/x-www-form-urlencoded") {
-                        request.parseQueryParams(request.body);
-                    }
-                }
-            }
-
-            return request;
-        }
-
-    private:
-        void parseQueryParams(const std::string& queryString) {
-            std::istringstream stream(queryString);
-            std::string pair;
-            
-            while (std::getline(stream, pair, '&')) {
-                size_t equalsPos = pair.find('=');
-                if (equalsPos != std::string::npos) {
-                    std::string key = pair.substr(0, equalsPos);
-                    std::string value = pair.substr(equalsPos + 1);
-                    // URL decode the value
-                    queryParams[urlDecode(key)] = urlDecode(value);
-                }
-            }
-        }
-        
-        std::string urlDecode(const std::string& encoded) {
-            std::string result;
-            for (size_t i = 0; i < encoded.length(); ++i) {
-                if (encoded[i] == '%' && i + 2 < encoded.length()) {
-                    int value;
-                    std::istringstream(encoded.substr(i + 1, 2)) >> std::hex >> value;
-                    result += static_cast<char>(value);
-                    i += 2;
-                } else if (encoded[i] == '+') {
-                    result += ' ';
-                } else {
-                    result += encoded[i];
-                }
-            }
-            return result;
-        }
-};
-
-// HTTP response builder
-class HttpResponse {
-    public:
-        int statusCode;
-        std::string statusMessage;
-        std::map<std::string, std::string> headers;
-        std::string body;
-
-        HttpResponse() : statusCode(200), statusMessage("OK") {
-            headers["Server"] = "PhoneBookServer/1.0";
-            headers["Connection"] = "close";
-            setDate();
-        }
-
-        void setStatus(int code, const std::string& message) {
-            statusCode = code;
-            statusMessage = message;
-        }
-
-        void setContentType(const std::string& contentType) {
-            headers["Content-Type"] = contentType;
-        }
-
-        void setContentLength() {
-            headers["Content-Length"] = std::to_string(body.length());
-        }
-
-        void setDate() {
-            std::time_t now = std::time(nullptr);
-            std::tm* gmt = std::gmtime(&now);
-            
-            char buffer[100];
-            std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", gmt);
-            
-            headers["Date"] = buffer;
-        }
-
-        std::string toString() const {
-            std::ostringstream response;
-            response << "HTTP/1.1 " << statusCode << " " << statusMessage << "\r\n";
-            
-            for (const auto& header : headers) {
-                response << header.first << ": " << header.second << "\r\n";
-            }
-            
-            response << "\r\n";
-            response << body;
-            
-            return response.str();
-        }
-};
-
 // Phone Book class that manages contacts
 class PhoneBook {
     private:
         std::map<std::string, Contact> contacts;
         std::string imagesDir;
+        mutable std::mutex mutex;
 
     public:
         PhoneBook(const std::string& imageDirectory = "images") : imagesDir(imageDirectory) {
@@ -236,11 +85,13 @@ class PhoneBook {
                 return false;
             }
             
+            std::lock_guard<std::mutex> lock(mutex);
             contacts[name] = Contact(name, phone, imagePath);
             return true;
         }
 
         bool deleteContact(const std::string& name) {
+            std::lock_guard<std::mutex> lock(mutex);
             auto it = contacts.find(name);
             if (it != contacts.end()) {
                 // If the contact has an image, you might want to delete it as well
@@ -253,15 +104,19 @@ class PhoneBook {
             return false;
         }
 
-        Contact* findContact(const std::string& name) {
+        // Copies the contact out; connections are served concurrently
+        bool findContact(const std::string& name, Contact& contact) const {
+            std::lock_guard<std::mutex> lock(mutex);
             auto it = contacts.find(name);
             if (it != contacts.end()) {
-                return &it->second;
+                contact = it->second;
+                return true;
             }
-            return nullptr;
+            return false;
         }
 
         std::vector<Contact> getAllContacts() const {
+            std::lock_guard<std::mutex> lock(mutex);
             std::vector<Contact> result;
             for (const auto& pair : contacts) {
                 result.push_back(pair.second);
@@ -294,33 +149,117 @@ class PhoneBook {
         }
 };
 
+// Applies add/edit/delete deltas pushed over /ws; "resync" means updates were dropped
+const char* const LIVE_UPDATE_SCRIPT =
+    "    <script>\n"
+    "    (function () {\n"
+    "        if (!window.WebSocket || location.protocol !== 'http:') return;\n"
+    "        var list = document.getElementById('contacts');\n"
+    "        function find(name) {\n"
+    "            var rows = list.querySelectorAll('.contact');\n"
+    "            for (var i = 0; i < rows.length; i++) if (rows[i].dataset.name === name) return rows[i];\n"
+    "            return null;\n"
+    "        }\n"
+    "        function render(change) {\n"
+    "            var row = document.createElement('div');\n"
+    "            row.className = 'contact';\n"
+    "            row.dataset.name = change.name;\n"
+    "            var strong = document.createElement('strong');\n"
+    "            strong.textContent = change.name;\n"
+    "            row.appendChild(strong);\n"
+    "            row.appendChild(document.createTextNode(': ' + change.phone + ' '));\n"
+    "            var form = document.createElement('form');\n"
+    "            form.action = '/delete'; form.method = 'post';\n"
+    "            form.style.display = 'inline'; form.style.marginLeft = '10px';\n"
+    "            var hidden = document.createElement('input');\n"
+    "            hidden.type = 'hidden'; hidden.name = 'name'; hidden.value = change.name;\n"
+    "            var submit = document.createElement('input');\n"
+    "            submit.type = 'submit'; submit.className = 'delete'; submit.value = 'Delete';\n"
+    "            form.appendChild(hidden); form.appendChild(submit); row.appendChild(form);\n"
+    "            return row;\n"
+    "        }\n"
+    "        var socket = new WebSocket('ws://' + location.host + '/ws');\n"
+    "        socket.onmessage = function (event) {\n"
+    "            var change = JSON.parse(event.data);\n"
+    "            var row = change.name !== undefined ? find(change.name) : null;\n"
+    "            if (change.type === 'resync') { location.reload(); }\n"
+    "            else if (change.type === 'delete') { if (row) row.remove(); }\n"
+    "            else if (row) { row.replaceWith(render(change)); }\n"
+    "            else { list.appendChild(render(change)); }\n"
+    "        };\n"
+    "        socket.onclose = function () {\n"
+    "            // Server restarted or upgraded: reload once it answers again\n"
+    "            setTimeout(function retry() {\n"
+    "                fetch(location.href).then(function () { location.reload(); },\n"
+    "                                          function () { setTimeout(retry, 1000); });\n"
+    "            }, 500);\n"
+    "        };\n"
+    "    })();\n"
+    "    </script>\n";
+
+static std::string jsonEscape(const std::string& value) {
+    std::string result;
+    for (unsigned char c : value) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += static_cast<char>(c);
+        } else if (c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            result += escaped;
+        } else {
+            result += static_cast<char>(c);
+        }
+    }
+    return result;
+}
+
+const size_t MAX_HEADER_SIZE = 64 * 1024;
+const size_t MAX_BODY_SIZE = 8 * 1024 * 1024;
+// How long a successor gets to take over the listening sockets
+const int HANDOFF_TIMEOUT_MS = 10000;
+
+// Applies the log settings from the config; empty settings keep the environment's
+static void configureLogging(const ServerConfig& config) {
+    if (!config.logFormat.empty() || !config.logFile.empty()) {
+        logging::configure(logging::parseFormat(config.logFormat), config.logFile);
+    }
+}
+
 // HTTP Server class
 class HttpServer {
     private:
         socket_t serverSocket;
+        socket_t tlsSocket;
         int port;
         PhoneBook phoneBook;
-        bool running;
+        ThumbnailCache thumbnails;
+        WebSocketHub webSockets;
+        ServerConfig config;
+        std::mutex configMutex;                 // guards config and tlsContext
+        std::shared_ptr<TlsContext> tlsContext;
+        std::atomic<int> keepAliveTimeout;
+        std::atomic<bool> running;
+        std::atomic<bool> draining;
+        int wakePipe[2];                        // readable from stop() on; never read
+        int handoffChannel;
 
-    public:
-        HttpServer(int serverPort = 8080) : port(serverPort), running(false) {
-            // Initialize socket library on Windows
-            #ifdef _WIN32
-            WSADATA wsaData;
-            if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-                throw std::runtime_error("Failed to initialize Winsock");
-            }
-            #endif
+        // Open connections, mapped to whether they are idle (waiting for a request)
+        std::mutex connectionsMutex;
+        std::condition_variable connectionsChanged;
+        std::map<socket_t, bool> connections;
 
+        static socket_t createListeningSocket(int port) {
             // Create socket
-            serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-            if (serverSocket == INVALID_SOCKET) {
+            socket_t listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+            if (listenSocket == INVALID_SOCKET) {
                 throw std::runtime_error("Failed to create socket");
             }
 
             // Enable address reuse
             int opt = 1;
-            if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&opt, sizeof(opt)) < 0) {
+            if (setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&opt, sizeof(opt)) < 0) {
+                CLOSE_SOCKET(listenSocket);
                 throw std::runtime_error("Failed to set socket options");
             }
 
@@ -330,90 +269,456 @@ class HttpServer {
             serverAddr.sin_addr.s_addr = INADDR_ANY;
             serverAddr.sin_port = htons(port);
 
-            if (bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
-                CLOSE_SOCKET(serverSocket);
+            if (bind(listenSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
+                CLOSE_SOCKET(listenSocket);
                 throw std::runtime_error("Failed to bind socket");
             }
 
             // Listen for connections
-            if (listen(serverSocket, 5) == SOCKET_ERROR) {
-                CLOSE_SOCKET(serverSocket);
+            if (listen(listenSocket, SOMAXCONN) == SOCKET_ERROR) {
+                CLOSE_SOCKET(listenSocket);
                 throw std::runtime_error("Failed to listen on socket");
             }
 
-            std::cout << "Server started on port " << port << std::endl;
+            return listenSocket;
+        }
+
+        static int boundPort(socket_t listenSocket) {
+            sockaddr_in address;
+            socklen_t length = sizeof(address);
+            if (getsockname(listenSocket, (struct sockaddr*)&address, &length) != 0) {
+                return -1;
+            }
+            return ntohs(address.sin_port);
+        }
+
+        // Inherited sockets are reused unless the config moved the port
+        static socket_t adoptListeningSocket(socket_t inherited, int port) {
+            if (boundPort(inherited) == port) {
+                return inherited;
+            }
+            CLOSE_SOCKET(inherited);
+            return createListeningSocket(port);
+        }
+
+    public:
+        // With a handoff channel the listening sockets come from the process
+        // being upgraded instead of being bound here
+        HttpServer(const ServerConfig& serverConfig, int handoff = -1)
+            : serverSocket(INVALID_SOCKET), tlsSocket(INVALID_SOCKET), port(serverConfig.port), config(serverConfig),
+              keepAliveTimeout(serverConfig.keepAliveTimeout), running(false), draining(false), handoffChannel(handoff) {
+            // Initialize socket library on Windows
+            #ifdef _WIN32
+            WSADATA wsaData;
+            if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+                throw std::runtime_error("Failed to initialize Winsock");
+            }
+            #endif
+
+            if (handoffChannel >= 0) {
+                std::vector<int> listeners = receiveListeners(handoffChannel);
+                serverSocket = adoptListeningSocket(listeners[0], port);
+                if (listeners.size() > 1) {
+                    tlsSocket = listeners[1];
+                }
+                LOG_INFO("http", "Took over listening sockets from the previous process");
+            } else {
+                serverSocket = createListeningSocket(port);
+            }
+
+            if (pipe(wakePipe) != 0) {
+                throw std::runtime_error("Failed to create wake pipe");
+            }
+            LOG_INFO("http", "Server started on port " + std::to_string(port));
         }
 
         ~HttpServer() {
             stop();
             
             CLOSE_SOCKET(serverSocket);
+            if (tlsSocket != INVALID_SOCKET) {
+                CLOSE_SOCKET(tlsSocket);
+            }
+            close(wakePipe[0]);
+            close(wakePipe[1]);
             
             #ifdef _WIN32
             WSACleanup();
             #endif
         }
 
+        // Serves HTTPS on a second port, negotiating h2 or http/1.1 through ALPN
+        void enableTls() {
+            tlsContext = std::make_shared<TlsContext>(config.tlsCertificate, config.tlsPrivateKey);
+            if (tlsSocket != INVALID_SOCKET) {
+                tlsSocket = adoptListeningSocket(tlsSocket, config.tlsPort);
+            } else {
+                tlsSocket = createListeningSocket(config.tlsPort);
+            }
+            LOG_INFO("http", "TLS enabled on port " + std::to_string(config.tlsPort));
+        }
+
+        // Accepts until stop(), then drains the open connections before returning
         void start() {
             running = true;
-            
+
+            if (tlsSocket != INVALID_SOCKET && !tlsContext) {
+                // Inherited, but this build or config has no certificate
+                CLOSE_SOCKET(tlsSocket);
+                tlsSocket = INVALID_SOCKET;
+            }
+
+            std::vector<std::thread> acceptors;
+            acceptors.emplace_back(&HttpServer::acceptLoop, this, serverSocket, false);
+            if (tlsSocket != INVALID_SOCKET) {
+                acceptors.emplace_back(&HttpServer::acceptLoop, this, tlsSocket, true);
+            }
+
+            if (handoffChannel >= 0) {
+                // The previous process stops accepting once it reads this
+                signalReady(handoffChannel);
+                close(handoffChannel);
+                handoffChannel = -1;
+            }
+
+            for (auto& acceptor : acceptors) {
+                acceptor.join();
+            }
+            drain();
+        }
+
+        void stop() {
+            if (running.exchange(false)) {
+                char byte = 0;
+                ssize_t ignored = write(wakePipe[1], &byte, 1);
+                (void)ignored;
+            }
+        }
+
+        // SIGHUP: re-reads the config file. Logging, keep-alive and the TLS
+        // certificate change in place; ports only move with an upgrade.
+        void reload(const std::string& configPath) {
+            ServerConfig updated;
+            try {
+                updated = ServerConfig::load(configPath);
+                configureLogging(updated);
+            } catch (const std::exception& e) {
+                LOG_ERROR("http", std::string("Reload failed, keeping the current config: ") + e.what());
+                return;
+            }
+
+            std::shared_ptr<TlsContext> context;
+            if (tlsSocket != INVALID_SOCKET) {
+                try {
+                    context = std::make_shared<TlsContext>(updated.tlsCertificate, updated.tlsPrivateKey);
+                } catch (const std::exception& e) {
+                    LOG_ERROR("http", std::string("Keeping the current certificate: ") + e.what());
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(configMutex);
+            if (updated.port != config.port || updated.tlsPort != config.tlsPort) {
+                LOG_WARN("http", "Port changes take effect on the next upgrade (SIGUSR2)");
+            }
+            config = updated;
+            if (context) {
+                tlsContext = context;
+            }
+            keepAliveTimeout = updated.keepAliveTimeout;
+            LOG_INFO("http", "Configuration reloaded from " + configPath);
+        }
+
+        // SIGUSR2: starts executable with the listening sockets and, once it is
+        // accepting, stops accepting here. Returns false if this process has to
+        // keep serving.
+        bool upgrade(const std::string& executable, char* const argv[]) {
+            std::vector<int> listeners{serverSocket};
+            if (tlsSocket != INVALID_SOCKET) {
+                listeners.push_back(tlsSocket);
+            }
+
+            pid_t successor = spawnSuccessor(executable, argv, listeners, HANDOFF_TIMEOUT_MS);
+            if (successor < 0) {
+                LOG_ERROR("http", "Upgrade failed, " + executable + " did not take over; still serving");
+                return false;
+            }
+
+            LOG_INFO("http", "Process " + std::to_string(successor) + " took over the listening sockets");
+            stop();
+            return true;
+        }
+
+    private:
+        void acceptLoop(socket_t listenSocket, bool secure) {
+            // Non-blocking, because during an upgrade another process accepts from the same queue
+            fcntl(listenSocket, F_SETFL, fcntl(listenSocket, F_GETFL, 0) | O_NONBLOCK);
+
             while (running) {
+                pollfd fds[2] = {{listenSocket, POLLIN, 0}, {wakePipe[0], POLLIN, 0}};
+                if (poll(fds, 2, -1) < 0 || fds[1].revents != 0) {
+                    continue;
+                }
+
                 sockaddr_in clientAddr;
                 socklen_t clientAddrLen = sizeof(clientAddr);
                 
-                socket_t clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientAddrLen);
+                socket_t clientSocket = accept(listenSocket, (struct sockaddr*)&clientAddr, &clientAddrLen);
                 if (clientSocket == INVALID_SOCKET) {
-                    std::cerr << "Failed to accept connection" << std::endl;
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        LOG_WARN("http", "Failed to accept connection");
+                    }
                     continue;
                 }
+                fcntl(clientSocket, F_SETFL, fcntl(clientSocket, F_GETFL, 0) & ~O_NONBLOCK);
                 
-                // Handle client connection in the same thread
-                handleClient(clientSocket);
+                char clientIP[INET_ADDRSTRLEN] = "-";
+                inet_ntop(AF_INET, &clientAddr.sin_addr, clientIP, sizeof(clientIP));
+
+                // Connections stay open for keep-alive and HTTP/2, so each gets its own thread
+                std::lock_guard<std::mutex> lock(connectionsMutex);
+                connections[clientSocket] = false;
+                std::thread(&HttpServer::handleClient, this, clientSocket, std::string(clientIP), secure).detach();
             }
         }
 
-        void stop() {
-            running = false;
+        // Marks a connection as waiting for its next request. Returns false
+        // when the server is draining; the read side is then already shut.
+        bool markIdle(socket_t clientSocket) {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            connections[clientSocket] = true;
+            if (draining) {
+                shutdown(clientSocket, SHUT_RD);
+            }
+            return !draining;
         }
 
-    private:
-        void handleClient(socket_t clientSocket) {
-            const int bufferSize = 8192;
-            char buffer[bufferSize];
-            std::string requestData;
-            
-            // Receive data from client
-            int bytesReceived;
-            while ((bytesReceived = recv(clientSocket, buffer, bufferSize - 1, 0)) > 0) {
-                buffer[bytesReceived] = '\0';
-                requestData.append(buffer, bytesReceived);
-                
-                // Check if we've received the end of the HTTP headers
-                if (requestData.find("\r\n\r\n") != std::string::npos) {
-                    break;
+        void markBusy(socket_t clientSocket) {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            connections[clientSocket] = false;
+        }
+
+        void untrack(socket_t clientSocket) {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            connections.erase(clientSocket);
+            connectionsChanged.notify_all();
+        }
+
+        // Idle HTTP/1.1 connections are closed at once and busy ones finish
+        // their current request. HTTP/2 connections count as busy throughout:
+        // they see the wake pipe, send GOAWAY and close once their open
+        // streams are done. Whatever is left is cut at the deadline.
+        void drain() {
+            int deadline;
+            {
+                std::lock_guard<std::mutex> lock(configMutex);
+                deadline = config.drainTimeout;
+            }
+
+            std::unique_lock<std::mutex> lock(connectionsMutex);
+            draining = true;
+            for (auto& entry : connections) {
+                if (entry.second) {
+                    shutdown(entry.first, SHUT_RD);
                 }
             }
-            
-            if (bytesReceived < 0) {
-                std::cerr << "Error receiving data from client" << std::endl;
-                CLOSE_SOCKET(clientSocket);
-                return;
+            LOG_INFO("http", "Draining " + std::to_string(connections.size()) + " connections");
+
+            if (!connectionsChanged.wait_for(lock, std::chrono::seconds(deadline), [this] { return connections.empty(); })) {
+                LOG_WARN("http", "Drain deadline passed, closing " + std::to_string(connections.size()) + " connections");
+                for (auto& entry : connections) {
+                    shutdown(entry.first, SHUT_RDWR);
+                }
+                connectionsChanged.wait_for(lock, std::chrono::seconds(1), [this] { return connections.empty(); });
+            }
+        }
+
+        void handleClient(socket_t clientSocket, const std::string& remote, bool secure) {
+            #ifdef _WIN32
+            DWORD timeout = keepAliveTimeout * 1000;
+            #else
+            timeval timeout{keepAliveTimeout, 0};
+            #endif
+            setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+
+            if (secure) {
+                RequestHandler handler = [this, remote](const HttpRequest& request) {
+                    return handleRequest(request, remote, "HTTP/2.0");
+                };
+                std::shared_ptr<TlsContext> context;
+                {
+                    std::lock_guard<std::mutex> lock(configMutex);
+                    context = tlsContext;
+                }
+                std::unique_ptr<TlsTransport> transport = context->accept(clientSocket);
+                if (transport) {
+                    if (transport->selectedProtocol() == "h2") {
+                        Http2Connection(*transport, handler, "", wakePipe[0]).serve();
+                    } else {
+                        serveHttp1(*transport, clientSocket, true, remote);
+                    }
+                }
+            } else {
+                PlainTransport transport(clientSocket);
+                if (serveHttp1(transport, clientSocket, false, remote)) {
+                    // The WebSocket hub owns the socket now
+                    untrack(clientSocket);
+                    return;
+                }
             }
-            
-            // Parse the HTTP request
-            HttpRequest request = HttpRequest::parse(requestData);
-            
-            // Handle the request
-            HttpResponse response = routeRequest(request);
-            
-            // Send response to client
-            std::string responseStr = response.toString();
-            send(clientSocket, responseStr.c_str(), responseStr.length(), 0);
             
             // Close client socket
+            untrack(clientSocket);
             CLOSE_SOCKET(clientSocket);
         }
 
+        // HTTP/1.1 with keep-alive. Cleartext connections may switch to h2c,
+        // either with prior knowledge (client preface) or via Upgrade: h2c, or
+        // to a WebSocket on /ws. Returns true when the socket was handed to the
+        // WebSocket hub.
+        bool serveHttp1(Transport& transport, socket_t clientSocket, bool secure, const std::string& remote) {
+            bool allowH2c = !secure;
+            const int bufferSize = 8192;
+            char buffer[bufferSize];
+            std::string pending;
+
+            RequestHandler handler = [this, remote](const HttpRequest& request) {
+                return handleRequest(request, remote, "HTTP/2.0");
+            };
+
+            while (true) {
+                // Receive data until the end of the HTTP headers
+                size_t headerEnd = std::string::npos;
+                while (true) {
+                    size_t prefixLength = std::min(pending.size(), HTTP2_PREFACE.size());
+                    bool maybePreface = allowH2c && !pending.empty() &&
+                                        HTTP2_PREFACE.compare(0, prefixLength, pending, 0, prefixLength) == 0;
+                    if (maybePreface && prefixLength == HTTP2_PREFACE.size()) {
+                        Http2Connection(transport, handler, pending, wakePipe[0]).serve();
+                        return false;
+                    }
+                    if (!maybePreface && (headerEnd = pending.find("\r\n\r\n")) != std::string::npos) {
+                        break;
+                    }
+                    if (pending.size() > MAX_HEADER_SIZE) {
+                        return false;
+                    }
+
+                    // Between requests the connection is idle and a drain may close it
+                    bool idle = pending.empty();
+                    if (idle && !markIdle(clientSocket)) {
+                        return false;
+                    }
+                    long bytesReceived = transport.read(buffer, bufferSize);
+                    if (bytesReceived <= 0) {
+                        return false;
+                    }
+                    if (idle) {
+                        markBusy(clientSocket);
+                    }
+                    pending.append(buffer, bytesReceived);
+                }
+
+                // Wait for the whole body before parsing
+                size_t contentLength = 0;
+                HttpRequest head = HttpRequest::parse(pending.substr(0, headerEnd + 4));
+                // Bodies are framed by Content-Length alone. A chunked one would
+                // be read as the next request, so Transfer-Encoding is refused,
+                // with or without a length, and so is a Content-Length that is
+                // not one run of digits. Either way the connection closes, as
+                // where the next request starts is unknown.
+                if (head.headers.find("Transfer-Encoding") != head.headers.end()) {
+                    transport.writeAll(errorResponse(501, "Not Implemented").toString());
+                    return false;
+                }
+                auto lengthHeader = head.headers.find("Content-Length");
+                if (lengthHeader != head.headers.end() &&
+                    !HttpRequest::parseContentLength(lengthHeader->second, contentLength)) {
+                    transport.writeAll(errorResponse(400, "Bad Request").toString());
+                    return false;
+                }
+                if (contentLength > MAX_BODY_SIZE) {
+                    transport.writeAll(errorResponse(413, "Payload Too Large").toString());
+                    return false;
+                }
+
+                size_t requestSize = headerEnd + 4 + contentLength;
+                while (pending.size() < requestSize) {
+                    long bytesReceived = transport.read(buffer, bufferSize);
+                    if (bytesReceived <= 0) {
+                        return false;
+                    }
+                    pending.append(buffer, bytesReceived);
+                }
+
+                // Parse the HTTP request
+                HttpRequest request = HttpRequest::parse(pending.substr(0, requestSize));
+                pending.erase(0, requestSize);
+
+                auto upgrade = request.headers.find("Upgrade");
+                auto settings = request.headers.find("HTTP2-Settings");
+                if (allowH2c && upgrade != request.headers.end() && upgrade->second == "h2c" &&
+                    settings != request.headers.end()) {
+                    transport.writeAll("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+                    Http2Connection(transport, handler, pending, wakePipe[0]).serveUpgrade(request, settings->second);
+                    return false;
+                }
+
+                if (request.path == "/ws" && WebSocketHub::isUpgradeRequest(request)) {
+                    std::string handshake = WebSocketHub::handshakeResponse(request);
+                    if (handshake.empty() || secure) {
+                        transport.writeAll(errorResponse(400, "Bad Request").toString());
+                        return false;
+                    }
+                    webSockets.addSubscriber(clientSocket, handshake);
+                    return true;
+                }
+
+                // HTTP/1.1 defaults to keep-alive, HTTP/1.0 has to ask for it
+                auto connection = request.headers.find("Connection");
+                std::string connectionValue = connection != request.headers.end() ? connection->second : "";
+                std::transform(connectionValue.begin(), connectionValue.end(), connectionValue.begin(), ::tolower);
+                bool keepAlive = request.httpVersion == "HTTP/1.1" ? connectionValue != "close" : connectionValue == "keep-alive";
+                keepAlive = keepAlive && !draining;
+
+                // Handle the request
+                HttpResponse response = handleRequest(request, remote, request.httpVersion.c_str());
+                response.headers["Connection"] = keepAlive ? "keep-alive" : "close";
+
+                // Send response to client
+                if (!transport.writeAll(response.toString()) || !keepAlive) {
+                    return false;
+                }
+            }
+        }
+
+        HttpResponse errorResponse(int code, const std::string& message) {
+            HttpResponse response;
+            response.setStatus(code, message);
+            response.setContentType("text/plain");
+            response.body = message;
+            response.setContentLength();
+            return response;
+        }
+
+        // Routes the request and records it in the access log
+        HttpResponse handleRequest(const HttpRequest& request, const std::string& remote, const char* protocol) {
+            auto started = std::chrono::steady_clock::now();
+            HttpResponse response = routeRequest(request);
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+
+            logging::AccessEntry entry;
+            entry.component = "http";
+            entry.remote = remote.c_str();
+            entry.method = request.method.c_str();
+            entry.path = request.path.c_str();
+            entry.protocol = protocol;
+            entry.status = response.statusCode;
+            entry.bytes = response.body.size();
+            entry.durationUs = static_cast<uint32_t>(elapsed.count());
+            LOG_ACCESS(entry);
+            return response;
+        }
+
         HttpResponse routeRequest(const HttpRequest& request) {
             HttpResponse response;
             
@@ -424,7 +729,7 @@ class HttpServer {
                 } else if (request.path == "/search") {
                     handleSearch(request, response);
                 } else if (request.path == "/images" && request.queryParams.find("name") != request.queryParams.end()) {
-                    serveContactImage(request.queryParams.at("name"), response);
+                    serveContactImage(request, response);
                 } else if (request.path.find("/images/") == 0) {
                     // Serve a specific image file
                     serveFile(request.path.substr(1), response); // Remove leading slash
@@ -492,14 +797,15 @@ class HttpServer {
                 << "        <div><label for=\"q\">Name:</label><input type=\"text\" id=\"q\" name=\"q\" required></div>\n"
                 << "        <div><input type=\"submit\" value=\"Search\"></div>\n"
                 << "    </form>\n"
-                << "    <h2>Contacts</h2>\n";
+                << "    <h2>Contacts</h2>\n"
+                << "    <div id=\"contacts\">\n";
             
             for (const auto& contact : contacts) {
-                html << "    <div class=\"contact\">\n";
+                html << "    <div class=\"contact\" data-name=\"" << contact.name << "\">\n";
                 
                 // Display contact image if available
                 if (!contact.imagePath.empty() && fs::exists(contact.imagePath)) {
-                    html << "        <img src=\"/images?name=" << contact.name << "\" alt=\"" << contact.name << "\">\n";
+                    html << "        <img src=\"" << contactImageUrl(contact) << "\" alt=\"" << contact.name << "\">\n";
                 }
                 
                 html << "        <strong>" << contact.name << "</strong>: " << contact.phone << "\n"
@@ -510,7 +816,9 @@ class HttpServer {
                     << "    </div>\n";
             }
             
-            html << "</body>\n"
+            html << "    </div>\n"
+                << LIVE_UPDATE_SCRIPT
+                << "</body>\n"
                 << "</html>";
             
             response.setContentType("text/html");
@@ -523,7 +831,8 @@ class HttpServer {
                 query = request.queryParams.at("q");
             }
             
-            Contact* contact = phoneBook.findContact(query);
+            Contact contact;
+            bool found = phoneBook.findContact(query, contact);
             
             std::ostringstream html;
             html << "<!DOCTYPE html>\n"
@@ -543,15 +852,15 @@ class HttpServer {
                 << "    <h1>Search Results for \"" << query << "\"</h1>\n"
                 << "    <a href=\"/\">Back to Phone Book</a>\n";
             
-            if (contact) {
+            if (found) {
                 html << "    <div class=\"contact\">\n";
                 
                 // Display contact image if available
-                if (!contact->imagePath.empty() && fs::exists(contact->imagePath)) {
-                    html << "        <img src=\"/images?name=" << contact->name << "\" alt=\"" << contact->name << "\">\n";
+                if (!contact.imagePath.empty() && fs::exists(contact.imagePath)) {
+                    html << "        <img src=\"" << contactImageUrl(contact) << "\" alt=\"" << contact.name << "\">\n";
                 }
                 
-                html << "        <strong>" << contact->name << "</strong>: " << contact->phone << "\n"
+                html << "        <strong>" << contact.name << "</strong>: " << contact.phone << "\n"
                     << "    </div>\n";
             } else {
                 html << "    <p>No contact found with that name.</p>\n";
@@ -575,7 +884,12 @@ class HttpServer {
                 phone = request.queryParams.at("phone");
             }
             
-            bool success = phoneBook.addContact(name, phone);
+            Contact existing;
+            bool existed = phoneBook.findContact(name, existing);
+            if (phoneBook.addContact(name, phone)) {
+                webSockets.broadcast("{\"type\":\"" + std::string(existed ? "edit" : "add") +
+                                     "\",\"name\":\"" + jsonEscape(name) + "\",\"phone\":\"" + jsonEscape(phone) + "\"}");
+            }
             
             // Redirect to the main page
             response.setStatus(302, "Found");
@@ -588,7 +902,14 @@ class HttpServer {
             
             if (request.queryParams.find("name") != request.queryParams.end()) {
                 name = request.queryParams.at("name");
-                phoneBook.deleteContact(name);
+                Contact contact;
+                bool found = phoneBook.findContact(name, contact);
+                if (phoneBook.deleteContact(name)) {
+                    if (found && !contact.imagePath.empty()) {
+                        thumbnails.forget(contact.imagePath);
+                    }
+                    webSockets.broadcast("{\"type\":\"delete\",\"name\":\"" + jsonEscape(name) + "\"}");
+                }
             }
             
             // Redirect to the main page
@@ -597,12 +918,53 @@ class HttpServer {
             response.body = "";
         }
 
-        void serveContactImage(const std::string& name, HttpResponse& response) {
-            Contact* contact = phoneBook.findContact(name);
+        // Image URL for a contact. Once the thumbnail exists its content hash is
+        // appended, so the long-lived cache entry changes whenever the image does
+        std::string contactImageUrl(const Contact& contact) {
+            std::string url = "/images?name=" + contact.name;
+            std::string thumbnailPath, contentHash;
+            if (thumbnails.lookup(contact.imagePath, thumbnailPath, contentHash)) {
+                url += "&v=" + contentHash;
+            } else {
+                thumbnails.request(contact.imagePath);
+            }
+            return url;
+        }
+
+        void serveContactImage(const HttpRequest& request, HttpResponse& response) {
+            Contact contact;
+            bool found = phoneBook.findContact(request.queryParams.at("name"), contact);
             
-            if (contact && !contact->imagePath.empty() && fs::exists(contact->imagePath)) {
+            if (found && !contact.imagePath.empty() && fs::exists(contact.imagePath)) {
+                // Serve the cached thumbnail when ready, otherwise queue it and fall back to the original
+                std::string thumbnailPath, contentHash;
+                if (thumbnails.lookup(contact.imagePath, thumbnailPath, contentHash)) {
+                    // Only a URL naming this very content may be cached for
+                    // good; one without v, or with a stale v, has to revalidate
+                    std::string etag = "\"" + contentHash + "\"";
+                    auto version = request.queryParams.find("v");
+                    bool current = version != request.queryParams.end() && version->second == contentHash;
+                    response.headers["ETag"] = etag;
+                    response.headers["Cache-Control"] = current ? "public, max-age=31536000, immutable" : "no-cache";
+
+                    auto match = request.headers.find("If-None-Match");
+                    if (match != request.headers.end() && match->second == etag) {
+                        response.setStatus(304, "Not Modified");
+                        return;
+                    }
+
+                    if (serveFile(thumbnailPath, response)) {
+                        return;
+                    }
+                    response.headers.erase("ETag");
+                    response.headers.erase("Cache-Control");
+                } else {
+                    thumbnails.request(contact.imagePath);
+                }
+                response.headers["Cache-Control"] = "no-cache";
+
                 // Get the file extension
-                std::string ext = fs::path(contact->imagePath).extension().string();
+                std::string ext = fs::path(contact.imagePath).extension().string();
                 std::string contentType = "image/jpeg"; // Default
                 
                 auto it = MIME_TYPES.find(ext);
@@ -611,7 +973,7 @@ class HttpServer {
                 }
                 
                 // Read the image file
-                std::ifstream file(contact->imagePath, std::ios::binary);
+                std::ifstream file(contact.imagePath, std::ios::binary);
                 if (file) {
                     // Get file size
                     file.seekg(0, std::ios::end);
@@ -676,14 +1038,56 @@ class HttpServer {
         }
 };
 
-int main() {
+int main(int argc, char* argv[]) {
+    // Signals are taken with sigwait() below; block them before any thread starts
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGUSR2);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::string configPath = argc > 1 ? argv[1] : "server.conf";
+    std::string executable = fs::absolute(argv[0]).string();
+
     try {
-        HttpServer server(8080);
-        std::cout << "Phone Book Server started on port 8080" << std::endl;
-        std::cout << "Open your browser and navigate to http://localhost:8080" << std::endl;
-        server.start();
+        logging::configureFromEnvironment();
+        ServerConfig config = ServerConfig::load(configPath);
+        configureLogging(config);
+
+        HttpServer server(config, inheritedHandoffChannel());
+
+        // HTTPS (h2 or http/1.1 via ALPN) when a certificate is present
+        if (fs::exists(config.tlsCertificate) && fs::exists(config.tlsPrivateKey)) {
+            server.enableTls();
+        }
+
+        std::cout << "Open your browser and navigate to http://localhost:" << config.port << std::endl;
+        std::thread serving(&HttpServer::start, &server);
+
+        // SIGHUP reloads the config, SIGUSR2 hands over to a new build of this
+        // binary, SIGTERM/SIGINT drain and exit
+        while (true) {
+            int signal = 0;
+            if (sigwait(&signals, &signal) != 0) {
+                continue;
+            }
+            if (signal == SIGHUP) {
+                server.reload(configPath);
+            } else if (signal == SIGUSR2) {
+                if (server.upgrade(executable, argv)) {
+                    break;
+                }
+            } else {
+                LOG_INFO("http", "Shutting down");
+                server.stop();
+                break;
+            }
+        }
+        serving.join();
     } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
+        LOG_ERROR("http", std::string("Error: ") + e.what());
         return 1;
     }
     
@@ -0,0 +1,71 @@
+#include "server_config.h"
+#include <fstream>
+#include <stdexcept>
+
+static std::string trim(const std::string& value) {
+    size_t start = value.find_first_not_of(" \t\r");
+    if (start == std::string::npos) {
+        return "";
+    }
+    size_t end = value.find_last_not_of(" \t\r");
+    return value.substr(start, end - start + 1);
+}
+
+static int parsePositive(const std::string& key, const std::string& value) {
+    try {
+        size_t used = 0;
+        int number = std::stoi(value, &used);
+        if (used == value.size() && number > 0) {
+            return number;
+        }
+    } catch (const std::exception&) {
+    }
+    throw std::runtime_error("Invalid value for " + key + ": " + value);
+}
+
+ServerConfig ServerConfig::load(const std::string& path) {
+    ServerConfig config;
+    std::ifstream file(path);
+    if (!file) {
+        return config;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": expected key = value");
+        }
+        std::string key = trim(line.substr(0, equals));
+        std::string value = trim(line.substr(equals + 1));
+
+        if (key == "port") {
+            config.port = parsePositive(key, value);
+        } else if (key == "tls_port") {
+            config.tlsPort = parsePositive(key, value);
+        } else if (key == "tls_certificate") {
+            config.tlsCertificate = value;
+        } else if (key == "tls_private_key") {
+            config.tlsPrivateKey = value;
+        } else if (key == "keep_alive_timeout") {
+            config.keepAliveTimeout = parsePositive(key, value);
+        } else if (key == "drain_timeout") {
+            config.drainTimeout = parsePositive(key, value);
+        } else if (key == "log_format") {
+            config.logFormat = value;
+        } else if (key == "log_file") {
+            config.logFile = value;
+        } else {
+            throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": unknown key " + key);
+        }
+    }
+
+    return config;
+}
@@ -0,0 +1,23 @@
+// ServerConfig - Settings for the phone book server, read from a
+// "key = value" file. SIGHUP re-reads it while the server keeps running.
+
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+#include <string>
+
+struct ServerConfig {
+    int port = 8080;
+    int tlsPort = 8443;
+    std::string tlsCertificate = "server.crt";
+    std::string tlsPrivateKey = "server.key";
+    int keepAliveTimeout = 15;      // seconds an idle keep-alive connection is kept
+    int drainTimeout = 10;          // seconds open connections get on shutdown or upgrade
+    std::string logFormat;          // text, clf or json; empty keeps LOG_FORMAT
+    std::string logFile;            // empty keeps LOG_FILE
+
+    // A missing file gives the defaults; unknown keys and bad values throw
+    static ServerConfig load(const std::string& path);
+};
+
+#endif // SERVER_CONFIG_H
@@ -0,0 +1,172 @@
+#include "socket_handoff.h"
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+const char* const HANDOFF_ENV = "HTTP_SERVER_HANDOFF_FD";
+
+// The successor always finds its end of the channel here
+static const int CHILD_CHANNEL_FD = 3;
+static const size_t MAX_LISTENERS = 8;
+static const char READY = 'R';
+
+static bool sendListeners(int channel, const std::vector<int>& listeners) {
+    if (listeners.empty() || listeners.size() > MAX_LISTENERS) {
+        return false;
+    }
+
+    // One data byte (the count) carries the descriptors as ancillary data
+    char count = static_cast<char>(listeners.size());
+    iovec data{&count, 1};
+    union {
+        char buffer[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+        cmsghdr align;
+    } control;
+    std::memset(&control, 0, sizeof(control));
+
+    msghdr message{};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * listeners.size());
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * listeners.size());
+    std::memcpy(CMSG_DATA(header), listeners.data(), sizeof(int) * listeners.size());
+
+    return sendmsg(channel, &message, MSG_NOSIGNAL) == 1;
+}
+
+pid_t spawnSuccessor(const std::string& executable, char* const argv[],
+                     const std::vector<int>& listeners, int timeoutMs) {
+    int channels[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channels) != 0) {
+        return -1;
+    }
+
+    // Everything the child needs is built before fork(); between fork() and
+    // exec only async-signal-safe calls are allowed in a threaded process
+    std::string handoffPrefix = std::string(HANDOFF_ENV) + "=";
+    std::vector<std::string> environment;
+    for (char** variable = environ; *variable != nullptr; variable++) {
+        if (std::strncmp(*variable, handoffPrefix.c_str(), handoffPrefix.size()) != 0) {
+            environment.push_back(*variable);
+        }
+    }
+    environment.push_back(handoffPrefix + std::to_string(CHILD_CHANNEL_FD));
+
+    std::vector<char*> envp;
+    for (auto& variable : environment) {
+        envp.push_back(&variable[0]);
+    }
+    envp.push_back(nullptr);
+
+    long maxDescriptor = sysconf(_SC_OPEN_MAX);
+    if (maxDescriptor < 0) {
+        maxDescriptor = 1024;
+    }
+    sigset_t noSignals;
+    sigemptyset(&noSignals);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(channels[0]);
+        close(channels[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        // Keep stdio and the channel; client connections must not leak into the successor
+        if (channels[1] == CHILD_CHANNEL_FD) {
+            fcntl(CHILD_CHANNEL_FD, F_SETFD, 0);
+        } else {
+            dup2(channels[1], CHILD_CHANNEL_FD);
+        }
+        for (long fd = CHILD_CHANNEL_FD + 1; fd < maxDescriptor; fd++) {
+            close(static_cast<int>(fd));
+        }
+        sigprocmask(SIG_SETMASK, &noSignals, nullptr);
+        execve(executable.c_str(), argv, envp.data());
+        _exit(127);
+    }
+
+    close(channels[1]);
+    int channel = channels[0];
+
+    bool ready = sendListeners(channel, listeners);
+    if (ready) {
+        pollfd descriptor{channel, POLLIN, 0};
+        char reply = 0;
+        ready = poll(&descriptor, 1, timeoutMs) == 1 && recv(channel, &reply, 1, 0) == 1 && reply == READY;
+    }
+    close(channel);
+
+    if (!ready) {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        return -1;
+    }
+    return pid;
+}
+
+int inheritedHandoffChannel() {
+    const char* value = std::getenv(HANDOFF_ENV);
+    if (value == nullptr) {
+        return -1;
+    }
+
+    int channel = std::atoi(value);
+    unsetenv(HANDOFF_ENV);
+    fcntl(channel, F_SETFD, FD_CLOEXEC);
+    return channel;
+}
+
+std::vector<int> receiveListeners(int channel) {
+    char count = 0;
+    iovec data{&count, 1};
+    union {
+        char buffer[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+        cmsghdr align;
+    } control;
+
+    msghdr message{};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    if (recvmsg(channel, &message, MSG_CMSG_CLOEXEC) != 1) {
+        throw std::runtime_error("Failed to receive listening sockets");
+    }
+
+    std::vector<int> listeners;
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            size_t received = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            listeners.resize(received);
+            std::memcpy(listeners.data(), CMSG_DATA(header), sizeof(int) * received);
+        }
+    }
+
+    if (listeners.empty() || listeners.size() != static_cast<size_t>(count) ||
+        (message.msg_flags & MSG_CTRUNC) != 0) {
+        throw std::runtime_error("Incomplete listening socket handoff");
+    }
+    return listeners;
+}
+
+void signalReady(int channel) {
+    char ready = READY;
+    ssize_t ignored = send(channel, &ready, 1, MSG_NOSIGNAL);
+    (void)ignored;
+}
@@ -0,0 +1,28 @@
+// SocketHandoff - Binary upgrade without closing the listen queue. The
+// running server execs its successor and passes the listening sockets over a
+// Unix socket pair (SCM_RIGHTS); both accept from the same queue until the
+// successor reports ready and the old process starts draining.
+
+#ifndef SOCKET_HANDOFF_H
+#define SOCKET_HANDOFF_H
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// Names the successor's end of the handoff channel in its environment
+extern const char* const HANDOFF_ENV;
+
+// Old process: execs executable with argv, hands over the listeners and waits
+// up to timeoutMs for the successor to report ready. Returns its pid, or -1
+// (the successor is killed) if it never got that far.
+pid_t spawnSuccessor(const std::string& executable, char* const argv[],
+                     const std::vector<int>& listeners, int timeoutMs);
+
+// New process: the handoff channel from HANDOFF_ENV, or -1 for a cold start
+int inheritedHandoffChannel();
+
+std::vector<int> receiveListeners(int channel);
+void signalReady(int channel);
+
+#endif // SOCKET_HANDOFF_H
@@ -0,0 +1,403 @@
+#include "thumbnail.h"
+#include "async_logger.h"
+#include <cstdio>
+#include <png.h>
+#include <jpeglib.h>
+#include <openssl/evp.h>
+#include <algorithm>
+#include <csetjmp>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace fs = std::filesystem;
+
+// Headers can declare dimensions far beyond what the file holds; anything
+// larger is refused before its pixels are allocated
+static const unsigned long long MAX_IMAGE_PIXELS = 40ULL * 1000 * 1000;
+
+ImageFormat detectImageFormat(const std::string& data) {
+    static const unsigned char pngSignature[8] = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A};
+    if (data.size() >= 8 && data.compare(0, 8, reinterpret_cast<const char*>(pngSignature), 8) == 0) {
+        return ImageFormat::Png;
+    }
+    if (data.size() >= 3 && static_cast<unsigned char>(data[0]) == 0xFF &&
+        static_cast<unsigned char>(data[1]) == 0xD8 && static_cast<unsigned char>(data[2]) == 0xFF) {
+        return ImageFormat::Jpeg;
+    }
+    return ImageFormat::Unknown;
+}
+
+static bool decodePng(const std::string& data, Image& image) {
+    png_image png;
+    std::memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_memory(&png, data.data(), data.size())) {
+        return false;
+    }
+
+    if (static_cast<unsigned long long>(png.width) * png.height > MAX_IMAGE_PIXELS) {
+        png_image_free(&png);
+        return false;
+    }
+
+    png.format = PNG_FORMAT_RGBA;
+    image.width = static_cast<int>(png.width);
+    image.height = static_cast<int>(png.height);
+    image.channels = 4;
+    image.pixels.resize(PNG_IMAGE_SIZE(png));
+
+    if (!png_image_finish_read(&png, nullptr, image.pixels.data(), 0, nullptr)) {
+        png_image_free(&png);
+        return false;
+    }
+    return true;
+}
+
+// libjpeg reports fatal errors through error_exit, which must not return
+struct JpegErrorManager {
+    jpeg_error_mgr base;
+    std::jmp_buf jump;
+};
+
+static void jpegErrorExit(j_common_ptr info) {
+    JpegErrorManager* manager = reinterpret_cast<JpegErrorManager*>(info->err);
+    std::longjmp(manager->jump, 1);
+}
+
+static bool decodeJpeg(const std::string& data, Image& image) {
+    jpeg_decompress_struct info;
+    JpegErrorManager error;
+    info.err = jpeg_std_error(&error.base);
+    error.base.error_exit = jpegErrorExit;
+
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, reinterpret_cast<const unsigned char*>(data.data()), data.size());
+    jpeg_read_header(&info, TRUE);
+    if (static_cast<unsigned long long>(info.image_width) * info.image_height > MAX_IMAGE_PIXELS) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+    info.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&info);
+
+    image.width = static_cast<int>(info.output_width);
+    image.height = static_cast<int>(info.output_height);
+    image.channels = 3;
+    image.pixels.resize(static_cast<size_t>(image.width) * image.height * 3);
+
+    while (info.output_scanline < info.output_height) {
+        JSAMPROW row = image.pixels.data() + static_cast<size_t>(info.output_scanline) * image.width * 3;
+        jpeg_read_scanlines(&info, &row, 1);
+    }
+
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    return true;
+}
+
+bool decodeImage(const std::string& data, Image& image) {
+    switch (detectImageFormat(data)) {
+        case ImageFormat::Png:
+            return decodePng(data, image);
+        case ImageFormat::Jpeg:
+            return decodeJpeg(data, image);
+        default:
+            return false;
+    }
+}
+
+Image scaleToFit(const Image& source, int maxWidth, int maxHeight) {
+    if (source.width <= maxWidth && source.height <= maxHeight) {
+        return source;
+    }
+
+    // Keep the aspect ratio; the longer edge decides the scale
+    Image result;
+    result.channels = source.channels;
+    if (static_cast<long long>(source.width) * maxHeight >= static_cast<long long>(source.height) * maxWidth) {
+        result.width = maxWidth;
+        result.height = std::max(1, static_cast<int>(static_cast<long long>(source.height) * maxWidth / source.width));
+    } else {
+        result.height = maxHeight;
+        result.width = std::max(1, static_cast<int>(static_cast<long long>(source.width) * maxHeight / source.height));
+    }
+    result.pixels.resize(static_cast<size_t>(result.width) * result.height * result.channels);
+
+    // Box filter: every output pixel averages the source block it covers
+    const int channels = source.channels;
+    std::vector<unsigned long> sums(channels);
+    for (int dy = 0; dy < result.height; dy++) {
+        int y0 = static_cast<int>(static_cast<long long>(dy) * source.height / result.height);
+        int y1 = std::max(y0 + 1, static_cast<int>(static_cast<long long>(dy + 1) * source.height / result.height));
+
+        for (int dx = 0; dx < result.width; dx++) {
+            int x0 = static_cast<int>(static_cast<long long>(dx) * source.width / result.width);
+            int x1 = std::max(x0 + 1, static_cast<int>(static_cast<long long>(dx + 1) * source.width / result.width));
+
+            std::fill(sums.begin(), sums.end(), 0);
+            for (int sy = y0; sy < y1; sy++) {
+                const unsigned char* row = source.pixels.data() + (static_cast<size_t>(sy) * source.width + x0) * channels;
+                for (int sx = x0; sx < x1; sx++) {
+                    for (int c = 0; c < channels; c++) {
+                        sums[c] += *row++;
+                    }
+                }
+            }
+
+            unsigned long count = static_cast<unsigned long>(y1 - y0) * (x1 - x0);
+            unsigned char* out = result.pixels.data() + (static_cast<size_t>(dy) * result.width + dx) * channels;
+            for (int c = 0; c < channels; c++) {
+                out[c] = static_cast<unsigned char>((sums[c] + count / 2) / count);
+            }
+        }
+    }
+
+    return result;
+}
+
+bool encodePng(const Image& image, std::string& output) {
+    png_image png;
+    std::memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+    png.width = image.width;
+    png.height = image.height;
+    png.format = image.channels == 4 ? PNG_FORMAT_RGBA : PNG_FORMAT_RGB;
+
+    png_alloc_size_t size = 0;
+    if (!png_image_write_to_memory(&png, nullptr, &size, 0, image.pixels.data(), 0, nullptr)) {
+        return false;
+    }
+
+    output.resize(size);
+    if (!png_image_write_to_memory(&png, &output[0], &size, 0, image.pixels.data(), 0, nullptr)) {
+        return false;
+    }
+    output.resize(size);
+    return true;
+}
+
+bool encodeJpeg(const Image& image, int quality, std::string& output) {
+    if (image.channels != 3) {
+        return false;
+    }
+
+    jpeg_compress_struct info;
+    JpegErrorManager error;
+    info.err = jpeg_std_error(&error.base);
+    error.base.error_exit = jpegErrorExit;
+
+    unsigned char* buffer = nullptr;
+    unsigned long size = 0;
+
+    if (setjmp(error.jump)) {
+        jpeg_destroy_compress(&info);
+        std::free(buffer);
+        return false;
+    }
+
+    jpeg_create_compress(&info);
+    jpeg_mem_dest(&info, &buffer, &size);
+
+    info.image_width = image.width;
+    info.image_height = image.height;
+    info.input_components = 3;
+    info.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, quality, TRUE);
+    jpeg_start_compress(&info, TRUE);
+
+    while (info.next_scanline < info.image_height) {
+        JSAMPROW row = const_cast<unsigned char*>(image.pixels.data()) +
+                       static_cast<size_t>(info.next_scanline) * image.width * 3;
+        jpeg_write_scanlines(&info, &row, 1);
+    }
+
+    jpeg_finish_compress(&info);
+    output.assign(reinterpret_cast<const char*>(buffer), size);
+    jpeg_destroy_compress(&info);
+    std::free(buffer);
+    return true;
+}
+
+static std::string sha256Hex(const std::string& data) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLength = 0;
+    EVP_Digest(data.data(), data.size(), digest, &digestLength, EVP_sha256(), nullptr);
+
+    static const char hexDigits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(digestLength * 2);
+    for (unsigned int i = 0; i < digestLength; i++) {
+        hex += hexDigits[digest[i] >> 4];
+        hex += hexDigits[digest[i] & 0x0F];
+    }
+    return hex;
+}
+
+ThumbnailCache::ThumbnailCache(const std::string& directory, int maxEdge, size_t workerCount, size_t queueCapacity,
+                               size_t maxEntries)
+    : cacheDir(directory), maxEdge(maxEdge), queueCapacity(queueCapacity), maxEntries(maxEntries), stopping(false) {
+    std::error_code ec;
+    fs::create_directories(cacheDir, ec);
+
+    for (size_t i = 0; i < workerCount; i++) {
+        workers.emplace_back(&ThumbnailCache::workerLoop, this);
+    }
+}
+
+ThumbnailCache::~ThumbnailCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queueReady.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+const ThumbnailCache::Entry* ThumbnailCache::current(const std::string& sourcePath) {
+    auto it = entries.find(sourcePath);
+    if (it == entries.end()) return nullptr;
+
+    std::error_code ec;
+    auto sourceTime = fs::last_write_time(sourcePath, ec);
+    if (ec) return nullptr;
+    auto sourceSize = fs::file_size(sourcePath, ec);
+    if (ec) return nullptr;
+
+    if (it->second.sourceTime != sourceTime || it->second.sourceSize != sourceSize) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+void ThumbnailCache::record(const std::string& sourcePath, const Entry& entry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Entries only save re-reading sources, so when there are too many they
+    // all go rather than tracking which are used
+    if (entries.size() >= maxEntries && entries.find(sourcePath) == entries.end()) {
+        entries.clear();
+    }
+    entries[sourcePath] = entry;
+}
+
+bool ThumbnailCache::lookup(const std::string& sourcePath, std::string& thumbnailPath, std::string& contentHash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const Entry* entry = current(sourcePath);
+    if (!entry || entry->thumbnailPath.empty()) {
+        return false;
+    }
+
+    thumbnailPath = entry->thumbnailPath;
+    contentHash = entry->contentHash;
+    return true;
+}
+
+void ThumbnailCache::forget(const std::string& sourcePath) {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.erase(sourcePath);
+}
+
+bool ThumbnailCache::request(const std::string& sourcePath) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const Entry* entry = current(sourcePath);
+        if (entry && entry->thumbnailPath.empty()) {
+            // Failed before; nothing changed since
+            return true;
+        }
+        if (stopping || pending.count(sourcePath)) {
+            return !stopping;
+        }
+        if (queue.size() >= queueCapacity) {
+            return false;
+        }
+        pending.insert(sourcePath);
+        queue.push_back(sourcePath);
+    }
+    queueReady.notify_one();
+    return true;
+}
+
+void ThumbnailCache::workerLoop() {
+    while (true) {
+        std::string sourcePath;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queueReady.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) return;
+
+            sourcePath = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        try {
+            generate(sourcePath);
+        } catch (const std::exception& e) {
+            LOG_ERROR("thumbnail", "Generation failed for " + sourcePath + ": " + e.what());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.erase(sourcePath);
+    }
+}
+
+void ThumbnailCache::generate(const std::string& sourcePath) {
+    std::error_code ec;
+    auto sourceTime = fs::last_write_time(sourcePath, ec);
+    if (ec) return;
+
+    std::ifstream file(sourcePath, std::ios::binary);
+    if (!file) return;
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // The cache key covers the source bytes and the output size, so identical
+    // uploads share one thumbnail and renamed files need no regeneration
+    ImageFormat format = detectImageFormat(data);
+    std::string contentHash = sha256Hex(data + "/" + std::to_string(maxEdge)).substr(0, 32);
+    std::string extension = format == ImageFormat::Jpeg ? ".jpg" : ".png";
+    std::string thumbnailPath = cacheDir + "/" + contentHash + extension;
+
+    Entry failed{sourceTime, static_cast<std::uintmax_t>(data.size()), "", ""};
+    if (!fs::exists(thumbnailPath)) {
+        Image image;
+        if (!decodeImage(data, image)) {
+            LOG_WARN("thumbnail", "Unsupported or oversized image: " + sourcePath);
+            record(sourcePath, failed);
+            return;
+        }
+
+        Image thumbnail = scaleToFit(image, maxEdge, maxEdge);
+        std::string encoded;
+        bool ok = format == ImageFormat::Jpeg ? encodeJpeg(thumbnail, 85, encoded) : encodePng(thumbnail, encoded);
+        if (!ok) {
+            record(sourcePath, failed);
+            return;
+        }
+
+        // Write to a temporary name first so readers never see a partial file
+        std::string temporaryPath = thumbnailPath + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        {
+            std::ofstream out(temporaryPath, std::ios::binary);
+            if (!out) return;
+            out.write(encoded.data(), encoded.size());
+        }
+        fs::rename(temporaryPath, thumbnailPath, ec);
+        if (ec) {
+            fs::remove(temporaryPath, ec);
+            return;
+        }
+    }
+
+    record(sourcePath, Entry{sourceTime, static_cast<std::uintmax_t>(data.size()), thumbnailPath, contentHash});
+}
@@ -0,0 +1,85 @@
+// Thumbnail - Decodes PNG/JPEG contact images, scales them down and keeps
+// the results in a content-addressed on-disk cache filled by a worker pool.
+
+#ifndef THUMBNAIL_H
+#define THUMBNAIL_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+#include <cstdint>
+
+// Decoded image, 8 bits per channel, rows packed without padding
+struct Image {
+    int width = 0;
+    int height = 0;
+    int channels = 0; // 3 = RGB, 4 = RGBA
+    std::vector<unsigned char> pixels;
+};
+
+enum class ImageFormat { Unknown, Png, Jpeg };
+
+ImageFormat detectImageFormat(const std::string& data);
+bool decodeImage(const std::string& data, Image& image);
+Image scaleToFit(const Image& source, int maxWidth, int maxHeight);
+bool encodePng(const Image& image, std::string& output);
+bool encodeJpeg(const Image& image, int quality, std::string& output);
+
+class ThumbnailCache {
+    private:
+        // A source that could not be decoded gets an entry without a
+        // thumbnailPath, so it is not read again until it changes
+        struct Entry {
+            std::filesystem::file_time_type sourceTime;
+            std::uintmax_t sourceSize;
+            std::string thumbnailPath;
+            std::string contentHash;
+        };
+
+        std::string cacheDir;
+        int maxEdge;
+        size_t queueCapacity;
+        size_t maxEntries;
+
+        std::mutex mutex;
+        std::condition_variable queueReady;
+        std::deque<std::string> queue;
+        std::unordered_set<std::string> pending;
+        std::unordered_map<std::string, Entry> entries;
+        std::vector<std::thread> workers;
+        bool stopping;
+
+        void workerLoop();
+        void generate(const std::string& sourcePath);
+        // The entry for sourcePath if it is still current; mutex is held
+        const Entry* current(const std::string& sourcePath);
+        void record(const std::string& sourcePath, const Entry& entry);
+
+    public:
+        ThumbnailCache(const std::string& directory = "images/.thumbs", int maxEdge = 100,
+                       size_t workerCount = 2, size_t queueCapacity = 64, size_t maxEntries = 10000);
+        ~ThumbnailCache();
+
+        ThumbnailCache(const ThumbnailCache&) = delete;
+        ThumbnailCache& operator=(const ThumbnailCache&) = delete;
+
+        // Returns true and fills thumbnailPath/contentHash when an up to date
+        // thumbnail exists for sourcePath. Never decodes on the calling thread.
+        bool lookup(const std::string& sourcePath, std::string& thumbnailPath, std::string& contentHash);
+
+        // Queues sourcePath for thumbnail generation, unless it already
+        // failed to decode as it is now. Returns false when the queue is
+        // full; the caller should keep serving the original.
+        bool request(const std::string& sourcePath);
+
+        // Drops what is known about sourcePath, e.g. once it is deleted
+        void forget(const std::string& sourcePath);
+};
+
+#endif // THUMBNAIL_H
@@ -0,0 +1,135 @@
+#include "transport.h"
+#include <openssl/err.h>
+#include <stdexcept>
+#include <cstring>
+#include <poll.h>
+
+// poll() on the socket and wakeFd, bounded by the socket's SO_RCVTIMEO
+static int waitForSocket(socket_t socket, int wakeFd) {
+    timeval timeout{0, 0};
+    socklen_t timeoutLength = sizeof(timeout);
+    getsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, &timeoutLength);
+    int milliseconds = timeout.tv_sec == 0 && timeout.tv_usec == 0 ? -1 :
+                       static_cast<int>(timeout.tv_sec * 1000 + timeout.tv_usec / 1000);
+
+    pollfd fds[2] = {{socket, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+    int ready = poll(fds, 2, milliseconds);
+    if (ready <= 0) {
+        return -1;
+    }
+    return fds[0].revents != 0 ? 1 : 0;
+}
+
+PlainTransport::PlainTransport(socket_t socket) : socket(socket) {}
+
+long PlainTransport::read(void* buffer, size_t length) {
+    return recv(socket, static_cast<char*>(buffer), length, 0);
+}
+
+int PlainTransport::wait(int wakeFd) {
+    return waitForSocket(socket, wakeFd);
+}
+
+bool PlainTransport::writeAll(const void* data, size_t length) {
+    const char* bytes = static_cast<const char*>(data);
+    while (length > 0) {
+        long sent = send(socket, bytes, length, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+TlsTransport::TlsTransport(SSL* ssl) : ssl(ssl) {}
+
+TlsTransport::~TlsTransport() {
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+}
+
+std::string TlsTransport::selectedProtocol() const {
+    const unsigned char* protocol = nullptr;
+    unsigned int length = 0;
+    SSL_get0_alpn_selected(ssl, &protocol, &length);
+    return std::string(reinterpret_cast<const char*>(protocol), protocol ? length : 0);
+}
+
+long TlsTransport::read(void* buffer, size_t length) {
+    int received = SSL_read(ssl, buffer, static_cast<int>(length));
+    if (received <= 0) {
+        return SSL_get_error(ssl, received) == SSL_ERROR_ZERO_RETURN ? 0 : -1;
+    }
+    return received;
+}
+
+int TlsTransport::wait(int wakeFd) {
+    // Records already decrypted are not visible to poll()
+    if (SSL_pending(ssl) > 0) {
+        return 1;
+    }
+    return waitForSocket(SSL_get_fd(ssl), wakeFd);
+}
+
+bool TlsTransport::writeAll(const void* data, size_t length) {
+    const char* bytes = static_cast<const char*>(data);
+    while (length > 0) {
+        int sent = SSL_write(ssl, bytes, static_cast<int>(length));
+        if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+// Prefer h2, fall back to http/1.1 (RFC 7301 wire format: length-prefixed names)
+static int selectAlpnProtocol(SSL*, const unsigned char** out, unsigned char* outlen,
+                              const unsigned char* in, unsigned int inlen, void*) {
+    static const unsigned char supported[] = "\x02h2\x08http/1.1";
+    unsigned char* selected = nullptr;
+    if (SSL_select_next_proto(&selected, outlen, supported, sizeof(supported) - 1, in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+TlsContext::TlsContext(const std::string& certificateFile, const std::string& privateKeyFile) {
+    ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        throw std::runtime_error("Failed to create TLS context");
+    }
+
+    // HTTP/2 requires TLS 1.2 or newer (RFC 7540 section 9.2)
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_alpn_select_cb(ctx, selectAlpnProtocol, nullptr);
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, certificateFile.c_str()) <= 0 ||
+        SSL_CTX_use_PrivateKey_file(ctx, privateKeyFile.c_str(), SSL_FILETYPE_PEM) <= 0) {
+        SSL_CTX_free(ctx);
+        throw std::runtime_error("Failed to load TLS certificate or key");
+    }
+}
+
+TlsContext::~TlsContext() {
+    SSL_CTX_free(ctx);
+}
+
+std::unique_ptr<TlsTransport> TlsContext::accept(socket_t socket) {
+    SSL* ssl = SSL_new(ctx);
+    if (!ssl) {
+        return nullptr;
+    }
+    SSL_set_fd(ssl, socket);
+
+    if (SSL_accept(ssl) <= 0) {
+        ERR_clear_error();
+        SSL_free(ssl);
+        return nullptr;
+    }
+    return std::unique_ptr<TlsTransport>(new TlsTransport(ssl));
+}
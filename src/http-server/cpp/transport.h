@@ -0,0 +1,95 @@
+// Transport - Byte stream over a plain TCP socket or a TLS session, so the
+// HTTP/1.1 and HTTP/2 code paths do not care which one they are served on.
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <string>
+#include <cstddef>
+#include <memory>
+#include <openssl/ssl.h>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+    typedef SOCKET socket_t;
+    #define CLOSE_SOCKET closesocket
+    #define MSG_NOSIGNAL 0
+#else
+    #include <unistd.h>
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+    typedef int socket_t;
+    #define CLOSE_SOCKET close
+    #define INVALID_SOCKET -1
+    #define SOCKET_ERROR -1
+#endif
+
+class Transport {
+    public:
+        virtual ~Transport() = default;
+
+        // Returns the number of bytes read, 0 on orderly close, < 0 on error or timeout
+        virtual long read(void* buffer, size_t length) = 0;
+        virtual bool writeAll(const void* data, size_t length) = 0;
+
+        // Waits for input to read or for wakeFd to turn readable, at most as
+        // long as the socket's receive timeout. Returns 1 for input (or a
+        // close), 0 when woken and < 0 on timeout or error.
+        virtual int wait(int wakeFd) = 0;
+
+        bool writeAll(const std::string& data) {
+            return writeAll(data.data(), data.size());
+        }
+};
+
+class PlainTransport : public Transport {
+    private:
+        socket_t socket;
+
+    public:
+        explicit PlainTransport(socket_t socket);
+
+        long read(void* buffer, size_t length) override;
+        bool writeAll(const void* data, size_t length) override;
+        int wait(int wakeFd) override;
+};
+
+class TlsTransport : public Transport {
+    private:
+        SSL* ssl;
+
+    public:
+        explicit TlsTransport(SSL* ssl);
+        ~TlsTransport();
+
+        TlsTransport(const TlsTransport&) = delete;
+        TlsTransport& operator=(const TlsTransport&) = delete;
+
+        // Protocol chosen through ALPN, empty if the client offered none
+        std::string selectedProtocol() const;
+
+        long read(void* buffer, size_t length) override;
+        bool writeAll(const void* data, size_t length) override;
+        int wait(int wakeFd) override;
+};
+
+// Server-side TLS configuration advertising h2 and http/1.1 through ALPN
+class TlsContext {
+    private:
+        SSL_CTX* ctx;
+
+    public:
+        TlsContext(const std::string& certificateFile, const std::string& privateKeyFile);
+        ~TlsContext();
+
+        TlsContext(const TlsContext&) = delete;
+        TlsContext& operator=(const TlsContext&) = delete;
+
+        // Performs the handshake; returns nullptr if it fails
+        std::unique_ptr<TlsTransport> accept(socket_t socket);
+};
+
+#endif // TRANSPORT_H
@@ -0,0 +1,338 @@
+#include "websocket.h"
+#include "openssl_base64.h"
+#include "async_logger.h"
+#include <openssl/sha.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+
+static const char* WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+static const size_t MAX_CLIENT_FRAME = 64 * 1024;
+static const int PING_INTERVAL_MS = 30000;
+
+// Opcodes
+static const unsigned char OPCODE_TEXT = 0x1;
+static const unsigned char OPCODE_CLOSE = 0x8;
+static const unsigned char OPCODE_PING = 0x9;
+static const unsigned char OPCODE_PONG = 0xA;
+
+static bool containsToken(std::string value, const std::string& token) {
+    std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+    return value.find(token) != std::string::npos;
+}
+
+WebSocketHub::WebSocketHub(size_t highWaterBytes)
+    : highWaterBytes(highWaterBytes),
+      resyncFrame(std::make_shared<const std::string>(encodeFrame(OPCODE_TEXT, "{\"type\":\"resync\"}"))),
+      stopping(false) {
+    if (pipe(wakePipe) != 0) {
+        throw std::runtime_error("Failed to create WebSocket wake pipe");
+    }
+    fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+    thread = std::thread(&WebSocketHub::run, this);
+}
+
+WebSocketHub::~WebSocketHub() {
+    stopping = true;
+    wake();
+    thread.join();
+
+    for (auto& entry : subscribers) {
+        CLOSE_SOCKET(entry.first);
+    }
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+}
+
+bool WebSocketHub::isUpgradeRequest(const HttpRequest& request) {
+    auto upgrade = request.headers.find("Upgrade");
+    return upgrade != request.headers.end() && containsToken(upgrade->second, "websocket");
+}
+
+std::string WebSocketHub::handshakeResponse(const HttpRequest& request) {
+    auto key = request.headers.find("Sec-WebSocket-Key");
+    auto version = request.headers.find("Sec-WebSocket-Version");
+    auto connection = request.headers.find("Connection");
+    if (request.method != "GET" || key == request.headers.end() || version == request.headers.end() ||
+        version->second != "13" || connection == request.headers.end() ||
+        !containsToken(connection->second, "upgrade")) {
+        return "";
+    }
+
+    std::string accept = key->second + WEBSOCKET_GUID;
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char*>(accept.data()), accept.size(), digest);
+
+    return "HTTP/1.1 101 Switching Protocols\r\n"
+           "Upgrade: websocket\r\n"
+           "Connection: Upgrade\r\n"
+           "Sec-WebSocket-Accept: " + base64_encode(std::string(reinterpret_cast<char*>(digest), sizeof(digest))) + "\r\n"
+           "\r\n";
+}
+
+std::string WebSocketHub::encodeFrame(unsigned char opcode, const std::string& payload) {
+    // Server frames are never masked
+    std::string frame;
+    frame.reserve(payload.size() + 10);
+    frame += static_cast<char>(0x80 | opcode);
+
+    if (payload.size() < 126) {
+        frame += static_cast<char>(payload.size());
+    } else if (payload.size() <= 0xFFFF) {
+        frame += static_cast<char>(126);
+        frame += static_cast<char>(payload.size() >> 8);
+        frame += static_cast<char>(payload.size() & 0xFF);
+    } else {
+        frame += static_cast<char>(127);
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            frame += static_cast<char>((static_cast<uint64_t>(payload.size()) >> shift) & 0xFF);
+        }
+    }
+
+    frame += payload;
+    return frame;
+}
+
+void WebSocketHub::addSubscriber(socket_t socket, const std::string& handshake) {
+    fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Subscriber& subscriber = subscribers[socket];
+        subscriber.queue.push_back(std::make_shared<const std::string>(handshake));
+        subscriber.queuedBytes = handshake.size();
+        // Sent under the lock, so no broadcast goes first; what does not fit
+        // is left to the hub thread
+        if (!flush(socket, subscriber)) {
+            remove(socket);
+            return;
+        }
+    }
+    wake();
+}
+
+void WebSocketHub::broadcast(const std::string& text) {
+    Frame frame = std::make_shared<const std::string>(encodeFrame(OPCODE_TEXT, text));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& entry : subscribers) {
+            enqueue(entry.second, frame);
+        }
+    }
+    wake();
+}
+
+size_t WebSocketHub::subscriberCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return subscribers.size();
+}
+
+void WebSocketHub::enqueue(Subscriber& subscriber, const Frame& frame) {
+    if (subscriber.closing || subscriber.resyncPending) {
+        // Anything queued after a resync is superseded by the reload it triggers
+        return;
+    }
+
+    if (subscriber.queuedBytes + frame->size() > highWaterBytes) {
+        // Slow consumer: keep only the frame already on the wire, then ask for a reload
+        while (subscriber.queue.size() > (subscriber.offset > 0 ? 1u : 0u)) {
+            subscriber.queuedBytes -= subscriber.queue.back()->size();
+            subscriber.queue.pop_back();
+        }
+        subscriber.queue.push_back(resyncFrame);
+        subscriber.queuedBytes += resyncFrame->size();
+        subscriber.resyncPending = true;
+        return;
+    }
+
+    subscriber.queue.push_back(frame);
+    subscriber.queuedBytes += frame->size();
+}
+
+bool WebSocketHub::enqueueControl(Subscriber& subscriber, const Frame& frame) {
+    // A client that sends pings without reading the pongs is as slow as one
+    // that does not read broadcasts, but control frames cannot be replaced
+    // by a resync
+    if (subscriber.queuedBytes + frame->size() > highWaterBytes) {
+        return false;
+    }
+    subscriber.queue.push_back(frame);
+    subscriber.queuedBytes += frame->size();
+    return true;
+}
+
+void WebSocketHub::wake() {
+    char byte = 0;
+    ssize_t ignored = write(wakePipe[1], &byte, 1);
+    (void)ignored;
+}
+
+void WebSocketHub::remove(socket_t socket) {
+    subscribers.erase(socket);
+    CLOSE_SOCKET(socket);
+}
+
+bool WebSocketHub::flush(socket_t socket, Subscriber& subscriber) {
+    while (!subscriber.queue.empty()) {
+        const std::string& frame = *subscriber.queue.front();
+        ssize_t sent = send(socket, frame.data() + subscriber.offset, frame.size() - subscriber.offset, MSG_NOSIGNAL);
+        if (sent < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        subscriber.offset += sent;
+        subscriber.lastActivity = Clock::now();
+        if (subscriber.offset < frame.size()) {
+            return true;
+        }
+
+        subscriber.queuedBytes -= frame.size();
+        subscriber.queue.pop_front();
+        subscriber.offset = 0;
+    }
+
+    subscriber.resyncPending = false;
+    return !subscriber.closing;
+}
+
+bool WebSocketHub::readFrames(socket_t socket, Subscriber& subscriber) {
+    char buffer[4096];
+    ssize_t received = recv(socket, buffer, sizeof(buffer), 0);
+    if (received == 0) {
+        return false;
+    }
+    if (received < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    subscriber.input.append(buffer, received);
+    subscriber.lastActivity = Clock::now();
+
+    while (subscriber.input.size() >= 2) {
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(subscriber.input.data());
+        unsigned char opcode = data[0] & 0x0F;
+        bool masked = (data[1] & 0x80) != 0;
+        uint64_t length = data[1] & 0x7F;
+        size_t headerSize = 2;
+
+        if (length == 126) {
+            if (subscriber.input.size() < 4) return true;
+            length = (data[2] << 8) | data[3];
+            headerSize = 4;
+        } else if (length == 127) {
+            if (subscriber.input.size() < 10) return true;
+            length = 0;
+            for (int i = 2; i < 10; i++) length = (length << 8) | data[i];
+            headerSize = 10;
+        }
+
+        // Clients must mask every frame (RFC 6455 section 5.1)
+        if (!masked || length > MAX_CLIENT_FRAME) {
+            return false;
+        }
+        if (subscriber.input.size() < headerSize + 4 + length) {
+            return true;
+        }
+
+        const unsigned char* mask = data + headerSize;
+        std::string payload(subscriber.input, headerSize + 4, length);
+        for (size_t i = 0; i < payload.size(); i++) {
+            payload[i] = static_cast<char>(payload[i] ^ mask[i % 4]);
+        }
+        subscriber.input.erase(0, headerSize + 4 + length);
+
+        if (opcode == OPCODE_CLOSE) {
+            // Echo the status code and close once it is flushed
+            subscriber.closing = true;
+            return enqueueControl(subscriber, std::make_shared<const std::string>(encodeFrame(OPCODE_CLOSE, payload.substr(0, 2))));
+        } else if (opcode == OPCODE_PING) {
+            if (!enqueueControl(subscriber, std::make_shared<const std::string>(encodeFrame(OPCODE_PONG, payload)))) {
+                return false;
+            }
+        }
+        // Text, binary and pong frames from browsers carry nothing for this endpoint
+    }
+
+    return true;
+}
+
+void WebSocketHub::run() {
+    Frame pingFrame = std::make_shared<const std::string>(encodeFrame(OPCODE_PING, ""));
+    std::vector<pollfd> fds;
+
+    const Clock::duration pingInterval = std::chrono::milliseconds(PING_INTERVAL_MS);
+
+    while (!stopping) {
+        fds.clear();
+        fds.push_back({wakePipe[0], POLLIN, 0});
+        // Sleep until the next subscriber is due a ping, if any
+        int timeout = -1;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Clock::time_point now = Clock::now();
+            for (auto& entry : subscribers) {
+                short events = POLLIN;
+                if (!entry.second.queue.empty()) events |= POLLOUT;
+                fds.push_back({entry.first, events, 0});
+
+                Clock::duration untilPing = std::max(Clock::duration::zero(), entry.second.lastActivity + pingInterval - now);
+                int milliseconds = static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(untilPing).count());
+                if (timeout < 0 || milliseconds < timeout) {
+                    timeout = milliseconds;
+                }
+            }
+        }
+
+        int ready = poll(fds.data(), fds.size(), timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("websocket", "poll failed");
+            return;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            char drain[256];
+            while (read(wakePipe[0], drain, sizeof(drain)) > 0) {}
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (size_t i = 1; i < fds.size(); i++) {
+            if (fds[i].revents == 0) continue;
+
+            auto it = subscribers.find(fds[i].fd);
+            if (it == subscribers.end()) continue;
+
+            bool keep = true;
+            if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                keep = false;
+            }
+            if (keep && (fds[i].revents & POLLIN)) {
+                keep = readFrames(it->first, it->second);
+            }
+            if (keep && !it->second.queue.empty()) {
+                keep = flush(it->first, it->second);
+            }
+            if (!keep) {
+                remove(fds[i].fd);
+            }
+        }
+
+        // Ping each subscriber that has been quiet for a whole interval, so
+        // intermediaries keep its connection open
+        Clock::time_point now = Clock::now();
+        for (auto it = subscribers.begin(); it != subscribers.end(); ) {
+            socket_t socket = it->first;
+            Subscriber& subscriber = (it++)->second;
+            if (subscriber.closing || now - subscriber.lastActivity < pingInterval) {
+                continue;
+            }
+            subscriber.lastActivity = now;
+            if (!enqueueControl(subscriber, pingFrame)) {
+                remove(socket);
+            }
+        }
+    }
+}
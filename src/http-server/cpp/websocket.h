@@ -0,0 +1,74 @@
+// WebSocket - RFC 6455 endpoint that pushes phone book changes to browsers.
+// A broadcast encodes its frame once and every subscriber queues a shared
+// reference to it; one thread polls all subscriber sockets.
+
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <string>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include "http_message.h"
+#include "transport.h"
+
+class WebSocketHub {
+    private:
+        typedef std::shared_ptr<const std::string> Frame;
+        typedef std::chrono::steady_clock Clock;
+
+        struct Subscriber {
+            std::deque<Frame> queue;
+            size_t offset = 0;          // bytes of queue.front() already sent
+            size_t queuedBytes = 0;
+            bool resyncPending = false;
+            bool closing = false;       // close frame queued, drop after flush
+            std::string input;
+            Clock::time_point lastActivity = Clock::now();  // last byte sent or received
+        };
+
+        std::mutex mutex;
+        std::map<socket_t, Subscriber> subscribers;
+        size_t highWaterBytes;
+        Frame resyncFrame;
+        int wakePipe[2];
+        std::atomic<bool> stopping;
+        std::thread thread;
+
+        void run();
+        void wake();
+        bool flush(socket_t socket, Subscriber& subscriber);
+        bool readFrames(socket_t socket, Subscriber& subscriber);
+        void enqueue(Subscriber& subscriber, const Frame& frame);
+        bool enqueueControl(Subscriber& subscriber, const Frame& frame);
+        void remove(socket_t socket);
+
+    public:
+        // Subscribers queueing more than highWaterBytes are switched to a
+        // single "resync" message instead of buffering without bound. Ping,
+        // pong and close frames count too; one that does not fit drops the
+        // subscriber.
+        explicit WebSocketHub(size_t highWaterBytes = 256 * 1024);
+        ~WebSocketHub();
+
+        WebSocketHub(const WebSocketHub&) = delete;
+        WebSocketHub& operator=(const WebSocketHub&) = delete;
+
+        static bool isUpgradeRequest(const HttpRequest& request);
+        // Returns the 101 response for a valid handshake, or an empty string
+        static std::string handshakeResponse(const HttpRequest& request);
+        static std::string encodeFrame(unsigned char opcode, const std::string& payload);
+
+        // Takes ownership of a socket whose handshake request was accepted and
+        // sends it handshake, ahead of every broadcast made after this call
+        void addSubscriber(socket_t socket, const std::string& handshake);
+        void broadcast(const std::string& text);
+        size_t subscriberCount();
+};
+
+#endif // WEBSOCKET_H
@@ -1,75 +1,99 @@
 #include "BEREncoder.h"
 #include <cstring>
 
-std::vector<unsigned char> BEREncoder::encodeLength(size_t len) {
-    std::vector<unsigned char> result;
-    
-    if (len < 128) {
-        result.push_back(static_cast<unsigned char>(len));
-    } else {
-        // Determine how many bytes we need
-        size_t tmpLen = len;
-        int numBytes = 0;
-        
-        while (tmpLen > 0) {
-            tmpLen >>= 8;
-            numBytes++;
-        }
-        
-        result.push_back(static_cast<unsigned char>(0x80 | numBytes));
-        
-        // Add length bytes in big-endian order
-        for (int i = numBytes - 1; i >= 0; i--) {
-            result.push_back(static_cast<unsigned char>((len >> (i * 8)) & 0xFF));
-        }
-    }
-    
-    return result;
+void BEREncoder::clear() {
+    buffer.clear();
+    open.clear();
 }
 
-std::vector<unsigned char> BEREncoder::encodeInteger(int value) {
-    std::vector<unsigned char> result;
-    
-    // Type: INTEGER (0x02)
-    result.push_back(0x02);
-    
-    result.push_back(0x01);
-    result.push_back(static_cast<unsigned char>(value & 0xFF));
-    
-    return result;
+void BEREncoder::writeLength(size_t length) {
+    if (length < 128) {
+        buffer.push_back(static_cast<unsigned char>(length));
+        return;
+    }
+
+    // Determine how many bytes we need
+    int numBytes = 0;
+    for (size_t tmpLen = length; tmpLen > 0; tmpLen >>= 8) {
+        numBytes++;
+    }
+
+    // Add length bytes in big-endian order
+    buffer.push_back(static_cast<unsigned char>(0x80 | numBytes));
+    for (int i = numBytes - 1; i >= 0; i--) {
+        buffer.push_back(static_cast<unsigned char>((length >> (i * 8)) & 0xFF));
+    }
 }
 
-std::vector<unsigned char> BEREncoder::encodeOctetString(const char* str) {
-    std::vector<unsigned char> result;
-    size_t len = strlen(str);
-    
-    // Type: OCTET STRING (0x04)
-    result.push_back(0x04);
-    
-    // Length
-    std::vector<unsigned char> lengthBytes = encodeLength(len);
-    result.insert(result.end(), lengthBytes.begin(), lengthBytes.end());
-    
-    // Value
-    for (size_t i = 0; i < len; i++) {
-        result.push_back(static_cast<unsigned char>(str[i]));
+void BEREncoder::writeInteger(int64_t value, unsigned char tag) {
+    unsigned char octets[8];
+    for (int i = 0; i < 8; i++) {
+        octets[i] = static_cast<unsigned char>(static_cast<uint64_t>(value) >> ((7 - i) * 8));
+    }
+
+    // Leading octets that only repeat the sign bit are dropped
+    int first = 0;
+    while (first < 7 && ((octets[first] == 0x00 && (octets[first + 1] & 0x80) == 0) ||
+                         (octets[first] == 0xFF && (octets[first + 1] & 0x80) != 0))) {
+        first++;
     }
-    
-    return result;
+
+    buffer.push_back(tag);
+    writeLength(static_cast<size_t>(8 - first));
+    buffer.insert(buffer.end(), octets + first, octets + 8);
+}
+
+void BEREncoder::writeEnumerated(int64_t value) {
+    writeInteger(value, 0x0A);
 }
 
-std::vector<unsigned char> BEREncoder::encodeSequence(const std::vector<unsigned char>& data) {
-    std::vector<unsigned char> result;
-    
-    // Type: SEQUENCE (0x30)
-    result.push_back(0x30);
-    
-    // Length
-    std::vector<unsigned char> lengthBytes = encodeLength(data.size());
-    result.insert(result.end(), lengthBytes.begin(), lengthBytes.end());
-    
-    // Value
-    result.insert(result.end(), data.begin(), data.end());
-    
-    return result;
+void BEREncoder::writeBoolean(bool value, unsigned char tag) {
+    buffer.push_back(tag);
+    buffer.push_back(0x01);
+    buffer.push_back(value ? 0xFF : 0x00);
+}
+
+void BEREncoder::writeOctetString(std::string_view value, unsigned char tag) {
+    buffer.push_back(tag);
+    writeLength(value.size());
+    buffer.insert(buffer.end(), value.begin(), value.end());
+}
+
+void BEREncoder::writeOctetString(const char* value, unsigned char tag) {
+    writeOctetString(std::string_view(value), tag);
+}
+
+void BEREncoder::writeEncoded(const unsigned char* data, size_t length) {
+    buffer.insert(buffer.end(), data, data + length);
+}
+
+void BEREncoder::begin(unsigned char tag) {
+    buffer.push_back(tag);
+    // One octet of length for now; end() widens it if need be
+    open.push_back(buffer.size());
+    buffer.push_back(0);
+}
+
+void BEREncoder::end() {
+    size_t lengthAt = open.back();
+    open.pop_back();
+    size_t length = buffer.size() - lengthAt - 1;
+
+    if (length < 128) {
+        buffer[lengthAt] = static_cast<unsigned char>(length);
+        return;
+    }
+
+    // Long form: move the contents up behind the extra length octets
+    size_t numBytes = 0;
+    for (size_t tmpLen = length; tmpLen > 0; tmpLen >>= 8) {
+        numBytes++;
+    }
+    buffer.resize(buffer.size() + numBytes);
+    std::memmove(buffer.data() + lengthAt + 1 + numBytes, buffer.data() + lengthAt + 1, length);
+
+    buffer[lengthAt] = static_cast<unsigned char>(0x80 | numBytes);
+    for (size_t i = 0; i < numBytes; i++) {
+        buffer[lengthAt + 1 + i] = static_cast<unsigned char>(length >> ((numBytes - 1 - i) * 8));
+    }
 }
@@ -1,18 +1,47 @@
 // BEREncoder - Handles all ASN.1 BER encoding functionality.
+//
+// Elements are written front to back into one buffer, which keeps its
+// memory across clear(), so an encoder reused for every request stops
+// allocating. A constructed element is opened with begin() before its
+// contents are known; end() goes back and fills in its length. Lengths
+// take one octet until the contents pass 127 bytes, and only then are the
+// contents moved up to make room.
 
 #ifndef BER_ENCODER_H
 #define BER_ENCODER_H
 
 #include <vector>
 #include <cstddef>
-#include <string>
+#include <cstdint>
+#include <string_view>
 
 class BEREncoder {
+    private:
+        std::vector<unsigned char> buffer;
+        std::vector<size_t> open;       // where each unfinished element's length goes
+
+        void writeLength(size_t length);
+
     public:
-        static std::vector<unsigned char> encodeInteger(int value);
-        static std::vector<unsigned char> encodeOctetString(const char* str);
-        static std::vector<unsigned char> encodeSequence(const std::vector<unsigned char>& data);
-        static std::vector<unsigned char> encodeLength(size_t len);
+        // Starts over, keeping the memory
+        void clear();
+
+        // Minimal two's complement, any width
+        void writeInteger(int64_t value, unsigned char tag = 0x02);
+        void writeEnumerated(int64_t value);
+        void writeBoolean(bool value, unsigned char tag = 0x01);
+        void writeOctetString(std::string_view value, unsigned char tag = 0x04);
+        void writeOctetString(const char* value, unsigned char tag = 0x04);
+        // Already encoded elements, e.g. a compiled filter
+        void writeEncoded(const unsigned char* data, size_t length);
+
+        // A constructed element, e.g. 0x30 for a SEQUENCE; its contents are
+        // what is written until the matching end()
+        void begin(unsigned char tag);
+        void end();
+
+        // The encoding so far; valid until the next write
+        const std::vector<unsigned char>& bytes() const { return buffer; }
 };
 
 #endif // BER_ENCODER_H
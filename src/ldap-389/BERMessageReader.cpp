@@ -0,0 +1,72 @@
+#include "BERMessageReader.h"
+#include <iostream>
+#include <sys/socket.h>
+#include <cerrno>
+#include <cstring>
+
+BERMessageReader::BERMessageReader(int sock) : sock(sock), buffer(INITIAL_CAPACITY), start(0), end(0) {}
+
+long long BERMessageReader::messageSize() const {
+    size_t available = end - start;
+    if (available < 2) return 0;
+
+    // LDAPMessage ::= SEQUENCE
+    if (buffer[start] != 0x30) return -1;
+
+    size_t length = buffer[start + 1];
+    if (length < 128) {
+        return static_cast<long long>(2 + length);
+    }
+
+    // Long form; LDAP forbids the indefinite one (0x80)
+    size_t numBytes = length & 0x7F;
+    if (numBytes == 0 || numBytes > 4) return -1;
+    if (available < 2 + numBytes) return 0;
+
+    length = 0;
+    for (size_t i = 0; i < numBytes; i++) {
+        length = (length << 8) | buffer[start + 2 + i];
+    }
+    return static_cast<long long>(2 + numBytes + length);
+}
+
+bool BERMessageReader::next(const unsigned char*& message, size_t& length) {
+    while (true) {
+        long long size = messageSize();
+        if (size < 0 || static_cast<unsigned long long>(size) > MAX_MESSAGE_SIZE) {
+            std::cerr << "Bad LDAP message from server" << std::endl;
+            return false;
+        }
+
+        if (size > 0 && end - start >= static_cast<size_t>(size)) {
+            message = buffer.data() + start;
+            length = static_cast<size_t>(size);
+            start += length;
+            return true;
+        }
+
+        // Only part of one message is left: move it to the front, and make
+        // room for all of it if it is bigger than the buffer
+        if (start > 0) {
+            std::memmove(buffer.data(), buffer.data() + start, end - start);
+            end -= start;
+            start = 0;
+        }
+        if (static_cast<size_t>(size) > buffer.size()) {
+            buffer.resize(static_cast<size_t>(size));
+        }
+
+        ssize_t received = recv(sock, buffer.data() + end, buffer.size() - end, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        end += static_cast<size_t>(received);
+    }
+}
+
+size_t BERMessageReader::capacity() const {
+    return buffer.size();
+}
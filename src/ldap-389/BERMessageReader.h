@@ -0,0 +1,37 @@
+// BERMessageReader - Splits the byte stream of an LDAP connection into whole
+// LDAPMessages, using the BER length of each to find where it ends. One
+// buffer is reused for the whole connection: it only grows to hold the
+// largest single message, however many messages a search returns.
+
+#ifndef BER_MESSAGE_READER_H
+#define BER_MESSAGE_READER_H
+
+#include <vector>
+#include <cstddef>
+
+class BERMessageReader {
+    private:
+        int sock;
+        std::vector<unsigned char> buffer;
+        size_t start;           // first byte not yet handed out
+        size_t end;             // one past the last byte received
+
+        // Size of the message at start, header included, once its header is
+        // in; 0 while it is not, -1 if it cannot be an LDAPMessage
+        long long messageSize() const;
+
+    public:
+        static const size_t INITIAL_CAPACITY = 16 * 1024;
+        static const size_t MAX_MESSAGE_SIZE = 16 * 1024 * 1024;
+
+        explicit BERMessageReader(int sock);
+
+        // Waits for the next whole message and points at it; it stays valid
+        // until the following call. False at the end of the stream, on an
+        // error or on a message over MAX_MESSAGE_SIZE.
+        bool next(const unsigned char*& message, size_t& length);
+
+        size_t capacity() const;
+};
+
+#endif // BER_MESSAGE_READER_H
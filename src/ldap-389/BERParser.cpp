@@ -1,84 +1,123 @@
 #include "BERParser.h"
 
-BERParser::BERParser(const std::vector<unsigned char>& data) : data(data), position(0) {}
+unsigned char BERTag::octet() const {
+    if (number >= 31) return 0;
+    return static_cast<unsigned char>(tagClass | (constructed ? 0x20 : 0x00) | number);
+}
+
+BERParser::BERParser() : BERParser(nullptr, 0) {}
+
+BERParser::BERParser(const unsigned char* data, size_t size) : data(data), size(size), position(0), failure(nullptr) {}
 
-unsigned char BERParser::readTag() {
-    if (position >= data.size()) return 0;
-    return data[position++];
+BERParser::BERParser(const std::vector<unsigned char>& data) : BERParser(data.data(), data.size()) {}
+
+bool BERParser::fail(const char* reason) {
+    if (failure == nullptr) {
+        failure = reason;
+    }
+    return false;
+}
+
+bool BERParser::readTag(BERTag& tag) {
+    if (failure) return false;
+    if (position >= size) return fail("tag past the end");
+
+    unsigned char identifier = data[position++];
+    tag.tagClass = identifier & 0xC0;
+    tag.constructed = (identifier & 0x20) != 0;
+    tag.number = identifier & 0x1F;
+    if (tag.number < 31) {
+        return true;
+    }
+
+    // High tag number form: base 128, high bit set on all but the last octet
+    tag.number = 0;
+    for (int octets = 0; ; octets++) {
+        if (position >= size) return fail("tag past the end");
+        if (octets == 4) return fail("tag number too large");
+        unsigned char octet = data[position++];
+        tag.number = (tag.number << 7) | (octet & 0x7F);
+        if ((octet & 0x80) == 0) break;
+    }
+    if (tag.number < 31) return fail("tag number not in its shortest form");
+    return true;
 }
 
-size_t BERParser::readLength() {
-    if (position >= data.size()) return 0;
-    
-    unsigned char len = data[position++];
-    
-    if (len < 128) {
-        return len;
+bool BERParser::readLength(size_t& length) {
+    if (failure) return false;
+    if (position >= size) return fail("length past the end");
+
+    unsigned char first = data[position++];
+    if (first < 128) {
+        length = first;
     } else {
-        int numBytes = len & 0x7F;
-        size_t result = 0;
-        
-        for (int i = 0; i < numBytes; i++) {
-            if (position >= data.size()) return 0;
-            result = (result << 8) | data[position++];
+        size_t numBytes = first & 0x7F;
+        // LDAP (RFC 4511 5.1) only allows definite lengths
+        if (numBytes == 0) return fail("indefinite length");
+        if (numBytes > sizeof(size_t)) return fail("length too large");
+        if (size - position < numBytes) return fail("length past the end");
+
+        length = 0;
+        for (size_t i = 0; i < numBytes; i++) {
+            length = (length << 8) | data[position++];
         }
-        
-        return result;
     }
+
+    if (length > size - position) return fail("element longer than its container");
+    return true;
 }
 
-std::vector<unsigned char> BERParser::readValue(size_t length) {
-    std::vector<unsigned char> result;
-    
-    for (size_t i = 0; i < length && position < data.size(); i++) {
-        result.push_back(data[position++]);
-    }
-    
-    return result;
+bool BERParser::readValue(size_t length, std::string_view& value) {
+    if (failure) return false;
+    if (length > size - position) return fail("value past the end");
+
+    value = std::string_view(reinterpret_cast<const char*>(data + position), length);
+    position += length;
+    return true;
 }
 
-int BERParser::readInteger() {
-    unsigned char tag = readTag();
-    // Not an INTEGER
-    if (tag != 0x02) return 0;
-    
-    size_t len = readLength();
-    std::vector<unsigned char> value = readValue(len);
-    
-    int result = 0;
-    for (unsigned char byte : value) {
-        result = (result << 8) | byte;
-    }
-    
-    return result;
+bool BERParser::readElement(BERTag& tag, std::string_view& value) {
+    size_t length;
+    return readTag(tag) && readLength(length) && readValue(length, value);
 }
 
-std::string BERParser::readOctetString() {
-    unsigned char tag = readTag();
-    // Not an OCTET STRING
-    if (tag != 0x04) return "";
-    
-    size_t len = readLength();
-    std::vector<unsigned char> value = readValue(len);
-    
-    std::string result;
-    for (unsigned char byte : value) {
-        result += static_cast<char>(byte);
-    }
-    
-    return result;
+bool BERParser::readElement(BERTag& tag, BERParser& contents) {
+    std::string_view value;
+    if (!readElement(tag, value)) return false;
+    contents = BERParser(reinterpret_cast<const unsigned char*>(value.data()), value.size());
+    return true;
+}
+
+bool BERParser::skipElement() {
+    BERTag tag;
+    std::string_view value;
+    return readElement(tag, value);
 }
 
-void BERParser::skipEntry() {
-    unsigned char tag = readTag();
-    size_t len = readLength();
-    position += len;
+bool BERParser::readInteger(int64_t& value, unsigned char expected) {
+    BERTag tag;
+    std::string_view bytes;
+    if (!readElement(tag, bytes)) return false;
+    if (tag.octet() != expected) return fail("unexpected tag for an integer");
+    if (bytes.empty()) return fail("empty integer");
+    if (bytes.size() > sizeof(int64_t)) return fail("integer too large");
+
+    // Two's complement, most significant octet first
+    uint64_t result = static_cast<unsigned char>(bytes[0]) & 0x80 ? ~uint64_t(0) : 0;
+    for (char byte : bytes) {
+        result = (result << 8) | static_cast<unsigned char>(byte);
+    }
+    value = static_cast<int64_t>(result);
+    return true;
 }
 
-size_t BERParser::getPosition() const {
-    return position;
+bool BERParser::readEnumerated(int64_t& value) {
+    return readInteger(value, 0x0A);
 }
 
-size_t BERParser::getSize() const {
-    return data.size();
+bool BERParser::readOctetString(std::string_view& value, unsigned char expected) {
+    BERTag tag;
+    if (!readElement(tag, value)) return false;
+    if (tag.octet() != expected) return fail("unexpected tag for an octet string");
+    return true;
 }
@@ -1,29 +1,71 @@
 // BERParser - Handles parsing of BER-encoded responses.
+//
+// The parser reads in place: it only points into bytes owned by the caller,
+// which must outlive it, and values come back as string_views into them.
+// Every read is checked against the end of the data (and of the enclosing
+// element, for nested parsers). A read that fails returns false and leaves
+// the parser failed, so later reads fail too and error() says what went
+// wrong first.
 
 #ifndef BER_PARSER_H
 #define BER_PARSER_H
 
 #include <vector>
-#include <string>
+#include <string_view>
 #include <cstddef>
+#include <cstdint>
+
+// An identifier: class and constructed bits and a tag number, which takes
+// more octets from 31 up (X.690 8.1.2.4)
+struct BERTag {
+    unsigned char tagClass;     // 0x00 universal, 0x40 application, 0x80 context, 0xC0 private
+    bool constructed;
+    uint32_t number;
+
+    // The one identifier octet of a tag numbered below 31, e.g. 0x30 for a
+    // SEQUENCE or 0x64 for a SearchResultEntry; 0 for higher numbers
+    unsigned char octet() const;
+};
 
 class BERParser {
     private:
-        std::vector<unsigned char> data;
+        const unsigned char* data;
+        size_t size;
         size_t position;
-        
+        const char* failure;    // the first error, or null
+
+        bool fail(const char* reason);
+
     public:
-        BERParser(const std::vector<unsigned char>& data);
-        
-        unsigned char readTag();
-        size_t readLength();
-        std::vector<unsigned char> readValue(size_t length);
-        int readInteger();
-        std::string readOctetString();
-        void skipEntry();
-        
-        size_t getPosition() const;
-        size_t getSize() const;
+        BERParser();
+        BERParser(const unsigned char* data, size_t size);
+        explicit BERParser(const std::vector<unsigned char>& data);
+        // Would point into a temporary
+        explicit BERParser(std::vector<unsigned char>&&) = delete;
+
+        bool readTag(BERTag& tag);
+        // A definite length that fits in what is left
+        bool readLength(size_t& length);
+        bool readValue(size_t length, std::string_view& value);
+
+        // A whole element: its tag and its contents
+        bool readElement(BERTag& tag, std::string_view& value);
+        // A whole element, with a parser over its contents
+        bool readElement(BERTag& tag, BERParser& contents);
+        bool skipElement();
+
+        // Elements of an expected single-octet tag
+        bool readInteger(int64_t& value, unsigned char expected = 0x02);
+        bool readEnumerated(int64_t& value);
+        bool readOctetString(std::string_view& value, unsigned char expected = 0x04);
+
+        bool atEnd() const { return failure != nullptr || position >= size; }
+        bool failed() const { return failure != nullptr; }
+        const char* error() const { return failure ? failure : ""; }
+
+        size_t getPosition() const { return position; }
+        size_t getSize() const { return size; }
+        const unsigned char* current() const { return data + position; }
 };
 
 #endif // BER_PARSER_H
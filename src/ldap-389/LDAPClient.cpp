@@ -1,14 +1,18 @@
 #include "LDAPClient.h"
 #include "BEREncoder.h"
 #include "BERParser.h"
+#include "BERMessageReader.h"
+#include "LDAPFilter.h"
+#include "LDAPSearchCache.h"
 #include <iostream>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <cstring>
+#include <cerrno>
 #include <algorithm>
 
-LDAPClient::LDAPClient() : sock(-1), messageID(1) {}
+LDAPClient::LDAPClient() : sock(-1), messageID(0), connected(false), sizeLimit(0), timeLimit(0) {}
 
 LDAPClient::~LDAPClient() {
     close();
@@ -29,390 +33,310 @@ bool LDAPClient::connect(const char* host, int port) {
     // Connection - using :: to specify global namespace
     if (::connect(sock, (struct sockaddr *)&server, sizeof(server)) < 0) {
         std::cerr << "Connect failed" << std::endl;
+        ::close(sock);
+        sock = -1;
         return false;
     }
     
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        connected = true;
+    }
+    reader = std::thread(&LDAPClient::readResponses, this);
+    
     std::cout << "Connected to " << host << ":" << port << std::endl;
     return true;
 }
 
-std::vector<unsigned char> LDAPClient::createLDAPBindRequest(int messageID, const char* bindDN, const char* password) {
-    std::vector<unsigned char> result;
-    
-    // Message ID
-    std::vector<unsigned char> messageIDBytes = BEREncoder::encodeInteger(messageID);
-    
-    // Bind Request components
-    std::vector<unsigned char> bindRequestComponents;
-    
-    // Version (INTEGER 3)
-    bindRequestComponents.push_back(0x02);
-    bindRequestComponents.push_back(0x01);
-    bindRequestComponents.push_back(0x03);
-    
-    // Bind DN (OCTET STRING)
-    std::vector<unsigned char> bindDNBytes = BEREncoder::encodeOctetString(bindDN);
-    bindRequestComponents.insert(bindRequestComponents.end(), bindDNBytes.begin(), bindDNBytes.end());
-    
-    // Authentication (OCTET STRING)
-    
-    bindRequestComponents.push_back(0x80);
-    bindRequestComponents.push_back(static_cast<unsigned char>(strlen(password)));
-    for (size_t i = 0; i < strlen(password); i++) {
-        bindRequestComponents.push_back(static_cast<unsigned char>(password[i]));
+int LDAPClient::reserveMessageID() {
+    std::unique_lock<std::mutex> lock(pendingMutex);
+    idFreed.wait(lock, [this] { return !connected || pending.size() < MAX_IN_FLIGHT; });
+    if (!connected) {
+        return -1;
     }
     
-    // Wrap bind request components
-    std::vector<unsigned char> bindRequestSequence;
-    
-    // BIND REQUEST tag
-    bindRequestSequence.push_back(LDAP_BIND_REQUEST);
-    
-    std::vector<unsigned char> lengthBytes = BEREncoder::encodeLength(bindRequestComponents.size());
-    bindRequestSequence.insert(bindRequestSequence.end(), lengthBytes.begin(), lengthBytes.end());
-    
-    bindRequestSequence.insert(bindRequestSequence.end(), 
-                              bindRequestComponents.begin(), 
-                              bindRequestComponents.end());
-    
-    // Combine messageID and bindRequestSequence into final result
-    result.insert(result.end(), messageIDBytes.begin(), messageIDBytes.end());
-    result.insert(result.end(), bindRequestSequence.begin(), bindRequestSequence.end());
-    
-    // Wrap everything in a SEQUENCE
-    return BEREncoder::encodeSequence(result);
+    // The next ID not still waiting for its response
+    do {
+        messageID = messageID == MAX_MESSAGE_ID ? 1 : messageID + 1;
+    } while (pending.count(messageID) != 0);
+    pending[messageID];
+    return messageID;
 }
 
-std::vector<unsigned char> LDAPClient::createEqualityFilter(const std::string& attribute, const std::string& value) {
-    std::vector<unsigned char> filterBytes;
-    
-    // Context specific tag [3] for equality match
-    filterBytes.push_back(LDAP_FILTER_EQUALITY);
-    
-    // Construct filter sequence: attribute name + value
-    std::vector<unsigned char> filterSeq;
-    
-    // Attribute name
-    std::vector<unsigned char> attrBytes = BEREncoder::encodeOctetString(attribute.c_str());
-    filterSeq.insert(filterSeq.end(), attrBytes.begin(), attrBytes.end());
-    
-    // Value
-    std::vector<unsigned char> valueBytes = BEREncoder::encodeOctetString(value.c_str());
-    filterSeq.insert(filterSeq.end(), valueBytes.begin(), valueBytes.end());
-    
-    // Add length to filter
-    std::vector<unsigned char> lenBytes = BEREncoder::encodeLength(filterSeq.size());
-    filterBytes.insert(filterBytes.end(), lenBytes.begin(), lenBytes.end());
-    
-    // Add filter sequence to filterBytes
-    filterBytes.insert(filterBytes.end(), filterSeq.begin(), filterSeq.end());
+std::future<LDAPResponse> LDAPClient::submit(int id, const std::vector<unsigned char>& request, EntryCallback onEntry) {
+    std::future<LDAPResponse> response;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        auto entry = pending.find(id);
+        if (entry == pending.end()) {
+            // Never reserved, or the connection failed meanwhile
+            std::promise<LDAPResponse> failed;
+            failed.set_value(LDAPResponse());
+            return failed.get_future();
+        }
+        response = entry->second.promise.get_future();
+        entry->second.onEntry = std::move(onEntry);
+    }
     
-    return filterBytes;
+    std::lock_guard<std::mutex> lock(sendMutex);
+    size_t sent = 0;
+    while (sent < request.size()) {
+        ssize_t result = send(sock, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            std::cerr << "Send failed" << std::endl;
+            // The reader sees the connection end and fails every request
+            shutdown(sock, SHUT_RDWR);
+            break;
+        }
+        sent += static_cast<size_t>(result);
+    }
+    return response;
 }
 
-std::vector<unsigned char> LDAPClient::createSubstringFilter(const std::string& attribute, const std::string& value) {
-    std::vector<unsigned char> filterBytes;
-    
-    // Context specific tag [4] for substring match
-    filterBytes.push_back(LDAP_FILTER_SUBSTRING);
-    
-    // Construct filter sequence
-    std::vector<unsigned char> filterSeq;
-    
-    // Attribute name
-    std::vector<unsigned char> attrBytes = BEREncoder::encodeOctetString(attribute.c_str());
-    filterSeq.insert(filterSeq.end(), attrBytes.begin(), attrBytes.end());
-    
-    // Substrings - filter with *value*
-    std::vector<unsigned char> substringsSeq;
-    
-    // Context specific tag [1] for "any" substring
-    substringsSeq.push_back(0x81);
-    substringsSeq.push_back(static_cast<unsigned char>(value.length()));
-    for (char c : value) {
-        substringsSeq.push_back(static_cast<unsigned char>(c));
+// Runs on the reader thread until the connection ends. Entries are handed
+// on as they arrive, so only one message at a time is held in raw form.
+void LDAPClient::readResponses() {
+    BERMessageReader reader(sock);
+    const unsigned char* bytes;
+    size_t length;
+    
+    while (reader.next(bytes, length)) {
+        // LDAPMessage ::= SEQUENCE { messageID, protocolOp, controls OPTIONAL }
+        BERParser message(bytes, length);
+        BERParser fields;
+        BERParser contents;
+        BERTag tag;
+        BERTag operation;
+        int64_t receivedID;
+        if (!message.readElement(tag, fields) || !fields.readInteger(receivedID) ||
+            !fields.readElement(operation, contents)) {
+            // Nothing after it can be trusted to be framed right
+            std::cerr << "Bad LDAP message from server: " << message.error() << fields.error() << std::endl;
+            break;
+        }
+        if (receivedID < 0 || receivedID > MAX_MESSAGE_ID) {
+            // Would alias another request's ID if narrowed
+            std::cerr << "Bad LDAP message from server: messageID " << receivedID << " out of range" << std::endl;
+            break;
+        }
+        int id = static_cast<int>(receivedID);
+        
+        if (operation.octet() == LDAP_SEARCH_RESULT_REFERENCE) {
+            // Continuation references name other servers; not followed
+            continue;
+        }
+        
+        if (operation.octet() == LDAP_SEARCH_RESULT_ENTRY) {
+            // Only this thread removes requests, so it may use one unlocked
+            PendingRequest* request = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                auto entry = pending.find(id);
+                if (entry != pending.end()) {
+                    request = &entry->second;
+                }
+            }
+            if (request == nullptr) {
+                continue;
+            }
+            
+            LDAPEntryView view(contents.current(), contents.getSize());
+            if (request->onEntry) {
+                request->onEntry(view);
+            } else {
+                request->response.entries.push_back(view.toContact());
+            }
+            continue;
+        }
+        
+        // Any other operation ends the request; its LDAPResult starts with
+        // the resultCode (ENUMERATED)
+        int64_t resultCode = LDAP_CONNECTION_FAILED;
+        if (!contents.readEnumerated(resultCode)) {
+            std::cerr << "Bad LDAP result from server: " << contents.error() << std::endl;
+            resultCode = LDAP_CONNECTION_FAILED;
+        }
+        
+        std::unique_lock<std::mutex> lock(pendingMutex);
+        auto entry = pending.find(id);
+        if (entry == pending.end()) {
+            // Unsolicited, e.g. a Notice of Disconnection (messageID 0)
+            continue;
+        }
+        
+        std::promise<LDAPResponse> promise = std::move(entry->second.promise);
+        LDAPResponse finished = std::move(entry->second.response);
+        finished.resultCode = static_cast<int>(resultCode);
+        if (!readControls(fields, finished.controls)) {
+            std::cerr << "Bad LDAP controls from server: " << fields.error() << std::endl;
+        }
+        pending.erase(entry);
+        lock.unlock();
+        
+        idFreed.notify_one();
+        promise.set_value(std::move(finished));
     }
     
-    // Wrap substrings in a SEQUENCE
-    std::vector<unsigned char> substringsWrapper = BEREncoder::encodeSequence(substringsSeq);
-    filterSeq.insert(filterSeq.end(), substringsWrapper.begin(), substringsWrapper.end());
-    
-    // Add length to filter
-    std::vector<unsigned char> lenBytes = BEREncoder::encodeLength(filterSeq.size());
-    filterBytes.insert(filterBytes.end(), lenBytes.begin(), lenBytes.end());
-    
-    // Add filter sequence to filterBytes
-    filterBytes.insert(filterBytes.end(), filterSeq.begin(), filterSeq.end());
-    
-    return filterBytes;
+    failPending();
 }
 
-std::vector<unsigned char> LDAPClient::createORFilter(const std::vector<std::vector<unsigned char>>& filters) {
-    std::vector<unsigned char> orFilterComponents;
-    
-    // Combine all filters
-    for (const auto& filter : filters) {
-        orFilterComponents.insert(orFilterComponents.end(), filter.begin(), filter.end());
+void LDAPClient::failPending() {
+    std::map<int, PendingRequest> failed;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        connected = false;
+        failed.swap(pending);
     }
+    idFreed.notify_all();
     
-    std::vector<unsigned char> orFilter;
+    // Entries that did arrive are kept; resultCode says they are not all
+    for (auto& entry : failed) {
+        entry.second.response.resultCode = LDAP_CONNECTION_FAILED;
+        entry.second.promise.set_value(std::move(entry.second.response));
+    }
+}
 
-    // Context specific tag [1] for OR
-    orFilter.push_back(LDAP_FILTER_OR);
-    
-    // Add length
-    std::vector<unsigned char> lenBytes = BEREncoder::encodeLength(orFilterComponents.size());
-    orFilter.insert(orFilter.end(), lenBytes.begin(), lenBytes.end());
-    
-    // Add components
-    orFilter.insert(orFilter.end(), orFilterComponents.begin(), orFilterComponents.end());
-    
-    return orFilter;
+void LDAPClient::setLimits(int sizeLimit, int timeLimit) {
+    this->sizeLimit = sizeLimit;
+    this->timeLimit = timeLimit;
 }
 
-std::vector<unsigned char> LDAPClient::createLDAPSearchRequest(
-    int messageID, const char* baseDN, 
-    const char* filter, 
-    const std::vector<std::string>& attributes,
-    int scope
-) {
-    std::vector<unsigned char> result;
-    
-    // Message ID
-    std::vector<unsigned char> messageIDBytes = BEREncoder::encodeInteger(messageID);
-    
-    // Search Request components
-    std::vector<unsigned char> searchRequestComponents;
-    
-    // Base DN (OCTET STRING)
-    std::vector<unsigned char> baseDNBytes = BEREncoder::encodeOctetString(baseDN);
-    searchRequestComponents.insert(searchRequestComponents.end(), baseDNBytes.begin(), baseDNBytes.end());
-    
-    // Scope (ENUMERATED)
-    searchRequestComponents.push_back(0x0A);
-    searchRequestComponents.push_back(0x01);
-    searchRequestComponents.push_back(static_cast<unsigned char>(scope));
-    
-    // Deref Aliases (ENUMERATED 3 = derefAlways)
-    searchRequestComponents.push_back(0x0A);
-    searchRequestComponents.push_back(0x01);
-    searchRequestComponents.push_back(0x03);
-    
-    // Size Limit (INTEGER 0 = no limit)
-    searchRequestComponents.push_back(0x02);
-    searchRequestComponents.push_back(0x01);
-    searchRequestComponents.push_back(0x00);
-    
-    // Time Limit (INTEGER 0 = no limit)
-    searchRequestComponents.push_back(0x02);
-    searchRequestComponents.push_back(0x01);
-    searchRequestComponents.push_back(0x00);
+void LDAPClient::setCache(std::shared_ptr<LDAPSearchCache> cache) {
+    this->cache = std::move(cache);
+}
+
+bool LDAPClient::isConnected() {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    return connected;
+}
+
+size_t LDAPClient::inFlight() {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    return pending.size();
+}
+
+BEREncoder& LDAPClient::requestEncoder() {
+    // One per thread, as any thread may submit
+    static thread_local BEREncoder encoder;
+    encoder.clear();
+    return encoder;
+}
+
+void LDAPClient::encodeBindRequest(BEREncoder& request, int messageID, const char* bindDN, const char* password) {
+    // LDAPMessage SEQUENCE { messageID, BindRequest }
+    request.begin(0x30);
+    request.writeInteger(messageID);
     
-    // Types Only (BOOLEAN false)
-    searchRequestComponents.push_back(0x01);
-    searchRequestComponents.push_back(0x01);
-    searchRequestComponents.push_back(0x00);
+    request.begin(LDAP_BIND_REQUEST);
+    // Version (INTEGER 3)
+    request.writeInteger(3);
+    request.writeOctetString(bindDN);
+    // Authentication: simple [0] password
+    request.writeOctetString(password, 0x80);
+    request.end();
     
-    // Filter
-    if (std::string(filter) == "(objectClass=*)") {
-        // Present filter for (objectClass=*)
-        searchRequestComponents.push_back(0x87);
-        
-        // Length of "objectClass"
-        searchRequestComponents.push_back(0x0B);
-        for (char c : std::string("objectClass")) {
-            searchRequestComponents.push_back(static_cast<unsigned char>(c));
-        }
-    } else {
-        // For simple filter: (cn=<filter>)
-        std::vector<unsigned char> filterBytes = createEqualityFilter("cn", filter);
-        searchRequestComponents.insert(searchRequestComponents.end(), filterBytes.begin(), filterBytes.end());
+    request.end();
+}
+
+void LDAPClient::encodeControls(BEREncoder& request, const std::vector<LDAPControl>& controls) {
+    // controls [0] Controls OPTIONAL, after the protocolOp
+    if (controls.empty()) {
+        return;
     }
     
-    // Attributes to return (SEQUENCE OF OCTET STRING)
-    std::vector<unsigned char> attrsSequence;
-    
-    for (const auto& attr : attributes) {
-        std::vector<unsigned char> attrBytes = BEREncoder::encodeOctetString(attr.c_str());
-        attrsSequence.insert(attrsSequence.end(), attrBytes.begin(), attrBytes.end());
+    request.begin(0xA0);
+    for (const auto& control : controls) {
+        request.begin(0x30);
+        request.writeOctetString(control.type);
+        // Criticality is FALSE unless written
+        if (control.critical) {
+            request.writeBoolean(true);
+        }
+        if (!control.value.empty()) {
+            request.writeOctetString(control.value);
+        }
+        request.end();
     }
-    
-    // Wrap attributes in a SEQUENCE
-    std::vector<unsigned char> attrsWrapper = BEREncoder::encodeSequence(attrsSequence);
-    searchRequestComponents.insert(searchRequestComponents.end(), attrsWrapper.begin(), attrsWrapper.end());
-    
-    // Wrap search request components in a SEQUENCE with SEARCH REQUEST tag (0x63)
-    std::vector<unsigned char> searchRequestSequence;
-    searchRequestSequence.push_back(LDAP_SEARCH_REQUEST);
-    
-    std::vector<unsigned char> reqLenBytes = BEREncoder::encodeLength(searchRequestComponents.size());
-    searchRequestSequence.insert(searchRequestSequence.end(), reqLenBytes.begin(), reqLenBytes.end());
-    
-    searchRequestSequence.insert(searchRequestSequence.end(), 
-                                searchRequestComponents.begin(), 
-                                searchRequestComponents.end());
-    
-    // Combine messageID and searchRequestSequence into final result
-    result.insert(result.end(), messageIDBytes.begin(), messageIDBytes.end());
-    result.insert(result.end(), searchRequestSequence.begin(), searchRequestSequence.end());
-    
-    // Wrap everything in a SEQUENCE
-    return BEREncoder::encodeSequence(result);
+    request.end();
 }
 
-std::string LDAPClient::parseLDAPSearchResponse(const std::vector<unsigned char>& response) {
-    std::string result;
-    BERParser parser(response);
-    
-    // Skip the outer SEQUENCE
-    parser.readTag();
-    parser.readLength();
-    
-    // Skip the Message ID
-    parser.readInteger();
+bool LDAPClient::readControls(BERParser& fields, std::vector<LDAPControl>& controls) {
+    BERParser list;
+    BERParser fieldsOf;
+    BERTag tag;
+    if (fields.atEnd()) {
+        return !fields.failed();
+    }
+    if (!fields.readElement(tag, list) || tag.octet() != 0xA0) {
+        return false;
+    }
     
-    while (parser.getPosition() < parser.getSize()) {
-        unsigned char tag = parser.readTag();
-        size_t len = parser.readLength();
+    // Control ::= SEQUENCE { controlType, criticality DEFAULT FALSE, controlValue OPTIONAL }
+    while (!list.atEnd()) {
+        LDAPControl control{std::string(), false, std::string()};
+        std::string_view type;
+        if (!list.readElement(tag, fieldsOf) || !fieldsOf.readOctetString(type)) {
+            return false;
+        }
+        control.type = std::string(type);
         
-        // Check if this is a search result entry
-        if (tag == LDAP_SEARCH_RESULT_ENTRY) {
-            size_t entryEnd = parser.getPosition() + len;
-            
-            // Skip the object name
-            parser.skipEntry();
-            
-            // Read attributes (SEQUENCE OF SEQUENCE)
-            unsigned char attrsTag = parser.readTag();
-            parser.readLength();
-            
-            while (parser.getPosition() < entryEnd) {
-                // Each attribute is a SEQUENCE
-                parser.readTag();
-                parser.readLength();
-                
-                // Read attribute type
-                std::string attrType = parser.readOctetString();
-                
-                // Read attribute values (SET OF OCTET STRING)
-                parser.readTag();
-                parser.readLength();
-                
-                // Read the first value
-                std::string attrValue = parser.readOctetString();
-                
-                if (attrType == "telephoneNumber") {
-                    result = attrValue;
-                }
+        std::string_view value;
+        while (!fieldsOf.atEnd() && fieldsOf.readElement(tag, value)) {
+            if (tag.octet() == 0x01) {
+                control.critical = !value.empty() && value[0] != 0;
+            } else if (tag.octet() == 0x04) {
+                control.value = std::string(value);
             }
-        } else if (tag == LDAP_SEARCH_RESULT_DONE) {
-            // Read the result code
-            parser.readInteger();
-            break;
-        } else {
-            parser.readValue(len);
         }
+        if (fieldsOf.failed()) {
+            return false;
+        }
+        controls.push_back(std::move(control));
     }
-    
-    return result;
+    return !list.failed();
 }
 
-std::vector<Contact> LDAPClient::parseLDAPSearchResponseMultiple(const std::vector<unsigned char>& response) {
-    std::vector<Contact> contacts;
-    BERParser parser(response);
+void LDAPClient::encodeSearchRequest(BEREncoder& request, int messageID, const char* baseDN, int scope, const LDAPFilter& filter,
+                                     const std::vector<std::string>& attributes, const std::vector<LDAPControl>& controls) {
+    // LDAPMessage SEQUENCE { messageID, SearchRequest }
+    request.begin(0x30);
+    request.writeInteger(messageID);
+    
+    request.begin(LDAP_SEARCH_REQUEST);
+    request.writeOctetString(baseDN);
+    request.writeEnumerated(scope);
+    // Deref Aliases (3 = derefAlways)
+    request.writeEnumerated(3);
+    // Size and time limits (0 = no limit)
+    request.writeInteger(sizeLimit);
+    request.writeInteger(timeLimit);
+    // Types Only
+    request.writeBoolean(false);
+    // The filter, compiled once already
+    request.writeEncoded(filter.bytes().data(), filter.bytes().size());
     
-    // Skip the outer SEQUENCE
-    parser.readTag();
-    parser.readLength();
-    
-    // Skip the Message ID
-    parser.readInteger();
-    
-    while (parser.getPosition() < parser.getSize()) {
-        unsigned char tag = parser.readTag();
-        size_t len = parser.readLength();
-        size_t entryEnd = parser.getPosition() + len;
-        
-        // Check if this is a search result entry
-        if (tag == LDAP_SEARCH_RESULT_ENTRY) {
-            Contact contact;
-            
-            // Read the object name (DN)
-            contact.dn = parser.readOctetString();
-            
-            // Read attributes sequence tag and length
-            parser.readTag();
-            size_t attrsLen = parser.readLength();
-            size_t attrsEnd = parser.getPosition() + attrsLen;
-            
-            // Process all attributes
-            while (parser.getPosition() < attrsEnd) {
-                // Each attribute is a SEQUENCE
-                parser.readTag();
-                parser.readLength();
-                
-                // Read attribute type
-                std::string attrType = parser.readOctetString();
-                
-                // Read attribute values (SET OF OCTET STRING)
-                parser.readTag();
-                size_t valuesLen = parser.readLength();
-                size_t valuesEnd = parser.getPosition() + valuesLen;
-                
-                std::vector<std::string> values;
-                while (parser.getPosition() < valuesEnd) {
-                    std::string attrValue = parser.readOctetString();
-                    values.push_back(attrValue);
-                }
-                
-                // Store all attributes in the map
-                contact.attributes[attrType] = values;
-                
-                // Store common attributes in easy-to-access fields
-                if (attrType == "cn" && !values.empty()) {
-                    contact.name = values[0];
-                } else if (attrType == "telephoneNumber" && !values.empty()) {
-                    contact.phoneNumber = values[0];
-                }
-            }
-            
-            contacts.push_back(contact);
-        } else if (tag == LDAP_SEARCH_RESULT_DONE) {
-            // Read the result code
-            int resultCode = parser.readInteger();
-            if (resultCode != 0) {
-                std::cerr << "LDAP search failed with result code: " << resultCode << std::endl;
-            }
-            break;
-        } else {
-            parser.readValue(len);
-        }
+    // Attributes to return (SEQUENCE OF OCTET STRING)
+    request.begin(0x30);
+    for (const auto& attr : attributes) {
+        request.writeOctetString(attr);
     }
+    request.end();
+    request.end();
     
-    return contacts;
+    encodeControls(request, controls);
+    request.end();
 }
 
 bool LDAPClient::bind(const char* bindDN, const char* password) {
-    std::vector<unsigned char> bindRequest = createLDAPBindRequest(messageID++, bindDN, password);
-    
-    // Send the bind request
-    if (send(sock, bindRequest.data(), bindRequest.size(), 0) < 0) {
-        std::cerr << "Send failed" << std::endl;
-        return false;
-    }
+    int id = reserveMessageID();
+    BEREncoder& request = requestEncoder();
+    encodeBindRequest(request, id, bindDN, password);
+    LDAPResponse response = submit(id, request.bytes()).get();
     
-    // Receive response
-    std::vector<unsigned char> response(1024, 0);
-    int recvSize = recv(sock, response.data(), response.size(), 0);
-    
-    if (recvSize < 0) {
-        std::cerr << "Receive failed" << std::endl;
-        return false;
-    }
-    
-    response.resize(recvSize);
-    
-    if (response.size() > 0 && response[0] == 0x30) {
+    if (response.resultCode == LDAP_SUCCESS) {
         std::cout << "Bind successful" << std::endl;
         return true;
     } else {
@@ -422,176 +346,145 @@ bool LDAPClient::bind(const char* bindDN, const char* password) {
 }
 
 std::string LDAPClient::search(const char* baseDN, const char* filter) {
-    std::vector<std::string> attributes = {"telephoneNumber"};
-    std::vector<unsigned char> searchRequest = createLDAPSearchRequest(messageID++, baseDN, filter, attributes);
-    
-    // Send the search request
-    if (send(sock, searchRequest.data(), searchRequest.size(), 0) < 0) {
-        std::cerr << "Send failed" << std::endl;
-        return "";
+    return searchAsync(baseDN, filter).get();
+}
+
+std::vector<Contact> LDAPClient::searchAll(const char* baseDN, const char* filter) {
+    return searchAllAsync(baseDN, filter).get();
+}
+
+std::vector<Contact> LDAPClient::advancedSearch(const char* baseDN, const std::string& nameFilter, const std::string& phoneFilter) {
+    return advancedSearchAsync(baseDN, nameFilter, phoneFilter).get();
+}
+
+// The entries of a search, once it is done
+static std::future<std::vector<Contact>> contactsOf(std::future<LDAPResponse> pending) {
+    return std::async(std::launch::deferred, [pending = std::move(pending)]() mutable {
+        LDAPResponse response = pending.get();
+        if (response.resultCode == LDAP_CONNECTION_FAILED) {
+            std::cerr << "Receive failed" << std::endl;
+        } else if (response.resultCode != LDAP_SUCCESS) {
+            std::cerr << "LDAP search failed with result code: " << response.resultCode << std::endl;
+        }
+        return std::move(response.entries);
+    });
+}
+
+std::future<LDAPResponse> LDAPClient::submitSearch(const char* baseDN, const std::string& filter, const std::vector<std::string>& attributes,
+                                               EntryCallback onEntry, const std::vector<LDAPControl>& controls) {
+    std::shared_ptr<const LDAPFilter> compiled = LDAPFilter::compile(filter);
+    if (!compiled->isValid()) {
+        std::cerr << "Bad search filter " << filter << ": " << compiled->error() << std::endl;
+        std::promise<LDAPResponse> failed;
+        LDAPResponse response;
+        response.resultCode = LDAP_FILTER_ERROR;
+        failed.set_value(std::move(response));
+        return failed.get_future();
     }
     
-    std::vector<unsigned char> response(2048, 0);
-    int recvSize = recv(sock, response.data(), response.size(), 0);
+    // Streamed entries are not kept, so there would be nothing to cache, and
+    // a page is only part of a result
+    std::string key;
+    if (cache && !onEntry && controls.empty()) {
+        key = LDAPSearchCache::keyOf(baseDN, LDAP_SCOPE_SUBTREE, sizeLimit, timeLimit, filter, attributes);
+        std::shared_ptr<const LDAPResponse> cached = cache->find(key);
+        if (cached) {
+            std::promise<LDAPResponse> hit;
+            hit.set_value(*cached);
+            return hit.get_future();
+        }
+    }
     
-    if (recvSize < 0) {
-        std::cerr << "Receive failed" << std::endl;
-        return "";
+    int id = reserveMessageID();
+    BEREncoder& request = requestEncoder();
+    encodeSearchRequest(request, id, baseDN, LDAP_SCOPE_SUBTREE, *compiled, attributes, controls);
+    std::future<LDAPResponse> pending = submit(id, request.bytes(), std::move(onEntry));
+    if (key.empty()) {
+        return pending;
     }
     
-    response.resize(recvSize);
+    return std::async(std::launch::deferred, [pending = std::move(pending), cache = cache, key = std::move(key)]() mutable {
+        LDAPResponse response = pending.get();
+        cache->store(key, response);
+        return response;
+    });
+}
+
+std::future<std::string> LDAPClient::searchAsync(const char* baseDN, const char* filter) {
+    std::future<LDAPResponse> pending = submitSearch(baseDN, filter, {"telephoneNumber"});
     
-    // Parse the response to extract the telephone number
-    return parseLDAPSearchResponse(response);
+    return std::async(std::launch::deferred, [pending = std::move(pending)]() mutable {
+        LDAPResponse response = pending.get();
+        if (response.resultCode == LDAP_CONNECTION_FAILED) {
+            std::cerr << "Receive failed" << std::endl;
+        }
+        
+        // The telephone number of the first entry that has one
+        for (const auto& contact : response.entries) {
+            if (!contact.phoneNumber.empty()) {
+                return contact.phoneNumber;
+            }
+        }
+        return std::string();
+    });
 }
 
-std::vector<Contact> LDAPClient::searchAll(const char* baseDN, const char* filter) {
-    std::vector<std::string> attributes = {"cn", "telephoneNumber"};
+std::future<int> LDAPClient::searchEach(const char* baseDN, const char* filter, const std::vector<std::string>& attributes, EntryCallback onEntry) {
+    std::future<LDAPResponse> pending = submitSearch(baseDN, filter, attributes, std::move(onEntry));
     
+    return std::async(std::launch::deferred, [pending = std::move(pending)]() mutable {
+        return pending.get().resultCode;
+    });
+}
+
+std::future<LDAPResponse> LDAPClient::searchPageAsync(const char* baseDN, const char* filter, const std::vector<std::string>& attributes,
+                                                  int pageSize, const std::string& cookie, EntryCallback onEntry) {
+    // realSearchControlValue ::= SEQUENCE { size INTEGER, cookie OCTET STRING }
+    BEREncoder value;
+    value.begin(0x30);
+    value.writeInteger(pageSize);
+    value.writeOctetString(cookie);
+    value.end();
+    
+    LDAPControl paged{LDAP_CONTROL_PAGED_RESULTS, false, std::string(value.bytes().begin(), value.bytes().end())};
+    return submitSearch(baseDN, filter, attributes, std::move(onEntry), {paged});
+}
+
+std::future<std::vector<Contact>> LDAPClient::searchAllAsync(const char* baseDN, const char* filter) {
     // If no filter provided, use objectClass=* to get all entries
     const char* searchFilter = filter ? filter : "(objectClass=*)";
     
-    std::vector<unsigned char> searchRequest = createLDAPSearchRequest(messageID++, baseDN, searchFilter, attributes, LDAP_SCOPE_SUBTREE);
-    
-    // Search request
-    if (send(sock, searchRequest.data(), searchRequest.size(), 0) < 0) {
-        std::cerr << "Send failed" << std::endl;
-        return {};
-    }
-    
-    std::vector<unsigned char> response(8192, 0);
-    int recvSize = recv(sock, response.data(), response.size(), 0);
-    
-    if (recvSize < 0) {
-        std::cerr << "Receive failed" << std::endl;
-        return {};
-    }
-    
-    response.resize(recvSize);
-    
-    return parseLDAPSearchResponseMultiple(response);
+    return contactsOf(submitSearch(baseDN, searchFilter, {"cn", "telephoneNumber"}));
 }
 
-std::vector<Contact> LDAPClient::advancedSearch(const char* baseDN, const std::string& nameFilter, const std::string& phoneFilter) {
-    std::vector<std::vector<unsigned char>> filters;
-    std::vector<std::string> attributes = {"cn", "telephoneNumber"};
-    
-    // Create filters based on provided criteria
-    if (!nameFilter.empty()) {
-        filters.push_back(createSubstringFilter("cn", nameFilter));
-    }
-    
-    if (!phoneFilter.empty()) {
-        filters.push_back(createSubstringFilter("telephoneNumber", phoneFilter));
-    }
-    
+std::future<std::vector<Contact>> LDAPClient::advancedSearchAsync(const char* baseDN, const std::string& nameFilter, const std::string& phoneFilter) {
     // If no filters provided, return all contacts
-    if (filters.empty()) {
-        return searchAll(baseDN);
-    }
-    
-    // Create OR filter if multiple conditions
-    std::vector<unsigned char> finalFilter;
-    if (filters.size() > 1) {
-        finalFilter = createORFilter(filters);
-    } else {
-        finalFilter = filters[0];
+    if (nameFilter.empty() && phoneFilter.empty()) {
+        return searchAllAsync(baseDN);
     }
     
-    // Create custom search request with the OR filter
-    std::vector<unsigned char> result;
-    
-    // Message ID
-    std::vector<unsigned char> messageIDBytes = BEREncoder::encodeInteger(messageID++);
-    
-    // Search Request components
-    std::vector<unsigned char> searchRequestComponents;
-    
-    // Base DN (OCTET STRING)
-    std::vector<unsigned char> baseDNBytes = BEREncoder::encodeOctetString(baseDN);
-    searchRequestComponents.insert(searchRequestComponents.end(), baseDNBytes.begin(), baseDNBytes.end());
-    
-    // Scope (ENUMERATED 2 = subtree)
-    searchRequestComponents.push_back(0x0A);
-    searchRequestComponents.push_back(0x01);
-    searchRequestComponents.push_back(0x02);
-    
-    // Deref Aliases (ENUMERATED 3 = derefAlways)
-    searchRequestComponents.push_back(0x0A);
-    searchRequestComponents.push_back(0x01);
-    searchRequestComponents.push_back(0x03);
-    
-    // Size Limit (INTEGER 0 = no limit)
-    searchRequestComponents.push_back(0x02);
-    searchRequestComponents.push_back(0x01);
-    searchRequestComponents.push_back(0x00);
-    
-    // Time Limit (INTEGER 0 = no limit)
-    searchRequestComponents.push_back(0x02);
-    searchRequestComponents.push_back(0x01);
-    searchRequestComponents.push_back(0x00);
-    
-    // Types Only (BOOLEAN false)
-    searchRequestComponents.push_back(0x01);
-    searchRequestComponents.push_back(0x01);
-    searchRequestComponents.push_back(0x00);
-    
-    // Add the custom filter
-    searchRequestComponents.insert(searchRequestComponents.end(), finalFilter.begin(), finalFilter.end());
-    
-    // Attributes to return (SEQUENCE OF OCTET STRING)
-    std::vector<unsigned char> attrsSequence;
-    
-    for (const auto& attr : attributes) {
-        std::vector<unsigned char> attrBytes = BEREncoder::encodeOctetString(attr.c_str());
-        attrsSequence.insert(attrsSequence.end(), attrBytes.begin(), attrBytes.end());
+    // Either contains its value; an OR of both if both are given
+    std::string filter;
+    if (!nameFilter.empty()) {
+        filter += "(cn=*" + LDAPFilter::escape(nameFilter) + "*)";
     }
-    
-    // Wrap attributes in a SEQUENCE
-    std::vector<unsigned char> attrsWrapper = BEREncoder::encodeSequence(attrsSequence);
-    searchRequestComponents.insert(searchRequestComponents.end(), attrsWrapper.begin(), attrsWrapper.end());
-    
-    // Wrap search request components in a SEQUENCE with SEARCH REQUEST tag
-    std::vector<unsigned char> searchRequestSequence;
-    searchRequestSequence.push_back(LDAP_SEARCH_REQUEST);
-    
-    std::vector<unsigned char> reqLenBytes = BEREncoder::encodeLength(searchRequestComponents.size());
-    searchRequestSequence.insert(searchRequestSequence.end(), reqLenBytes.begin(), reqLenBytes.end());
-    
-    searchRequestSequence.insert(searchRequestSequence.end(), 
-                                searchRequestComponents.begin(), 
-                                searchRequestComponents.end());
-    
-    // Combine messageID and searchRequestSequence into final result
-    result.insert(result.end(), messageIDBytes.begin(), messageIDBytes.end());
-    result.insert(result.end(), searchRequestSequence.begin(), searchRequestSequence.end());
-    
-    // Wrap everything in a SEQUENCE
-    std::vector<unsigned char> searchRequest = BEREncoder::encodeSequence(result);
-    
-    // Send the request
-    if (send(sock, searchRequest.data(), searchRequest.size(), 0) < 0) {
-        std::cerr << "Send failed" << std::endl;
-        return {};
+    if (!phoneFilter.empty()) {
+        filter += "(telephoneNumber=*" + LDAPFilter::escape(phoneFilter) + "*)";
     }
-    
-    // Receive response
-    std::vector<unsigned char> response(8192, 0);
-    int recvSize = recv(sock, response.data(), response.size(), 0);
-    
-    if (recvSize < 0) {
-        std::cerr << "Receive failed" << std::endl;
-        return {};
+    if (!nameFilter.empty() && !phoneFilter.empty()) {
+        filter = "(|" + filter + ")";
     }
     
-    response.resize(recvSize);
-    
-    // Parse the response to extract all contacts
-    return parseLDAPSearchResponseMultiple(response);
+    return contactsOf(submitSearch(baseDN, filter, {"cn", "telephoneNumber"}));
 }
 
 void LDAPClient::close() {
     if (sock != -1) {
+        // Wakes the reader, which fails whatever is still pending
+        shutdown(sock, SHUT_RDWR);
+        if (reader.joinable()) {
+            reader.join();
+        }
         ::close(sock);
         sock = -1;
     }
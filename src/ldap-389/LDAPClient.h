@@ -1,11 +1,26 @@
+// LDAPClient - One connection to an LDAP server. Requests are pipelined:
+// any number of threads may submit at once, each request goes out under its
+// own messageID and a reader thread hands every response to the request
+// with that ID (RFC 4511 section 4.1.1). The blocking calls wait on the
+// future of the asynchronous ones.
+
 #ifndef LDAP_CLIENT_H
 #define LDAP_CLIENT_H
 
 #include <string>
 #include <vector>
 #include <map>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <condition_variable>
+#include <functional>
 #include <netinet/in.h>
 #include "Contact.h"
+#include "LDAPEntryView.h"
+#include "BEREncoder.h"
+#include "LDAPFilter.h"
+#include "BERParser.h"
 
 // LDAP Operation Codes
 #define LDAP_BIND_REQUEST 0x60
@@ -13,45 +28,142 @@
 #define LDAP_SEARCH_REQUEST 0x63
 #define LDAP_SEARCH_RESULT_ENTRY 0x64
 #define LDAP_SEARCH_RESULT_DONE 0x65
+#define LDAP_SEARCH_RESULT_REFERENCE 0x73
 
 // LDAP Result Codes
 #define LDAP_SUCCESS 0
+#define LDAP_TIME_LIMIT_EXCEEDED 3
+#define LDAP_SIZE_LIMIT_EXCEEDED 4
+#define LDAP_NO_SUCH_OBJECT 32
 #define LDAP_INVALID_CREDENTIALS 49
+#define LDAP_CONNECTION_FAILED -1       // not from the server: the connection went away first
+#define LDAP_DECODING_ERROR -4          // not from the server: what it sent could not be read
+#define LDAP_FILTER_ERROR -7            // not from the server: the filter did not compile
 
 // LDAP Search Scope
 #define LDAP_SCOPE_BASE 0
 #define LDAP_SCOPE_ONELEVEL 1
 #define LDAP_SCOPE_SUBTREE 2
 
-// LDAP Filter Types
-#define LDAP_FILTER_EQUALITY 0xA3
-#define LDAP_FILTER_SUBSTRING 0xA4
-#define LDAP_FILTER_OR 0xA1
+// LDAP Controls
+#define LDAP_CONTROL_PAGED_RESULTS "1.2.840.113556.1.4.319"     // RFC 2696
+
+class LDAPSearchCache;
+
+// A control sent with a request or returned with a response (RFC 4511
+// section 4.1.11); the value is left out when empty
+struct LDAPControl {
+    std::string type;
+    bool critical;
+    std::string value;              // BER, as the control defines it
+};
+
+// Called on the connection's reader thread for each entry as it arrives;
+// the next entry is not read until it returns
+typedef std::function<void(const LDAPEntryView& entry)> EntryCallback;
+
+// Everything the server sent back for one request
+struct LDAPResponse {
+    int resultCode;                 // of the final message
+    std::vector<Contact> entries;   // in the order the server sent them, unless streamed
+    std::vector<LDAPControl> controls;  // of the final message
+
+    LDAPResponse() : resultCode(LDAP_CONNECTION_FAILED) {}
+};
 
 class LDAPClient {
     private:
+        // messageIDs go round 1..MAX_MESSAGE_ID (RFC 4511 maxInt); beyond
+        // MAX_IN_FLIGHT submitters wait for a response
+        static const int MAX_MESSAGE_ID = 2147483647;
+        static const size_t MAX_IN_FLIGHT = 1024;
+
+        struct PendingRequest {
+            std::promise<LDAPResponse> promise;
+            LDAPResponse response;
+            EntryCallback onEntry;      // if set, entries go here instead
+        };
+
         int sock;
         struct sockaddr_in server;
-        int messageID;
-        
-        std::vector<unsigned char> createLDAPBindRequest(int messageID, const char* bindDN, const char* password);
-        std::vector<unsigned char> createLDAPSearchRequest(int messageID, const char* baseDN, const char* filter, const std::vector<std::string>& attributes, int scope = LDAP_SCOPE_SUBTREE);
-        std::vector<Contact> parseLDAPSearchResponseMultiple(const std::vector<unsigned char>& response);
-        std::string parseLDAPSearchResponse(const std::vector<unsigned char>& response);
-        std::vector<unsigned char> createEqualityFilter(const std::string& attribute, const std::string& value);
-        std::vector<unsigned char> createSubstringFilter(const std::string& attribute, const std::string& value);
-        std::vector<unsigned char> createORFilter(const std::vector<std::vector<unsigned char>>& filters);
-        
+        int messageID;          // the last one handed out
+
+        std::mutex sendMutex;   // one request on the wire at a time
+        std::mutex pendingMutex;
+        std::condition_variable idFreed;
+        std::map<int, PendingRequest> pending;
+        bool connected;
+        std::thread reader;
+
+        std::shared_ptr<LDAPSearchCache> cache;
+        int sizeLimit;
+        int timeLimit;
+
+        // Requests are encoded in one pass into the calling thread's encoder
+        static BEREncoder& requestEncoder();
+        static void encodeBindRequest(BEREncoder& request, int messageID, const char* bindDN, const char* password);
+        void encodeSearchRequest(BEREncoder& request, int messageID, const char* baseDN, int scope, const LDAPFilter& filter,
+                                 const std::vector<std::string>& attributes, const std::vector<LDAPControl>& controls);
+        static void encodeControls(BEREncoder& request, const std::vector<LDAPControl>& controls);
+        static bool readControls(BERParser& fields, std::vector<LDAPControl>& controls);
+
+        // Reserves a messageID, waiting while MAX_IN_FLIGHT are outstanding;
+        // -1 once the connection is gone
+        int reserveMessageID();
+        // Sends a request built for the reserved messageID
+        std::future<LDAPResponse> submit(int id, const std::vector<unsigned char>& request, EntryCallback onEntry = nullptr);
+        // Compiles the filter (or finds it compiled) and sends a SearchRequest;
+        // a bad filter fails with LDAP_FILTER_ERROR without being sent. Unless
+        // streamed or sent with controls, the answer may come from the cache
+        // and goes into it.
+        std::future<LDAPResponse> submitSearch(const char* baseDN, const std::string& filter, const std::vector<std::string>& attributes,
+                                               EntryCallback onEntry = nullptr, const std::vector<LDAPControl>& controls = {});
+        void readResponses();
+        void failPending();
+
     public:
         LDAPClient();
         ~LDAPClient();
-        
+
+        LDAPClient(const LDAPClient&) = delete;
+        LDAPClient& operator=(const LDAPClient&) = delete;
+
         bool connect(const char* host, int port);
         bool bind(const char* bindDN, const char* password);
         std::string search(const char* baseDN, const char* filter);
         std::vector<Contact> searchAll(const char* baseDN, const char* filter = "(objectClass=*)");
         std::vector<Contact> advancedSearch(const char* baseDN, const std::string& nameFilter, const std::string& phoneFilter);
         void close();
+
+        // The same, without waiting; any thread may call these
+        std::future<std::string> searchAsync(const char* baseDN, const char* filter);
+        std::future<std::vector<Contact>> searchAllAsync(const char* baseDN, const char* filter = "(objectClass=*)");
+        std::future<std::vector<Contact>> advancedSearchAsync(const char* baseDN, const std::string& nameFilter, const std::string& phoneFilter);
+
+        // Streams the entries to onEntry as they arrive, without keeping any;
+        // the future gives the resultCode once the search is done
+        std::future<int> searchEach(const char* baseDN, const char* filter, const std::vector<std::string>& attributes, EntryCallback onEntry);
+
+        // One page of a paged search (RFC 2696): up to pageSize entries, from
+        // where cookie left off (empty for the first page). The response's
+        // paged results control has the cookie for the next page; see
+        // LDAPPagedSearch, which follows the cookies. A pageSize of 0 with a
+        // cookie tells the server the rest will not be asked for.
+        std::future<LDAPResponse> searchPageAsync(const char* baseDN, const char* filter, const std::vector<std::string>& attributes,
+                                                  int pageSize, const std::string& cookie, EntryCallback onEntry = nullptr);
+
+        // Limits sent with every search from now on: at most sizeLimit entries
+        // and timeLimit seconds, 0 for none. A search that goes over ends with
+        // LDAP_SIZE_LIMIT_EXCEEDED or LDAP_TIME_LIMIT_EXCEEDED and the entries
+        // found until then. Set them before searching.
+        void setLimits(int sizeLimit, int timeLimit);
+
+        // Searches that are not streamed are answered from, and kept in,
+        // cache from now on; null stops caching. Set it before searching.
+        void setCache(std::shared_ptr<LDAPSearchCache> cache);
+
+        bool isConnected();
+        size_t inFlight();
 };
 
 #endif // LDAP_CLIENT_H
@@ -0,0 +1,108 @@
+#include "LDAPClientPool.h"
+
+constexpr std::chrono::seconds LDAPClientPool::RECONNECT_INTERVAL;
+
+LDAPClientPool::LDAPClientPool(const std::string& host, int port, size_t size)
+    : host(host), port(port), slots(size) {}
+
+std::shared_ptr<LDAPClient> LDAPClientPool::openClient(const std::string& bindDN, const std::string& password) {
+    std::shared_ptr<LDAPClient> client = std::make_shared<LDAPClient>();
+    if (client->connect(host.c_str(), port) && !client->bind(bindDN.c_str(), password.c_str())) {
+        // Not handed out: its searches would run anonymously
+        client->close();
+    }
+    return client;
+}
+
+bool LDAPClientPool::open(const char* bindDN, const char* password) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->bindDN = bindDN;
+        this->password = password;
+    }
+
+    // Connecting takes a while; nobody else waits on the lock for it
+    std::vector<std::shared_ptr<LDAPClient>> opened;
+    for (size_t i = 0; i < slots.size(); i++) {
+        opened.push_back(openClient(bindDN, password));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    bool any = false;
+    auto retryAt = std::chrono::steady_clock::now() + RECONNECT_INTERVAL;
+    for (size_t i = 0; i < slots.size(); i++) {
+        slots[i] = Slot{opened[i], retryAt, false};
+        any = any || opened[i]->isConnected();
+    }
+    return any;
+}
+
+std::shared_ptr<LDAPClient> LDAPClientPool::acquire() {
+    std::shared_ptr<LDAPClient> best;
+    size_t bestLoad = 0;
+    Slot* dropped = nullptr;
+    std::string dn;
+    std::string pw;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
+
+        for (auto& slot : slots) {
+            if (!slot.client || !slot.client->isConnected()) {
+                // Whoever still holds the dropped one keeps it until they let go
+                if (slot.client && !slot.reconnecting && now >= slot.retryAt && dropped == nullptr) {
+                    dropped = &slot;
+                }
+                continue;
+            }
+
+            size_t load = slot.client->inFlight();
+            if (!best || load < bestLoad) {
+                best = slot.client;
+                bestLoad = load;
+            }
+        }
+
+        if (dropped == nullptr) {
+            if (!best && !slots.empty()) {
+                best = slots.front().client;
+            }
+            return best;
+        }
+        dropped->reconnecting = true;
+        dn = bindDN;
+        pw = password;
+    }
+
+    // One reconnect per call, outside the lock, so an outage costs this
+    // caller one connect attempt per interval and everyone else nothing
+    std::shared_ptr<LDAPClient> fresh = openClient(dn, pw);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    dropped->reconnecting = false;
+    dropped->retryAt = std::chrono::steady_clock::now() + RECONNECT_INTERVAL;
+    if (!dropped->client) {
+        // The pool was closed meanwhile
+        fresh->close();
+    } else if (fresh->isConnected()) {
+        dropped->client = fresh;
+        if (!best || fresh->inFlight() < bestLoad) {
+            best = fresh;
+        }
+    }
+    if (!best && !slots.empty()) {
+        best = slots.front().client;
+    }
+    return best;
+}
+
+void LDAPClientPool::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& slot : slots) {
+        // Slots stay, as a reconnecting caller may still point at one
+        if (slot.client) {
+            slot.client->close();
+            slot.client.reset();
+        }
+    }
+}
@@ -0,0 +1,52 @@
+// LDAPClientPool - A fixed number of bound connections to one LDAP server,
+// shared by any number of threads. Connections are pipelined, so callers do
+// not check one out: acquire() names the one with the fewest requests in
+// flight, and callers may hold on to it while their futures are pending.
+// A connection found dropped, or that could not be bound, is replaced by a
+// fresh one, at most once per RECONNECT_INTERVAL and never under the lock.
+
+#ifndef LDAP_CLIENT_POOL_H
+#define LDAP_CLIENT_POOL_H
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "LDAPClient.h"
+
+class LDAPClientPool {
+    private:
+        static constexpr std::chrono::seconds RECONNECT_INTERVAL{1};
+
+        struct Slot {
+            std::shared_ptr<LDAPClient> client;
+            std::chrono::steady_clock::time_point retryAt;  // no reconnect before then
+            bool reconnecting;                              // by some caller, unlocked
+        };
+
+        std::string host;
+        int port;
+        std::string bindDN;
+        std::string password;
+        std::vector<Slot> slots;
+        std::mutex mutex;
+
+        // Connected and bound, or closed if either failed
+        std::shared_ptr<LDAPClient> openClient(const std::string& bindDN, const std::string& password);
+
+    public:
+        LDAPClientPool(const std::string& host, int port, size_t size);
+
+        // Connects and binds every connection; false if none could be
+        bool open(const char* bindDN, const char* password);
+
+        // The least busy connection. If the server cannot be reached or the
+        // bind fails it may be a closed one, whose requests fail with
+        // LDAP_CONNECTION_FAILED.
+        std::shared_ptr<LDAPClient> acquire();
+
+        void close();
+};
+
+#endif // LDAP_CLIENT_POOL_H
@@ -0,0 +1,49 @@
+#include "LDAPEntryView.h"
+#include <cctype>
+
+LDAPEntryView::LDAPEntryView(const unsigned char* content, size_t length) : valid(false) {
+    BERParser entry(content, length);
+    BERTag tag;
+
+    // SearchResultEntry ::= [APPLICATION 4] SEQUENCE { objectName, attributes }
+    valid = entry.readOctetString(objectName) && entry.readElement(tag, attributes);
+    if (!valid) {
+        attributes = BERParser();
+    }
+}
+
+static bool sameType(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view LDAPEntryView::first(std::string_view type) const {
+    std::string_view found;
+    bool seen = false;
+    forEachValue([&](std::string_view valueType, std::string_view value) {
+        if (!seen && sameType(valueType, type)) {
+            found = value;
+            seen = true;
+        }
+    });
+    return found;
+}
+
+Contact LDAPEntryView::toContact() const {
+    Contact contact;
+    contact.dn = std::string(objectName);
+
+    forEachValue([&](std::string_view type, std::string_view value) {
+        contact.attributes[std::string(type)].push_back(std::string(value));
+    });
+
+    // Store common attributes in easy-to-access fields
+    contact.name = std::string(first("cn"));
+    contact.phoneNumber = std::string(first("telephoneNumber"));
+    return contact;
+}
@@ -0,0 +1,60 @@
+// LDAPEntryView - A SearchResultEntry read in place, where it lies in the
+// connection's receive buffer. Nothing is copied: the DN and the values are
+// string_views, valid only while the entry callback that was handed the
+// view is running. Copy what has to be kept, e.g. with toContact().
+
+#ifndef LDAP_ENTRY_VIEW_H
+#define LDAP_ENTRY_VIEW_H
+
+#include <string_view>
+#include <cstddef>
+#include "BERParser.h"
+#include "Contact.h"
+
+class LDAPEntryView {
+    private:
+        std::string_view objectName;
+        BERParser attributes;       // over the contents of the PartialAttributeList
+        bool valid;
+
+    public:
+        // content: the entry past its tag and length
+        LDAPEntryView(const unsigned char* content, size_t length);
+
+        // False if the entry is malformed; it then has no attributes
+        bool isValid() const { return valid; }
+
+        std::string_view dn() const { return objectName; }
+
+        // The first value of the attribute (any case), or an empty view
+        std::string_view first(std::string_view type) const;
+
+        // Calls visit(type, value) for every value of every attribute, in
+        // the order the server sent them, up to anything malformed
+        template <typename Visit>
+        void forEachValue(Visit visit) const;
+
+        Contact toContact() const;
+};
+
+template <typename Visit>
+void LDAPEntryView::forEachValue(Visit visit) const {
+    BERParser list = attributes;
+    BERParser attribute;
+    BERParser values;
+    BERTag tag;
+    std::string_view type;
+    std::string_view value;
+
+    // PartialAttribute ::= SEQUENCE { type, vals SET OF value }
+    while (!list.atEnd() && list.readElement(tag, attribute)) {
+        if (!attribute.readOctetString(type) || !attribute.readElement(tag, values)) {
+            return;
+        }
+        while (!values.atEnd() && values.readOctetString(value)) {
+            visit(type, value);
+        }
+    }
+}
+
+#endif // LDAP_ENTRY_VIEW_H
@@ -0,0 +1,351 @@
+#include "LDAPFilter.h"
+#include "BEREncoder.h"
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <cctype>
+
+namespace {
+
+// Filters nested deeper than this are refused rather than recursed into
+const int MAX_DEPTH = 100;
+
+bool isAttributeChar(char c) {
+    // keystring or numericoid, with ;options (RFC 4512 section 2.5)
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '.' || c == ';';
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Recursive descent over the filter text, writing the BER as it goes.
+// After a failure what was written is unbalanced and of no use.
+class FilterCompiler {
+    private:
+        std::string_view text;
+        size_t position;
+        BEREncoder& out;
+        std::string value;      // the current assertion value, unescaped
+        std::string failure;
+
+        bool fail(const char* reason, size_t at) {
+            failure = std::string(reason) + " at offset " + std::to_string(at);
+            return false;
+        }
+
+        bool expect(char c) {
+            if (position >= text.size() || text[position] != c) {
+                return fail(c == '(' ? "expected '('" : "expected ')'", position);
+            }
+            position++;
+            return true;
+        }
+
+        // filter = "(" filtercomp ")"
+        bool filter(int depth) {
+            if (depth > MAX_DEPTH) {
+                return fail("filter nested too deeply", position);
+            }
+            if (!expect('(')) {
+                return false;
+            }
+            if (position >= text.size()) {
+                return fail("unexpected end of filter", position);
+            }
+
+            bool ok;
+            switch (text[position]) {
+                case '&':
+                    position++;
+                    ok = filterList(LDAP_FILTER_AND, depth);
+                    break;
+                case '|':
+                    position++;
+                    ok = filterList(LDAP_FILTER_OR, depth);
+                    break;
+                case '!':
+                    position++;
+                    out.begin(LDAP_FILTER_NOT);
+                    ok = filter(depth + 1);
+                    out.end();
+                    break;
+                default:
+                    ok = item();
+                    break;
+            }
+            return ok && expect(')');
+        }
+
+        // Empty lists are the absolute true and false of RFC 4526
+        bool filterList(unsigned char tag, int depth) {
+            out.begin(tag);
+            while (position < text.size() && text[position] == '(') {
+                if (!filter(depth + 1)) {
+                    return false;
+                }
+            }
+            out.end();
+            return true;
+        }
+
+        // simple, present, substring or extensible
+        bool item() {
+            size_t start = position;
+            while (position < text.size() && isAttributeChar(text[position])) {
+                position++;
+            }
+            std::string_view attribute = text.substr(start, position - start);
+
+            if (position < text.size() && text[position] == ':') {
+                return extensible(attribute);
+            }
+            if (attribute.empty()) {
+                return fail("expected an attribute", start);
+            }
+
+            unsigned char tag;
+            if (position < text.size() && text[position] == '=') {
+                tag = LDAP_FILTER_EQUALITY;
+                position++;
+            } else if (position + 1 < text.size() && text[position + 1] == '=' &&
+                       (text[position] == '>' || text[position] == '<' || text[position] == '~')) {
+                tag = text[position] == '>' ? LDAP_FILTER_GREATER_OR_EQUAL :
+                      text[position] == '<' ? LDAP_FILTER_LESS_OR_EQUAL : LDAP_FILTER_APPROX;
+                position += 2;
+            } else {
+                return fail("expected '=', '>=', '<=' or '~='", position);
+            }
+
+            size_t valueAt = position;
+            std::string_view raw;
+            if (!assertionValue(raw)) {
+                return false;
+            }
+
+            // An unescaped '*' only ever means presence or substrings
+            if (tag == LDAP_FILTER_EQUALITY && raw == "*") {
+                out.writeOctetString(attribute, LDAP_FILTER_PRESENT);
+                return true;
+            }
+            if (tag == LDAP_FILTER_EQUALITY && raw.find('*') != std::string_view::npos) {
+                return substrings(attribute, raw, valueAt);
+            }
+
+            if (!unescape(raw, valueAt)) {
+                return false;
+            }
+            out.begin(tag);
+            out.writeOctetString(attribute);
+            out.writeOctetString(value);
+            out.end();
+            return true;
+        }
+
+        // initial*any*any*final, each part optional but not all of them:
+        // the list of substrings is SIZE (1..MAX) in RFC 4511
+        bool substrings(std::string_view attribute, std::string_view raw, size_t valueAt) {
+            if (raw.find_first_not_of('*') == std::string_view::npos) {
+                return fail("substring filter without a substring", valueAt);
+            }
+            out.begin(LDAP_FILTER_SUBSTRING);
+            out.writeOctetString(attribute);
+            out.begin(0x30);
+
+            size_t star = raw.find('*');
+            if (star > 0) {
+                if (!unescape(raw.substr(0, star), valueAt)) {
+                    return false;
+                }
+                out.writeOctetString(value, 0x80);
+            }
+
+            size_t partAt = star + 1;
+            for (size_t next = raw.find('*', partAt); ; next = raw.find('*', partAt)) {
+                size_t end = next == std::string_view::npos ? raw.size() : next;
+                if (end > partAt) {
+                    if (!unescape(raw.substr(partAt, end - partAt), valueAt + partAt)) {
+                        return false;
+                    }
+                    // The last part, with no '*' after it, is the final one
+                    out.writeOctetString(value, next == std::string_view::npos ? 0x82 : 0x81);
+                }
+                if (next == std::string_view::npos) {
+                    break;
+                }
+                partAt = next + 1;
+            }
+
+            out.end();
+            out.end();
+            return true;
+        }
+
+        // attr [":dn"] [":" matchingrule] ":=" value, the attribute optional
+        // when there is a matching rule
+        bool extensible(std::string_view attribute) {
+            bool dnAttributes = false;
+            std::string_view rule;
+
+            while (true) {
+                position++;     // the ':'
+                if (position < text.size() && text[position] == '=') {
+                    position++;
+                    break;
+                }
+
+                size_t start = position;
+                while (position < text.size() && isAttributeChar(text[position])) {
+                    position++;
+                }
+                std::string_view part = text.substr(start, position - start);
+                if (part.empty()) {
+                    return fail("expected a matching rule", start);
+                }
+
+                bool isDN = part.size() == 2 && std::tolower(static_cast<unsigned char>(part[0])) == 'd' &&
+                            std::tolower(static_cast<unsigned char>(part[1])) == 'n';
+                if (isDN && !dnAttributes && rule.empty()) {
+                    dnAttributes = true;
+                } else if (rule.empty()) {
+                    rule = part;
+                } else {
+                    return fail("expected ':='", start);
+                }
+                if (position >= text.size() || text[position] != ':') {
+                    return fail("expected ':='", position);
+                }
+            }
+
+            if (attribute.empty() && rule.empty()) {
+                return fail("extensible match without an attribute or a matching rule", position);
+            }
+
+            size_t valueAt = position;
+            std::string_view raw;
+            if (!assertionValue(raw) || !unescape(raw, valueAt)) {
+                return false;
+            }
+
+            // MatchingRuleAssertion ::= SEQUENCE { [1] rule, [2] type, [3] value, [4] dnAttributes }
+            out.begin(LDAP_FILTER_EXTENSIBLE);
+            if (!rule.empty()) {
+                out.writeOctetString(rule, 0x81);
+            }
+            if (!attribute.empty()) {
+                out.writeOctetString(attribute, 0x82);
+            }
+            out.writeOctetString(value, 0x83);
+            if (dnAttributes) {
+                out.writeBoolean(true, 0x84);
+            }
+            out.end();
+            return true;
+        }
+
+        // The raw value, up to the ')' that closes the item
+        bool assertionValue(std::string_view& raw) {
+            size_t start = position;
+            while (position < text.size() && text[position] != ')') {
+                if (text[position] == '(') {
+                    return fail("unescaped '(' in value", position);
+                }
+                position++;
+            }
+            raw = text.substr(start, position - start);
+            return true;
+        }
+
+        // raw with its \XX escapes decoded, into value
+        bool unescape(std::string_view raw, size_t at) {
+            value.clear();
+            for (size_t i = 0; i < raw.size(); i++) {
+                char c = raw[i];
+                if (c == '*') {
+                    return fail("unescaped '*' in value", at + i);
+                }
+                if (c == '\0') {
+                    return fail("NUL in value", at + i);
+                }
+                if (c == '\\') {
+                    int high = i + 1 < raw.size() ? hexValue(raw[i + 1]) : -1;
+                    int low = i + 2 < raw.size() ? hexValue(raw[i + 2]) : -1;
+                    if (high < 0 || low < 0) {
+                        return fail("'\\' not followed by two hex digits", at + i);
+                    }
+                    c = static_cast<char>(high * 16 + low);
+                    i += 2;
+                }
+                value.push_back(c);
+            }
+            return true;
+        }
+
+    public:
+        FilterCompiler(std::string_view text, BEREncoder& out) : text(text), position(0), out(out) {}
+
+        bool compile(std::string& error) {
+            if (filter(0) && position != text.size()) {
+                fail("unexpected text after the filter", position);
+            }
+            error = failure;
+            return failure.empty();
+        }
+};
+
+std::shared_mutex cacheMutex;
+std::unordered_map<std::string, std::shared_ptr<const LDAPFilter>> cache;
+
+}
+
+LDAPFilter::LDAPFilter(std::string_view text) {
+    // One per thread, as any thread may compile
+    static thread_local BEREncoder encoder;
+    encoder.clear();
+
+    FilterCompiler compiler(text, encoder);
+    if (compiler.compile(failure)) {
+        ber = encoder.bytes();
+    }
+}
+
+std::shared_ptr<const LDAPFilter> LDAPFilter::compile(const std::string& text) {
+    {
+        std::shared_lock<std::shared_mutex> lock(cacheMutex);
+        auto found = cache.find(text);
+        if (found != cache.end()) {
+            return found->second;
+        }
+    }
+
+    // Compiled outside the lock; two threads may both compile a new text,
+    // which is harmless
+    auto filter = std::make_shared<const LDAPFilter>(text);
+
+    std::unique_lock<std::shared_mutex> lock(cacheMutex);
+    if (cache.size() >= MAX_CACHED) {
+        cache.clear();
+    }
+    cache.emplace(text, filter);
+    return filter;
+}
+
+std::string LDAPFilter::escape(std::string_view value) {
+    static const char hex[] = "0123456789abcdef";
+    std::string escaped;
+    escaped.reserve(value.size());
+
+    for (char c : value) {
+        if (c == '*' || c == '(' || c == ')' || c == '\\' || c == '\0') {
+            escaped.push_back('\\');
+            escaped.push_back(hex[static_cast<unsigned char>(c) >> 4]);
+            escaped.push_back(hex[static_cast<unsigned char>(c) & 0x0F]);
+        } else {
+            escaped.push_back(c);
+        }
+    }
+    return escaped;
+}
@@ -0,0 +1,57 @@
+// LDAPFilter - A search filter in its string form (RFC 4515), compiled
+// into the BER of a SearchRequest Filter (RFC 4511 section 4.5.1.7).
+//
+// Everything RFC 4515 has is understood: &, | and !, equality, >=, <=, ~=,
+// presence, substrings with initial, any and final parts, extensible
+// matches and \XX escapes in values. Compiling is done once per filter
+// text: compile() keeps what it built, so a filter used again is only
+// looked up.
+
+#ifndef LDAP_FILTER_H
+#define LDAP_FILTER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+// LDAP Filter Types
+#define LDAP_FILTER_AND 0xA0
+#define LDAP_FILTER_OR 0xA1
+#define LDAP_FILTER_NOT 0xA2
+#define LDAP_FILTER_EQUALITY 0xA3
+#define LDAP_FILTER_SUBSTRING 0xA4
+#define LDAP_FILTER_GREATER_OR_EQUAL 0xA5
+#define LDAP_FILTER_LESS_OR_EQUAL 0xA6
+#define LDAP_FILTER_PRESENT 0x87
+#define LDAP_FILTER_APPROX 0xA8
+#define LDAP_FILTER_EXTENSIBLE 0xA9
+
+class LDAPFilter {
+    private:
+        // Compiled filters kept, by text, before the cache starts over
+        static const size_t MAX_CACHED = 1024;
+
+        std::vector<unsigned char> ber;
+        std::string failure;
+
+    public:
+        explicit LDAPFilter(std::string_view text);
+
+        // False if the text is not a filter; error() then says why
+        bool isValid() const { return failure.empty(); }
+        const std::string& error() const { return failure; }
+
+        // The encoded Filter, empty if not valid
+        const std::vector<unsigned char>& bytes() const { return ber; }
+
+        // The filter for text, compiled on first use; any thread may call it
+        static std::shared_ptr<const LDAPFilter> compile(const std::string& text);
+
+        // value with the characters a filter reserves escaped, so that it
+        // can be put into filter text as an assertion value
+        static std::string escape(std::string_view value);
+};
+
+#endif // LDAP_FILTER_H
@@ -0,0 +1,74 @@
+#include "LDAPPagedSearch.h"
+#include "BERParser.h"
+#include <iostream>
+
+LDAPPagedSearch::LDAPPagedSearch(LDAPClient& client, const char* baseDN, const char* filter,
+                                 const std::vector<std::string>& attributes, int pageSize)
+    : client(client), baseDN(baseDN), filter(filter), attributes(attributes), pageSize(pageSize),
+      started(false), finished(false), result(LDAP_SUCCESS) {}
+
+LDAPPagedSearch::~LDAPPagedSearch() {
+    abandon();
+}
+
+bool LDAPPagedSearch::next(std::vector<Contact>& page) {
+    page.clear();
+    return fetch(nullptr, &page);
+}
+
+bool LDAPPagedSearch::next(EntryCallback onEntry) {
+    return fetch(std::move(onEntry), nullptr);
+}
+
+bool LDAPPagedSearch::fetch(EntryCallback onEntry, std::vector<Contact>* page) {
+    if (finished) {
+        return false;
+    }
+    
+    LDAPResponse response = client.searchPageAsync(baseDN.c_str(), filter.c_str(), attributes, pageSize, cookie, std::move(onEntry)).get();
+    started = true;
+    result = response.resultCode;
+    if (page != nullptr) {
+        *page = std::move(response.entries);
+    }
+    
+    // The server's paged results control says where the next page starts;
+    // an empty cookie, or none at all, means this was the last
+    cookie.clear();
+    for (const auto& control : response.controls) {
+        if (control.type != LDAP_CONTROL_PAGED_RESULTS) {
+            continue;
+        }
+        
+        // realSearchControlValue ::= SEQUENCE { size INTEGER, cookie OCTET STRING }
+        BERParser value(reinterpret_cast<const unsigned char*>(control.value.data()), control.value.size());
+        BERParser fields;
+        BERTag tag;
+        int64_t estimate;
+        std::string_view next;
+        if (!value.readElement(tag, fields) || !fields.readInteger(estimate) || !fields.readOctetString(next)) {
+            std::cerr << "Bad paged results control from server: " << value.error() << fields.error() << std::endl;
+            if (result == LDAP_SUCCESS) {
+                result = LDAP_DECODING_ERROR;
+            }
+            break;
+        }
+        cookie = std::string(next);
+    }
+    
+    if (result != LDAP_SUCCESS) {
+        finished = true;
+        return false;
+    }
+    finished = cookie.empty();
+    return true;
+}
+
+void LDAPPagedSearch::abandon() {
+    if (started && !finished) {
+        // A size of 0 with the cookie lets the server free the search; the
+        // answer is not waited for
+        client.searchPageAsync(baseDN.c_str(), filter.c_str(), attributes, 0, cookie);
+    }
+    finished = true;
+}
@@ -0,0 +1,60 @@
+// LDAPPagedSearch - A search walked a page at a time with the Simple Paged
+// Results control (RFC 2696), so a directory of any size comes back in
+// chunks of at most pageSize entries and stays under the server's size
+// limit. Nothing is asked for until next(), and each next() asks for one
+// page, following the cookie the server returned with the one before.
+//
+//     LDAPPagedSearch pages(client, baseDN, "(objectClass=*)", {"cn"}, 500);
+//     std::vector<Contact> page;
+//     while (pages.next(page)) { ... }
+//     if (pages.resultCode() != LDAP_SUCCESS) { ... }
+
+#ifndef LDAP_PAGED_SEARCH_H
+#define LDAP_PAGED_SEARCH_H
+
+#include <string>
+#include <vector>
+#include "LDAPClient.h"
+
+class LDAPPagedSearch {
+    private:
+        LDAPClient& client;
+        std::string baseDN;
+        std::string filter;
+        std::vector<std::string> attributes;
+        int pageSize;
+        std::string cookie;     // where the next page starts
+        bool started;
+        bool finished;
+        int result;
+
+        bool fetch(EntryCallback onEntry, std::vector<Contact>* page);
+
+    public:
+        LDAPPagedSearch(LDAPClient& client, const char* baseDN, const char* filter,
+                        const std::vector<std::string>& attributes, int pageSize);
+        // Abandons the search if pages are left
+        ~LDAPPagedSearch();
+
+        LDAPPagedSearch(const LDAPPagedSearch&) = delete;
+        LDAPPagedSearch& operator=(const LDAPPagedSearch&) = delete;
+
+        // Fetches the next page into page, or streams it to onEntry as it
+        // arrives. False, with nothing fetched, once there are no pages
+        // left; false too if the search failed, with page holding what came.
+        bool next(std::vector<Contact>& page);
+        bool next(EntryCallback onEntry);
+
+        // Whether pages are left to fetch
+        bool hasMore() const { return !finished; }
+
+        // LDAP_SUCCESS so far if every page came back; otherwise the code
+        // that ended the search, e.g. LDAP_SIZE_LIMIT_EXCEEDED past the
+        // client's limit. A server that does not page sends one page of all.
+        int resultCode() const { return result; }
+
+        // Tells the server no more pages will be fetched
+        void abandon();
+};
+
+#endif // LDAP_PAGED_SEARCH_H
@@ -0,0 +1,120 @@
+#include "LDAPSearchCache.h"
+#include <cctype>
+
+LDAPSearchCache::LDAPSearchCache(size_t maxResults, size_t maxContacts,
+                                 std::chrono::milliseconds ttl, std::chrono::milliseconds negativeTtl)
+    : maxResults(maxResults), maxContacts(maxContacts), ttl(ttl), negativeTtl(negativeTtl), counts() {}
+
+std::string LDAPSearchCache::keyOf(const char* baseDN, int scope, int sizeLimit, int timeLimit,
+                                   const std::string& filter, const std::vector<std::string>& attributes) {
+    // NUL cannot occur in a DN or an unescaped filter, so it separates the parts;
+    // the base DN comes first for invalidate()
+    std::string key = baseDN;
+    key.push_back('\0');
+    key.push_back(static_cast<char>('0' + scope));
+    key.push_back('\0');
+    // A result complete without limits is not what a limited search gets
+    key += std::to_string(sizeLimit);
+    key.push_back('\0');
+    key += std::to_string(timeLimit);
+    key.push_back('\0');
+    key += filter;
+    for (const auto& attr : attributes) {
+        key.push_back('\0');
+        key += attr;
+    }
+    return key;
+}
+
+void LDAPSearchCache::erase(std::list<Result>::iterator result) {
+    counts.contacts -= result->response->entries.size();
+    index.erase(result->key);
+    results.erase(result);
+}
+
+std::shared_ptr<const LDAPResponse> LDAPSearchCache::find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = index.find(key);
+    if (found == index.end()) {
+        counts.misses++;
+        return nullptr;
+    }
+
+    auto result = found->second;
+    if (Clock::now() >= result->expires) {
+        erase(result);
+        counts.misses++;
+        return nullptr;
+    }
+
+    results.splice(results.begin(), results, result);
+    counts.hits++;
+    return result->response;
+}
+
+void LDAPSearchCache::store(const std::string& key, const LDAPResponse& response) {
+    // A base DN that does not exist is as negative a result as an empty one
+    bool found = response.resultCode == LDAP_SUCCESS && !response.entries.empty();
+    bool negative = (response.resultCode == LDAP_SUCCESS && response.entries.empty()) ||
+                    response.resultCode == LDAP_NO_SUCH_OBJECT;
+    if ((!found && !negative) || response.entries.size() > maxContacts || maxResults == 0) {
+        return;
+    }
+
+    std::shared_ptr<const LDAPResponse> kept = std::make_shared<const LDAPResponse>(response);
+    Clock::time_point expires = Clock::now() + (found ? ttl : negativeTtl);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto existing = index.find(key);
+    if (existing != index.end()) {
+        erase(existing->second);
+    }
+
+    results.push_front(Result{key, kept, expires});
+    index.emplace(results.front().key, results.begin());
+    counts.contacts += kept->entries.size();
+
+    while (results.size() > maxResults || counts.contacts > maxContacts) {
+        erase(std::prev(results.end()));
+        counts.evictions++;
+    }
+}
+
+// Whether base is dn or one of its ancestors, comparing as written but for case
+static bool isWithin(std::string_view dn, std::string_view base) {
+    if (base.size() > dn.size()) return false;
+    size_t offset = dn.size() - base.size();
+    if (offset > 0 && dn[offset - 1] != ',') return false;
+    for (size_t i = 0; i < base.size(); i++) {
+        if (std::tolower(static_cast<unsigned char>(dn[offset + i])) != std::tolower(static_cast<unsigned char>(base[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void LDAPSearchCache::invalidate(std::string_view dn) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto result = results.begin(); result != results.end(); ) {
+        auto next = std::next(result);
+        std::string_view key = result->key;
+        if (isWithin(dn, key.substr(0, key.find('\0')))) {
+            erase(result);
+        }
+        result = next;
+    }
+}
+
+void LDAPSearchCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    index.clear();
+    results.clear();
+    counts.contacts = 0;
+}
+
+LDAPSearchCache::Stats LDAPSearchCache::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats now = counts;
+    now.results = results.size();
+    return now;
+}
@@ -0,0 +1,79 @@
+// LDAPSearchCache - Recent search results, kept on the client so a search
+// repeated within its TTL is answered without asking the server. Results
+// are keyed by everything that shapes them: base DN, scope, size and time
+// limits, filter and attributes. Searches that found nothing are cached too, for a shorter
+// TTL. The least recently used results go first once there are more
+// than maxResults of them, or more than maxContacts entries between them.
+//
+// One cache may be shared by any number of clients and threads.
+
+#ifndef LDAP_SEARCH_CACHE_H
+#define LDAP_SEARCH_CACHE_H
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "LDAPClient.h"
+
+class LDAPSearchCache {
+    public:
+        struct Stats {
+            size_t hits;
+            size_t misses;          // including results found expired
+            size_t evictions;
+            size_t results;         // cached now
+            size_t contacts;        // in those results
+        };
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Result {
+            std::string key;
+            std::shared_ptr<const LDAPResponse> response;
+            Clock::time_point expires;
+        };
+
+        size_t maxResults;
+        size_t maxContacts;
+        std::chrono::milliseconds ttl;
+        std::chrono::milliseconds negativeTtl;
+
+        std::mutex mutex;
+        std::list<Result> results;      // most recently used first
+        std::unordered_map<std::string_view, std::list<Result>::iterator> index;   // views of the keys in results
+        Stats counts;
+
+        void erase(std::list<Result>::iterator result);
+
+    public:
+        LDAPSearchCache(size_t maxResults, size_t maxContacts,
+                        std::chrono::milliseconds ttl, std::chrono::milliseconds negativeTtl);
+
+        LDAPSearchCache(const LDAPSearchCache&) = delete;
+        LDAPSearchCache& operator=(const LDAPSearchCache&) = delete;
+
+        static std::string keyOf(const char* baseDN, int scope, int sizeLimit, int timeLimit,
+                                 const std::string& filter, const std::vector<std::string>& attributes);
+
+        // The cached response, or null if there is none or it has expired
+        std::shared_ptr<const LDAPResponse> find(const std::string& key);
+
+        // Keeps a response that completed. Failures are not kept, and
+        // neither is a response too big for the cache.
+        void store(const std::string& key, const LDAPResponse& response);
+
+        // Drops every result that could include the entry dn, i.e. those of
+        // searches based at dn or above it, after a change to that entry
+        void invalidate(std::string_view dn);
+        void clear();
+
+        Stats stats();
+};
+
+#endif // LDAP_SEARCH_CACHE_H
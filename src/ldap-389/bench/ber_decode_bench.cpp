@@ -0,0 +1,86 @@
+// ber_decode_bench - Decodes a 10 MB synthetic search response with
+// BERParser, the way the reader thread does, and reports MB/s.
+//
+//     make bench && ./bench/ber_decode
+
+#include "../BERParser.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+static std::string berLength(size_t length) {
+    if (length < 128) {
+        return std::string(1, static_cast<char>(length));
+    }
+    std::string octets;
+    for (; length > 0; length >>= 8) {
+        octets.insert(octets.begin(), static_cast<char>(length & 0xFF));
+    }
+    return std::string(1, static_cast<char>(0x80 | octets.size())) + octets;
+}
+
+static std::string tlv(unsigned char tag, const std::string& value) {
+    return std::string(1, static_cast<char>(tag)) + berLength(value.size()) + value;
+}
+
+// SearchResultEntry messages for "Friend N" until there are 10 MB of them
+static std::vector<unsigned char> syntheticResponse(size_t& entries) {
+    std::string all;
+    for (entries = 0; all.size() < 10 * 1024 * 1024; entries++) {
+        char name[64];
+        char phone[32];
+        snprintf(name, sizeof(name), "Friend %06zu", entries);
+        snprintf(phone, sizeof(phone), "+27-66-%06zu", entries);
+
+        std::string attributes = tlv(0x30, tlv(0x04, "cn") + tlv(0x31, tlv(0x04, name))) +
+                                 tlv(0x30, tlv(0x04, "telephoneNumber") + tlv(0x31, tlv(0x04, phone))) +
+                                 tlv(0x30, tlv(0x04, "objectClass") + tlv(0x31, tlv(0x04, "top") + tlv(0x04, "person") + tlv(0x04, "inetOrgPerson")));
+        std::string dn = std::string("cn=") + name + ",ou=Friends,dc=friends,dc=local";
+        all += tlv(0x30, tlv(0x02, std::string(1, 7)) + tlv(0x64, tlv(0x04, dn) + tlv(0x30, attributes)));
+    }
+    return std::vector<unsigned char>(all.begin(), all.end());
+}
+
+int main() {
+    const int rounds = 20;
+    size_t entries;
+    std::vector<unsigned char> response = syntheticResponse(entries);
+
+    size_t checksum = 0;
+    size_t values = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        BERParser messages(response);
+        BERParser message, entry, list, attribute, set;
+        BERTag tag;
+        int64_t messageID;
+        std::string_view value;
+
+        while (!messages.atEnd()) {
+            if (!messages.readElement(tag, message) || !message.readInteger(messageID) ||
+                !message.readElement(tag, entry) || !entry.readOctetString(value) || !entry.readElement(tag, list)) {
+                fprintf(stderr, "decode failed: %s%s%s\n", messages.error(), message.error(), entry.error());
+                return 1;
+            }
+            checksum += value.size();
+
+            while (!list.atEnd() && list.readElement(tag, attribute)) {
+                attribute.readOctetString(value);
+                checksum += value.size();
+                attribute.readElement(tag, set);
+                while (!set.atEnd() && set.readOctetString(value)) {
+                    checksum += value.size();
+                    values++;
+                }
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double megabytes = response.size() / 1048576.0;
+    printf("%zu entries, %.1f MB x %d: %.1f MB/s (checksum %zu, values %zu)\n",
+           entries, megabytes, rounds, megabytes * rounds / seconds, checksum, values);
+    return 0;
+}
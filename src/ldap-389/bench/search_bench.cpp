@@ -0,0 +1,88 @@
+// search_bench - Searches per second against an LDAP server (e.g. the
+// stand-in), one at a time, pipelined on one connection, or through a
+// pool shared by many threads.
+//
+//     ./bench/search PORT COUNT sequential
+//     ./bench/search PORT COUNT pipelined WINDOW
+//     ./bench/search PORT COUNT pool CONNECTIONS THREADS
+
+#include "../LDAPClient.h"
+#include "../LDAPClientPool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char* BASE_DN = "ou=Friends,dc=friends,dc=local";
+static const char* FILTER = "(cn=Friend)";
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s PORT COUNT sequential | pipelined WINDOW | pool CONNECTIONS THREADS\n", argv[0]);
+        return 1;
+    }
+    int port = atoi(argv[1]);
+    int count = atoi(argv[2]);
+    std::string mode = argv[3];
+    // The client reports connects and binds on stdout
+    std::cout.setstate(std::ios::failbit);
+
+    long found = 0;
+    auto start = std::chrono::steady_clock::now();
+    if (mode == "sequential" || mode == "pipelined") {
+        int window = mode == "pipelined" && argc > 4 ? atoi(argv[4]) : 1;
+        LDAPClient client;
+        if (!client.connect("127.0.0.1", port) || !client.bind("", "")) {
+            return 1;
+        }
+
+        start = std::chrono::steady_clock::now();
+        std::deque<std::future<std::string>> inFlight;
+        for (int i = 0; i < count; i++) {
+            if (static_cast<int>(inFlight.size()) == window) {
+                found += !inFlight.front().get().empty();
+                inFlight.pop_front();
+            }
+            inFlight.push_back(client.searchAsync(BASE_DN, FILTER));
+        }
+        for (auto& search : inFlight) {
+            found += !search.get().empty();
+        }
+    } else if (mode == "pool" && argc > 5) {
+        int connections = atoi(argv[4]);
+        int threads = atoi(argv[5]);
+        LDAPClientPool pool("127.0.0.1", port, connections);
+        if (!pool.open("", "")) {
+            return 1;
+        }
+
+        std::atomic<long> total(0);
+        start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&] {
+                long mine = 0;
+                for (int i = 0; i < count / threads; i++) {
+                    mine += !pool.acquire()->search(BASE_DN, FILTER).empty();
+                }
+                total += mine;
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        found = total;
+    } else {
+        fprintf(stderr, "unknown mode %s\n", mode.c_str());
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    fprintf(stderr, "%s: %ld of %d found in %.3f s, %.0f searches/s\n", mode.c_str(), found, count, seconds, found / seconds);
+    return 0;
+}
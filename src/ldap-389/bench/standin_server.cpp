@@ -0,0 +1,188 @@
+// standin_server - A stand-in LDAP server for benchmarking the client on
+// loopback. Binds succeed; every search is answered with ENTRIES entries
+// after LATENCY_US microseconds. Answers are queued by when they are due,
+// so many searches can be outstanding at once, as on a real server, and
+// long answers go out 1000 entries at a time.
+//
+//     ./bench/standin PORT [ENTRIES] [LATENCY_US]
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+static int entriesPerSearch = 1;
+static int latencyMicros = 1000;
+
+struct Outgoing {
+    Clock::time_point due;
+    int fd;
+    std::string bytes;
+
+    bool operator<(const Outgoing& other) const { return due > other.due; }
+};
+
+static std::priority_queue<Outgoing> outgoing;
+static std::mutex outgoingMutex;
+static std::condition_variable outgoingReady;
+
+static std::string berLength(size_t length) {
+    if (length < 128) {
+        return std::string(1, static_cast<char>(length));
+    }
+    std::string octets;
+    for (; length > 0; length >>= 8) {
+        octets.insert(octets.begin(), static_cast<char>(length & 0xFF));
+    }
+    return std::string(1, static_cast<char>(0x80 | octets.size())) + octets;
+}
+
+static std::string tlv(unsigned char tag, const std::string& value) {
+    return std::string(1, static_cast<char>(tag)) + berLength(value.size()) + value;
+}
+
+static void queue(Clock::time_point due, int fd, std::string bytes) {
+    std::lock_guard<std::mutex> lock(outgoingMutex);
+    outgoing.push(Outgoing{due, fd, std::move(bytes)});
+    outgoingReady.notify_one();
+}
+
+// Sends each answer once it is due
+static void writer() {
+    std::unique_lock<std::mutex> lock(outgoingMutex);
+    while (true) {
+        if (outgoing.empty()) {
+            outgoingReady.wait(lock);
+            continue;
+        }
+        if (outgoing.top().due > Clock::now()) {
+            outgoingReady.wait_until(lock, outgoing.top().due);
+            continue;
+        }
+
+        Outgoing next = outgoing.top();
+        outgoing.pop();
+        lock.unlock();
+        for (size_t sent = 0; sent < next.bytes.size(); ) {
+            ssize_t result = send(next.fd, next.bytes.data() + sent, next.bytes.size() - sent, MSG_NOSIGNAL);
+            if (result <= 0) {
+                break;
+            }
+            sent += static_cast<size_t>(result);
+        }
+        lock.lock();
+    }
+}
+
+static void serve(int fd) {
+    std::string in;
+    char buffer[65536];
+    int counter = 0;
+
+    while (true) {
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            break;
+        }
+        in.append(buffer, static_cast<size_t>(received));
+
+        // Whole LDAPMessages only
+        while (in.size() >= 2) {
+            size_t header = 2;
+            size_t length = static_cast<unsigned char>(in[1]);
+            if (length & 0x80) {
+                size_t octets = length & 0x7F;
+                if (in.size() < 2 + octets) {
+                    break;
+                }
+                length = 0;
+                for (size_t i = 0; i < octets; i++) {
+                    length = length << 8 | static_cast<unsigned char>(in[2 + i]);
+                }
+                header += octets;
+            }
+            if (in.size() < header + length) {
+                break;
+            }
+            std::string message = in.substr(0, header + length);
+            in.erase(0, header + length);
+
+            // The messageID element is echoed back as it came
+            std::string messageID = message.substr(header, 2 + static_cast<unsigned char>(message[header + 1]));
+            unsigned char operation = static_cast<unsigned char>(message[header + messageID.size()]);
+            std::string done = tlv(0x0A, std::string(1, 0)) + tlv(0x04, "") + tlv(0x04, "");
+
+            if (operation == 0x60) {
+                queue(Clock::now(), fd, tlv(0x30, messageID + tlv(0x61, done)));
+                continue;
+            }
+            if (operation == 0x42) {
+                close(fd);
+                return;
+            }
+
+            Clock::time_point due = Clock::now() + std::chrono::microseconds(latencyMicros);
+            int piece = 0;
+            std::string answer;
+            for (int entry = 0; entry < entriesPerSearch; entry++) {
+                if (entry > 0 && entry % 1000 == 0) {
+                    queue(due + std::chrono::nanoseconds(piece++), fd, std::move(answer));
+                    answer.clear();
+                }
+                char name[64];
+                char phone[32];
+                snprintf(name, sizeof(name), "Friend %06d", counter);
+                snprintf(phone, sizeof(phone), "+27-66-%06d", counter++);
+                std::string attributes = tlv(0x30, tlv(0x04, "cn") + tlv(0x31, tlv(0x04, name))) +
+                                         tlv(0x30, tlv(0x04, "telephoneNumber") + tlv(0x31, tlv(0x04, phone)));
+                std::string dn = std::string("cn=") + name + ",ou=Friends,dc=friends,dc=local";
+                answer += tlv(0x30, messageID + tlv(0x64, tlv(0x04, dn) + tlv(0x30, attributes)));
+            }
+            answer += tlv(0x30, messageID + tlv(0x65, done));
+            queue(due + std::chrono::nanoseconds(piece), fd, std::move(answer));
+        }
+    }
+    close(fd);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s PORT [ENTRIES] [LATENCY_US]\n", argv[0]);
+        return 1;
+    }
+    int port = atoi(argv[1]);
+    if (argc > 2) entriesPerSearch = atoi(argv[2]);
+    if (argc > 3) latencyMicros = atoi(argv[3]);
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 64) < 0) {
+        perror("bind");
+        return 1;
+    }
+
+    std::thread(writer).detach();
+    while (true) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client >= 0) {
+            setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            std::thread(serve, client).detach();
+        }
+    }
+}
@@ -1,4 +1,6 @@
 #include "LDAPClient.h"
+#include "LDAPSearchCache.h"
+#include "LDAPPagedSearch.h"
 #include "Contact.h"
 #include <iostream>
 #include <string>
@@ -122,7 +124,8 @@ void searchContact(LDAPClient& client) {
     std::cout << "Please wait..." << std::endl;
     
     // Search for the contact's telephone number
-    std::string phoneNumber = client.search("ou=Friends,dc=friends,dc=local", contactName.c_str());
+    std::string filter = "(cn=" + LDAPFilter::escape(contactName) + ")";
+    std::string phoneNumber = client.search("ou=Friends,dc=friends,dc=local", filter.c_str());
     
     displaySearchResult(contactName, phoneNumber);
     
@@ -139,11 +142,31 @@ void listAllContacts(LDAPClient& client) {
     
     std::cout << ansiColor(33) << "Retrieving all contacts..." << ansiReset() << std::endl;
     
-    // Retrieve all contacts using the searchAll method
-    std::vector<Contact> contacts = client.searchAll("ou=Friends,dc=friends,dc=local");
+    // Rows are shown as the server sends them, so a big directory starts
+    // appearing at once and is never held in memory. It is fetched in pages
+    // of 500, OpenLDAP's default size limit, so it is never cut short by it.
+    size_t count = 0;
+    LDAPPagedSearch pages(client, "ou=Friends,dc=friends,dc=local", "(objectClass=*)", {"cn", "telephoneNumber"}, 500);
+    while (pages.next([&count](const LDAPEntryView& entry) {
+        std::string_view name = entry.first("cn");
+        std::string_view phoneNumber = entry.first("telephoneNumber");
+        std::cout << "  * " << ansiColor(36) << (name.empty() ? "[No Name]" : name) << ansiReset() << ": "
+                  << ansiColor(33) << (phoneNumber.empty() ? "[No Phone]" : phoneNumber) << ansiReset() << std::endl;
+        count++;
+    })) {}
+    int resultCode = pages.resultCode();
     
-    // Display the contacts
-    displayContacts(contacts);
+    if (count == 0) {
+        std::cout << ansiColor(31) << "✗ " << ansiReset();
+        std::cout << "No contacts found." << std::endl;
+    } else {
+        std::cout << std::endl;
+        std::cout << "Total: " << count << " contact(s)" << std::endl;
+    }
+    if (resultCode != LDAP_SUCCESS) {
+        std::cerr << "LDAP search failed with result code: " << resultCode << std::endl;
+    }
+    std::cout << std::endl;
     
     std::cout << ansiColor(33) << "Press Enter to continue..." << ansiReset();
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
@@ -209,6 +232,10 @@ int main() {
         return 1;
     }
     
+    // Looking the same name up again within a minute needs no round trip;
+    // names that were not found are asked about again after ten seconds
+    client.setCache(std::make_shared<LDAPSearchCache>(256, 10000, std::chrono::seconds(60), std::chrono::seconds(10)));
+    
     showWelcomeScreen();
     std::cout << "Press Enter to continue...";
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
@@ -0,0 +1,467 @@
+#include "async_logger.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace logging {
+
+namespace {
+
+const size_t RING_CAPACITY = 128;           // records per producer thread
+const size_t BATCH_BYTES = 64 * 1024;       // formatted bytes per write()
+const int IDLE_WAIT_MS = 5;
+
+const char* LEVEL_NAMES[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR"};
+const char* LEVEL_JSON[] = {"trace", "debug", "info", "warn", "error"};
+const char* MONTHS[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+// Single producer (the owning thread), single consumer (the writer thread).
+// head and tail only ever grow; padding keeps them on separate cache lines.
+struct Ring {
+    LogRecord records[RING_CAPACITY];
+    std::atomic<size_t> head;
+    char headPadding[64];
+    std::atomic<size_t> tail;
+    char tailPadding[64];
+    std::atomic<bool> retired;
+    uint32_t threadId;
+
+    explicit Ring(uint32_t threadId) : head(0), tail(0), retired(false), threadId(threadId) {}
+
+    LogRecord* claim() {
+        size_t current = head.load(std::memory_order_relaxed);
+        if (current - tail.load(std::memory_order_acquire) == RING_CAPACITY) {
+            return nullptr;
+        }
+        return &records[current % RING_CAPACITY];
+    }
+
+    void publish() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+class Writer {
+    private:
+        std::mutex ringsMutex;
+        std::vector<std::shared_ptr<Ring>> rings;
+        std::atomic<uint32_t> nextThreadId;
+        std::atomic<int> format;
+        int fd;                         // the writer thread's alone
+        std::atomic<int> pendingFd;     // from configure(), taken between batches; -1 if none
+        std::mutex wakeMutex;
+        std::condition_variable wakeCondition;
+        std::condition_variable drainedCondition;
+        std::atomic<bool> flushRequested;
+        std::string batch;
+
+        void adoptPendingFd();
+        size_t drainOnce();
+        void formatRecord(const LogRecord& record);
+        void writeBatch();
+
+    public:
+        std::atomic<uint64_t> dropped;
+
+        Writer();
+        void run();
+        std::shared_ptr<Ring> registerThread();
+        void configure(LogFormat format, int fd);
+        void flush();
+};
+
+Writer& writer() {
+    // Never destroyed: detached connection threads may still log during exit
+    static Writer* instance = new Writer();
+    return *instance;
+}
+
+void flushAtExit() {
+    writer().flush();
+}
+
+// Per-thread handle; marks the ring retired so the writer can reclaim it
+struct Producer {
+    std::shared_ptr<Ring> ring;
+
+    ~Producer() {
+        if (ring) {
+            ring->retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local Producer producer;
+
+Ring* currentRing() {
+    if (!producer.ring) {
+        producer.ring = writer().registerThread();
+    }
+    return producer.ring.get();
+}
+
+uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void copyField(char* destination, size_t capacity, const char* source, size_t length) {
+    if (source == nullptr) {
+        destination[0] = '\0';
+        return;
+    }
+    if (length >= capacity) {
+        length = capacity - 1;
+    }
+    std::memcpy(destination, source, length);
+    destination[length] = '\0';
+}
+
+void copyField(char* destination, size_t capacity, const char* source) {
+    copyField(destination, capacity, source, source ? std::strlen(source) : 0);
+}
+
+void appendJsonString(std::string& out, const char* text) {
+    out += '"';
+    for (const char* p = text; *p; p++) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    out += '"';
+}
+
+}
+
+Writer::Writer()
+    : nextThreadId(1), format(FORMAT_TEXT), fd(STDERR_FILENO), pendingFd(-1), flushRequested(false), dropped(0) {
+    batch.reserve(BATCH_BYTES + 1024);
+    std::thread(&Writer::run, this).detach();
+    std::atexit(flushAtExit);
+}
+
+std::shared_ptr<Ring> Writer::registerThread() {
+    std::shared_ptr<Ring> ring = std::make_shared<Ring>(nextThreadId++);
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    rings.push_back(ring);
+    return ring;
+}
+
+void Writer::configure(LogFormat newFormat, int newFd) {
+    flush();
+
+    // The writer thread swaps and closes, so the old fd is never closed
+    // under a write() in progress, where its number could be reused, e.g.
+    // by a client socket, and get log lines. A fd handed over before and
+    // not yet taken was never written to.
+    int superseded = pendingFd.exchange(newFd);
+    if (superseded != -1 && superseded != STDERR_FILENO && superseded != STDOUT_FILENO) {
+        close(superseded);
+    }
+    format = newFormat;
+
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    while (pendingFd.load() != -1) {
+        flushRequested = true;
+        wakeCondition.notify_one();
+        drainedCondition.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT_MS));
+    }
+}
+
+void Writer::adoptPendingFd() {
+    int next = pendingFd.exchange(-1);
+    if (next == -1) {
+        return;
+    }
+    int previous = fd;
+    fd = next;
+    if (previous != STDERR_FILENO && previous != STDOUT_FILENO) {
+        close(previous);
+    }
+}
+
+void Writer::run() {
+    while (true) {
+        size_t drained = drainOnce();
+        drainedCondition.notify_all();
+
+        if (drained == 0) {
+            // Producers never signal; an idle writer polls at a coarse interval
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wakeCondition.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT_MS), [this] {
+                return flushRequested.load();
+            });
+            flushRequested = false;
+        }
+    }
+}
+
+size_t Writer::drainOnce() {
+    // Between batches, nothing is being written
+    adoptPendingFd();
+
+    std::vector<std::shared_ptr<Ring>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        snapshot = rings;
+    }
+
+    size_t drained = 0;
+    for (size_t i = 0; i < snapshot.size(); i++) {
+        Ring& ring = *snapshot[i];
+        size_t tail = ring.tail.load(std::memory_order_relaxed);
+        size_t head = ring.head.load(std::memory_order_acquire);
+
+        while (tail != head) {
+            formatRecord(ring.records[tail % RING_CAPACITY]);
+            tail++;
+            if (batch.size() >= BATCH_BYTES) {
+                writeBatch();
+            }
+        }
+        drained += head - ring.tail.load(std::memory_order_relaxed);
+        ring.tail.store(tail, std::memory_order_release);
+    }
+    writeBatch();
+
+    // Reclaim rings whose thread has exited and which are fully drained
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (size_t i = 0; i < rings.size();) {
+        Ring& ring = *rings[i];
+        if (ring.retired.load(std::memory_order_acquire) &&
+            ring.head.load(std::memory_order_acquire) == ring.tail.load(std::memory_order_relaxed)) {
+            rings[i] = rings.back();
+            rings.pop_back();
+        } else {
+            i++;
+        }
+    }
+    return drained;
+}
+
+void Writer::formatRecord(const LogRecord& record) {
+    time_t seconds = static_cast<time_t>(record.timestampNs / 1000000000ULL);
+    unsigned millis = static_cast<unsigned>((record.timestampNs / 1000000ULL) % 1000);
+    struct tm utc;
+    gmtime_r(&seconds, &utc);
+
+    char line[512];
+    int length = 0;
+    int level = record.level <= LEVEL_ERROR ? static_cast<int>(record.level) : static_cast<int>(LEVEL_ERROR);
+    int currentFormat = format.load(std::memory_order_relaxed);
+
+    if (currentFormat == FORMAT_JSON) {
+        char timestamp[64];
+        std::snprintf(timestamp, sizeof(timestamp), "%04d-%02d-%02dT%02d:%02d:%02d.%03uZ",
+                      utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+                      utc.tm_hour, utc.tm_min, utc.tm_sec, millis);
+
+        batch += "{\"ts\":\"";
+        batch += timestamp;
+        batch += "\",\"level\":\"";
+        batch += LEVEL_JSON[level];
+        batch += "\",\"component\":";
+        appendJsonString(batch, record.component);
+        batch += ",\"thread\":";
+        batch += std::to_string(record.threadId);
+
+        if (record.kind == RECORD_ACCESS) {
+            batch += ",\"remote\":";
+            appendJsonString(batch, record.remote);
+            batch += ",\"method\":";
+            appendJsonString(batch, record.method);
+            batch += ",\"path\":";
+            appendJsonString(batch, record.text);
+            batch += ",\"protocol\":";
+            appendJsonString(batch, record.protocol);
+            batch += ",\"status\":" + std::to_string(record.status);
+            batch += ",\"bytes\":" + std::to_string(record.bytes);
+            batch += ",\"duration_us\":" + std::to_string(record.durationUs);
+        } else {
+            batch += ",\"msg\":";
+            appendJsonString(batch, record.text);
+        }
+        batch += "}\n";
+        return;
+    }
+
+    if (record.kind == RECORD_ACCESS && currentFormat == FORMAT_COMMON_LOG) {
+        // host ident authuser [date] "request" status bytes
+        char size[24];
+        if (record.bytes == 0) {
+            std::strcpy(size, "-");
+        } else {
+            std::snprintf(size, sizeof(size), "%llu", static_cast<unsigned long long>(record.bytes));
+        }
+        length = std::snprintf(line, sizeof(line), "%s - - [%02d/%s/%04d:%02d:%02d:%02d +0000] \"%s %s %s\" %u %s\n",
+                               record.remote[0] ? record.remote : "-",
+                               utc.tm_mday, MONTHS[utc.tm_mon], utc.tm_year + 1900,
+                               utc.tm_hour, utc.tm_min, utc.tm_sec,
+                               record.method, record.text, record.protocol,
+                               static_cast<unsigned>(record.status), size);
+    } else {
+        length = std::snprintf(line, sizeof(line), "%04d-%02d-%02dT%02d:%02d:%02d.%03uZ %-5s %s[%u]: ",
+                               utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+                               utc.tm_hour, utc.tm_min, utc.tm_sec, millis,
+                               LEVEL_NAMES[level], record.component, record.threadId);
+        if (length > 0 && static_cast<size_t>(length) < sizeof(line)) {
+            if (record.kind == RECORD_ACCESS) {
+                length += std::snprintf(line + length, sizeof(line) - length, "%s \"%s %s %s\" %u %llu %uus\n",
+                                        record.remote, record.method, record.text, record.protocol,
+                                        static_cast<unsigned>(record.status),
+                                        static_cast<unsigned long long>(record.bytes), record.durationUs);
+            } else {
+                length += std::snprintf(line + length, sizeof(line) - length, "%s\n", record.text);
+            }
+        }
+    }
+
+    if (length > 0) {
+        if (static_cast<size_t>(length) >= sizeof(line)) {
+            length = sizeof(line) - 1;
+            line[length - 1] = '\n';
+        }
+        batch.append(line, length);
+    }
+}
+
+void Writer::writeBatch() {
+    size_t offset = 0;
+    while (offset < batch.size()) {
+        ssize_t written = write(fd, batch.data() + offset, batch.size() - offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        offset += written;
+    }
+    batch.clear();
+}
+
+void Writer::flush() {
+    std::vector<std::pair<std::shared_ptr<Ring>, size_t>> pending;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (size_t i = 0; i < rings.size(); i++) {
+            pending.push_back(std::make_pair(rings[i], rings[i]->head.load(std::memory_order_acquire)));
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    while (true) {
+        bool done = true;
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (pending[i].first->tail.load(std::memory_order_acquire) < pending[i].second) {
+                done = false;
+                break;
+            }
+        }
+        if (done) {
+            return;
+        }
+        flushRequested = true;
+        wakeCondition.notify_one();
+        drainedCondition.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT_MS));
+    }
+}
+
+void configure(LogFormat format, const std::string& path) {
+    int fd = STDERR_FILENO;
+    if (!path.empty()) {
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open log file: " + path);
+        }
+    }
+    writer().configure(format, fd);
+}
+
+void configureFromEnvironment() {
+    const char* formatName = std::getenv("LOG_FORMAT");
+    const char* path = std::getenv("LOG_FILE");
+    configure(parseFormat(formatName != nullptr ? formatName : ""), path != nullptr ? path : "");
+}
+
+LogFormat parseFormat(const std::string& name) {
+    if (name == "clf") {
+        return FORMAT_COMMON_LOG;
+    } else if (name == "json") {
+        return FORMAT_JSON;
+    }
+    return FORMAT_TEXT;
+}
+
+void logMessage(int level, const char* component, const char* text, size_t length) {
+    Ring* ring = currentRing();
+    LogRecord* record = ring->claim();
+    if (record == nullptr) {
+        writer().dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    record->timestampNs = nowNs();
+    record->threadId = ring->threadId;
+    record->level = static_cast<uint8_t>(level);
+    record->kind = RECORD_MESSAGE;
+    copyField(record->component, sizeof(record->component), component);
+    copyField(record->text, sizeof(record->text), text, length);
+    ring->publish();
+}
+
+void logAccess(const AccessEntry& entry) {
+    Ring* ring = currentRing();
+    LogRecord* record = ring->claim();
+    if (record == nullptr) {
+        writer().dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    record->timestampNs = nowNs();
+    record->threadId = ring->threadId;
+    record->level = LEVEL_INFO;
+    record->kind = RECORD_ACCESS;
+    record->status = static_cast<uint16_t>(entry.status);
+    record->bytes = entry.bytes;
+    record->durationUs = entry.durationUs;
+    copyField(record->component, sizeof(record->component), entry.component);
+    copyField(record->remote, sizeof(record->remote), entry.remote);
+    copyField(record->method, sizeof(record->method), entry.method);
+    copyField(record->protocol, sizeof(record->protocol), entry.protocol);
+    copyField(record->text, sizeof(record->text), entry.path);
+    ring->publish();
+}
+
+void flush() {
+    writer().flush();
+}
+
+uint64_t droppedRecords() {
+    return writer().dropped.load(std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,127 @@
+// AsyncLogger - Shared asynchronous logging for the servers in this repo.
+//
+// Hot paths copy a fixed-size binary record into a per-thread single-producer
+// single-consumer ring and return; a background thread drains every ring,
+// formats the records as text, Common Log Format or JSON and writes them in
+// batches. Levels below LOG_MIN_LEVEL are removed at compile time, so their
+// arguments are never evaluated.
+
+#ifndef ASYNC_LOGGER_H
+#define ASYNC_LOGGER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 0 = trace, 1 = debug, 2 = info, 3 = warn, 4 = error, 5 = off
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 2
+#endif
+
+namespace logging {
+
+enum LogLevel {
+    LEVEL_TRACE = 0,
+    LEVEL_DEBUG = 1,
+    LEVEL_INFO = 2,
+    LEVEL_WARN = 3,
+    LEVEL_ERROR = 4
+};
+
+enum LogFormat {
+    FORMAT_TEXT,        // 2026-10-18T19:05:15.123Z INFO  http: message
+    FORMAT_COMMON_LOG,  // access records in Common Log Format, messages as text
+    FORMAT_JSON         // one JSON object per line
+};
+
+template <int Level>
+struct LevelEnabled {
+    static const bool value = Level >= LOG_MIN_LEVEL;
+};
+
+enum RecordKind : uint8_t {
+    RECORD_MESSAGE,
+    RECORD_ACCESS
+};
+
+// Fixed-size, trivially copyable record; strings are truncated to fit
+struct LogRecord {
+    uint64_t timestampNs;
+    uint32_t threadId;
+    uint32_t durationUs;
+    uint64_t bytes;
+    uint16_t status;
+    uint8_t level;
+    uint8_t kind;
+    char component[12];
+    char remote[46];
+    char method[10];
+    char protocol[10];
+    char text[160];     // message, or request path for access records
+};
+
+// One HTTP request, as written to the access log
+struct AccessEntry {
+    const char* component;
+    const char* remote;
+    const char* method;
+    const char* path;
+    const char* protocol;
+    int status;
+    uint64_t bytes;
+    uint32_t durationUs;
+};
+
+// Selects the output format and destination ("" = stderr). Safe to call
+// once at startup before the first record; the writer thread starts lazily.
+void configure(LogFormat format, const std::string& path = "");
+
+// configure() from LOG_FORMAT (text, clf or json) and LOG_FILE
+void configureFromEnvironment();
+
+// "clf" and "json" select those formats; anything else is text
+LogFormat parseFormat(const std::string& name);
+
+void logMessage(int level, const char* component, const char* text, size_t length);
+void logAccess(const AccessEntry& entry);
+
+// Blocks until every record pushed so far has been written
+void flush();
+
+// Records dropped because a producer's ring was full
+uint64_t droppedRecords();
+
+inline void logMessage(int level, const char* component, const std::string& text) {
+    logMessage(level, component, text.data(), text.size());
+}
+
+inline void logMessage(int level, const char* component, const char* text) {
+    size_t length = 0;
+    while (text[length] != '\0') length++;
+    logMessage(level, component, text, length);
+}
+
+}
+
+#define LOG_AT(level, component, message) \
+    do { \
+        if (::logging::LevelEnabled<level>::value) { \
+            ::logging::logMessage(level, component, message); \
+        } \
+    } while (0)
+
+#define LOG_TRACE(component, message) LOG_AT(0, component, message)
+#define LOG_DEBUG(component, message) LOG_AT(1, component, message)
+#define LOG_INFO(component, message) LOG_AT(2, component, message)
+#define LOG_WARN(component, message) LOG_AT(3, component, message)
+#define LOG_ERROR(component, message) LOG_AT(4, component, message)
+
+#define LOG_ACCESS(entry) \
+    do { \
+        if (::logging::LevelEnabled<2>::value) { \
+            ::logging::logAccess(entry); \
+        } \
+    } while (0)
+
+#endif // ASYNC_LOGGER_H
@@ -4,8 +4,11 @@
 #include "config.h"
 #include "utils.h"
 #include "email_manager.h"
+#include "async_logger.h"
 
 int main() {
+    logging::configureFromEnvironment();
+
     EmailManager email_manager;
     email_manager.run();
 
@@ -1,6 +1,7 @@
 // pop3_client.cpp
 #include "pop3_client.h"
 #include "utils.h"
+#include "async_logger.h"
 #include <iostream>
 #include <string>
 #include <cstring>
@@ -22,7 +23,7 @@
 bool POP3Client::send_command(const std::string& command) {
     std::string cmd_with_crlf = command + "\r\n";
     
-    std::cout << ansiColor(90) << "Client: " << command << ansiReset() << std::endl;
+    LOG_INFO("pop3", "Client: " + (command.compare(0, 5, "PASS ") == 0 ? "PASS ********" : command));
     
     int result = 0;
     if (use_ssl && ssl) {
@@ -128,9 +129,9 @@ std::string POP3Client::receive_response(int timeout_seconds) {
     }
     
     if (complete_response.find("out of range") != std::string::npos) {
-        std::cout << ansiColor(90) << "Server: " << "+OK Message deleted" << ansiReset() << std::endl;
+        LOG_INFO("pop3", "Server: +OK Message deleted");
     } else {
-        std::cout << ansiColor(90) << "Server: " << complete_response << ansiReset();
+        LOG_INFO("pop3", "Server: " + complete_response.substr(0, complete_response.find_last_not_of("\r\n") + 1));
     }
     return complete_response;
 }
@@ -297,7 +298,8 @@ bool POP3Client::connect_to_server(const std::string& host, int port) {
             return false;
         }
         buffer[bytes_read] = '\0';
-        std::cout << ansiColor(90) << "Server: " << buffer << ansiReset();
+        std::string greeting(buffer);
+        LOG_INFO("pop3", "Server: " + greeting.substr(0, greeting.find_last_not_of("\r\n") + 1));
         
         // Check if the response starts with "+OK"
         if (strncmp(buffer, "+OK", 3) != 0) {
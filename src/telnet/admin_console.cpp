@@ -0,0 +1,205 @@
+#include "admin_console.h"
+#include "async_logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <poll.h>
+
+const int AdminConsole::ACCEPT_RETRY_MILLISECONDS;
+
+static const size_t OPERATIONS = static_cast<size_t>(Operation::Count);
+
+// 850ns, 12.3us, 4.56ms, 1.20s
+static std::string formatDuration(uint64_t nanoseconds) {
+    char text[32];
+    if (nanoseconds < 1000) {
+        std::snprintf(text, sizeof(text), "%lluns", static_cast<unsigned long long>(nanoseconds));
+    } else if (nanoseconds < 1000000) {
+        std::snprintf(text, sizeof(text), "%.1fus", nanoseconds / 1e3);
+    } else if (nanoseconds < 1000000000) {
+        std::snprintf(text, sizeof(text), "%.2fms", nanoseconds / 1e6);
+    } else {
+        std::snprintf(text, sizeof(text), "%.2fs", nanoseconds / 1e9);
+    }
+    return text;
+}
+
+static std::string lockLine(const char* kind, const Histogram& wait, const Histogram& hold) {
+    char line[160];
+    uint64_t waits = wait.count();
+    uint64_t holds = hold.count();
+    std::snprintf(line, sizeof(line), "  %-10s %10llu %10s %10s %10s %10s %10s %10s", kind,
+                  static_cast<unsigned long long>(waits),
+                  formatDuration(waits ? wait.total() / waits : 0).c_str(),
+                  formatDuration(wait.percentile(0.99)).c_str(), formatDuration(wait.max()).c_str(),
+                  formatDuration(holds ? hold.total() / holds : 0).c_str(),
+                  formatDuration(hold.percentile(0.99)).c_str(), formatDuration(hold.max()).c_str());
+    return line;
+}
+
+AdminConsole::AdminConsole(int port, Metrics& metrics) : port(port), metrics(metrics) {
+}
+
+void AdminConsole::start() {
+    socket_t listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listenSocket == INVALID_SOCKET) {
+        throw std::runtime_error("Failed to create admin socket: " + std::string(std::strerror(errno)));
+    }
+
+    int reuse = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    // Operators only: never reachable from other hosts
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listenSocket, (struct sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+        listen(listenSocket, 4) == SOCKET_ERROR) {
+        std::string reason = std::strerror(errno);
+        CLOSE_SOCKET(listenSocket);
+        throw std::runtime_error("Failed to open admin port " + std::to_string(port) + ": " + reason);
+    }
+
+    socklen_t length = sizeof(address);
+    if (getsockname(listenSocket, (struct sockaddr*)&address, &length) == 0) {
+        port = ntohs(address.sin_port);
+    }
+
+    std::thread(&AdminConsole::acceptClients, this, listenSocket).detach();
+}
+
+void AdminConsole::acceptClients(socket_t listenSocket) {
+    while (true) {
+        socket_t client = accept(listenSocket, nullptr, nullptr);
+        if (client == INVALID_SOCKET) {
+            if (errno != EINTR) {
+                // EMFILE and the like would fail again at once; the pending
+                // connection stays queued, so waiting loses nothing
+                LOG_WARN("telnet", "Admin accept failed: " + std::string(std::strerror(errno)));
+                std::this_thread::sleep_for(std::chrono::milliseconds(ACCEPT_RETRY_MILLISECONDS));
+            }
+            continue;
+        }
+        std::thread(&AdminConsole::serve, this, client).detach();
+    }
+}
+
+void AdminConsole::serve(socket_t client) {
+    LOG_INFO("telnet", "Admin console opened");
+    Totals previous;
+    previous.at = 0;
+
+    while (true) {
+        std::string screen = render(previous);
+        if (send(client, screen.data(), screen.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(screen.size())) {
+            break;
+        }
+
+        // Redraw once a second, or at once after a key
+        pollfd ready;
+        ready.fd = client;
+        ready.events = POLLIN;
+        if (poll(&ready, 1, REFRESH_MILLISECONDS) <= 0) {
+            continue;
+        }
+
+        char keys[256];
+        ssize_t received = recv(client, keys, sizeof(keys), 0);
+        if (received <= 0) {
+            break;
+        }
+        if (std::memchr(keys, 'q', static_cast<size_t>(received)) != nullptr) {
+            break;
+        }
+        if (std::memchr(keys, 'r', static_cast<size_t>(received)) != nullptr) {
+            metrics.reset();
+            previous.at = 0;
+        }
+    }
+
+    CLOSE_SOCKET(client);
+    LOG_INFO("telnet", "Admin console closed");
+}
+
+std::string AdminConsole::render(Totals& previous) const {
+    uint64_t now = Metrics::now();
+    Totals current;
+    current.at = now;
+    for (size_t i = 0; i < OPERATIONS; i++) {
+        OperationStats& stats = metrics.operation(static_cast<Operation>(i));
+        current.calls.push_back(stats.latency.count());
+        current.lockNanoseconds.push_back(stats.lockWaitNanoseconds.load() + stats.lockHoldNanoseconds.load());
+    }
+
+    // Rates cover the time since the last screen; the first one has none
+    bool rates = previous.at != 0 && now > previous.at;
+    double interval = rates ? (now - previous.at) / 1e9 : 0;
+
+    std::string screen = "\x1B[2J\x1B[1;1H";
+    char line[200];
+
+    uint64_t uptime = (now - metrics.startedAt()) / 1000000000;
+    std::snprintf(line, sizeof(line), "Phone Book Server - up %llu:%02llu:%02llu - %lld sessions (%lld batch), %llu since start",
+                  static_cast<unsigned long long>(uptime / 3600), static_cast<unsigned long long>(uptime / 60 % 60),
+                  static_cast<unsigned long long>(uptime % 60), static_cast<long long>(metrics.activeSessions()),
+                  static_cast<long long>(metrics.activeBatchSessions()),
+                  static_cast<unsigned long long>(metrics.openedSessions()));
+    screen += line;
+    screen += "\r\n\r\n";
+
+    std::snprintf(line, sizeof(line), "%-12s %10s %10s %10s %10s %10s %10s %10s", "contactsMutex", "taken",
+                  "wait avg", "wait p99", "wait max", "hold avg", "hold p99", "hold max");
+    screen += line;
+    screen += "\r\n";
+    const LockStats& lock = metrics.contactsLock();
+    screen += lockLine("exclusive", lock.exclusiveWait, lock.exclusiveHold) + "\r\n";
+    screen += lockLine("shared", lock.sharedWait, lock.sharedHold) + "\r\n\r\n";
+
+    // Busiest lock users in the last interval first, then by calls
+    std::vector<size_t> order;
+    for (size_t i = 0; i < OPERATIONS; i++) {
+        if (current.calls[i] > 0 || current.lockNanoseconds[i] > 0) {
+            order.push_back(i);
+        }
+    }
+    auto recentLock = [&](size_t i) {
+        return rates ? current.lockNanoseconds[i] - std::min(current.lockNanoseconds[i], previous.lockNanoseconds[i]) : 0;
+    };
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (recentLock(a) != recentLock(b)) {
+            return recentLock(a) > recentLock(b);
+        }
+        return current.calls[a] > current.calls[b];
+    });
+
+    std::snprintf(line, sizeof(line), "%-12s %10s %8s %10s %10s %10s %7s %12s %12s", "OPERATION", "calls", "/s",
+                  "avg", "p99", "max", "lock%", "lock wait", "lock hold");
+    screen += line;
+    screen += "\r\n";
+    for (size_t i : order) {
+        const OperationStats& stats = metrics.operation(static_cast<Operation>(i));
+        uint64_t calls = current.calls[i];
+        double perSecond = rates ? (calls - std::min(calls, previous.calls[i])) / interval : 0;
+        double lockShare = rates ? recentLock(i) / (interval * 1e9) * 100 : 0;
+        std::snprintf(line, sizeof(line), "%-12s %10llu %8.0f %10s %10s %10s %6.1f%% %12s %12s",
+                      operationName(static_cast<Operation>(i)), static_cast<unsigned long long>(calls), perSecond,
+                      formatDuration(calls ? stats.latency.total() / calls : 0).c_str(),
+                      formatDuration(stats.latency.percentile(0.99)).c_str(),
+                      formatDuration(stats.latency.max()).c_str(), lockShare,
+                      formatDuration(stats.lockWaitNanoseconds.load()).c_str(),
+                      formatDuration(stats.lockHoldNanoseconds.load()).c_str());
+        screen += line;
+        screen += "\r\n";
+    }
+
+    screen += "\r\nlock% is time waiting for or holding contactsMutex in the last second; q quits, r resets\r\n";
+    previous = current;
+    return screen;
+}
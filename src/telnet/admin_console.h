@@ -0,0 +1,50 @@
+// AdminConsole - Operator view of the telnet server on a port bound to the
+// loopback interface. A connected client sees a "top"-style screen, redrawn
+// every second: active sessions, how long contactsMutex is waited for and
+// held, and per operation the calls, rate, latency and lock time, busiest
+// lock user first. Keys: q quits, r resets the counters.
+//
+// Each console client has a thread of its own instead of an event loop
+// session, so the view still updates while every worker is stuck behind
+// the lock it is meant to diagnose.
+
+#ifndef ADMIN_CONSOLE_H
+#define ADMIN_CONSOLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "metrics.h"
+#include "session.h"
+
+class AdminConsole {
+    public:
+        static const int REFRESH_MILLISECONDS = 1000;
+        // Pause after a failed accept, e.g. out of descriptors, before the next
+        static const int ACCEPT_RETRY_MILLISECONDS = 200;
+
+        AdminConsole(int port, Metrics& metrics);
+
+        // Starts accepting in the background; throws if the port is taken
+        void start();
+
+        // The bound port once started, if 0 was asked for
+        int listeningPort() const { return port; }
+
+    private:
+        // What the previous screen showed, for per-second rates
+        struct Totals {
+            uint64_t at;
+            std::vector<uint64_t> calls;
+            std::vector<uint64_t> lockNanoseconds;
+        };
+
+        void acceptClients(socket_t listenSocket);
+        void serve(socket_t client);
+        std::string render(Totals& previous) const;
+
+        int port;
+        Metrics& metrics;
+};
+
+#endif // ADMIN_CONSOLE_H
@@ -0,0 +1,41 @@
+#include "command_parser.h"
+#include <algorithm>
+#include <cctype>
+
+bool parseContact(const std::string& contactInfo, std::string& name, std::string& phoneNumber) {
+    size_t pos = contactInfo.find(':');
+    if (pos == std::string::npos) {
+        return false;
+    }
+
+    name = contactInfo.substr(0, pos);
+    phoneNumber = contactInfo.substr(pos + 1);
+    
+    // Trim whitespace
+    name.erase(0, name.find_first_not_of(" \t"));
+    name.erase(name.find_last_not_of(" \t") + 1);
+    phoneNumber.erase(0, phoneNumber.find_first_not_of(" \t"));
+    phoneNumber.erase(phoneNumber.find_last_not_of(" \t") + 1);
+    return true;
+}
+
+BatchCommand parseBatchCommand(const std::string& line) {
+    BatchCommand command;
+    size_t space = line.find(' ');
+    command.verb = line.substr(0, space);
+    size_t start = space == std::string::npos ? space : line.find_first_not_of(' ', space);
+    if (start != std::string::npos) {
+        command.argument = line.substr(start);
+    }
+    std::transform(command.verb.begin(), command.verb.end(), command.verb.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+
+    if (command.verb == "ADD" || command.verb == "DEL") {
+        command.access = BatchAccess::Change;
+    } else if (command.verb == "GET" || command.verb == "FIND") {
+        command.access = BatchAccess::Read;
+    } else {
+        command.access = BatchAccess::Other;
+    }
+    return command;
+}
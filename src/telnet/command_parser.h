@@ -0,0 +1,30 @@
+// CommandParser - Parsing of the text the phone book server is sent:
+// "Name:PhoneNumber" entries and batch protocol lines. Plain functions of
+// their input, apart from sessions and sockets, so they can be driven on
+// their own (e.g. by a fuzzer).
+
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+
+#include <string>
+
+// Splits "Name:PhoneNumber" into its trimmed halves; false without a colon
+bool parseContact(const std::string& contactInfo, std::string& name, std::string& phoneNumber);
+
+// What a batch command needs of contactsMutex
+enum class BatchAccess {
+    Read,       // under the shared lock
+    Change,     // under the exclusive lock
+    Other       // no lock, or takes its own
+};
+
+struct BatchCommand {
+    std::string verb;       // upper-cased
+    std::string argument;
+    BatchAccess access;
+};
+
+// "VERB argument"; the verb is matched in any case
+BatchCommand parseBatchCommand(const std::string& line);
+
+#endif // COMMAND_PARSER_H
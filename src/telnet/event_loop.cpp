@@ -0,0 +1,317 @@
+#include "event_loop.h"
+#include "async_logger.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <sys/epoll.h>
+
+static const int MAX_EVENTS = 64;
+static const int WAIT_TIMEOUT_MS = 1000;
+static const size_t RECEIVE_BUFFER_SIZE = 64 * 1024;
+static const int READS_PER_EVENT = 4;
+
+static int64_t steadySeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void setNonBlocking(socket_t socket) {
+    int flags = fcntl(socket, F_GETFL, 0);
+    fcntl(socket, F_SETFL, flags | O_NONBLOCK);
+}
+
+EventLoop::EventLoop(socket_t listenSocket, const Handlers& handlers, size_t workers,
+                     size_t maxSessions, int idleTimeoutSeconds)
+    : handlers(handlers), workers(workers < 1 ? 1 : workers),
+      maxSessions(maxSessions), idleTimeout(idleTimeoutSeconds), nextSweep(0) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        throw std::runtime_error("Failed to create epoll instance: " + std::string(std::strerror(errno)));
+    }
+
+    try {
+        addListener(listenSocket, handlers.open);
+    } catch (...) {
+        close(epollFd);
+        throw;
+    }
+}
+
+EventLoop::~EventLoop() {
+    close(epollFd);
+}
+
+void EventLoop::addListener(socket_t listenSocket, const OpenHandler& open) {
+    listeners.emplace_back(new Listener{listenSocket, open, {}});
+
+    // Listeners stay level-triggered; any worker that wakes for one accepts
+    setNonBlocking(listenSocket);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = listeners.back().get();
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenSocket, &event) != 0) {
+        listeners.pop_back();
+        throw std::runtime_error("Failed to watch listening socket: " + std::string(std::strerror(errno)));
+    }
+}
+
+void EventLoop::run() {
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers; i++) {
+        threads.emplace_back(&EventLoop::work, this);
+    }
+    work();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void EventLoop::work() {
+    epoll_event events[MAX_EVENTS];
+
+    while (true) {
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, WAIT_TIMEOUT_MS);
+        if (count < 0 && errno != EINTR) {
+            LOG_ERROR("telnet", "epoll_wait failed: " + std::string(std::strerror(errno)));
+            return;
+        }
+
+        for (int i = 0; i < count; i++) {
+            Listener* listener = nullptr;
+            for (const auto& candidate : listeners) {
+                if (events[i].data.ptr == candidate.get()) {
+                    listener = candidate.get();
+                }
+            }
+
+            if (listener != nullptr) {
+                acceptClients(*listener);
+            } else {
+                service(*static_cast<Session*>(events[i].data.ptr), events[i].events);
+            }
+        }
+
+        // One worker per interval looks for idle sessions
+        int64_t now = steadySeconds();
+        int64_t due = nextSweep.load();
+        if (now >= due && nextSweep.compare_exchange_strong(due, now + 1)) {
+            closeIdleSessions(now);
+            // Descriptors may also have been freed outside this loop
+            resumeListeners();
+        }
+    }
+}
+
+void EventLoop::acceptClients(Listener& listener) {
+    while (true) {
+        sockaddr_in clientAddr;
+        socklen_t clientAddrSize = sizeof(clientAddr);
+        socket_t clientSocket = accept(listener.socket, (struct sockaddr*)&clientAddr, &clientAddrSize);
+        if (clientSocket == INVALID_SOCKET) {
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                // The listener is level-triggered, so every worker would wake
+                // for it and fail again at once; the connection stays queued
+                // until a descriptor is free
+                if (!listener.paused.exchange(true)) {
+                    LOG_WARN("telnet", "Accept failed: " + std::string(std::strerror(errno)) +
+                                       "; not accepting until a session closes");
+                    watchListener(listener, false);
+                }
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_WARN("telnet", "Accept failed: " + std::string(std::strerror(errno)));
+            }
+            return;
+        }
+
+        char clientIP[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &(clientAddr.sin_addr), clientIP, INET_ADDRSTRLEN);
+        setNonBlocking(clientSocket);
+
+        // Output is already coalesced per screen, so Nagle would only add latency
+        int noDelay = 1;
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+        std::unique_lock<std::mutex> lock(sessionsMutex);
+        if (sessions.size() >= maxSessions) {
+            lock.unlock();
+            static const char busy[] = "Server is busy, please try again later.\r\n";
+            ssize_t ignored = send(clientSocket, busy, sizeof(busy) - 1, MSG_NOSIGNAL);
+            (void)ignored;
+            CLOSE_SOCKET(clientSocket);
+            LOG_WARN("telnet", std::string("Session limit reached, refused ") + clientIP);
+            continue;
+        }
+
+        Session* session = new Session(clientSocket, clientIP);
+        sessions[clientSocket].reset(session);
+        lock.unlock();
+
+        // Not registered yet, so no other worker can see the session
+        session->lastActivity = steadySeconds();
+        listener.open(*session);
+        if (!session->output.flush()) {
+            closeSession(*session);
+            continue;
+        }
+        rearm(*session, EPOLL_CTL_ADD);
+    }
+}
+
+void EventLoop::watchListener(Listener& listener, bool accepting) {
+    epoll_event event{};
+    event.events = accepting ? EPOLLIN : 0;
+    event.data.ptr = &listener;
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, listener.socket, &event) != 0) {
+        LOG_WARN("telnet", "Failed to watch listening socket: " + std::string(std::strerror(errno)));
+    }
+}
+
+void EventLoop::resumeListeners() {
+    for (const auto& listener : listeners) {
+        if (listener->paused.exchange(false)) {
+            LOG_INFO("telnet", "Accepting again");
+            watchListener(*listener, true);
+        }
+    }
+}
+
+void EventLoop::receive(Session& session, bool drain) {
+    static thread_local char buffer[RECEIVE_BUFFER_SIZE];
+    static thread_local std::string plain;
+    static thread_local std::string replies;
+
+    for (int reads = 0; drain || reads < READS_PER_EVENT; reads++) {
+        ssize_t received = recv(session.socket, buffer, sizeof(buffer), 0);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            session.inputClosed = true;
+            return;
+        }
+        session.lastActivity = steadySeconds();
+
+        // Telnet commands are answered here; only the data reaches the line reader
+        plain.clear();
+        replies.clear();
+        session.telnet.parse(buffer, static_cast<size_t>(received), plain, replies);
+        if (!replies.empty()) {
+            session.output.append(replies);
+        }
+        session.input.feed(plain.data(), plain.size(), session.lines);
+    }
+}
+
+void EventLoop::service(Session& session, uint32_t events) {
+    // A hang-up may leave input behind the FIN; it is read now because the
+    // one-shot registration will not report it again
+    bool hangUp = (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0;
+    if (!session.inputClosed && (hangUp || session.output.pendingBytes() < OUTPUT_HIGH_WATER)) {
+        receive(session, hangUp);
+    }
+
+    // Only the idle sweep shuts the read side, so end of input means timed out
+    bool timedOut = session.inputClosed && session.timedOut;
+    if (timedOut) {
+        session.lines.clear();
+        session.output.appendLine("");
+        session.output.appendLine("Disconnected after " + std::to_string(idleTimeout / 60) +
+                                  " minutes of inactivity.");
+        session.output.flush();
+        closeSession(session);
+        return;
+    }
+
+    // Lines held back by the high-water mark are answered as soon as a
+    // flush makes room; nothing else would wake the session for them when
+    // the flush sent everything or the client has stopped sending
+    bool connected;
+    while (true) {
+        while (!session.lines.empty() && session.state != SessionState::Closing &&
+               session.output.pendingBytes() < OUTPUT_HIGH_WATER) {
+            // Pipelined batch commands are answered several at a time
+            if (session.state == SessionState::Batch && handlers.batch) {
+                handlers.batch(session, session.lines);
+                continue;
+            }
+
+            std::string line;
+            line.swap(session.lines.front());
+            session.lines.pop_front();
+            handlers.line(session, line);
+        }
+        if (session.state == SessionState::Closing) {
+            session.lines.clear();
+        }
+
+        connected = session.output.flush();
+        if (!connected || session.lines.empty() || session.output.pendingBytes() >= OUTPUT_HIGH_WATER) {
+            break;
+        }
+    }
+    bool finished = session.state == SessionState::Closing ||
+                    (session.inputClosed && session.lines.empty());
+    if (!connected || (finished && session.output.pendingBytes() == 0)) {
+        closeSession(session);
+        return;
+    }
+    rearm(session, EPOLL_CTL_MOD);
+}
+
+void EventLoop::rearm(Session& session, int operation) {
+    epoll_event event{};
+    event.events = EPOLLONESHOT;
+    if (session.state != SessionState::Closing && !session.inputClosed) {
+        event.events |= EPOLLRDHUP;
+        if (session.output.pendingBytes() < OUTPUT_HIGH_WATER) {
+            event.events |= EPOLLIN;
+        }
+    }
+    if (session.output.pendingBytes() > 0) {
+        event.events |= EPOLLOUT;
+    }
+    event.data.ptr = &session;
+
+    if (epoll_ctl(epollFd, operation, session.socket, &event) != 0) {
+        LOG_WARN("telnet", "Failed to watch " + session.clientIP + ": " + std::string(std::strerror(errno)));
+        closeSession(session);
+    }
+}
+
+void EventLoop::closeSession(Session& session) {
+    socket_t socket = session.socket;
+    handlers.close(session);
+
+    // Removed before the descriptor is closed and can be reused by accept()
+    {
+        std::lock_guard<std::mutex> lock(sessionsMutex);
+        sessions.erase(socket);
+    }
+    CLOSE_SOCKET(socket);
+    resumeListeners();
+}
+
+void EventLoop::closeIdleSessions(int64_t now) {
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+    for (const auto& entry : sessions) {
+        Session& session = *entry.second;
+        if (now - session.lastActivity < idleTimeout) {
+            continue;
+        }
+
+        // Ending the input wakes the owning worker, which says goodbye and
+        // closes. A session that still has not gone a sweep later is not
+        // reading its output either, so the write side goes too.
+        if (!session.timedOut.exchange(true)) {
+            shutdown(session.socket, SHUT_RD);
+        } else {
+            shutdown(session.socket, SHUT_RDWR);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+// EventLoop - Serves all telnet sessions from one epoll set shared by a small
+// pool of worker threads. Sockets are registered one-shot, so a session is
+// only ever handled by one worker at a time and needs no lock of its own.
+// Idle sessions cost a Session object and the kernel's socket buffers instead
+// of a thread and its stack. Further listening sockets can open their
+// sessions differently, e.g. straight into batch mode.
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "session.h"
+
+class EventLoop {
+    public:
+        typedef std::function<void(Session&)> OpenHandler;
+
+        struct Handlers {
+            OpenHandler open;                                           // queue the first screen
+            std::function<void(Session&, const std::string&)> line;     // answer one input line
+            // In batch mode: answer some of the queued lines, taking them off the front
+            std::function<void(Session&, std::deque<std::string>&)> batch;
+            std::function<void(Session&)> close;
+        };
+
+        // Stop reading a client's input while this much output is unsent
+        static const size_t OUTPUT_HIGH_WATER = 256 * 1024;
+
+        EventLoop(socket_t listenSocket, const Handlers& handlers, size_t workers,
+                  size_t maxSessions, int idleTimeoutSeconds);
+        ~EventLoop();
+
+        // Also accepts on listenSocket, opening its sessions with open.
+        // Called before run().
+        void addListener(socket_t listenSocket, const OpenHandler& open);
+
+        // Runs the workers on this and workers - 1 further threads; does not return
+        void run();
+
+    private:
+        struct Listener {
+            socket_t socket;
+            OpenHandler open;
+            std::atomic<bool> paused;   // out of descriptors; watched again once one is free
+        };
+
+        void work();
+        void acceptClients(Listener& listener);
+        void watchListener(Listener& listener, bool accepting);
+        void resumeListeners();
+        void service(Session& session, uint32_t events);
+        void receive(Session& session, bool drain);
+        void rearm(Session& session, int operation);
+        void closeSession(Session& session);
+        void closeIdleSessions(int64_t now);
+
+        std::vector<std::unique_ptr<Listener>> listeners;   // their epoll data points at them
+        Handlers handlers;
+        size_t workers;
+        size_t maxSessions;
+        int idleTimeout;
+        int epollFd;
+        std::atomic<int64_t> nextSweep;
+
+        std::mutex sessionsMutex;
+        std::unordered_map<socket_t, std::unique_ptr<Session>> sessions;
+};
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,134 @@
+// fuzz_parsers - libFuzzer entry point for everything that reads client
+// bytes: the telnet option parser, then the line reader, then the batch
+// and contact parsers. The first input byte says where to split the rest
+// into two reads, so commands and option sequences cut across reads are
+// covered too. Invariants are checked with abort(), which the fuzzer
+// reports as a crash.
+//
+//     make fuzz && ./harness/fuzz_parsers -max_total_time=60
+//     make fuzz-standalone && ./harness/fuzz_standalone 2000000    (no clang)
+
+#include "../telnet_parser.h"
+#include "../session.h"
+#include "../command_parser.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iterator>
+#include <string>
+#include <vector>
+
+static void check(bool ok, const char* invariant) {
+    if (!ok) {
+        std::fprintf(stderr, "invariant broken: %s\n", invariant);
+        std::abort();
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    const char* text = reinterpret_cast<const char*>(data + 1);
+    size_t length = size - 1;
+    size_t cut = std::min(static_cast<size_t>(data[0]) % size, length);
+
+    TelnetParser telnet;
+    std::string plain;
+    std::string replies;
+    telnet.parse(text, cut, plain, replies);
+    telnet.parse(text + cut, length - cut, plain, replies);
+    check(plain.size() <= length, "plain text no longer than the input");
+    check(replies.size() <= 9 * length + 6, "replies bounded by the input");
+
+    // Replies are IAC verb option triples, or IAC SB TTYPE SEND IAC SE
+    for (size_t i = 0; i < replies.size(); ) {
+        check(static_cast<unsigned char>(replies[i]) == TelnetParser::IAC, "reply starts with IAC");
+        check(i + 1 < replies.size(), "reply has a verb");
+        if (static_cast<unsigned char>(replies[i + 1]) == TelnetParser::SB) {
+            check(i + 6 <= replies.size(), "subnegotiation reply complete");
+            i += 6;
+        } else {
+            check(i + 3 <= replies.size(), "reply is a triple");
+            i += 3;
+        }
+    }
+    check(telnet.terminalType().size() <= TelnetParser::MAX_SUBNEGOTIATION, "terminal type bounded");
+
+    LineReader reader;
+    std::deque<std::string> lines;
+    size_t plainCut = std::min(cut, plain.size());
+    reader.feed(plain.data(), plainCut, lines);
+    reader.feed(plain.data() + plainCut, plain.size() - plainCut, lines);
+
+    for (const auto& line : lines) {
+        check(line.size() <= LineReader::MAX_LINE_LENGTH, "line bounded");
+        check(line.find_first_of("\r\n") == std::string::npos, "line has no terminator");
+
+        BatchCommand command = parseBatchCommand(line);
+        check(command.verb.find(' ') == std::string::npos, "verb has no space");
+
+        std::string name;
+        std::string phone;
+        if (parseContact(line, name, phone)) {
+            check(name.find(':') == std::string::npos, "name has no colon");
+            check(name.empty() || (name.front() != ' ' && name.back() != ' '), "name trimmed");
+        }
+    }
+    return 0;
+}
+
+#ifdef STANDALONE
+// Without libFuzzer: random mutations of a few seeds, keeping some results
+// as further seeds
+static const char* seeds[] = {
+    "\xff\xfb\x1f\xff\xfa\x1f\x00\x50\x00\x18\xff\xf0hello\r\n",
+    "\xff\xfb\x18\xff\xfa\x18\x00xterm-256color\xff\xf0\xff\xfd\x01\xff\xfd\x03",
+    "ADD Alice:123\nGET alice\r\nDEL bob\r\0FIND x\rLIST 1 2\n",
+    "\xff\xff\xff\xfa\xff\xff\xff\xf0 add  a : b \r\n",
+};
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? std::atol(argv[1]) : 1000000;
+    std::srand(12345);
+    std::vector<std::string> corpus(std::begin(seeds), std::end(seeds));
+    const unsigned char interesting[] = {255, 254, 253, 252, 251, 250, 240, 31, 24, 1, 3, 0, '\r', '\n', ':', ' '};
+
+    for (long n = 0; n < iterations; n++) {
+        std::string input = corpus[std::rand() % corpus.size()];
+        int edits = 1 + std::rand() % 8;
+        for (int e = 0; e < edits; e++) {
+            size_t at = std::rand() % (input.size() + 1);
+            switch (std::rand() % 5) {
+                case 0:
+                    input.insert(at, 1, static_cast<char>(interesting[std::rand() % sizeof(interesting)]));
+                    break;
+                case 1:
+                    input.insert(at, 1, static_cast<char>(std::rand() & 0xFF));
+                    break;
+                case 2:
+                    if (at < input.size()) {
+                        input.erase(at, 1 + std::rand() % 4);
+                    }
+                    break;
+                case 3:
+                    input.insert(at, corpus[std::rand() % corpus.size()].substr(0, std::rand() % 32));
+                    break;
+                case 4:
+                    if (std::rand() % 50 == 0) {
+                        input.append(2000, static_cast<char>(std::rand() & 0xFF));
+                    }
+                    break;
+            }
+        }
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+        if (corpus.size() < 256 && std::rand() % 100 == 0) {
+            corpus.push_back(input.substr(0, 4096));
+        }
+    }
+    std::printf("%ld inputs, no failures\n", iterations);
+    return 0;
+}
+#endif
@@ -0,0 +1,569 @@
+// harness - Throughput and latency gate for the telnet server. Starts the
+// server on ephemeral ports with a scratch database of --contacts entries,
+// then drives --sessions concurrent scripted menu sessions, each doing
+// --rounds of list, search, add, edit and delete. Prints ops/s and p50/p99
+// overall and per operation, and exits non-zero if ops/s is below
+// --min-ops or p99 is above --max-p99 (milliseconds).
+//
+// With --stalled N, N further clients connect to the batch port first, ask
+// for the whole list over and over and never read an answer. The gate is
+// then on the scripted sessions alone: a client that stops reading must
+// not slow down the others.
+//
+// With --pipeline N, the run is a throughput benchmark instead: N of each
+// command are written down one connection without waiting for answers, the
+// menu's add on the menu port, then ADD, GET, FIND, a LIST of the whole
+// book in pages and DEL on the batch port. Prints commands/s and bytes of
+// output per command for each. --alloc-counter ./harness/alloc_count.so
+// preloads the allocation counter into the server and adds allocations per
+// command (or per op, for the sessions).
+//
+//     make harness && ./harness/harness --server ./main --sessions 100 --min-ops 1000 --max-p99 250
+//     make perf-gate HARNESS_ARGS="--sessions 100 --min-ops 1000"
+//     make perf-gate HARNESS_ARGS="--sessions 100 --stalled 50 --min-ops 1000 --max-p99 250"
+//     make bench
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const char* CHOICE = "Enter your choice: ";
+static const char* PAUSE = "Press Enter to return to main menu...";
+static const char* PAGE = "q quit: ";
+static const char* EDIT_NAME = "Enter the name of the contact to edit: ";
+static const char* NEW_PHONE = "Enter new phone number for ";
+
+typedef std::chrono::steady_clock Clock;
+typedef std::map<std::string, std::vector<double>> Latencies;     // seconds, by operation
+
+struct Options {
+    std::string server;
+    int sessions;
+    int rounds;
+    int contacts;
+    double minOps;
+    double maxP99;
+    int stalled;
+    int pipeline;
+    std::string allocCounter;
+
+    Options() : server("./main"), sessions(20), rounds(20), contacts(1000), minOps(0), maxP99(0), stalled(0),
+                pipeline(0) {}
+};
+
+// Totals alloc_count wrote to the server's stderr
+static std::mutex allocationsMutex;
+static std::vector<unsigned long> allocationReports;
+
+static int connectTo(int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sock, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// One scripted client; any failure ends the run
+class Session {
+    private:
+        int sock;
+
+        void fail(const std::string& what) {
+            std::fprintf(stderr, "session failed: %s\n", what.c_str());
+            std::exit(2);
+        }
+
+        void send(const std::string& line) {
+            std::string data = line + "\r\n";
+            if (::send(sock, data.data(), data.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(data.size())) {
+                fail("send");
+            }
+        }
+
+        // Reads until one of the markers has arrived and says which
+        const char* until(const std::vector<const char*>& markers) {
+            std::string received;
+            char buffer[65536];
+            while (true) {
+                ssize_t length = recv(sock, buffer, sizeof(buffer), 0);
+                if (length <= 0) {
+                    fail("server closed the connection");
+                }
+                received.append(buffer, static_cast<size_t>(length));
+
+                // Only the new bytes, and enough before them for a marker cut in two
+                size_t from = received.size() > static_cast<size_t>(length) + 64 ? received.size() - length - 64 : 0;
+                for (const char* marker : markers) {
+                    if (received.find(marker, from) != std::string::npos) {
+                        return marker;
+                    }
+                }
+            }
+        }
+
+        // Sends each line and waits for its markers. A listing that comes up
+        // unasked for is quit. Back at the menu afterwards.
+        void operation(const std::string& name, const std::vector<std::string>& lines,
+                       const std::vector<std::vector<const char*>>& markers, Latencies& latencies) {
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < lines.size(); i++) {
+                send(lines[i]);
+                const char* got = until(markers[i]);
+                if (got == PAGE && markers[i].size() > 1) {
+                    send("q");
+                    until({PAUSE, EDIT_NAME});
+                }
+            }
+            latencies[name].push_back(std::chrono::duration<double>(Clock::now() - start).count());
+
+            send("");
+            until({CHOICE});
+        }
+
+    public:
+        Session() : sock(-1) {}
+
+        ~Session() {
+            if (sock != -1) {
+                close(sock);
+            }
+        }
+
+        void run(int port, int id, int rounds, Latencies& latencies) {
+            sock = connectTo(port);
+            if (sock == -1) {
+                fail("connect");
+            }
+            int one = 1;
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            until({CHOICE});
+
+            for (int round = 0; round < rounds; round++) {
+                std::string me = "H" + std::to_string(id) + "_" + std::to_string(round);
+                operation("list", {"1"}, {{PAUSE, PAGE}}, latencies);
+                operation("search", {"search P1"}, {{PAUSE}}, latencies);
+                operation("add", {"add " + me + ":555"}, {{PAUSE}}, latencies);
+                operation("edit", {"4", me, "556"}, {{EDIT_NAME, PAGE}, {NEW_PHONE}, {PAUSE}}, latencies);
+                operation("delete", {"delete " + me}, {{PAUSE}}, latencies);
+            }
+            send("6");
+        }
+};
+
+// Connects to the batch port and queues LIST requests for far more output
+// than the server will buffer, then never reads. Returns the socket, kept
+// open until the run is over.
+static int stallClient(int batchPort) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    // A small window so the server's side fills up, not the kernel's
+    int window = 4096;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &window, sizeof(window));
+    close(sock);
+
+    sock = connectTo(batchPort);
+    if (sock == -1) {
+        return -1;
+    }
+    std::string requests;
+    for (int i = 0; i < 64; i++) {
+        requests += "LIST 0 10000\n";
+    }
+    // The server stops reading once enough is unsent; what it has is plenty
+    send(sock, requests.data(), requests.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    return sock;
+}
+
+static double percentile(std::vector<double> values, double p) {
+    std::sort(values.begin(), values.end());
+    size_t at = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    return values[at];
+}
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (flag == "--server") options.server = value;
+        else if (flag == "--sessions") options.sessions = std::atoi(value.c_str());
+        else if (flag == "--rounds") options.rounds = std::atoi(value.c_str());
+        else if (flag == "--contacts") options.contacts = std::atoi(value.c_str());
+        else if (flag == "--min-ops") options.minOps = std::atof(value.c_str());
+        else if (flag == "--max-p99") options.maxP99 = std::atof(value.c_str());
+        else if (flag == "--stalled") options.stalled = std::atoi(value.c_str());
+        else if (flag == "--pipeline") options.pipeline = std::atoi(value.c_str());
+        else if (flag == "--alloc-counter") options.allocCounter = value;
+        else return false;
+    }
+    return options.sessions > 0 && options.rounds > 0 && options.stalled >= 0 && options.pipeline >= 0;
+}
+
+// Starts the server in dir and returns its pid; port and batchPort are the
+// ones it logs
+static pid_t startServer(const Options& options, const std::string& dir, int& port, int& batchPort) {
+    int logPipe[2];
+    if (pipe(logPipe) < 0) {
+        return -1;
+    }
+
+    char serverPath[4096];
+    if (realpath(options.server.c_str(), serverPath) == nullptr) {
+        std::fprintf(stderr, "no server at %s\n", options.server.c_str());
+        return -1;
+    }
+    char counterPath[4096];
+    if (!options.allocCounter.empty() && realpath(options.allocCounter.c_str(), counterPath) == nullptr) {
+        std::fprintf(stderr, "no allocation counter at %s\n", options.allocCounter.c_str());
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(logPipe[1], STDERR_FILENO);
+        close(logPipe[0]);
+        close(logPipe[1]);
+        if (chdir(dir.c_str()) < 0) {
+            _exit(127);
+        }
+        setenv("DATABASE_FILE", (dir + "/phonebook.txt").c_str(), 1);
+        setenv("TELNET_PORT", "0", 1);
+        setenv("TELNET_BATCH_PORT", "0", 1);
+        setenv("TELNET_ADMIN_PORT", "0", 1);
+        if (!options.allocCounter.empty()) {
+            setenv("LD_PRELOAD", counterPath, 1);
+        }
+        execl(serverPath, serverPath, (char*)nullptr);
+        _exit(127);
+    }
+    close(logPipe[1]);
+
+    // The log says which ports were picked; after that it is only drained,
+    // apart from the allocation counter's reports
+    FILE* log = fdopen(logPipe[0], "r");
+    char line[4096];
+    port = 0;
+    batchPort = 0;
+    while (port == 0 && std::fgets(line, sizeof(line), log) != nullptr) {
+        const char* started = std::strstr(line, "started on port ");
+        if (started != nullptr) {
+            port = std::atoi(started + std::strlen("started on port "));
+        }
+        const char* batch = std::strstr(line, "batch protocol on port ");
+        if (batch != nullptr) {
+            batchPort = std::atoi(batch + std::strlen("batch protocol on port "));
+        }
+    }
+    std::thread([log] {
+        char rest[4096];
+        while (std::fgets(rest, sizeof(rest), log) != nullptr) {
+            const char* report = std::strstr(rest, "alloc_count: ");
+            if (report != nullptr) {
+                std::lock_guard<std::mutex> lock(allocationsMutex);
+                allocationReports.push_back(std::strtoul(report + std::strlen("alloc_count: "), nullptr, 10));
+            }
+        }
+        std::fclose(log);
+    }).detach();
+    return pid;
+}
+
+// The server's allocations so far, or -1 without --alloc-counter
+static long serverAllocations(const Options& options, pid_t server) {
+    if (options.allocCounter.empty()) {
+        return -1;
+    }
+    size_t reports;
+    {
+        std::lock_guard<std::mutex> lock(allocationsMutex);
+        reports = allocationReports.size();
+    }
+    kill(server, SIGUSR2);
+    for (int waited = 0; waited < 2000; waited++) {
+        {
+            std::lock_guard<std::mutex> lock(allocationsMutex);
+            if (allocationReports.size() > reports) {
+                return static_cast<long>(allocationReports.back());
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::fprintf(stderr, "no report from the allocation counter\n");
+    return -1;
+}
+
+// One kind of command for --pipeline, written all at once
+struct Phase {
+    std::string name;
+    bool batch;                         // else the menu; each command ends back at it
+    std::vector<std::string> commands;
+};
+
+// Writes the phase's commands from a second thread and reads until every
+// one has been answered; returns the bytes received
+static size_t pipelinePhase(int sock, const Phase& phase) {
+    std::string requests;
+    for (const auto& command : phase.commands) {
+        requests += command + "\r\n";
+    }
+    std::thread writer([&] {
+        size_t offset = 0;
+        while (offset < requests.size()) {
+            ssize_t sent = send(sock, requests.data() + offset, requests.size() - offset, MSG_NOSIGNAL);
+            if (sent <= 0) {
+                return;
+            }
+            offset += static_cast<size_t>(sent);
+        }
+    });
+
+    // Menu commands are counted by the prompt they return to; batch replies
+    // by their first line, skipping the rows a FIND or LIST announces
+    size_t answered = 0;
+    size_t received = 0;
+    size_t rowsLeft = 0;
+    std::string pending;
+    char buffer[65536];
+    while (answered < phase.commands.size() || rowsLeft > 0) {
+        ssize_t length = recv(sock, buffer, sizeof(buffer), 0);
+        if (length <= 0) {
+            std::fprintf(stderr, "%s: server closed the connection\n", phase.name.c_str());
+            std::exit(2);
+        }
+        received += static_cast<size_t>(length);
+        pending.append(buffer, static_cast<size_t>(length));
+
+        if (!phase.batch) {
+            size_t at;
+            while ((at = pending.find(CHOICE)) != std::string::npos) {
+                answered++;
+                pending.erase(0, at + std::strlen(CHOICE));
+            }
+            if (pending.size() > 64) {
+                pending.erase(0, pending.size() - 64);
+            }
+            continue;
+        }
+
+        size_t start = 0;
+        size_t end;
+        while ((end = pending.find('\n', start)) != std::string::npos) {
+            if (rowsLeft > 0) {
+                rowsLeft--;
+            } else {
+                answered++;
+                unsigned long rows = 0;
+                unsigned long total = 0;
+                if (std::sscanf(pending.c_str() + start, "OK %lu %lu", &rows, &total) == 2) {
+                    rowsLeft = rows;
+                }
+            }
+            start = end + 1;
+        }
+        pending.erase(0, start);
+    }
+    writer.join();
+    return received;
+}
+
+// --pipeline: every phase on one menu and one batch connection
+static void runPipeline(const Options& options, pid_t server, int port, int batchPort) {
+    size_t count = static_cast<size_t>(options.pipeline);
+    std::vector<Phase> phases;
+    phases.push_back({"add", false, {}});
+    phases.push_back({"ADD", true, {}});
+    phases.push_back({"GET", true, {}});
+    phases.push_back({"FIND", true, {}});
+    phases.push_back({"LIST", true, {}});
+    phases.push_back({"DEL", true, {}});
+    for (size_t i = 0; i < count; i++) {
+        std::string number = std::to_string(i);
+        // With the Enter that returns to the menu
+        phases[0].commands.push_back("add M" + number + ":555-" + number + "\r\n");
+        phases[1].commands.push_back("ADD B" + number + ":555-" + number);
+        phases[2].commands.push_back("GET B" + number);
+        phases[3].commands.push_back("FIND B" + number);
+        phases[5].commands.push_back("DEL B" + number);
+    }
+    // BATCH_MAX_ROWS at a time
+    for (size_t offset = 0; offset < options.contacts + 2 * count; offset += 10000) {
+        phases[4].commands.push_back("LIST " + std::to_string(offset) + " 10000");
+    }
+
+    int menu = connectTo(port);
+    int batch = batchPort != 0 ? connectTo(batchPort) : -1;
+    if (menu == -1 || batch == -1) {
+        std::fprintf(stderr, "could not connect\n");
+        std::exit(2);
+    }
+    int one = 1;
+    setsockopt(menu, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(batch, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // Past the welcome screen
+    std::string welcome;
+    char buffer[4096];
+    while (welcome.find(CHOICE) == std::string::npos) {
+        ssize_t length = recv(menu, buffer, sizeof(buffer), 0);
+        if (length <= 0) {
+            std::fprintf(stderr, "server closed the connection\n");
+            std::exit(2);
+        }
+        welcome.append(buffer, static_cast<size_t>(length));
+    }
+
+    for (const auto& phase : phases) {
+        size_t commands = phase.commands.size();
+        long allocationsBefore = serverAllocations(options, server);
+        Clock::time_point start = Clock::now();
+        size_t received = pipelinePhase(phase.batch ? batch : menu, phase);
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        long allocationsAfter = serverAllocations(options, server);
+
+        std::printf("  %-5s n=%-7zu %10.1f commands/s %10.1f bytes out/command", phase.name.c_str(), commands,
+                    commands / elapsed, static_cast<double>(received) / commands);
+        if (allocationsBefore >= 0 && allocationsAfter >= 0) {
+            std::printf(" %10.1f allocations/command", static_cast<double>(allocationsAfter - allocationsBefore) / commands);
+        }
+        std::printf("\n");
+    }
+    close(menu);
+    close(batch);
+}
+
+static void stopServer(pid_t server, const std::string& dir) {
+    kill(server, SIGKILL);
+    waitpid(server, nullptr, 0);
+    unlink((dir + "/phonebook.txt").c_str());
+    unlink((dir + "/phonebook.txt.journal").c_str());
+    rmdir(dir.c_str());
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "usage: %s [--server ./main] [--sessions N] [--rounds N] [--contacts N] "
+                             "[--min-ops OPS] [--max-p99 MS] [--stalled N] [--pipeline N] "
+                             "[--alloc-counter ./harness/alloc_count.so]\n", argv[0]);
+        return 2;
+    }
+
+    char dirTemplate[] = "/tmp/telnet-harness-XXXXXX";
+    if (mkdtemp(dirTemplate) == nullptr) {
+        std::perror("mkdtemp");
+        return 2;
+    }
+    std::string dir = dirTemplate;
+    FILE* database = std::fopen((dir + "/phonebook.txt").c_str(), "w");
+    for (int i = 0; i < options.contacts; i++) {
+        std::fprintf(database, "P%d:555-%04d\n", i, i);
+    }
+    std::fclose(database);
+
+    int port;
+    int batchPort;
+    pid_t server = startServer(options, dir, port, batchPort);
+    if (server < 0 || port == 0) {
+        std::fprintf(stderr, "server did not start\n");
+        return 2;
+    }
+
+    std::vector<int> stalled;
+    for (int i = 0; i < options.stalled; i++) {
+        int sock = batchPort != 0 ? stallClient(batchPort) : -1;
+        if (sock == -1) {
+            std::fprintf(stderr, "stalled client could not connect\n");
+            return 2;
+        }
+        stalled.push_back(sock);
+    }
+
+    if (options.pipeline > 0) {
+        std::printf("%d commands of each kind pipelined, %d contacts:\n", options.pipeline, options.contacts);
+        runPipeline(options, server, port, batchPort);
+        for (int sock : stalled) {
+            close(sock);
+        }
+        stopServer(server, dir);
+        return 0;
+    }
+
+    long allocationsBefore = serverAllocations(options, server);
+    std::vector<Latencies> perSession(options.sessions);
+    std::vector<std::thread> clients;
+    Clock::time_point start = Clock::now();
+    for (int id = 0; id < options.sessions; id++) {
+        clients.emplace_back([&, id] {
+            Session session;
+            session.run(port, id, options.rounds, perSession[id]);
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    long allocationsAfter = serverAllocations(options, server);
+
+    for (int sock : stalled) {
+        close(sock);
+    }
+    stopServer(server, dir);
+
+    Latencies byOperation;
+    std::vector<double> all;
+    for (const auto& latencies : perSession) {
+        for (const auto& operation : latencies) {
+            auto& into = byOperation[operation.first];
+            into.insert(into.end(), operation.second.begin(), operation.second.end());
+            all.insert(all.end(), operation.second.begin(), operation.second.end());
+        }
+    }
+
+    double opsPerSecond = all.size() / elapsed;
+    double p99 = percentile(all, 0.99) * 1e3;
+    std::printf("%zu ops in %.3f s: %.1f ops/s, p50 %.3f ms, p99 %.3f ms",
+                all.size(), elapsed, opsPerSecond, percentile(all, 0.5) * 1e3, p99);
+    if (options.stalled > 0) {
+        std::printf(" (%d stalled clients)", options.stalled);
+    }
+    if (allocationsBefore >= 0 && allocationsAfter >= 0) {
+        std::printf(", %.1f allocations/op", static_cast<double>(allocationsAfter - allocationsBefore) / all.size());
+    }
+    std::printf("\n");
+    for (const auto& operation : byOperation) {
+        std::printf("  %-7s n=%-6zu p50 %8.3f ms  p99 %8.3f ms\n", operation.first.c_str(), operation.second.size(),
+                    percentile(operation.second, 0.5) * 1e3, percentile(operation.second, 0.99) * 1e3);
+    }
+
+    bool failed = false;
+    if (options.minOps > 0 && opsPerSecond < options.minOps) {
+        std::printf("FAIL: %.1f ops/s is below --min-ops %.1f\n", opsPerSecond, options.minOps);
+        failed = true;
+    }
+    if (options.maxP99 > 0 && p99 > options.maxP99) {
+        std::printf("FAIL: p99 %.3f ms is above --max-p99 %.3f\n", p99, options.maxP99);
+        failed = true;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+// phone_book_bench - Times the PhoneBook on a large book, without the
+// server: building it, name lookups (the duplicate check, edit and delete
+// all start with one), searches with few, many and short matches, and
+// deletes. Names are one of 16 first names followed by the contact's
+// number, so "ivan" matches one in 16 and "99999" a handful. Prints the
+// mean time per operation and the resident memory after building.
+//
+//     make phone-book-bench && ./harness/phone_book_bench 1000000
+
+#include "../phone_book.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const char* FIRST_NAMES[] = {
+    "Alice", "Bob", "Carol", "Dave", "Erin", "Frank", "Grace", "Heidi",
+    "Ivan", "Judy", "Mallory", "Niaj", "Olivia", "Peggy", "Rupert", "Sybil"
+};
+
+static std::string nameOf(size_t number) {
+    return FIRST_NAMES[number % 16] + std::to_string(number);
+}
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static long residentKilobytes() {
+    FILE* status = std::fopen("/proc/self/status", "r");
+    if (status == nullptr) {
+        return -1;
+    }
+    char line[256];
+    long kilobytes = -1;
+    while (std::fgets(line, sizeof(line), status) != nullptr) {
+        if (std::strncmp(line, "VmRSS:", 6) == 0) {
+            kilobytes = std::atol(line + 6);
+        }
+    }
+    std::fclose(status);
+    return kilobytes;
+}
+
+static void searches(const PhoneBook& book, const char* query, int repeats) {
+    size_t hits = 0;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < repeats; i++) {
+        hits = book.search(query).size();
+    }
+    std::printf("  %-16s %8zu hits  %10.3f ms\n", ("search \"" + std::string(query) + "\"").c_str(), hits,
+                secondsSince(start) / repeats * 1e3);
+}
+
+int main(int argc, char** argv) {
+    size_t contacts = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    if (contacts == 0) {
+        std::fprintf(stderr, "usage: %s [CONTACTS]\n", argv[0]);
+        return 2;
+    }
+
+    long before = residentKilobytes();
+    PhoneBook book;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < contacts; i++) {
+        book.add(nameOf(i), "555-" + std::to_string(i));
+    }
+    std::printf("%zu contacts built in %.3f s, %ld MB resident\n", contacts, secondsSince(start),
+                (residentKilobytes() - before) / 1024);
+
+    std::mt19937 random(42);
+    std::uniform_int_distribution<size_t> anyContact(0, contacts - 1);
+    const int LOOKUPS = 100000;
+    std::vector<std::string> names;
+    for (int i = 0; i < LOOKUPS; i++) {
+        names.push_back(nameOf(anyContact(random)));
+    }
+
+    size_t found = 0;
+    start = Clock::now();
+    for (const auto& name : names) {
+        found += book.find(name) != nullptr;
+    }
+    std::printf("  %-16s %8zu found %10.3f us\n", "name lookup", found, secondsSince(start) / LOOKUPS * 1e6);
+
+    searches(book, "99999", 100);
+    searches(book, "ivan", 10);
+    searches(book, "zz", 10);
+
+    // Distinct names, so every one is there to delete
+    const size_t DELETES = std::min<size_t>(10000, contacts);
+    std::vector<std::string> doomed;
+    for (size_t i = 0; i < DELETES; i++) {
+        doomed.push_back(nameOf(i * (contacts / DELETES)));
+    }
+    size_t removed = 0;
+    start = Clock::now();
+    for (const auto& name : doomed) {
+        removed += book.remove(name);
+    }
+    std::printf("  %-16s %8zu done  %10.3f us\n", "delete", removed, secondsSince(start) / DELETES * 1e6);
+    return 0;
+}
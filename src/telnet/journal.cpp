@@ -0,0 +1,259 @@
+#include "journal.h"
+#include "async_logger.h"
+#include "metrics.h"
+#include "phone_book.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+
+static void trim(std::string& text) {
+    text.erase(0, text.find_first_not_of(" \t"));
+    text.erase(text.find_last_not_of(" \t") + 1);
+}
+
+static bool writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+Journal::Journal(const std::string& databasePath)
+    : databasePath(databasePath), journalPath(databasePath + ".journal"), journalFd(-1),
+      journalBytes(0), snapshotBytes(0), replayed(0), dataLock(nullptr), stopping(false) {
+}
+
+Journal::~Journal() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueReady.notify_one();
+    if (writer.joinable()) {
+        writer.join();
+    }
+    if (journalFd >= 0) {
+        close(journalFd);
+    }
+}
+
+std::vector<JournalEntry> Journal::load() {
+    // Entries keep their order; a deleted one is only marked until the end
+    std::vector<JournalEntry> entries;
+    std::vector<bool> alive;
+    std::unordered_map<std::string, size_t> byName;
+
+    auto set = [&](const std::string& name, const std::string& phoneNumber) {
+        auto inserted = byName.insert(std::make_pair(PhoneBook::foldCase(name), entries.size()));
+        if (!inserted.second) {
+            entries[inserted.first->second].phoneNumber = phoneNumber;
+            return;
+        }
+        entries.push_back(JournalEntry{name, phoneNumber});
+        alive.push_back(true);
+    };
+    auto remove = [&](const std::string& name) {
+        auto found = byName.find(PhoneBook::foldCase(name));
+        if (found != byName.end()) {
+            alive[found->second] = false;
+            byName.erase(found);
+        }
+    };
+
+    std::ifstream snapshot(databasePath);
+    std::string line;
+    while (std::getline(snapshot, line)) {
+        snapshotBytes += line.size() + 1;
+        size_t pos = line.find(':');
+        if (pos != std::string::npos) {
+            std::string name = line.substr(0, pos);
+            std::string phoneNumber = line.substr(pos + 1);
+            trim(name);
+            trim(phoneNumber);
+            set(name, phoneNumber);
+        }
+    }
+
+    std::ifstream journal(journalPath, std::ios::binary);
+    std::stringstream contents;
+    contents << journal.rdbuf();
+    const std::string records = contents.str();
+
+    // Replay stops at a torn or unreadable record; start() cuts it off
+    size_t offset = 0;
+    while (offset < records.size()) {
+        size_t end = records.find('\n', offset);
+        if (end == std::string::npos) {
+            break;
+        }
+        std::string record = records.substr(offset, end - offset);
+        size_t colon = record.find(':');
+        if (record.compare(0, 2, "S ") == 0 && colon != std::string::npos) {
+            set(record.substr(2, colon - 2), record.substr(colon + 1));
+        } else if (record.compare(0, 2, "D ") == 0) {
+            remove(record.substr(2));
+        } else {
+            break;
+        }
+        offset = end + 1;
+        replayed++;
+    }
+    journalBytes = offset;
+    if (offset < records.size()) {
+        LOG_WARN("telnet", "Ignoring " + std::to_string(records.size() - offset) +
+                 " bytes after the last complete journal record");
+    }
+
+    std::vector<JournalEntry> live;
+    live.reserve(byName.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (alive[i]) {
+            live.push_back(std::move(entries[i]));
+        }
+    }
+    return live;
+}
+
+void Journal::start(RwLock& dataLock, SnapshotSource source) {
+    this->dataLock = &dataLock;
+    snapshotSource = source;
+
+    journalFd = open(journalPath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (journalFd < 0) {
+        throw std::runtime_error("Could not open " + journalPath + ": " + std::strerror(errno));
+    }
+    if (ftruncate(journalFd, static_cast<off_t>(journalBytes)) != 0) {
+        throw std::runtime_error("Could not truncate " + journalPath + ": " + std::strerror(errno));
+    }
+
+    writer = std::thread(&Journal::writeLoop, this);
+}
+
+void Journal::recordSet(const std::string& name, const std::string& phoneNumber) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        queued += "S ";
+        queued += name;
+        queued += ':';
+        queued += phoneNumber;
+        queued += '\n';
+    }
+    queueReady.notify_one();
+}
+
+void Journal::recordDelete(const std::string& name) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        queued += "D ";
+        queued += name;
+        queued += '\n';
+    }
+    queueReady.notify_one();
+}
+
+void Journal::writeLoop() {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    while (true) {
+        queueReady.wait(lock, [this] { return stopping || !queued.empty(); });
+        if (queued.empty()) {
+            return;
+        }
+
+        // Whatever queued up during the last sync goes out in one write and one sync
+        std::string batch;
+        batch.swap(queued);
+        lock.unlock();
+
+        append(batch);
+        if (journalBytes > COMPACT_MIN_BYTES && journalBytes > snapshotBytes) {
+            compact();
+        }
+
+        lock.lock();
+    }
+}
+
+void Journal::append(const std::string& batch) {
+    if (!writeAll(journalFd, batch.data(), batch.size()) || fdatasync(journalFd) != 0) {
+        LOG_ERROR("telnet", "Error writing " + journalPath + ": " + std::strerror(errno));
+        return;
+    }
+    journalBytes += batch.size();
+}
+
+void Journal::compact() {
+    Metrics::Scope scope(Operation::Compaction);
+    std::vector<JournalEntry> entries;
+    std::string batch;
+    {
+        // Records queued so far are in the copy; later ones go to the new journal
+        SharedLock data(*dataLock);
+        entries = snapshotSource();
+        std::lock_guard<std::mutex> queue(queueMutex);
+        batch.swap(queued);
+    }
+
+    // The old snapshot and journal stay complete until the rename
+    if (!batch.empty()) {
+        append(batch);
+    }
+    uint64_t bytes = 0;
+    if (!writeSnapshot(entries, bytes)) {
+        return;
+    }
+
+    if (ftruncate(journalFd, 0) != 0 || fdatasync(journalFd) != 0) {
+        LOG_ERROR("telnet", "Error truncating " + journalPath + ": " + std::strerror(errno));
+        return;
+    }
+    LOG_DEBUG("telnet", "Compacted " + std::to_string(journalBytes) + " journal bytes into a snapshot of " +
+              std::to_string(entries.size()) + " contacts");
+    journalBytes = 0;
+    snapshotBytes = bytes;
+}
+
+bool Journal::writeSnapshot(const std::vector<JournalEntry>& entries, uint64_t& bytes) {
+    std::string contents;
+    for (const auto& entry : entries) {
+        contents += entry.name;
+        contents += ':';
+        contents += entry.phoneNumber;
+        contents += '\n';
+    }
+
+    std::string temporaryPath = databasePath + ".tmp";
+    int fd = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool written = fd >= 0 && writeAll(fd, contents.data(), contents.size()) && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (!written || rename(temporaryPath.c_str(), databasePath.c_str()) != 0) {
+        LOG_ERROR("telnet", "Error saving contacts to " + databasePath + ": " + std::strerror(errno));
+        unlink(temporaryPath.c_str());
+        return false;
+    }
+
+    // Make the rename itself durable before the journal is emptied
+    size_t slash = databasePath.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : databasePath.substr(0, slash + 1);
+    int directoryFd = open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if (directoryFd >= 0) {
+        fsync(directoryFd);
+        close(directoryFd);
+    }
+    bytes = contents.size();
+    return true;
+}
@@ -0,0 +1,74 @@
+// Journal - Append-only persistence for the phone book. The database file
+// holds a snapshot ("Name:PhoneNumber" lines); every change since is appended
+// to <database>.journal by a writer thread that syncs in batches, and the
+// journal is folded into a new snapshot once it outgrows it.
+//
+// Records are states, not operations ("S name:phone" sets, "D name" deletes),
+// so replaying a journal over a snapshot that already contains it is
+// harmless. That keeps a crash in the middle of a compaction safe.
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "rw_lock.h"
+
+struct JournalEntry {
+    std::string name;
+    std::string phoneNumber;
+};
+
+class Journal {
+    public:
+        typedef std::function<std::vector<JournalEntry>()> SnapshotSource;
+
+        // Compact once the journal is larger than this and than the snapshot
+        static const uint64_t COMPACT_MIN_BYTES = 1024 * 1024;
+
+        explicit Journal(const std::string& databasePath);
+        ~Journal();
+
+        // Reads the snapshot and replays the journal over it
+        std::vector<JournalEntry> load();
+
+        // Starts the writer. For compaction, source is called with dataLock
+        // held (shared) and copies the current entries.
+        void start(RwLock& dataLock, SnapshotSource source);
+
+        // Called with dataLock held exclusively, so records are ordered like the changes.
+        // Only queues the record; it is on disk a sync interval later.
+        void recordSet(const std::string& name, const std::string& phoneNumber);
+        void recordDelete(const std::string& name);
+
+        size_t replayedRecords() const { return replayed; }
+
+    private:
+        void writeLoop();
+        void append(const std::string& batch);
+        void compact();
+        bool writeSnapshot(const std::vector<JournalEntry>& entries, uint64_t& bytes);
+
+        std::string databasePath;
+        std::string journalPath;
+        int journalFd;
+        uint64_t journalBytes;
+        uint64_t snapshotBytes;
+        size_t replayed;
+
+        RwLock* dataLock;
+        SnapshotSource snapshotSource;
+
+        std::mutex queueMutex;
+        std::condition_variable queueReady;
+        std::string queued;
+        bool stopping;
+        std::thread writer;
+};
+
+#endif // JOURNAL_H
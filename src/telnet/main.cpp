@@ -1,572 +1,889 @@
 #include <iostream>
-#include <fstream>
 #include <vector>
 #include <string>
 #include <sstream>
 #include <algorithm>
-#include <thread>
 #include <mutex>
 #include <memory>
-// * Socket headers
-#ifdef _WIN32
-    #include <winsock2.h>
-    #include <ws2tcpip.h>
-    #pragma comment(lib, "ws2_32.lib")
-    typedef SOCKET socket_t;
-    #define CLOSE_SOCKET closesocket
-#else
-    #include <unistd.h>
-    #include <sys/socket.h>
-    #include <netinet/in.h>
-    #include <arpa/inet.h>
-    #include <fcntl.h>
-    typedef int socket_t;
-    #define CLOSE_SOCKET close
-    #define INVALID_SOCKET -1
-    #define SOCKET_ERROR -1
-#endif
-
+#include <chrono>
+#include <cstdlib>
+#include <initializer_list>
+#include <sys/resource.h>
+#include "async_logger.h"
+#include "session.h"
+#include "event_loop.h"
+#include "journal.h"
+#include "phone_book.h"
+#include "rw_lock.h"
+#include "metrics.h"
+#include "command_parser.h"
+#include "admin_console.h"
+#include "screen_template.h"
+
+std::string environmentOr(const char* name, const std::string& fallback);
+int environmentPort(const char* name, int fallback);
+
+// The environment may override the ports (0 picks a free one, which is
+// logged) and the database, e.g. for a test run on a scratch copy:
+// TELNET_PORT, TELNET_BATCH_PORT, TELNET_ADMIN_PORT and DATABASE_FILE
 const int PORT = 8080;
-const std::string DATABASE_FILE = "phonebook.txt";
-std::mutex contactsMutex;
-
-class Contact {
-    private:
-        std::string name;
-        std::string phoneNumber;
-
-    public:
-        Contact(const std::string& name, const std::string& phoneNumber)
-            : name(name), phoneNumber(phoneNumber) {}
-
-        std::string getName() const { return name; }
-        std::string getPhoneNumber() const { return phoneNumber; }
-        void setPhoneNumber(const std::string& newNumber) { phoneNumber = newNumber; }
-
-        std::string toString() const {
-            return name + ": " + phoneNumber;
-        }
-};
+const int BATCH_PORT = 8081;            // sessions start in batch mode, no screens
+const int ADMIN_PORT = 8082;            // live metrics, loopback only
+const std::string DATABASE_FILE = environmentOr("DATABASE_FILE", "phonebook.txt");
+const size_t WORKER_THREADS = 4;
+const size_t MAX_SESSIONS = 10000;
+const int IDLE_TIMEOUT = 15 * 60;       // seconds
+const int DEFAULT_WINDOW_HEIGHT = 24;   // rows, for clients that do not send NAWS
+const size_t BATCH_SIZE = 256;          // batch commands answered per lock
+const size_t BATCH_MAX_ROWS = 10000;    // rows in one FIND or LIST reply
+const size_t SEARCH_MAX_ROWS = 1000;    // rows on an interactive search screen
+RwLock contactsMutex;
 
 // Global contacts database
-std::vector<Contact> contacts;
+PhoneBook contacts;
+Journal journal(DATABASE_FILE);
 
 // Function prototypes
 void loadContactsFromFile();
-void saveContactsToFile();
-void handleClient(socket_t clientSocket);
-std::string readLine(socket_t socket);
-void sendLine(socket_t socket, const std::string& line);
-
-// ANSI escape sequence utilities
-std::string clearScreen() {
-    return "\x1B[2J\x1B[1;1H";
-}
-
-std::string moveCursor(int row, int col) {
-    return "\x1B[" + std::to_string(row) + ";" + std::to_string(col) + "H";
-}
-
-std::string ansiColor(int colorCode) {
-    return "\x1B[" + std::to_string(colorCode) + "m";
-}
-
-std::string ansiReset() {
-    return "\x1B[0m";
-}
+std::vector<JournalEntry> copyContacts();
+socket_t openListener(int port);
+int listenerPort(socket_t listenSocket);
+void sendLine(Session& session, const std::string& line);
+void openSession(Session& session);
+void openBatchSession(Session& session);
+void handleLine(Session& session, const std::string& inputLine);
+void handleBatch(Session& session, std::deque<std::string>& lines);
+void closeSession(Session& session);
+
+// Rows of listings, search results and batch replies
+const RowTemplate LISTING_ROW(std::string("{index}. ") + ansi::CYAN + "{name}" + ansi::RESET + " - " +
+                              ansi::MAGENTA + "{phone}" + ansi::RESET + "\r\n");
+const RowTemplate SEARCH_ROW(std::string(ansi::CYAN) + "{name}" + ansi::RESET + " - " +
+                             ansi::MAGENTA + "{phone}" + ansi::RESET + "\r\n");
+const RowTemplate BATCH_ROW("{name}:{phone}\r\n");
+const RowTemplate BATCH_FOUND("OK {name}:{phone}\r\n");
 
 int main() {
+    logging::configureFromEnvironment();
+
     // Load contacts from file
-    loadContactsFromFile();
+    try {
+        loadContactsFromFile();
+    } catch (const std::exception& e) {
+        LOG_ERROR("telnet", e.what());
+        return 1;
+    }
 
 #ifdef _WIN32
     // Initialize Winsock for Windows
     WSADATA wsaData;
     int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
     if (result != 0) {
-        std::cerr << "WSAStartup failed: " << result << std::endl;
+        LOG_ERROR("telnet", "WSAStartup failed: " + std::to_string(result));
         return 1;
     }
 #endif
 
-    // Create server socket
-    socket_t serverSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (serverSocket == INVALID_SOCKET) {
-        std::cerr << "Failed to create socket" << std::endl;
+    // Create the listening sockets: menus, and the batch protocol
+    socket_t serverSocket = openListener(environmentPort("TELNET_PORT", PORT));
+    socket_t batchSocket = serverSocket == INVALID_SOCKET ? INVALID_SOCKET
+                                                          : openListener(environmentPort("TELNET_BATCH_PORT", BATCH_PORT));
+    if (batchSocket == INVALID_SOCKET) {
+        if (serverSocket != INVALID_SOCKET) {
+            CLOSE_SOCKET(serverSocket);
+        }
 #ifdef _WIN32
         WSACleanup();
 #endif
         return 1;
     }
 
+    // Every session holds a descriptor; the default soft limit is often 1024
+    rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < MAX_SESSIONS + 64) {
+        files.rlim_cur = std::min<rlim_t>(files.rlim_max, MAX_SESSIONS + 64);
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    LOG_INFO("telnet", "Phone Book Server started on port " + std::to_string(listenerPort(serverSocket)) +
+             ", batch protocol on port " + std::to_string(listenerPort(batchSocket)));
+
+    // The server runs on without its console
+    AdminConsole console(environmentPort("TELNET_ADMIN_PORT", ADMIN_PORT), metrics);
+    try {
+        console.start();
+        LOG_INFO("telnet", "Admin console on 127.0.0.1:" + std::to_string(console.listeningPort()));
+    } catch (const std::exception& e) {
+        LOG_WARN("telnet", e.what());
+    }
+
+    // Sessions are served by a few workers sharing one epoll set
+    try {
+        EventLoop::Handlers handlers;
+        handlers.open = openSession;
+        handlers.line = handleLine;
+        handlers.batch = handleBatch;
+        handlers.close = closeSession;
+        EventLoop loop(serverSocket, handlers, WORKER_THREADS, MAX_SESSIONS, IDLE_TIMEOUT);
+        loop.addListener(batchSocket, openBatchSession);
+        loop.run();
+    } catch (const std::exception& e) {
+        LOG_ERROR("telnet", e.what());
+    }
+
+    // Clean up
+    CLOSE_SOCKET(serverSocket);
+    CLOSE_SOCKET(batchSocket);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
+
+void loadContactsFromFile() {
+    auto start = std::chrono::steady_clock::now();
+    for (auto& entry : journal.load()) {
+        contacts.add(entry.name, entry.phoneNumber);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    LOG_INFO("telnet", "Loaded " + std::to_string(contacts.size()) + " contacts from database (" +
+             std::to_string(journal.replayedRecords()) + " journal records replayed in " +
+             std::to_string(elapsed.count()) + " ms)");
+
+    journal.start(contactsMutex, copyContacts);
+}
+
+// Called by the journal with contactsMutex held (shared) when it compacts
+std::vector<JournalEntry> copyContacts() {
+    std::vector<JournalEntry> entries;
+    entries.reserve(contacts.size());
+    contacts.forEach([&](const Contact& contact) {
+        entries.push_back(JournalEntry{contact.getName(), contact.getPhoneNumber()});
+    });
+    return entries;
+}
+
+// Creates a socket listening on port; INVALID_SOCKET after logging why not
+socket_t openListener(int port) {
+    socket_t listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listenSocket == INVALID_SOCKET) {
+        LOG_ERROR("telnet", "Failed to create socket");
+        return INVALID_SOCKET;
+    }
+
+    // A restarted server need not wait for the last run's connections to time out
+    int reuse = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
     // Setup server address structure
     sockaddr_in serverAddr;
     serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(PORT);
+    serverAddr.sin_port = htons(port);
     serverAddr.sin_addr.s_addr = INADDR_ANY;
 
     // Bind socket to address
-    if (bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
-        std::cerr << "Bind failed" << std::endl;
-        CLOSE_SOCKET(serverSocket);
-#ifdef _WIN32
-        WSACleanup();
-#endif
-        return 1;
+    if (bind(listenSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
+        LOG_ERROR("telnet", "Bind failed on port " + std::to_string(port));
+        CLOSE_SOCKET(listenSocket);
+        return INVALID_SOCKET;
     }
 
     // Listen for connections
-    if (listen(serverSocket, SOMAXCONN) == SOCKET_ERROR) {
-        std::cerr << "Listen failed" << std::endl;
-        CLOSE_SOCKET(serverSocket);
-#ifdef _WIN32
-        WSACleanup();
-#endif
-        return 1;
+    if (listen(listenSocket, SOMAXCONN) == SOCKET_ERROR) {
+        LOG_ERROR("telnet", "Listen failed on port " + std::to_string(port));
+        CLOSE_SOCKET(listenSocket);
+        return INVALID_SOCKET;
+    }
+    return listenSocket;
+}
+
+// The port listenSocket is bound to, which differs from the one asked for
+// when that was 0
+int listenerPort(socket_t listenSocket) {
+    sockaddr_in address;
+    socklen_t length = sizeof(address);
+    if (getsockname(listenSocket, (struct sockaddr*)&address, &length) != 0) {
+        return -1;
     }
+    return ntohs(address.sin_port);
+}
 
-    std::cout << "Phone Book Server started on port " << PORT << std::endl;
-    std::cout << "Waiting for clients to connect..." << std::endl;
+std::string environmentOr(const char* name, const std::string& fallback) {
+    const char* value = std::getenv(name);
+    return value != nullptr && *value != '\0' ? value : fallback;
+}
 
-    // Accept connections and handle clients
-    while (true) {
-        sockaddr_in clientAddr;
-        socklen_t clientAddrSize = sizeof(clientAddr);
-        
-        socket_t clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientAddrSize);
-        if (clientSocket == INVALID_SOCKET) {
-            std::cerr << "Accept failed" << std::endl;
-            continue;
-        }
+int environmentPort(const char* name, int fallback) {
+    return std::atoi(environmentOr(name, std::to_string(fallback)).c_str());
+}
 
-        // Get client IP address
-        char clientIP[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &(clientAddr.sin_addr), clientIP, INET_ADDRSTRLEN);
-        std::cout << "Client connected: " << clientIP << std::endl;
+// Queues a line; it is sent with the rest of the screen when input is awaited
+void sendLine(Session& session, const std::string& line) {
+    session.output.appendLine(line);
+}
 
-        // Create a new thread to handle the client
-        std::thread clientThread(handleClient, clientSocket);
-        clientThread.detach();
+// Joins the lines of a fixed screen into one block, encoded once and reused
+std::string encodeScreen(std::initializer_list<std::string> lines) {
+    std::string block;
+    for (const auto& line : lines) {
+        block += line;
+        block += "\r\n";
     }
+    return block;
+}
 
-    // Clean up
-    CLOSE_SOCKET(serverSocket);
-#ifdef _WIN32
-    WSACleanup();
-#endif
-    return 0;
+void showWelcomeScreen(Session& session) {
+    static const std::string screen = encodeScreen({
+        ansi::CLEAR_SCREEN,
+        ansi::CYAN + std::string("╔════════════════════════════════════════════════════════════════════════╗"),
+        "║                                                                        ║",
+        "║           ████████╗███████╗██╗     ███╗   ██╗███████╗████████╗         ║",
+        "║           ╚══██╔══╝██╔════╝██║     ████╗  ██║██╔════╝╚══██╔══╝         ║",
+        "║              ██║   █████╗  ██║     ██╔██╗ ██║█████╗     ██║            ║",
+        "║              ██║   ██╔══╝  ██║     ██║╚██╗██║██╔══╝     ██║            ║",
+        "║              ██║   ███████╗███████╗██║ ╚████║███████╗   ██║            ║",
+        "║              ╚═╝   ╚══════╝╚══════╝╚═╝  ╚═══╝╚══════╝   ╚═╝            ║",
+        "║                                                                        ║",
+        "║            Welcome to the Telnet Contact Management Server!            ║",
+        "║            Connect, manage, and retrieve your contacts easily.         ║",
+        "║                                                                        ║",
+        std::string("╚════════════════════════════════════════════════════════════════════════╝") + ansi::RESET,
+        ""
+    });
+    session.output.append(screen);
 }
 
-void loadContactsFromFile() {
-    std::ifstream file(DATABASE_FILE);
-    if (!file.is_open()) {
-        std::cout << "Created new database file: " << DATABASE_FILE << std::endl;
-        return;
-    }
 
-    std::string line;
-    while (std::getline(file, line)) {
-        size_t pos = line.find(':');
-        if (pos != std::string::npos) {
-            std::string name = line.substr(0, pos);
-            std::string phoneNumber = line.substr(pos + 1);
-            
-            // Trim whitespace
-            name.erase(0, name.find_first_not_of(" \t"));
-            name.erase(name.find_last_not_of(" \t") + 1);
-            phoneNumber.erase(0, phoneNumber.find_first_not_of(" \t"));
-            phoneNumber.erase(phoneNumber.find_last_not_of(" \t") + 1);
-            
-            contacts.emplace_back(name, phoneNumber);
-        }
-    }
-    file.close();
-    std::cout << "Loaded " << contacts.size() << " contacts from database" << std::endl;
+void showMainMenu(Session& session) {
+    static const std::string screen = encodeScreen({
+        ansi::colored(ansi::YELLOW, "MAIN MENU:"),
+        "1. List all contacts",
+        "2. Search for a contact",
+        "3. Add a new contact",
+        "4. Edit a contact",
+        "5. Delete a contact",
+        "6. Exit",
+        "",
+        "Type 'h' for help, 'c' to clear screen",
+        ansi::colored(ansi::GREEN, "Enter your choice: ")
+    });
+    session.output.append(screen);
 }
 
-void saveContactsToFile() {
-    std::ofstream file(DATABASE_FILE);
-    if (!file.is_open()) {
-        std::cerr << "Error saving contacts: Could not open file" << std::endl;
-        return;
+
+void showHelp(Session& session) {
+    static const std::string screen = encodeScreen({
+        ansi::CLEAR_SCREEN,
+        ansi::colored(ansi::YELLOW, "HELP INFORMATION:"),
+        "This application allows you to manage your phone book contacts.",
+        "",
+        "Available commands:",
+        "  1-6        - Select menu options",
+        "  m          - Display main menu",
+        "  h          - Display this help screen",
+        "  c          - Clear the screen",
+        "  search NAME - Search for contacts by name",
+        "  add NAME:NUMBER - Add a new contact",
+        "  delete NAME - Delete a contact by name",
+        "  BATCH      - Switch to the line protocol for scripts",
+        "  n, p, /TEXT, q - Next or previous page, filter or quit a listing",
+        "",
+        "Press Enter to return to main menu..."
+    });
+    session.output.append(screen);
+    session.state = SessionState::Pause;
+}
+
+// The next line only brings back the main menu
+void promptReturn(Session& session) {
+    sendLine(session, "Press Enter to return to main menu...");
+    session.state = SessionState::Pause;
+}
+
+void prompt(Session& session, const std::string& text, SessionState state) {
+    sendLine(session, "");
+    sendLine(session, text);
+    session.state = state;
+}
+
+bool hasContacts() {
+    SharedLock lock(contactsMutex);
+    return !contacts.empty();
+}
+
+// Rows per listing page: the client's window less the title and the prompt.
+// Without a window size (no NAWS) a 24-line terminal is assumed.
+size_t listingPageSize(const Session& session) {
+    int height = session.telnet.windowHeight();
+    if (height <= 0) {
+        height = DEFAULT_WINDOW_HEIGHT;
     }
-    
-    for (const auto& contact : contacts) {
-        file << contact.getName() << ":" << contact.getPhoneNumber() << std::endl;
+    return static_cast<size_t>(std::max(height - 6, 1));
+}
+
+void finishListing(Session& session) {
+    bool thenEdit = session.listing.thenEdit;
+    session.listing = ListingCursor();      // lets go of the snapshot
+    if (thenEdit) {
+        sendLine(session, "Enter the name of the contact to edit: ");
+        session.state = SessionState::EditName;
+    } else {
+        promptReturn(session);
     }
-    file.close();
-    std::cout << "Saved " << contacts.size() << " contacts to database" << std::endl;
 }
 
-std::string readLine(socket_t socket) {
-    std::string result;
-    char buffer[1];
-    ssize_t bytesRead;
+// Renders the page at the cursor from its snapshot; no lock is held
+void showListingPage(Session& session) {
+    const ListingCursor& listing = session.listing;
+    size_t total = listing.size();
+    size_t end = std::min(listing.offset + listingPageSize(session), total);
+    bool filtered = !listing.filter.empty();
+
+    sendLine(session, ansi::CLEAR_SCREEN);
+    if (filtered) {
+        sendLine(session, ansi::colored(ansi::YELLOW, "CONTACTS MATCHING '" + listing.filter + "':"));
+    } else {
+        sendLine(session, ansi::colored(ansi::YELLOW, "ALL CONTACTS:"));
+    }
+    sendLine(session, "");
 
-    while (true) {
-        bytesRead = recv(socket, buffer, 1, 0);
-        if (bytesRead <= 0) {
-            return result;
+    if (total == 0) {
+        sendLine(session, filtered ? "No matching contacts found." : "No contacts found in the phone book.");
+    } else {
+        session.output.cork();
+        for (size_t index = listing.offset; index < end; index++) {
+            const ContactRow& row = listing.row(index);
+            LISTING_ROW.render(session.output, index + 1, row.name, row.phoneNumber);
         }
+        session.output.uncork();
+    }
+    sendLine(session, "");
+
+    // A list that fits on one page needs no paging
+    if (!filtered && listing.offset == 0 && end == total) {
+        finishListing(session);
+        return;
+    }
+
+    std::string shown = total == 0 ? "0" : std::to_string(listing.offset + 1) + "-" + std::to_string(end);
+    std::string of = filtered ? std::to_string(total) + " matching of " + std::to_string(listing.snapshot->size())
+                              : std::to_string(total);
+    sendLine(session, "-- " + shown + " of " + of + " -- n/Enter next, p previous, /text filter, q quit: ");
+    session.state = SessionState::ListPage;
+}
+
+void beginListing(Session& session, bool thenEdit) {
+    session.listing = ListingCursor();
+    session.listing.thenEdit = thenEdit;
+    {
+        SharedLock lock(contactsMutex);
+        session.listing.snapshot = contacts.snapshot();
+    }
+    showListingPage(session);
+}
 
-        if (buffer[0] == '\r' || buffer[0] == '\n') {
-            if (buffer[0] == '\r') {
-                recv(socket, buffer, 1, 0);
+// Narrows the listing to the names containing text (any case); an empty
+// text shows everything again
+void filterListing(Session& session, std::string text) {
+    text.erase(0, text.find_first_not_of(" \t"));
+    text.erase(text.find_last_not_of(" \t") + 1);
+
+    ListingCursor& listing = session.listing;
+    listing.filter = text;
+    listing.matches.clear();
+    listing.offset = 0;
+    if (!text.empty()) {
+        std::string folded = PhoneBook::foldCase(text);
+        listing.snapshot->forEach([&](size_t position, const ContactRow& row) {
+            if (row.key.find(folded) != std::string::npos) {
+                listing.matches.push_back(static_cast<uint32_t>(position));
             }
-            break;
+        });
+    }
+    showListingPage(session);
+}
+
+// A line typed at a listing page
+void pageListing(Session& session, const std::string& inputLine) {
+    ListingCursor& listing = session.listing;
+    size_t pageSize = listingPageSize(session);
+
+    if (inputLine == "q") {
+        finishListing(session);
+    } else if (inputLine.empty() || inputLine == "n") {
+        // Past the last page the listing is done, as with more(1)
+        if (listing.offset + pageSize >= listing.size()) {
+            finishListing(session);
+            return;
         }
-        
-        result += buffer[0];
-    }
-
-    return result;
-}
-
-void sendLine(socket_t socket, const std::string& line) {
-    std::string data = line + "\r\n";
-    send(socket, data.c_str(), data.size(), 0);
-}
-
-void showWelcomeScreen(socket_t clientSocket) {
-    sendLine(clientSocket, clearScreen());
-    sendLine(clientSocket, ansiColor(36) + "╔════════════════════════════════════════════════════════════════════════╗");
-    sendLine(clientSocket, "║                                                                        ║");
-    sendLine(clientSocket, "║           ████████╗███████╗██╗     ███╗   ██╗███████╗████████╗         ║");
-    sendLine(clientSocket, "║           ╚══██╔══╝██╔════╝██║     ████╗  ██║██╔════╝╚══██╔══╝         ║");
-    sendLine(clientSocket, "║              ██║   █████╗  ██║     ██╔██╗ ██║█████╗     ██║            ║");
-    sendLine(clientSocket, "║              ██║   ██╔══╝  ██║     ██║╚██╗██║██╔══╝     ██║            ║");
-    sendLine(clientSocket, "║              ██║   ███████╗███████╗██║ ╚████║███████╗   ██║            ║");
-    sendLine(clientSocket, "║              ╚═╝   ╚══════╝╚══════╝╚═╝  ╚═══╝╚══════╝   ╚═╝            ║");
-    sendLine(clientSocket, "║                                                                        ║");
-    sendLine(clientSocket, "║            Welcome to the Telnet Contact Management Server!            ║");
-    sendLine(clientSocket, "║            Connect, manage, and retrieve your contacts easily.         ║");
-    sendLine(clientSocket, "║                                                                        ║");
-    sendLine(clientSocket, "╚════════════════════════════════════════════════════════════════════════╝" + ansiReset());
-    sendLine(clientSocket, "");
-}
-
-
-void showMainMenu(socket_t clientSocket) {
-    sendLine(clientSocket, ansiColor(33) + "MAIN MENU:" + ansiReset());
-    sendLine(clientSocket, "1. List all contacts");
-    sendLine(clientSocket, "2. Search for a contact");
-    sendLine(clientSocket, "3. Add a new contact");
-    sendLine(clientSocket, "4. Edit a contact");
-    sendLine(clientSocket, "5. Delete a contact");
-    sendLine(clientSocket, "6. Exit");
-    sendLine(clientSocket, "");
-    sendLine(clientSocket, "Type 'h' for help, 'c' to clear screen");
-    sendLine(clientSocket, ansiColor(32) + "Enter your choice: " + ansiReset());
-}
-
-void showHelp(socket_t clientSocket) {
-    sendLine(clientSocket, clearScreen());
-    sendLine(clientSocket, ansiColor(33) + "HELP INFORMATION:" + ansiReset());
-    sendLine(clientSocket, "This application allows you to manage your phone book contacts.");
-    sendLine(clientSocket, "");
-    sendLine(clientSocket, "Available commands:");
-    sendLine(clientSocket, "  1-6        - Select menu options");
-    sendLine(clientSocket, "  m          - Display main menu");
-    sendLine(clientSocket, "  h          - Display this help screen");
-    sendLine(clientSocket, "  c          - Clear the screen");
-    sendLine(clientSocket, "  search NAME - Search for contacts by name");
-    sendLine(clientSocket, "  add NAME:NUMBER - Add a new contact");
-    sendLine(clientSocket, "  delete NAME - Delete a contact by name");
-    sendLine(clientSocket, "");
-    sendLine(clientSocket, "Press Enter to return to main menu...");
-    std::string dummy = readLine(clientSocket);
-    showMainMenu(clientSocket);
-}
-
-void listAllContacts(socket_t clientSocket) {
-    std::unique_lock<std::mutex> lock(contactsMutex);
-    
-    sendLine(clientSocket, clearScreen());
-    sendLine(clientSocket, ansiColor(33) + "ALL CONTACTS:" + ansiReset());
-    sendLine(clientSocket, "");
-    
-    if (contacts.empty()) {
-        sendLine(clientSocket, "No contacts found in the phone book.");
+        listing.offset += pageSize;
+        showListingPage(session);
+    } else if (inputLine == "p") {
+        listing.offset -= std::min(listing.offset, pageSize);
+        showListingPage(session);
+    } else if (inputLine[0] == '/') {
+        filterListing(session, inputLine.substr(1));
     } else {
-        int index = 1;
-        for (const auto& contact : contacts) {
-            sendLine(clientSocket, std::to_string(index) + ". " + 
-                     ansiColor(36) + contact.getName() + ansiReset() + 
-                     " - " + ansiColor(35) + contact.getPhoneNumber() + ansiReset());
-            index++;
-        }
+        sendLine(session, "n or Enter for the next page, p for the previous one, /text to filter, q to quit: ");
     }
-    
-    lock.unlock();
-    sendLine(clientSocket, "");
-    sendLine(clientSocket, "Press Enter to return to main menu...");
-    std::string dummy = readLine(clientSocket);
-    showMainMenu(clientSocket);
 }
 
-void searchContact(socket_t clientSocket, const std::string& query) {
-    std::unique_lock<std::mutex> lock(contactsMutex);
-    
-    sendLine(clientSocket, clearScreen());
-    sendLine(clientSocket, ansiColor(33) + "SEARCH RESULTS FOR '" + query + "':" + ansiReset());
-    sendLine(clientSocket, "");
+void listAllContacts(Session& session) {
+    beginListing(session, false);
+}
+
+void searchContact(Session& session, const std::string& query) {
+    sendLine(session, ansi::CLEAR_SCREEN);
+    sendLine(session, ansi::colored(ansi::YELLOW, "SEARCH RESULTS FOR '" + query + "':"));
+    sendLine(session, "");
     
-    bool found = false;
-    for (const auto& contact : contacts) {
-        std::string name = contact.getName();
-        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
-        
-        std::string queryLower = query;
-        std::transform(queryLower.begin(), queryLower.end(), queryLower.begin(), ::tolower);
-        
-        if (name.find(queryLower) != std::string::npos) {
-            sendLine(clientSocket, ansiColor(36) + contact.getName() + ansiReset() + 
-                     " - " + ansiColor(35) + contact.getPhoneNumber() + ansiReset());
-            found = true;
+    // The rows shown are copied out under the lock and rendered after it,
+    // so a client that is slow to read never holds up writers
+    std::vector<ContactRow> rows;
+    size_t total;
+    {
+        SharedLock lock(contactsMutex);
+        std::vector<const Contact*> matches = contacts.search(query);
+        total = matches.size();
+        size_t shown = std::min(total, SEARCH_MAX_ROWS);
+        rows.reserve(shown);
+        for (size_t i = 0; i < shown; i++) {
+            rows.push_back(ContactRow{matches[i]->getName(), matches[i]->getPhoneNumber(), std::string()});
         }
     }
-    
-    if (!found) {
-        sendLine(clientSocket, "No matching contacts found.");
+
+    session.output.cork();
+    for (const ContactRow& row : rows) {
+        SEARCH_ROW.render(session.output, 0, row.name, row.phoneNumber);
+    }
+    session.output.uncork();
+
+    if (total == 0) {
+        sendLine(session, "No matching contacts found.");
+    } else if (total > rows.size()) {
+        sendLine(session, "");
+        sendLine(session, "First " + std::to_string(rows.size()) + " of " + std::to_string(total) +
+                          " matches. Narrow the search, or list all contacts and filter with /text to page through them.");
     }
     
-    lock.unlock();
-    sendLine(clientSocket, "");
-    sendLine(clientSocket, "Press Enter to return to main menu...");
-    std::string dummy = readLine(clientSocket);
-    showMainMenu(clientSocket);
+    sendLine(session, "");
+    promptReturn(session);
 }
 
-void addContact(socket_t clientSocket, const std::string& name, const std::string& phoneNumber) {
-    std::unique_lock<std::mutex> lock(contactsMutex);
+void addContact(Session& session, const std::string& name, const std::string& phoneNumber) {
+    std::unique_lock<RwLock> lock(contactsMutex);
     
-    // Check if contact already exists
-    for (const auto& contact : contacts) {
-        std::string existingName = contact.getName();
-        std::transform(existingName.begin(), existingName.end(), existingName.begin(), ::tolower);
-        
-        std::string newName = name;
-        std::transform(newName.begin(), newName.end(), newName.begin(), ::tolower);
-        
-        if (existingName == newName) {
-            sendLine(clientSocket, "");
-            sendLine(clientSocket, "Contact with name '" + name + "' already exists.");
-            sendLine(clientSocket, "");
-            sendLine(clientSocket, "Press Enter to return to main menu...");
-            std::string dummy = readLine(clientSocket);
-            showMainMenu(clientSocket);
-            return;
-        }
+    // Fails if the contact already exists
+    if (!contacts.add(name, phoneNumber)) {
+        lock.unlock();
+        sendLine(session, "");
+        sendLine(session, "Contact with name '" + name + "' already exists.");
+        sendLine(session, "");
+        promptReturn(session);
+        return;
     }
-    
-    // Add new contact
-    contacts.emplace_back(name, phoneNumber);
-    saveContactsToFile();
+    journal.recordSet(name, phoneNumber);
 
     lock.unlock();
-    sendLine(clientSocket, "");
-    sendLine(clientSocket, ansiColor(32) + "Contact added successfully: " + ansiReset() + 
-             ansiColor(36) + name + ansiReset() + " - " + 
-             ansiColor(35) + phoneNumber + ansiReset());
-    sendLine(clientSocket, "");
-    sendLine(clientSocket, "Press Enter to return to main menu...");
-    std::string dummy = readLine(clientSocket);
-    showMainMenu(clientSocket);
-}
-
-void editContact(socket_t clientSocket, const std::string& name) {
-    std::unique_lock<std::mutex> lock(contactsMutex);
+    sendLine(session, "");
+    sendLine(session, ansi::colored(ansi::GREEN, "Contact added successfully: ") +
+             ansi::colored(ansi::CYAN, name) + " - " + ansi::colored(ansi::MAGENTA, phoneNumber));
+    sendLine(session, "");
+    promptReturn(session);
+}
+
+// Parses "Name:PhoneNumber" and adds the contact; usage names the expected form
+void addContactEntry(Session& session, const std::string& contactInfo, const std::string& usage) {
+    std::string name;
+    std::string phoneNumber;
+    if (!parseContact(contactInfo, name, phoneNumber)) {
+        sendLine(session, "Invalid format. Use: " + usage);
+        session.state = SessionState::Menu;
+        return;
+    }
+    addContact(session, name, phoneNumber);
+}
+
+// First half of an edit: look the contact up, remember the version that
+// was shown and ask for the new number
+void beginEdit(Session& session, const std::string& name) {
+    SharedLock lock(contactsMutex);
     
-    bool found = false;
-    for (auto& contact : contacts) {
-        std::string existingName = contact.getName();
-        std::transform(existingName.begin(), existingName.end(), existingName.begin(), ::tolower);
-        
-        std::string searchName = name;
-        std::transform(searchName.begin(), searchName.end(), searchName.begin(), ::tolower);
-        
-        if (existingName == searchName) {
-            found = true;
-            sendLine(clientSocket, "Enter new phone number for " + 
-                     ansiColor(36) + contact.getName() + ansiReset() + ": ");
-            
-            std::string newPhoneNumber = readLine(clientSocket);
-            contact.setPhoneNumber(newPhoneNumber);
-            saveContactsToFile();
-            
-            sendLine(clientSocket, "");
-            sendLine(clientSocket, ansiColor(32) + "Contact updated successfully!" + ansiReset());
-            break;
-        }
+    const Contact* contact = contacts.find(name);
+    if (contact != nullptr) {
+        session.editName = contact->getName();
+        session.editVersion = contact->getVersion();
+        lock.unlock();
+        sendLine(session, "Enter new phone number for " + 
+                 ansi::colored(ansi::CYAN, session.editName) + ": ");
+        session.state = SessionState::EditPhone;
+        return;
     }
     
-    if (!found) {
-        sendLine(clientSocket, "No contact found with name '" + name + "'.");
+    lock.unlock();
+    sendLine(session, "No contact found with name '" + name + "'.");
+    sendLine(session, "");
+    promptReturn(session);
+}
+
+// Second half: the number is only stored if nobody changed the contact
+// while this session was typing
+void finishEdit(Session& session, const std::string& newPhoneNumber) {
+    std::unique_lock<RwLock> lock(contactsMutex);
+    
+    PhoneBook::UpdateResult result = contacts.updatePhoneNumber(session.editName, session.editVersion, newPhoneNumber);
+    if (result == PhoneBook::UPDATED) {
+        journal.recordSet(session.editName, newPhoneNumber);
     }
     
-    sendLine(clientSocket, "");
     lock.unlock();
-    sendLine(clientSocket, "Press Enter to return to main menu...");
-    std::string dummy = readLine(clientSocket);
-    showMainMenu(clientSocket);
+    if (result == PhoneBook::UPDATED) {
+        sendLine(session, "");
+        sendLine(session, ansi::colored(ansi::GREEN, "Contact updated successfully!"));
+    } else if (result == PhoneBook::CHANGED) {
+        sendLine(session, "");
+        sendLine(session, "Contact " + ansi::colored(ansi::CYAN, session.editName) +
+                 " was changed by someone else meanwhile; not updated. Please try again.");
+    } else {
+        sendLine(session, "No contact found with name '" + session.editName + "'.");
+    }
+    session.editName.clear();
+    
+    sendLine(session, "");
+    promptReturn(session);
 }
 
-void deleteContact(socket_t clientSocket, const std::string& name) {
-    std::unique_lock<std::mutex> lock(contactsMutex);
+void deleteContact(Session& session, const std::string& name) {
+    std::unique_lock<RwLock> lock(contactsMutex);
     
-    bool found = false;
-    for (auto it = contacts.begin(); it != contacts.end(); ++it) {
-        std::string existingName = it->getName();
-        std::transform(existingName.begin(), existingName.end(), existingName.begin(), ::tolower);
-        
-        std::string searchName = name;
-        std::transform(searchName.begin(), searchName.end(), searchName.begin(), ::tolower);
-        
-        if (existingName == searchName) {
-            contacts.erase(it);
-            saveContactsToFile();
-            found = true;
-            break;
-        }
+    const Contact* contact = contacts.find(name);
+    bool found = contact != nullptr;
+    if (found) {
+        journal.recordDelete(contact->getName());
+        contacts.remove(name);
     }
     
+    lock.unlock();
     if (found) {
-        sendLine(clientSocket, "");
-        sendLine(clientSocket, ansiColor(32) + "Contact '" + name + "' deleted successfully!" + ansiReset());
+        sendLine(session, "");
+        sendLine(session, ansi::colored(ansi::GREEN, "Contact '" + name + "' deleted successfully!"));
     } else {
-        sendLine(clientSocket, "");
-        sendLine(clientSocket, "No contact found with name '" + name + "'.");
+        sendLine(session, "");
+        sendLine(session, "No contact found with name '" + name + "'.");
     }
     
-    sendLine(clientSocket, "");
-    lock.unlock();
-    sendLine(clientSocket, "Press Enter to return to main menu...");
-    std::string dummy = readLine(clientSocket);
-    showMainMenu(clientSocket);
+    sendLine(session, "");
+    promptReturn(session);
 }
 
-void handleClient(socket_t clientSocket) {
-    // Welcome the user and show menu
-    showWelcomeScreen(clientSocket);
-    showMainMenu(clientSocket);
-    
-    std::string inputLine;
-    while (true) {
-        inputLine = readLine(clientSocket);
-        
-        // Handle client disconnection
-        if (inputLine.empty() && errno != 0) {
+// Batch mode: a line protocol for scripts, one command per line and one
+// reply per command, in order. Replies start with OK or ERR; FIND and LIST
+// say how many rows follow.
+//
+//   ADD name:phone          OK | ERR exists | ERR usage: ADD name:phone
+//   DEL name                OK | ERR not found
+//   GET name                OK name:phone | ERR not found
+//   FIND text               OK <rows> <matches>, then a name:phone line per row
+//   LIST [offset [count]]   OK <rows> <contacts>, then a name:phone line per row
+//   QUIT                    OK bye
+//
+// FIND and LIST send at most BATCH_MAX_ROWS rows; LIST pages with offset.
+
+// Runs a Change command; contactsMutex is held exclusively
+void runBatchChange(Session& session, const BatchCommand& command) {
+    if (command.verb == "ADD") {
+        std::string name;
+        std::string phoneNumber;
+        if (!parseContact(command.argument, name, phoneNumber)) {
+            sendLine(session, "ERR usage: ADD name:phone");
+        } else if (!contacts.add(name, phoneNumber)) {
+            sendLine(session, "ERR exists");
+        } else {
+            journal.recordSet(name, phoneNumber);
+            sendLine(session, "OK");
+        }
+        return;
+    }
+
+    const Contact* contact = contacts.find(command.argument);
+    if (contact == nullptr) {
+        sendLine(session, "ERR not found");
+        return;
+    }
+    journal.recordDelete(contact->getName());
+    contacts.remove(command.argument);
+    sendLine(session, "OK");
+}
+
+// Runs a Read command; contactsMutex is held shared
+void runBatchRead(Session& session, const BatchCommand& command) {
+    if (command.verb == "GET") {
+        const Contact* contact = contacts.find(command.argument);
+        if (contact == nullptr) {
+            sendLine(session, "ERR not found");
+        } else {
+            BATCH_FOUND.render(session.output, 0, contact->getName(), contact->getPhoneNumber());
+        }
+        return;
+    }
+
+    std::vector<const Contact*> matches = contacts.search(command.argument);
+    size_t shown = std::min(matches.size(), BATCH_MAX_ROWS);
+    sendLine(session, "OK " + std::to_string(shown) + " " + std::to_string(matches.size()));
+    for (size_t i = 0; i < shown; i++) {
+        BATCH_ROW.render(session.output, 0, matches[i]->getName(), matches[i]->getPhoneNumber());
+    }
+}
+
+// LIST pages through a snapshot, so the lock is only held to take it
+void runBatchList(Session& session, const std::string& argument) {
+    std::istringstream words(argument);
+    size_t offset = 0;
+    size_t count = BATCH_MAX_ROWS;
+    words >> offset >> count;
+
+    std::shared_ptr<const ContactSnapshot> snapshot;
+    {
+        SharedLock lock(contactsMutex);
+        snapshot = contacts.snapshot();
+    }
+
+    size_t total = snapshot->size();
+    size_t first = std::min(offset, total);
+    size_t end = first + std::min(std::min(count, BATCH_MAX_ROWS), total - first);
+    sendLine(session, "OK " + std::to_string(end - first) + " " + std::to_string(total));
+    for (size_t position = first; position < end; position++) {
+        const ContactRow& row = (*snapshot)[position];
+        BATCH_ROW.render(session.output, 0, row.name, row.phoneNumber);
+    }
+}
+
+Operation batchOperation(const BatchCommand& command) {
+    if (command.verb == "ADD") {
+        return Operation::BatchAdd;
+    } else if (command.verb == "DEL") {
+        return Operation::BatchDelete;
+    } else if (command.verb == "GET") {
+        return Operation::BatchGet;
+    } else if (command.verb == "FIND") {
+        return Operation::BatchFind;
+    } else if (command.verb == "LIST") {
+        return Operation::BatchList;
+    }
+    return Operation::Other;
+}
+
+// Runs the commands at the front of lines for as long as they need the
+// given access, at most limit of them and not past the output high-water
+// mark; the caller holds the lock
+size_t runBatchCommands(Session& session, std::deque<std::string>& lines, BatchAccess access, size_t limit) {
+    size_t handled = 0;
+    while (handled < limit && !lines.empty() && session.output.pendingBytes() < EventLoop::OUTPUT_HIGH_WATER) {
+        BatchCommand command = parseBatchCommand(lines.front());
+        if (command.access != access) {
             break;
         }
-        
-        // Process commands
-        if (inputLine.empty()) {
-            showMainMenu(clientSocket);
+        Metrics::Scope scope(batchOperation(command));
+        if (access == BatchAccess::Change) {
+            runBatchChange(session, command);
+        } else {
+            runBatchRead(session, command);
+        }
+        lines.pop_front();
+        handled++;
+    }
+    return handled;
+}
+
+// Answers up to BATCH_SIZE of the queued commands. A run of reads shares one
+// shared lock and a run of changes one exclusive lock, so a pipelined batch
+// costs a lock round trip per run instead of per command. Stops at the
+// output high-water mark: the rest waits until the client reads.
+void handleBatch(Session& session, std::deque<std::string>& lines) {
+    size_t handled = 0;
+    while (handled < BATCH_SIZE && !lines.empty() && session.state == SessionState::Batch &&
+           session.output.pendingBytes() < EventLoop::OUTPUT_HIGH_WATER) {
+        BatchCommand command = parseBatchCommand(lines.front());
+
+        // The run's lock wait and hold count against its first command
+        Metrics::Charge charge(batchOperation(command));
+        if (command.access == BatchAccess::Change) {
+            std::lock_guard<RwLock> lock(contactsMutex);
+            handled += runBatchCommands(session, lines, BatchAccess::Change, BATCH_SIZE - handled);
             continue;
         }
-        try {
-            if (inputLine == "1") {
-                listAllContacts(clientSocket);
-            } else if (inputLine == "2") {
-                sendLine(clientSocket, "");
-                sendLine(clientSocket, "Enter search term: ");
-                std::string query = readLine(clientSocket);
-                searchContact(clientSocket, query);
-            } else if (inputLine == "3") {
-                sendLine(clientSocket, "");
-                sendLine(clientSocket, "Enter new contact (Name:PhoneNumber): ");
-
-                std::string contactInfo = readLine(clientSocket);
-                size_t pos = contactInfo.find(':');
-                if (pos != std::string::npos) {
-                    std::string name = contactInfo.substr(0, pos);
-                    std::string phoneNumber = contactInfo.substr(pos + 1);
-                    
-                    // Trim whitespace
-                    name.erase(0, name.find_first_not_of(" \t"));
-                    name.erase(name.find_last_not_of(" \t") + 1);
-                    phoneNumber.erase(0, phoneNumber.find_first_not_of(" \t"));
-                    phoneNumber.erase(phoneNumber.find_last_not_of(" \t") + 1);
-                    
-                    addContact(clientSocket, name, phoneNumber);
-                } else {
-                    sendLine(clientSocket, "Invalid format. Use: Name:PhoneNumber");
-                }
-            } else if (inputLine == "4") {
-                sendLine(clientSocket, "");
-                if (contacts.empty()) {
-                    sendLine(clientSocket, "No contacts in the phone book to edit.");
-                    sendLine(clientSocket, "Press Enter to return to main menu...");
-                    std::string dummy = readLine(clientSocket);
-                    showMainMenu(clientSocket);
-                    continue;
-                }
-                
-                listAllContacts(clientSocket);
-                sendLine(clientSocket, "Enter the name of the contact to edit: ");
-                std::string name = readLine(clientSocket);
-                editContact(clientSocket, name);
-            } else if (inputLine == "5") {
-                sendLine(clientSocket, "");
-                if (contacts.empty()) {
-                    sendLine(clientSocket, "No contacts in the phone book to delete.");
-                    sendLine(clientSocket, "Press Enter to return to main menu...");
-                    std::string dummy = readLine(clientSocket);
-                    showMainMenu(clientSocket);
-                    continue;
-                }
-                
-                sendLine(clientSocket, "Enter the name of the contact to delete: ");
-                std::string name = readLine(clientSocket);
-                deleteContact(clientSocket, name);
-            } else if (inputLine == "6") {
-                sendLine(clientSocket, "");
-                sendLine(clientSocket, ansiColor(32) + "Thank you for using the Phone Book Server!");
-                sendLine(clientSocket, "Disconnecting..." + ansiReset());
-                break;
-            } else if (inputLine == "m") {
-                showMainMenu(clientSocket);
-            } else if (inputLine == "h") {
-                showHelp(clientSocket);
-            } else if (inputLine == "c") {
-                sendLine(clientSocket, clearScreen());
-                showMainMenu(clientSocket);
+        if (command.access == BatchAccess::Read) {
+            SharedLock lock(contactsMutex);
+            handled += runBatchCommands(session, lines, BatchAccess::Read, BATCH_SIZE - handled);
+            continue;
+        }
+
+        if (command.verb == "LIST") {
+            Metrics::Scope scope(Operation::BatchList);
+            runBatchList(session, command.argument);
+        } else if (command.verb == "QUIT") {
+            sendLine(session, "OK bye");
+            session.state = SessionState::Closing;
+        } else if (!command.verb.empty()) {
+            sendLine(session, "ERR unknown command");
+        }
+        lines.pop_front();
+        handled++;
+    }
+}
+
+// A line typed at the main menu
+void handleCommand(Session& session, const std::string& inputLine) {
+    if (inputLine.empty()) {
+        showMainMenu(session);
+    } else if (inputLine == "1") {
+        listAllContacts(session);
+    } else if (inputLine == "2") {
+        prompt(session, "Enter search term: ", SessionState::SearchQuery);
+    } else if (inputLine == "3") {
+        prompt(session, "Enter new contact (Name:PhoneNumber): ", SessionState::AddEntry);
+    } else if (inputLine == "4") {
+        if (!hasContacts()) {
+            sendLine(session, "");
+            sendLine(session, "No contacts in the phone book to edit.");
+            promptReturn(session);
+            return;
+        }
+        
+        // The name is asked for once the listing is done
+        beginListing(session, true);
+    } else if (inputLine == "5") {
+        if (!hasContacts()) {
+            sendLine(session, "");
+            sendLine(session, "No contacts in the phone book to delete.");
+            promptReturn(session);
+            return;
+        }
+        
+        prompt(session, "Enter the name of the contact to delete: ", SessionState::DeleteName);
+    } else if (inputLine == "6") {
+        sendLine(session, "");
+        sendLine(session, ansi::GREEN + std::string("Thank you for using the Phone Book Server!"));
+        sendLine(session, "Disconnecting..." + std::string(ansi::RESET));
+        session.state = SessionState::Closing;
+    } else if (inputLine == "BATCH") {
+        // Scripts skip everything up to this reply
+        sendLine(session, "OK BATCH");
+        session.state = SessionState::Batch;
+        session.batch = true;
+        metrics.batchStarted();
+    } else if (inputLine == "m") {
+        showMainMenu(session);
+    } else if (inputLine == "h") {
+        showHelp(session);
+    } else if (inputLine == "c") {
+        sendLine(session, ansi::CLEAR_SCREEN);
+        showMainMenu(session);
+    } else if (inputLine.substr(0, 7) == "search ") {
+        searchContact(session, inputLine.substr(7));
+    } else if (inputLine.substr(0, 4) == "add ") {
+        addContactEntry(session, inputLine.substr(4), "add Name:PhoneNumber");
+    } else if (inputLine.substr(0, 7) == "delete ") {
+        deleteContact(session, inputLine.substr(7));
+    } else {
+        sendLine(session, "Unknown command. Type 'h' for help or 'm' for menu.");
+    }
+}
+
+// What answering inputLine counts as in the metrics
+Operation lineOperation(const Session& session, const std::string& inputLine) {
+    switch (session.state) {
+        case SessionState::Menu:
+            if (inputLine == "1" || inputLine == "4") {
+                return Operation::List;
             } else if (inputLine.substr(0, 7) == "search ") {
-                std::string query = inputLine.substr(7);
-                searchContact(clientSocket, query);
+                return Operation::Search;
             } else if (inputLine.substr(0, 4) == "add ") {
-                std::string contactInfo = inputLine.substr(4);
-                size_t pos = contactInfo.find(':');
-                if (pos != std::string::npos) {
-                    std::string name = contactInfo.substr(0, pos);
-                    std::string phoneNumber = contactInfo.substr(pos + 1);
-                    
-                    // Trim whitespace
-                    name.erase(0, name.find_first_not_of(" \t"));
-                    name.erase(name.find_last_not_of(" \t") + 1);
-                    phoneNumber.erase(0, phoneNumber.find_first_not_of(" \t"));
-                    phoneNumber.erase(phoneNumber.find_last_not_of(" \t") + 1);
-                    
-                    addContact(clientSocket, name, phoneNumber);
-                } else {
-                    sendLine(clientSocket, "Invalid format. Use: add Name:PhoneNumber");
-                }
+                return Operation::Add;
             } else if (inputLine.substr(0, 7) == "delete ") {
-                std::string name = inputLine.substr(7);
-                deleteContact(clientSocket, name);
-            } else {
-                sendLine(clientSocket, "Unknown command. Type 'h' for help or 'm' for menu.");
+                return Operation::Delete;
+            }
+            return Operation::Menu;
+        case SessionState::ListPage:
+            return Operation::List;
+        case SessionState::SearchQuery:
+            return Operation::Search;
+        case SessionState::AddEntry:
+            return Operation::Add;
+        case SessionState::EditName:
+        case SessionState::EditPhone:
+            return Operation::Edit;
+        case SessionState::DeleteName:
+            return Operation::Delete;
+        default:
+            return Operation::Menu;
+    }
+}
+
+// Answers one input line according to the prompt the session is showing
+void handleLine(Session& session, const std::string& inputLine) {
+    LOG_DEBUG("telnet", session.clientIP + " command: " + inputLine);
+    Metrics::Scope scope(lineOperation(session, inputLine));
+
+    try {
+        switch (session.state) {
+            case SessionState::Menu:
+                handleCommand(session, inputLine);
+                break;
+            case SessionState::Pause:
+                session.state = SessionState::Menu;
+                showMainMenu(session);
+                break;
+            case SessionState::ListPage:
+                pageListing(session, inputLine);
+                break;
+            case SessionState::SearchQuery:
+                searchContact(session, inputLine);
+                break;
+            case SessionState::AddEntry:
+                addContactEntry(session, inputLine, "Name:PhoneNumber");
+                break;
+            case SessionState::EditName:
+                beginEdit(session, inputLine);
+                break;
+            case SessionState::EditPhone:
+                finishEdit(session, inputLine);
+                break;
+            case SessionState::DeleteName:
+                deleteContact(session, inputLine);
+                break;
+            case SessionState::Batch: {
+                std::deque<std::string> lines(1, inputLine);
+                handleBatch(session, lines);
+                break;
             }
-        } catch (const std::exception& e) {
-            sendLine(clientSocket, "An error occurred: " + std::string(e.what()));
-            sendLine(clientSocket, "");
-            sendLine(clientSocket, "Press Enter to return to main menu...");
-            std::string dummy = readLine(clientSocket);
-            showMainMenu(clientSocket);
+            case SessionState::Closing:
+                break;
         }
+    } catch (const std::exception& e) {
+        sendLine(session, "An error occurred: " + std::string(e.what()));
+        sendLine(session, "");
+        promptReturn(session);
     }
-    
-    // Close client socket
-    CLOSE_SOCKET(clientSocket);
-    std::cout << "Client disconnected" << std::endl;
+}
+
+void openSession(Session& session) {
+    LOG_INFO("telnet", "Client connected: " + session.clientIP);
+    metrics.sessionOpened();
+    session.output.append(session.telnet.negotiate());
+    showWelcomeScreen(session);
+    showMainMenu(session);
+}
+
+void openBatchSession(Session& session) {
+    LOG_INFO("telnet", "Batch client connected: " + session.clientIP);
+    metrics.sessionOpened();
+    metrics.batchStarted();
+    session.state = SessionState::Batch;
+    session.batch = true;
+}
+
+void closeSession(Session& session) {
+    LOG_INFO("telnet", "Client disconnected: " + session.clientIP);
+    metrics.sessionClosed(session.batch);
 }
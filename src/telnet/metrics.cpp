@@ -0,0 +1,133 @@
+#include "metrics.h"
+
+Metrics metrics;
+
+// The operation each thread is working on; see Metrics::Scope
+static thread_local Operation currentOperation = Operation::Other;
+
+static size_t bucketOf(uint64_t value) {
+    if (value < 4) {
+        return static_cast<size_t>(value);
+    }
+    // The top bit picks the power of two, the two bits below it the quarter
+    int top = 63 - __builtin_clzll(value);
+    size_t bucket = static_cast<size_t>(top - 1) * 4 + static_cast<size_t>((value >> (top - 2)) & 3);
+    return bucket < Histogram::BUCKETS ? bucket : Histogram::BUCKETS - 1;
+}
+
+// The smallest value falling into bucket
+static uint64_t bucketStart(size_t bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    return static_cast<uint64_t>(4 + bucket % 4) << (bucket / 4 - 1);
+}
+
+Histogram::Histogram() : samples(0), sum(0), maximum(0) {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::record(uint64_t nanoseconds) {
+    buckets[bucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    samples.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+    uint64_t seen = maximum.load(std::memory_order_relaxed);
+    while (nanoseconds > seen && !maximum.compare_exchange_weak(seen, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t Histogram::percentile(double fraction) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(total));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+        seen += buckets[bucket].load(std::memory_order_relaxed);
+        if (seen > rank) {
+            uint64_t end = bucket + 1 < BUCKETS ? bucketStart(bucket + 1) - 1 : max();
+            return end < max() ? end : max();
+        }
+    }
+    return max();
+}
+
+void Histogram::reset() {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    samples.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    maximum.store(0, std::memory_order_relaxed);
+}
+
+const char* operationName(Operation operation) {
+    switch (operation) {
+        case Operation::Other: return "other";
+        case Operation::Menu: return "menu";
+        case Operation::List: return "list";
+        case Operation::Search: return "search";
+        case Operation::Add: return "add";
+        case Operation::Edit: return "edit";
+        case Operation::Delete: return "delete";
+        case Operation::BatchAdd: return "batch ADD";
+        case Operation::BatchDelete: return "batch DEL";
+        case Operation::BatchGet: return "batch GET";
+        case Operation::BatchFind: return "batch FIND";
+        case Operation::BatchList: return "batch LIST";
+        case Operation::Compaction: return "compaction";
+        case Operation::Count: break;
+    }
+    return "?";
+}
+
+Metrics::Metrics() : sessions(0), batchSessions(0), sessionsOpened(0), started(now()) {
+}
+
+Operation Metrics::current() {
+    return currentOperation;
+}
+
+Metrics::Scope::Scope(Operation operation) : operation(operation), previous(currentOperation), start(now()) {
+    currentOperation = operation;
+}
+
+Metrics::Scope::~Scope() {
+    metrics.operation(operation).latency.record(now() - start);
+    currentOperation = previous;
+}
+
+Metrics::Charge::Charge(Operation operation) : previous(currentOperation) {
+    currentOperation = operation;
+}
+
+Metrics::Charge::~Charge() {
+    currentOperation = previous;
+}
+
+void Metrics::lockWaited(bool exclusive, Operation operation, uint64_t nanoseconds) {
+    (exclusive ? lockStats.exclusiveWait : lockStats.sharedWait).record(nanoseconds);
+    this->operation(operation).lockWaitNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+void Metrics::lockHeld(bool exclusive, Operation operation, uint64_t nanoseconds) {
+    (exclusive ? lockStats.exclusiveHold : lockStats.sharedHold).record(nanoseconds);
+    this->operation(operation).lockHoldNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+void Metrics::reset() {
+    for (auto& stats : operations) {
+        stats.latency.reset();
+        stats.lockWaitNanoseconds.store(0, std::memory_order_relaxed);
+        stats.lockHoldNanoseconds.store(0, std::memory_order_relaxed);
+    }
+    lockStats.exclusiveWait.reset();
+    lockStats.exclusiveHold.reset();
+    lockStats.sharedWait.reset();
+    lockStats.sharedHold.reset();
+}
@@ -0,0 +1,153 @@
+// Metrics - Counters and latency histograms for the telnet server, shown by
+// the admin console. Everything is a relaxed atomic, so recording never
+// takes a lock. Each thread names the operation it is working on; waits for
+// and holds of contactsMutex are charged to that operation, which is how
+// the console tells which command causes contention.
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <time.h>
+
+// Durations in nanoseconds. Every power of two is split into four buckets,
+// so percentiles are within 25%.
+class Histogram {
+    public:
+        static const size_t BUCKETS = 160;      // up to about 18 minutes
+
+        Histogram();
+
+        void record(uint64_t nanoseconds);
+
+        uint64_t count() const { return samples.load(std::memory_order_relaxed); }
+        uint64_t total() const { return sum.load(std::memory_order_relaxed); }
+        uint64_t max() const { return maximum.load(std::memory_order_relaxed); }
+        // Upper bound of the bucket holding the fraction-th sample
+        uint64_t percentile(double fraction) const;
+
+        void reset();
+
+    private:
+        std::atomic<uint64_t> buckets[BUCKETS];
+        std::atomic<uint64_t> samples;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> maximum;
+};
+
+enum class Operation {
+    Other,          // not inside any command, e.g. opening a session
+    Menu,           // menu, help and prompt screens
+    List,           // listing pages
+    Search,
+    Add,
+    Edit,
+    Delete,
+    BatchAdd,
+    BatchDelete,
+    BatchGet,
+    BatchFind,
+    BatchList,
+    Compaction,     // the journal folding itself into a snapshot
+    Count
+};
+
+const char* operationName(Operation operation);
+
+struct OperationStats {
+    Histogram latency;                          // time to answer, lock waits included
+    std::atomic<uint64_t> lockWaitNanoseconds;
+    std::atomic<uint64_t> lockHoldNanoseconds;
+
+    OperationStats() : lockWaitNanoseconds(0), lockHoldNanoseconds(0) {}
+};
+
+struct LockStats {
+    Histogram exclusiveWait;
+    Histogram exclusiveHold;
+    Histogram sharedWait;
+    Histogram sharedHold;
+};
+
+class Metrics {
+    public:
+        Metrics();
+
+        // Monotonic nanoseconds; clock_gettime directly, as the unoptimized
+        // build pays for every layer of std::chrono
+        static uint64_t now() {
+            timespec time;
+            clock_gettime(CLOCK_MONOTONIC, &time);
+            return static_cast<uint64_t>(time.tv_sec) * 1000000000 + static_cast<uint64_t>(time.tv_nsec);
+        }
+
+        OperationStats& operation(Operation operation) { return operations[static_cast<size_t>(operation)]; }
+
+        // What the calling thread is working on
+        static Operation current();
+
+        // Names the calling thread's operation and records its latency when
+        // it goes out of scope
+        class Scope {
+            public:
+                explicit Scope(Operation operation);
+                ~Scope();
+
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+
+            private:
+                Operation operation;
+                Operation previous;
+                uint64_t start;
+        };
+
+        // Charges the calling thread's lock waits and holds to operation
+        // without timing it, e.g. around a lock taken for several commands
+        class Charge {
+            public:
+                explicit Charge(Operation operation);
+                ~Charge();
+
+                Charge(const Charge&) = delete;
+                Charge& operator=(const Charge&) = delete;
+
+            private:
+                Operation previous;
+        };
+
+        // Charges a wait for or a hold of contactsMutex
+        void lockWaited(bool exclusive, Operation operation, uint64_t nanoseconds);
+        void lockHeld(bool exclusive, Operation operation, uint64_t nanoseconds);
+        const LockStats& contactsLock() const { return lockStats; }
+
+        void sessionOpened() { sessions++; sessionsOpened++; }
+        void sessionClosed(bool batch) {
+            sessions--;
+            if (batch) {
+                batchSessions--;
+            }
+        }
+        void batchStarted() { batchSessions++; }
+        int64_t activeSessions() const { return sessions.load(); }
+        int64_t activeBatchSessions() const { return batchSessions.load(); }
+        uint64_t openedSessions() const { return sessionsOpened.load(); }
+        uint64_t startedAt() const { return started; }
+
+        // Starts every counter and histogram afresh; the session gauges stay
+        void reset();
+
+    private:
+        OperationStats operations[static_cast<size_t>(Operation::Count)];
+        LockStats lockStats;
+        std::atomic<int64_t> sessions;
+        std::atomic<int64_t> batchSessions;
+        std::atomic<uint64_t> sessionsOpened;
+        uint64_t started;
+};
+
+extern Metrics metrics;
+
+#endif // METRICS_H
@@ -0,0 +1,216 @@
+#include "phone_book.h"
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+
+// Searches shorter than a trigram scan the case-folded names instead
+static const size_t TRIGRAM = 3;
+// Dead slots are only reclaimed in bulk
+static const size_t MIN_DEAD_SLOTS = 1024;
+// Slots per snapshot chunk; a change costs the next snapshot one chunk copy
+static const size_t SNAPSHOT_CHUNK = 1024;
+
+static uint32_t trigramAt(const std::string& text, size_t position) {
+    return (static_cast<uint32_t>(static_cast<unsigned char>(text[position])) << 16) |
+           (static_cast<uint32_t>(static_cast<unsigned char>(text[position + 1])) << 8) |
+           static_cast<uint32_t>(static_cast<unsigned char>(text[position + 2]));
+}
+
+const ContactRow& ContactSnapshot::operator[](size_t position) const {
+    size_t chunk = static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), position) - starts.begin()) - 1;
+    return (*chunks[chunk])[position - starts[chunk]];
+}
+
+Contact::Contact(const std::string& name, const std::string& phoneNumber)
+    : name(name), phoneNumber(phoneNumber), key(PhoneBook::foldCase(name)), version(0) {
+}
+
+std::string PhoneBook::foldCase(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+PhoneBook::PhoneBook() : lastVersion(0) {
+}
+
+bool PhoneBook::add(const std::string& name, const std::string& phoneNumber) {
+    Contact contact(name, phoneNumber);
+    if (byKey.find(contact.getKey()) != byKey.end()) {
+        return false;
+    }
+
+    contact.setVersion(++lastVersion);
+    slots.push_back(std::move(contact));
+    live.push_back(true);
+    index(static_cast<uint32_t>(slots.size() - 1));
+    changed(static_cast<uint32_t>(slots.size() - 1));
+    return true;
+}
+
+const Contact* PhoneBook::find(const std::string& name) const {
+    auto found = byKey.find(foldCase(name));
+    return found == byKey.end() ? nullptr : &slots[found->second];
+}
+
+bool PhoneBook::setPhoneNumber(const std::string& name, const std::string& phoneNumber) {
+    auto found = byKey.find(foldCase(name));
+    if (found == byKey.end()) {
+        return false;
+    }
+    slots[found->second].setPhoneNumber(phoneNumber);
+    slots[found->second].setVersion(++lastVersion);
+    changed(found->second);
+    return true;
+}
+
+PhoneBook::UpdateResult PhoneBook::updatePhoneNumber(const std::string& name, uint64_t expectedVersion,
+                                                     const std::string& phoneNumber) {
+    auto found = byKey.find(foldCase(name));
+    if (found == byKey.end()) {
+        return MISSING;
+    }
+
+    // Versions come from one counter, so a deleted and re-added contact
+    // does not pass for the one that was read
+    Contact& contact = slots[found->second];
+    if (contact.getVersion() != expectedVersion) {
+        return CHANGED;
+    }
+    contact.setPhoneNumber(phoneNumber);
+    contact.setVersion(++lastVersion);
+    changed(found->second);
+    return UPDATED;
+}
+
+bool PhoneBook::remove(const std::string& name) {
+    auto found = byKey.find(foldCase(name));
+    if (found == byKey.end()) {
+        return false;
+    }
+
+    // The trigram postings still name the slot; search skips dead slots
+    live[found->second] = false;
+    changed(found->second);
+    byKey.erase(found);
+
+    size_t dead = slots.size() - byKey.size();
+    if (dead >= MIN_DEAD_SLOTS && dead > byKey.size()) {
+        rebuild();
+    }
+    return true;
+}
+
+std::vector<const Contact*> PhoneBook::search(const std::string& query) const {
+    std::string folded = foldCase(query);
+    std::vector<const Contact*> matches;
+
+    if (folded.size() < TRIGRAM) {
+        forEach([&](const Contact& contact) {
+            if (contact.getKey().find(folded) != std::string::npos) {
+                matches.push_back(&contact);
+            }
+        });
+        return matches;
+    }
+
+    // Every trigram of the query must occur in a match; start from the rarest
+    std::vector<const std::vector<uint32_t>*> postings;
+    for (size_t position = 0; position + TRIGRAM <= folded.size(); position++) {
+        auto found = byTrigram.find(trigramAt(folded, position));
+        if (found == byTrigram.end()) {
+            return matches;
+        }
+        postings.push_back(&found->second);
+    }
+    std::sort(postings.begin(), postings.end(),
+              [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b) { return a->size() < b->size(); });
+
+    std::vector<uint32_t> candidates(*postings[0]);
+    std::vector<uint32_t> narrowed;
+    for (size_t i = 1; i < postings.size() && !candidates.empty(); i++) {
+        narrowed.clear();
+        std::set_intersection(candidates.begin(), candidates.end(), postings[i]->begin(), postings[i]->end(),
+                              std::back_inserter(narrowed));
+        candidates.swap(narrowed);
+    }
+
+    // The trigrams need not be adjacent in the candidate, so check the substring
+    for (uint32_t slot : candidates) {
+        if (live[slot] && slots[slot].getKey().find(folded) != std::string::npos) {
+            matches.push_back(&slots[slot]);
+        }
+    }
+    return matches;
+}
+
+std::shared_ptr<const ContactSnapshot> PhoneBook::snapshot() const {
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    if (latest) {
+        return latest;
+    }
+
+    std::shared_ptr<ContactSnapshot> taken(new ContactSnapshot());
+    chunks.resize((slots.size() + SNAPSHOT_CHUNK - 1) / SNAPSHOT_CHUNK);
+    for (size_t chunk = 0; chunk < chunks.size(); chunk++) {
+        if (!chunks[chunk]) {
+            std::shared_ptr<ContactSnapshot::Chunk> rows = std::make_shared<ContactSnapshot::Chunk>();
+            size_t end = std::min(slots.size(), (chunk + 1) * SNAPSHOT_CHUNK);
+            for (size_t slot = chunk * SNAPSHOT_CHUNK; slot < end; slot++) {
+                if (live[slot]) {
+                    const Contact& contact = slots[slot];
+                    rows->push_back(ContactRow{contact.getName(), contact.getPhoneNumber(), contact.getKey()});
+                }
+            }
+            chunks[chunk] = rows;
+        }
+        if (!chunks[chunk]->empty()) {
+            taken->starts.push_back(taken->total);
+            taken->chunks.push_back(chunks[chunk]);
+            taken->total += chunks[chunk]->size();
+        }
+    }
+
+    latest = taken;
+    return latest;
+}
+
+// Called under the exclusive lock, so no snapshot is being taken
+void PhoneBook::changed(uint32_t slot) {
+    latest.reset();
+    if (slot / SNAPSHOT_CHUNK < chunks.size()) {
+        chunks[slot / SNAPSHOT_CHUNK].reset();
+    }
+}
+
+void PhoneBook::index(uint32_t slot) {
+    const std::string& key = slots[slot].getKey();
+    byKey[key] = slot;
+
+    for (size_t position = 0; position + TRIGRAM <= key.size(); position++) {
+        std::vector<uint32_t>& posting = byTrigram[trigramAt(key, position)];
+        if (posting.empty() || posting.back() != slot) {
+            posting.push_back(slot);
+        }
+    }
+}
+
+void PhoneBook::rebuild() {
+    std::vector<Contact> kept;
+    kept.reserve(byKey.size());
+    for (size_t slot = 0; slot < slots.size(); slot++) {
+        if (live[slot]) {
+            kept.push_back(std::move(slots[slot]));
+        }
+    }
+
+    slots.swap(kept);
+    live.assign(slots.size(), true);
+    chunks.clear();
+    latest.reset();
+    byKey.clear();
+    byTrigram.clear();
+    for (size_t slot = 0; slot < slots.size(); slot++) {
+        index(static_cast<uint32_t>(slot));
+    }
+}
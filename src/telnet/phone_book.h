@@ -0,0 +1,139 @@
+// PhoneBook - The contact list with indexes for the telnet server. Names are
+// matched case-insensitively through a hash index on the case-folded name;
+// substring search intersects trigram posting lists and checks only the
+// candidates. Contacts keep insertion order. Every change gives the contact a
+// new version, so an edit prepared earlier can tell whether it is still
+// current. Listings page through snapshots, which share unchanged chunks of
+// rows. Not synchronized; callers hold contactsMutex.
+
+#ifndef PHONE_BOOK_H
+#define PHONE_BOOK_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Contact {
+    private:
+        std::string name;
+        std::string phoneNumber;
+        std::string key;        // case-folded name, computed once
+        uint64_t version;
+
+    public:
+        Contact(const std::string& name, const std::string& phoneNumber);
+
+        const std::string& getName() const { return name; }
+        const std::string& getPhoneNumber() const { return phoneNumber; }
+        const std::string& getKey() const { return key; }
+        uint64_t getVersion() const { return version; }
+        void setPhoneNumber(const std::string& newNumber) { phoneNumber = newNumber; }
+        void setVersion(uint64_t newVersion) { version = newVersion; }
+
+        std::string toString() const {
+            return name + ": " + phoneNumber;
+        }
+};
+
+// What a listing shows of a contact
+struct ContactRow {
+    std::string name;
+    std::string phoneNumber;
+    std::string key;        // case-folded name, for filtering
+};
+
+// The contacts in insertion order at one moment. It never changes and is
+// read without contactsMutex; a session can keep it while others edit.
+class ContactSnapshot {
+    public:
+        typedef std::vector<ContactRow> Chunk;
+
+        size_t size() const { return total; }
+        const ContactRow& operator[](size_t position) const;
+
+        // Visits every row with its position
+        template<typename Visit>
+        void forEach(Visit visit) const {
+            size_t position = 0;
+            for (const auto& chunk : chunks) {
+                for (const ContactRow& row : *chunk) {
+                    visit(position++, row);
+                }
+            }
+        }
+
+    private:
+        friend class PhoneBook;
+        ContactSnapshot() : total(0) {}
+
+        std::vector<std::shared_ptr<const Chunk>> chunks;   // none empty
+        std::vector<size_t> starts;                         // position of each chunk's first row
+        size_t total;
+};
+
+class PhoneBook {
+    public:
+        enum UpdateResult {
+            UPDATED,
+            CHANGED,        // someone else changed or re-created the contact
+            MISSING
+        };
+
+        static std::string foldCase(std::string text);
+
+        PhoneBook();
+
+        size_t size() const { return byKey.size(); }
+        bool empty() const { return byKey.empty(); }
+
+        // Returns false if a contact with that name (in any case) exists
+        bool add(const std::string& name, const std::string& phoneNumber);
+
+        // nullptr if there is no such contact. Pointers are valid until the
+        // next add or remove.
+        const Contact* find(const std::string& name) const;
+        bool setPhoneNumber(const std::string& name, const std::string& phoneNumber);
+        // Sets the number only if the contact is still at expectedVersion
+        UpdateResult updatePhoneNumber(const std::string& name, uint64_t expectedVersion,
+                                       const std::string& phoneNumber);
+        bool remove(const std::string& name);
+
+        // Contacts whose name contains query (any case), in insertion order
+        std::vector<const Contact*> search(const std::string& query) const;
+
+        template<typename Visit>
+        void forEach(Visit visit) const {
+            for (size_t slot = 0; slot < slots.size(); slot++) {
+                if (live[slot]) {
+                    visit(slots[slot]);
+                }
+            }
+        }
+
+        // The current contents. The shared lock is enough; only the chunks
+        // changed since the last snapshot are copied.
+        std::shared_ptr<const ContactSnapshot> snapshot() const;
+
+    private:
+        void index(uint32_t slot);
+        void rebuild();
+        void changed(uint32_t slot);
+
+        // Removed contacts leave a dead slot until they outnumber the live ones
+        std::vector<Contact> slots;
+        std::vector<bool> live;
+        uint64_t lastVersion;
+        std::unordered_map<std::string, uint32_t> byKey;
+        std::unordered_map<uint32_t, std::vector<uint32_t>> byTrigram;   // ascending slots
+
+        // Snapshot rows by range of slots, dropped when a slot in the range
+        // changes. Readers holding the shared lock take snapshots together.
+        mutable std::mutex snapshotMutex;
+        mutable std::vector<std::shared_ptr<const ContactSnapshot::Chunk>> chunks;
+        mutable std::shared_ptr<const ContactSnapshot> latest;
+};
+
+#endif // PHONE_BOOK_H
@@ -0,0 +1,85 @@
+// RwLock - Readers-writer lock for the phone book (std::shared_mutex needs
+// C++17). Listings and searches share it; changes take it exclusively.
+// Waiting writers are preferred so a stream of readers cannot starve them.
+// Every wait and hold is timed and charged to the thread's operation in
+// metrics.
+
+#ifndef RW_LOCK_H
+#define RW_LOCK_H
+
+#include <pthread.h>
+#include "metrics.h"
+
+class RwLock {
+    public:
+        RwLock() : exclusiveSince(0), exclusiveOperation(Operation::Other) {
+            pthread_rwlockattr_t attributes;
+            pthread_rwlockattr_init(&attributes);
+#ifdef __GLIBC__
+            pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+            pthread_rwlock_init(&rwlock, &attributes);
+            pthread_rwlockattr_destroy(&attributes);
+        }
+        ~RwLock() { pthread_rwlock_destroy(&rwlock); }
+
+        RwLock(const RwLock&) = delete;
+        RwLock& operator=(const RwLock&) = delete;
+
+        // Exclusive, so std::unique_lock and std::lock_guard work
+        void lock() {
+            Operation operation = Metrics::current();
+            uint64_t start = Metrics::now();
+            pthread_rwlock_wrlock(&rwlock);
+            exclusiveSince = Metrics::now();
+            exclusiveOperation = operation;
+            metrics.lockWaited(true, operation, exclusiveSince - start);
+        }
+        void unlock() {
+            // Read while still the only holder
+            uint64_t held = Metrics::now() - exclusiveSince;
+            Operation operation = exclusiveOperation;
+            pthread_rwlock_unlock(&rwlock);
+            metrics.lockHeld(true, operation, held);
+        }
+
+        // Untimed; SharedLock times its holds
+        void lock_shared() { pthread_rwlock_rdlock(&rwlock); }
+        void unlock_shared() { pthread_rwlock_unlock(&rwlock); }
+
+    private:
+        pthread_rwlock_t rwlock;
+        uint64_t exclusiveSince;
+        Operation exclusiveOperation;
+};
+
+// Scoped shared ownership, released early with unlock()
+class SharedLock {
+    public:
+        explicit SharedLock(RwLock& rwLock) : rwLock(rwLock), owned(true), operation(Metrics::current()) {
+            uint64_t start = Metrics::now();
+            rwLock.lock_shared();
+            since = Metrics::now();
+            metrics.lockWaited(false, operation, since - start);
+        }
+        ~SharedLock() { unlock(); }
+
+        SharedLock(const SharedLock&) = delete;
+        SharedLock& operator=(const SharedLock&) = delete;
+
+        void unlock() {
+            if (owned) {
+                rwLock.unlock_shared();
+                owned = false;
+                metrics.lockHeld(false, operation, Metrics::now() - since);
+            }
+        }
+
+    private:
+        RwLock& rwLock;
+        bool owned;
+        Operation operation;
+        uint64_t since;
+};
+
+#endif // RW_LOCK_H
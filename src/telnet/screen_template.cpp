@@ -0,0 +1,83 @@
+#include "screen_template.h"
+#include <cstring>
+
+std::string ansi::colored(const char* color, const std::string& text) {
+    std::string line(color);
+    line += text;
+    line += RESET;
+    return line;
+}
+
+RowTemplate::RowTemplate(const std::string& layout) {
+    static const struct {
+        const char* name;
+        Field field;
+    } FIELDS[] = {
+        {"{index}", Field::Index},
+        {"{name}", Field::Name},
+        {"{phone}", Field::Phone},
+    };
+
+    size_t position = 0;
+    while (position < layout.size()) {
+        size_t brace = layout.find('{', position);
+        size_t end = brace == std::string::npos ? layout.size() : brace;
+        Field field = Field::Literal;
+        size_t fieldLength = 0;
+        for (const auto& candidate : FIELDS) {
+            if (brace != std::string::npos && layout.compare(brace, std::strlen(candidate.name), candidate.name) == 0) {
+                field = candidate.field;
+                fieldLength = std::strlen(candidate.name);
+                break;
+            }
+        }
+        // A brace that opens no field stays in the literal
+        if (brace != std::string::npos && field == Field::Literal) {
+            end = brace + 1;
+        }
+
+        if (end > position) {
+            // Adjacent literals share one piece
+            if (!pieces.empty() && pieces.back().field == Field::Literal) {
+                pieces.back().length += end - position;
+            } else {
+                pieces.push_back(Piece{Field::Literal, text.size(), end - position});
+            }
+            text.append(layout, position, end - position);
+        }
+        if (field != Field::Literal) {
+            pieces.push_back(Piece{field, 0, 0});
+            end += fieldLength;
+        }
+        position = end;
+    }
+}
+
+void RowTemplate::render(OutputBuffer& output, size_t index, const std::string& name,
+                         const std::string& phone) const {
+    for (const Piece& piece : pieces) {
+        switch (piece.field) {
+            case Field::Literal:
+                output.append(text.data() + piece.offset, piece.length);
+                break;
+            case Field::Index: {
+                // Digits from the right, in a buffer on the stack
+                char digits[24];
+                char* first = digits + sizeof(digits);
+                size_t value = index;
+                do {
+                    *--first = static_cast<char>('0' + value % 10);
+                    value /= 10;
+                } while (value != 0);
+                output.append(first, static_cast<size_t>(digits + sizeof(digits) - first));
+                break;
+            }
+            case Field::Name:
+                output.append(name.data(), name.size());
+                break;
+            case Field::Phone:
+                output.append(phone.data(), phone.size());
+                break;
+        }
+    }
+}
@@ -0,0 +1,49 @@
+// ScreenTemplate - Escape sequences and row layouts for the telnet screens.
+// The sequences are compile-time constants. A RowTemplate splits its layout
+// into literal text and fields once, at startup; rendering a row then only
+// copies slices into the session's output buffer, so a long listing costs
+// no allocation per row.
+
+#ifndef SCREEN_TEMPLATE_H
+#define SCREEN_TEMPLATE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "session.h"
+
+namespace ansi {
+    constexpr char CLEAR_SCREEN[] = "\x1B[2J\x1B[1;1H";
+    constexpr char RESET[] = "\x1B[0m";
+    constexpr char GREEN[] = "\x1B[32m";
+    constexpr char YELLOW[] = "\x1B[33m";
+    constexpr char MAGENTA[] = "\x1B[35m";
+    constexpr char CYAN[] = "\x1B[36m";
+
+    // text in color, then back to normal; for one-off lines
+    std::string colored(const char* color, const std::string& text);
+}
+
+// A layout with {index}, {name} and {phone} fields, e.g.
+// "{index}. {name} - {phone}\r\n". Braces that name no field are literal.
+class RowTemplate {
+    public:
+        explicit RowTemplate(const std::string& layout);
+
+        // Appends the row; index is printed as given
+        void render(OutputBuffer& output, size_t index, const std::string& name, const std::string& phone) const;
+
+    private:
+        enum class Field { Literal, Index, Name, Phone };
+
+        struct Piece {
+            Field field;
+            size_t offset;      // a Literal's slice of text
+            size_t length;
+        };
+
+        std::string text;
+        std::vector<Piece> pieces;
+};
+
+#endif // SCREEN_TEMPLATE_H
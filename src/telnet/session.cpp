@@ -0,0 +1,103 @@
+#include "session.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+LineReader::LineReader() : skipAfterCR(false) {
+}
+
+void LineReader::feed(const char* data, size_t length, std::deque<std::string>& lines) {
+    const char* end = data + length;
+
+    while (data < end) {
+        if (skipAfterCR) {
+            skipAfterCR = false;
+            if (*data == '\n' || *data == '\0') {
+                data++;
+                continue;
+            }
+        }
+
+        // The terminator is the first \r or \n; the \r search stops at the \n
+        size_t available = static_cast<size_t>(end - data);
+        const char* newline = static_cast<const char*>(std::memchr(data, '\n', available));
+        size_t scanLength = newline ? static_cast<size_t>(newline - data) : available;
+        const char* carriageReturn = static_cast<const char*>(std::memchr(data, '\r', scanLength));
+        const char* terminator = carriageReturn ? carriageReturn : newline;
+
+        size_t lineLength = terminator ? static_cast<size_t>(terminator - data) : available;
+        if (partial.size() < MAX_LINE_LENGTH) {
+            partial.append(data, std::min(lineLength, MAX_LINE_LENGTH - partial.size()));
+        }
+
+        if (terminator == nullptr) {
+            return;
+        }
+
+        lines.push_back(std::string());
+        lines.back().swap(partial);
+        data = terminator + 1;
+        skipAfterCR = *terminator == '\r';
+    }
+}
+
+OutputBuffer::OutputBuffer(socket_t socket) : socket(socket), failed(false) {
+}
+
+void OutputBuffer::append(const char* data, size_t length) {
+    pending.append(data, length);
+    if (pending.size() >= FLUSH_THRESHOLD) {
+        sendPending();
+    }
+}
+
+void OutputBuffer::appendLine(const std::string& line) {
+    pending.append(line);
+    pending.append("\r\n", 2);
+    if (pending.size() >= FLUSH_THRESHOLD) {
+        sendPending();
+    }
+}
+
+bool OutputBuffer::flush() {
+    sendPending();
+    if (failed || pending.empty()) {
+        // Idle sessions should not keep the memory of their last big screen
+        std::string().swap(pending);
+    }
+    return !failed;
+}
+
+void OutputBuffer::sendPending() {
+    size_t offset = 0;
+    while (!failed && offset < pending.size()) {
+        ssize_t sent = send(socket, pending.data() + offset, pending.size() - offset, MSG_NOSIGNAL);
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (sent <= 0) {
+            failed = true;
+            break;
+        }
+        offset += static_cast<size_t>(sent);
+    }
+    // Keeps the capacity for the rest of the screen
+    pending.erase(0, offset);
+}
+
+void OutputBuffer::cork() {
+    // Room for a whole piece of the listing, so it is not regrown per row
+    pending.reserve(FLUSH_THRESHOLD + FLUSH_THRESHOLD / 8);
+#ifdef TCP_CORK
+    int enable = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_CORK, &enable, sizeof(enable));
+#endif
+}
+
+void OutputBuffer::uncork() {
+    flush();
+#ifdef TCP_CORK
+    int disable = 0;
+    setsockopt(socket, IPPROTO_TCP, TCP_CORK, &disable, sizeof(disable));
+#endif
+}
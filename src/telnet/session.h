@@ -0,0 +1,139 @@
+// Session - Per-connection state for the telnet phone book server.
+// LineReader splits buffered input into lines without per-byte syscalls;
+// OutputBuffer collects a whole screen and sends it in one go, reusing its
+// memory until the screen is out. Sessions are state machines: every input
+// line is handled according to the prompt the client is answering, so no
+// thread ever blocks waiting for a client.
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <string>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "telnet_parser.h"
+#include "phone_book.h"
+// * Socket headers
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+    typedef SOCKET socket_t;
+    #define CLOSE_SOCKET closesocket
+    #define MSG_NOSIGNAL 0
+#else
+    #include <unistd.h>
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+    #include <netinet/tcp.h>
+    #include <fcntl.h>
+    typedef int socket_t;
+    #define CLOSE_SOCKET close
+    #define INVALID_SOCKET -1
+    #define SOCKET_ERROR -1
+#endif
+
+class LineReader {
+    public:
+        static const size_t MAX_LINE_LENGTH = 1024;
+
+        LineReader();
+
+        // Splits received bytes into lines without their terminators (\n,
+        // \r\n, \r\0 or a bare \r) and appends them to lines. An unfinished
+        // line is kept for the next call. Longer lines are cut at
+        // MAX_LINE_LENGTH and the rest is dropped.
+        void feed(const char* data, size_t length, std::deque<std::string>& lines);
+
+    private:
+        std::string partial;
+        bool skipAfterCR;       // a \n or \0 right after \r belongs to the same terminator
+};
+
+class OutputBuffer {
+    public:
+        // Long listings are sent in pieces of about this size
+        static const size_t FLUSH_THRESHOLD = 64 * 1024;
+
+        explicit OutputBuffer(socket_t socket);
+
+        void append(const char* data, size_t length);
+        void append(const std::string& data) { append(data.data(), data.size()); }
+        void appendLine(const std::string& line);
+
+        // Sends as much as the socket accepts without blocking; the rest stays
+        // queued. Returns false once the connection has failed.
+        bool flush();
+
+        size_t pendingBytes() const { return pending.size(); }
+
+        // While corked, partial TCP segments are held back so that the pieces
+        // of a long listing leave in full segments
+        void cork();
+        void uncork();
+
+    private:
+        // Sends without giving back the buffer's memory
+        void sendPending();
+
+        socket_t socket;
+        std::string pending;
+        bool failed;
+};
+
+// The prompt a session is answering
+enum class SessionState {
+    Menu,           // a menu choice or command
+    Pause,          // "Press Enter to return to main menu..."
+    ListPage,       // a page of a listing: n/Enter, p, /filter or q
+    SearchQuery,
+    AddEntry,       // Name:PhoneNumber
+    EditName,
+    EditPhone,      // new number for editName, if still at editVersion
+    DeleteName,
+    Batch,          // line protocol: one command per line, one reply each
+    Closing         // said goodbye; closed once the output is sent
+};
+
+// A paged listing in progress. Its pages come from the snapshot taken when
+// it began, so paging back and forth shows the same list while others edit.
+struct ListingCursor {
+    std::shared_ptr<const ContactSnapshot> snapshot;
+    std::string filter;                 // as typed; empty shows every row
+    std::vector<uint32_t> matches;      // snapshot positions passing the filter
+    size_t offset;                      // first row of the page shown
+    bool thenEdit;                      // the listing is step one of an edit
+
+    ListingCursor() : offset(0), thenEdit(false) {}
+
+    size_t size() const { return filter.empty() ? snapshot->size() : matches.size(); }
+    const ContactRow& row(size_t index) const { return (*snapshot)[filter.empty() ? index : matches[index]]; }
+};
+
+struct Session {
+    socket_t socket;
+    std::string clientIP;
+    SessionState state;
+    bool batch;                         // switched to the batch protocol, for metrics
+    std::string editName;
+    uint64_t editVersion;
+    ListingCursor listing;
+    TelnetParser telnet;
+    LineReader input;
+    std::deque<std::string> lines;      // received, not yet handled
+    OutputBuffer output;
+    bool inputClosed;
+    std::atomic<int64_t> lastActivity;  // steady clock seconds of the last input
+    std::atomic<bool> timedOut;
+
+    Session(socket_t socket, const std::string& clientIP)
+        : socket(socket), clientIP(clientIP), state(SessionState::Menu), batch(false), editVersion(0), output(socket),
+          inputClosed(false), lastActivity(0), timedOut(false) {}
+};
+
+#endif // SESSION_H
@@ -0,0 +1,164 @@
+#include "telnet_parser.h"
+#include <cstring>
+
+// TERMINAL-TYPE subnegotiation codes
+static const unsigned char TERMINAL_TYPE_IS = 0;
+static const unsigned char TERMINAL_TYPE_SEND = 1;
+
+static void appendCommand(std::string& out, unsigned char verb, unsigned char option) {
+    out += static_cast<char>(TelnetParser::IAC);
+    out += static_cast<char>(verb);
+    out += static_cast<char>(option);
+}
+
+TelnetParser::TelnetParser()
+    : state(DATA), verb(0), remoteNaws{false, false}, remoteTerminalType{false, false},
+      remoteSuppressGoAhead{false, false}, localSuppressGoAhead{false, false}, width(0), height(0) {
+}
+
+std::string TelnetParser::negotiate() {
+    std::string requests;
+    appendCommand(requests, DO, OPTION_NAWS);
+    appendCommand(requests, DO, OPTION_TERMINAL_TYPE);
+    remoteNaws.requested = true;
+    remoteTerminalType.requested = true;
+    return requests;
+}
+
+void TelnetParser::parse(const char* data, size_t length, std::string& plain, std::string& replies) {
+    const char* end = data + length;
+
+    while (data < end) {
+        unsigned char byte = static_cast<unsigned char>(*data);
+
+        switch (state) {
+            case DATA: {
+                // Plain text up to the next IAC is copied in one go
+                const void* found = std::memchr(data, IAC, static_cast<size_t>(end - data));
+                const char* command = found ? static_cast<const char*>(found) : end;
+                plain.append(data, static_cast<size_t>(command - data));
+                data = command;
+                if (command < end) {
+                    state = COMMAND;
+                    data++;
+                }
+                continue;
+            }
+
+            case COMMAND:
+                if (byte == IAC) {
+                    plain += static_cast<char>(IAC);        // escaped data byte
+                    state = DATA;
+                } else if (byte == WILL || byte == WONT || byte == DO || byte == DONT) {
+                    verb = byte;
+                    state = OPTION;
+                } else if (byte == SB) {
+                    subnegotiation.clear();
+                    state = SUBNEGOTIATION;
+                } else {
+                    state = DATA;                           // NOP, GA, AYT, ... are ignored
+                }
+                break;
+
+            case OPTION:
+                handleOption(verb, byte, replies);
+                state = DATA;
+                break;
+
+            case SUBNEGOTIATION:
+                if (byte == IAC) {
+                    state = SUBNEGOTIATION_IAC;
+                } else if (subnegotiation.size() < MAX_SUBNEGOTIATION) {
+                    subnegotiation += static_cast<char>(byte);
+                }
+                break;
+
+            case SUBNEGOTIATION_IAC:
+                if (byte == SE) {
+                    handleSubnegotiation();
+                    state = DATA;
+                } else {
+                    // IAC IAC is a 255 inside the parameters
+                    if (byte == IAC && subnegotiation.size() < MAX_SUBNEGOTIATION) {
+                        subnegotiation += static_cast<char>(byte);
+                    }
+                    state = SUBNEGOTIATION;
+                }
+                break;
+        }
+        data++;
+    }
+}
+
+TelnetParser::OptionState* TelnetParser::remoteOption(unsigned char option) {
+    switch (option) {
+        case OPTION_NAWS:
+            return &remoteNaws;
+        case OPTION_TERMINAL_TYPE:
+            return &remoteTerminalType;
+        case OPTION_SUPPRESS_GO_AHEAD:
+            return &remoteSuppressGoAhead;
+        default:
+            return nullptr;
+    }
+}
+
+TelnetParser::OptionState* TelnetParser::localOption(unsigned char option) {
+    // The server never echoes; input stays in the client's line mode
+    return option == OPTION_SUPPRESS_GO_AHEAD ? &localSuppressGoAhead : nullptr;
+}
+
+void TelnetParser::handleOption(unsigned char command, unsigned char option, std::string& replies) {
+    bool remote = command == WILL || command == WONT;
+    bool enable = command == WILL || command == DO;
+    OptionState* current = remote ? remoteOption(option) : localOption(option);
+
+    if (current == nullptr) {
+        // Refuse what is offered; a refusal of something we never had needs no answer
+        if (enable) {
+            appendCommand(replies, remote ? DONT : WONT, option);
+        }
+        return;
+    }
+
+    bool wasRequested = current->requested;
+    current->requested = false;
+    if (current->enabled == enable) {
+        return;
+    }
+    current->enabled = enable;
+
+    // An answer to our own request is an acknowledgement and is not answered again
+    if (!wasRequested) {
+        if (remote) {
+            appendCommand(replies, enable ? DO : DONT, option);
+        } else {
+            appendCommand(replies, enable ? WILL : WONT, option);
+        }
+    }
+
+    if (remote && enable && option == OPTION_TERMINAL_TYPE) {
+        replies += static_cast<char>(IAC);
+        replies += static_cast<char>(SB);
+        replies += static_cast<char>(OPTION_TERMINAL_TYPE);
+        replies += static_cast<char>(TERMINAL_TYPE_SEND);
+        replies += static_cast<char>(IAC);
+        replies += static_cast<char>(SE);
+    }
+}
+
+void TelnetParser::handleSubnegotiation() {
+    if (subnegotiation.empty()) {
+        return;
+    }
+
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(subnegotiation.data());
+    unsigned char option = bytes[0];
+
+    if (option == OPTION_NAWS && subnegotiation.size() >= 5) {
+        width = static_cast<uint16_t>((bytes[1] << 8) | bytes[2]);
+        height = static_cast<uint16_t>((bytes[3] << 8) | bytes[4]);
+    } else if (option == OPTION_TERMINAL_TYPE && subnegotiation.size() >= 2 && bytes[1] == TERMINAL_TYPE_IS) {
+        terminal = subnegotiation.substr(2);
+    }
+}
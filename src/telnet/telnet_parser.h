@@ -0,0 +1,81 @@
+// TelnetParser - Streaming parser for the telnet commands in a client's
+// input (RFC 854). Data bytes are passed through; IAC sequences are taken
+// out and answered. The server asks for the window size (NAWS, RFC 1073)
+// and the terminal type (RFC 1091), accepts SUPPRESS-GO-AHEAD and declines
+// ECHO and everything else, so clients stay in line mode. An option is only
+// answered when its state changes, so negotiation cannot loop.
+
+#ifndef TELNET_PARSER_H
+#define TELNET_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class TelnetParser {
+    public:
+        // Command bytes
+        static const unsigned char IAC = 255;
+        static const unsigned char DONT = 254;
+        static const unsigned char DO = 253;
+        static const unsigned char WONT = 252;
+        static const unsigned char WILL = 251;
+        static const unsigned char SB = 250;
+        static const unsigned char SE = 240;
+
+        // Options
+        static const unsigned char OPTION_ECHO = 1;
+        static const unsigned char OPTION_SUPPRESS_GO_AHEAD = 3;
+        static const unsigned char OPTION_TERMINAL_TYPE = 24;
+        static const unsigned char OPTION_NAWS = 31;
+
+        // Longer subnegotiations are cut off
+        static const size_t MAX_SUBNEGOTIATION = 64;
+
+        TelnetParser();
+
+        // The requests the server opens a session with
+        std::string negotiate();
+
+        // Appends the data in received bytes to plain and the answers to
+        // replies. Commands may be split across calls.
+        void parse(const char* data, size_t length, std::string& plain, std::string& replies);
+
+        // 0 until the client reports its window size
+        int windowWidth() const { return width; }
+        int windowHeight() const { return height; }
+        const std::string& terminalType() const { return terminal; }
+
+    private:
+        enum State {
+            DATA,
+            COMMAND,            // after IAC
+            OPTION,             // after IAC WILL/WONT/DO/DONT
+            SUBNEGOTIATION,
+            SUBNEGOTIATION_IAC
+        };
+
+        // Enabled and requested-by-us bits for the supported options
+        struct OptionState {
+            bool enabled;
+            bool requested;
+        };
+
+        void handleOption(unsigned char command, unsigned char option, std::string& replies);
+        void handleSubnegotiation();
+        OptionState* remoteOption(unsigned char option);
+        OptionState* localOption(unsigned char option);
+
+        State state;
+        unsigned char verb;
+        std::string subnegotiation;
+        OptionState remoteNaws;
+        OptionState remoteTerminalType;
+        OptionState remoteSuppressGoAhead;
+        OptionState localSuppressGoAhead;
+        uint16_t width;
+        uint16_t height;
+        std::string terminal;
+};
+
+#endif // TELNET_PARSER_H